@@ -0,0 +1,115 @@
+/** \file AllocationAudit.cpp
+ * \brief Implementation of the allocation audit
+ */
+
+#include "AllocationAudit.h"
+
+#ifdef TRAFFIC_AUDIT_ALLOCATIONS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+#include <atomic>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+
+static std::atomic<bool> armed(false);
+static std::atomic<size_t> count(0);
+static std::atomic<size_t> bytes(0);
+static thread_local int depth = 0; ///< Nesting of Scopes on this thread
+static thread_local bool reporting = false; ///< Printing may allocate itself
+
+AllocationAudit::Scope::Scope(){
+	depth++;
+}
+
+AllocationAudit::Scope::~Scope(){
+	depth--;
+}
+
+static void audit(size_t size){
+	if(!depth || reporting || !armed.load(std::memory_order_relaxed))
+		return;
+	bytes += size;
+	if(count++)
+		return;
+	reporting = true;
+	fprintf(stderr, "Allocated %u bytes during Graph::update():\n", unsigned(size));
+#if defined(__GLIBC__)
+	void *frames[32];
+	backtrace_symbols_fd(frames, backtrace(frames, 32), 2);
+#endif
+	reporting = false;
+}
+
+void *operator new(size_t size){
+	audit(size);
+	if(void *p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size){
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &)noexcept{
+	audit(size);
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &)noexcept{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p)noexcept{
+	free(p);
+}
+
+void operator delete[](void *p)noexcept{
+	free(p);
+}
+
+void operator delete(void *p, size_t)noexcept{
+	free(p);
+}
+
+void operator delete[](void *p, size_t)noexcept{
+	free(p);
+}
+
+bool AllocationAudit::isAvailable(){
+	return true;
+}
+
+/// \brief Starts or stops counting the allocations made inside Scopes.
+void AllocationAudit::arm(bool armed){
+	::armed = armed;
+}
+
+#else
+
+bool AllocationAudit::isAvailable(){
+	return false;
+}
+
+void AllocationAudit::arm(bool){
+}
+
+static const size_t count = 0;
+static const size_t bytes = 0;
+
+#endif
+
+/// \brief Allocations made inside Scopes while armed.
+size_t AllocationAudit::getCount(){
+	return count;
+}
+
+size_t AllocationAudit::getBytes(){
+	return bytes;
+}
@@ -0,0 +1,36 @@
+/** \file AllocationAudit.h
+ * \brief Catching heap allocations in the steady state tick
+ *
+ * Once the pools and scratch buffers have grown to the traffic they carry,
+ * a tick should not touch the heap at all; the allocator is the first thing
+ * threads would contend on.  Building with TRAFFIC_AUDIT_ALLOCATIONS defined
+ * replaces the global operator new with one that counts the allocations made
+ * by a thread while it is inside Graph::update() with the audit armed, and
+ * prints where the first one came from.  Other builds pay nothing; the scope
+ * in update() compiles to nothing.
+ */
+#ifndef ALLOCATIONAUDIT_H
+#define ALLOCATIONAUDIT_H
+
+#include <stddef.h>
+
+
+class AllocationAudit{
+public:
+	/// \brief Marks the thread as inside a region that must not allocate while it lives.
+	class Scope{
+	public:
+#ifdef TRAFFIC_AUDIT_ALLOCATIONS
+		Scope();
+		~Scope();
+#else
+		Scope(){} ///< Declared so that an unused scope does not warn
+#endif
+	};
+	static bool isAvailable();
+	static void arm(bool armed);
+	static size_t getCount();
+	static size_t getBytes();
+};
+
+#endif
@@ -0,0 +1,351 @@
+/** \file CellularModel.cpp
+ * \brief Implementation of CellularModel class
+ */
+
+#include "CellularModel.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "StepKernel.h"
+#include "StateTrace.h"
+#include "MemoryReport.h"
+#include "StateBuffer.h"
+
+#include <math.h>
+
+#include <thread>
+#include <algorithm>
+
+
+/// Length of a cell, and of a vehicle, in network units.
+const double CellularModel::defaultCellLength = 0.01;
+
+/// Chance that a vehicle slows down for no reason in a step.
+const double CellularModel::defaultSlowdown = 0.2;
+
+uint64_t CellularModel::spread[256];
+bool CellularModel::spreadReady = false;
+
+static const uint64_t nibbleOnes = 0x1111111111111111ULL;
+
+
+CellularModel::CellularModel() : cellLength(defaultCellLength), workers(1), parallelThreshold(65536), steps(0), vehicles(0),
+	lastMoving(0), lastVelocitySum(0), enabled(false)
+{
+	setSlowdown(defaultSlowdown);
+	if(!spreadReady){
+		for(int i = 0; i < 256; i++){
+			spread[i] = 0;
+			for(int j = 0; j < 8; j++)
+				spread[i] |= uint64_t((i >> j) & 1) << (j * 4);
+		}
+		spreadReady = true;
+	}
+}
+
+void CellularModel::setSlowdown(double p){
+	slowdown = std::min(1., std::max(0., p));
+	slowdownThreshold = uint32_t(std::min(4294967295., slowdown * 4294967296.));
+}
+
+/// \brief Simulated seconds a step takes, which makes the default maximum velocity the default speed limit.
+double CellularModel::getStepTime()const{
+	return cellLength * defaultMaxVelocity / GraphEdge::defaultSpeedLimit;
+}
+
+/// \brief Cuts the edges of graph into cells, adding lanes for the edges added since the last call.
+///
+/// Existing lanes keep their cells and their vehicles, so a road added in a
+/// run is simply appended.  A lane does not follow a change to the length of
+/// its edge.
+void CellularModel::layout(const Graph &graph){
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	for(size_t i = lanes.size() / 2; i < edges.size(); i++){
+		for(int dir = 0; dir < 2; dir++){
+			Lane l;
+			l.edge = edges[i];
+			l.cells = std::max(1, int(edges[i]->getLength() / cellLength + 0.5));
+			l.occupancy = uint32_t(occupancy.size());
+			l.velocity = uint32_t(velocity.size());
+			l.head = l.count = 0;
+			occupancy.resize(occupancy.size() + (l.cells + 63) / 64, 0);
+			velocity.resize(velocity.size() + (l.cells + 15) / 16, 0);
+			lanes.push_back(l);
+			// A lane never holds more vehicles than cells.
+			reserve(lanes.back(), l.cells);
+		}
+	}
+	// A lane has one exit a step at most.
+	workerState.resize(std::max(workerState.size(), size_t(1)));
+	workerState[0].exits.reserve(lanes.size());
+	exits.reserve(lanes.size());
+}
+
+/// \brief Takes every vehicle off the lanes and starts counting steps again.
+void CellularModel::clear(){
+	std::fill(occupancy.begin(), occupancy.end(), 0);
+	std::fill(velocity.begin(), velocity.end(), 0);
+	for(size_t i = 0; i < lanes.size(); i++)
+		lanes[i].head = lanes[i].count = 0;
+	exits.clear();
+	steps = 0;
+	vehicles = 0;
+	lastMoving = lastVelocitySum = 0;
+}
+
+/// \brief Forgets the lanes along with their vehicles, for a network that was replaced.
+void CellularModel::dropLanes(){
+	lanes.clear();
+	occupancy.clear();
+	velocity.clear();
+	clear();
+}
+
+/// \brief Returns the lane of e that heads to next.
+uint32_t CellularModel::getLane(const GraphEdge *e, const GraphVertex *next){
+	return uint32_t(e->getId()) * 2 + (next == e->getEnd() ? 0 : 1);
+}
+
+/// \brief Finds the cell a vehicle entering lane wanting to get ahead cells into it may take.
+/// \returns The cell, behind the last vehicle on the lane, or -1 if the first cell is taken.
+int CellularModel::getEntryCell(uint32_t lane, uint32_t ahead)const{
+	const Lane &l = lanes[lane];
+	uint32_t free = l.cells;
+	for(uint32_t w = 0; w * 64 < l.cells; w++){
+		if(uint64_t word = occupancy[l.occupancy + w]){
+			free = w * 64 + lowestBit(word);
+			break;
+		}
+	}
+	return free ? int(std::min(ahead, free - 1)) : -1;
+}
+
+/// \brief Sums the velocities of the vehicles on lane, in cells per step.
+uint32_t CellularModel::getVelocitySum(uint32_t lane)const{
+	const Lane &l = lanes[lane];
+	uint32_t ret = 0;
+	for(uint32_t w = 0; w * 16 < l.cells; w++){
+		// Add the nibbles in pairs into bytes, then the bytes together.
+		uint64_t word = velocity[l.velocity + w];
+		uint64_t bytes = (word & 0x0f0f0f0f0f0f0f0fULL) + ((word >> 4) & 0x0f0f0f0f0f0f0f0fULL);
+		ret += uint32_t((bytes * 0x0101010101010101ULL) >> 56);
+	}
+	return ret;
+}
+
+/// \brief Makes the ring of l hold at least count vehicles, unwrapping it so the front is first again.
+void CellularModel::reserve(Lane &l, uint32_t count){
+	if(count <= l.ring.size())
+		return;
+	size_t size = l.ring.empty() ? 4 : l.ring.size() * 2;
+	while(size < count)
+		size *= 2;
+	std::vector<Vehicle*> ring(size);
+	for(uint32_t i = 0; i < l.count; i++)
+		ring[i] = l.ring[(l.head + i) & (l.ring.size() - 1)];
+	l.ring.swap(ring);
+	l.head = 0;
+}
+
+/// \brief Puts v at the back of lane in cell, which must be behind every vehicle on it.
+void CellularModel::push(uint32_t lane, uint32_t cell, uint32_t velocity, Vehicle *v){
+	Lane &l = lanes[lane];
+	reserve(l, l.count + 1);
+	l.ring[(l.head + l.count) & (l.ring.size() - 1)] = v;
+	l.count++;
+	vehicles++;
+	setCell(l, cell, std::min(velocity, 7u));
+}
+
+/// \brief Takes the front vehicle off lane, after it left the lane's cells in the last step.
+void CellularModel::pop(uint32_t lane){
+	Lane &l = lanes[lane];
+	l.head = (l.head + 1) & (l.ring.size() - 1);
+	l.count--;
+	vehicles--;
+}
+
+/// \brief Stops the front vehicle of lane, which found no room ahead, in the last cell.
+void CellularModel::hold(uint32_t lane){
+	setCell(lanes[lane], lanes[lane].cells - 1, 0);
+}
+
+/// \brief Applies the rules to the vehicles of lanes begin to end, recording those that run past the end in w.
+void CellularModel::stepLanes(size_t begin, size_t end, Worker &w){
+	double stepTime = getStepTime();
+	uint64_t salt = mixDigest(steps ^ 0x5eed5eed5eed5eedULL);
+	for(size_t i = begin; i < end; i++){
+		Lane &l = lanes[i];
+		if(!l.count)
+			continue;
+		uint64_t vmax = uint64_t(std::min(7, std::max(1, int(l.edge->getSpeedLimit() * stepTime / cellLength + 0.5))));
+		uint64_t *occ = &occupancy[l.occupancy];
+		uint64_t *vel = &velocity[l.velocity];
+
+		// Accelerate 16 cells at a time, saturating at vmax.  Nibbles never
+		// exceed 8 on the way, so the adds do not carry into each other.
+		for(uint32_t j = 0; j * 16 < l.cells; j++){
+			uint64_t bits = (occ[j / 4] >> (j % 4 * 16)) & 0xffff;
+			if(!bits)
+				continue;
+			uint64_t x = vel[j] + (spread[bits & 0xff] | spread[bits >> 8] << 32);
+			uint64_t over = ((x + (7 - vmax) * nibbleOnes) >> 3) & nibbleOnes;
+			uint64_t mask = over * 0xf;
+			vel[j] = (x & ~mask) | (vmax * nibbleOnes & mask);
+		}
+
+		// Then the rest of the rules one vehicle at a time from the front,
+		// each against the cell the vehicle ahead held before this step.
+		uint32_t k = 0; // Position of the vehicle in the ring
+		int64_t ahead = -1;
+		for(uint32_t wi = (l.cells + 63) / 64; 0 < wi--;){
+			uint64_t word = occ[wi];
+			while(word){
+				int bit = highestBit(word);
+				word &= ~(uint64_t(1) << bit);
+				uint32_t x = wi * 64 + bit;
+				uint64_t &vw = vel[x / 16];
+				int shift = x % 16 * 4;
+				uint32_t v = uint32_t((vw >> shift) & 0xf);
+				if(0 <= ahead)
+					v = std::min(v, uint32_t(ahead - x - 1));
+				const Vehicle *vehicle = l.ring[(l.head + k) & (l.ring.size() - 1)];
+				if(v && uint32_t(mixDigest(salt ^ vehicle->getId()) >> 32) < slowdownThreshold)
+					v--;
+				occ[wi] &= ~(uint64_t(1) << bit);
+				vw &= ~(uint64_t(0xf) << shift);
+				if(ahead < 0 && l.cells <= x + v){
+					Exit e = {uint32_t(i), x, v, x + v - l.cells};
+					w.exits.push_back(e);
+				}
+				else
+					setCell(l, x + v, v);
+				if(v)
+					w.moving++;
+				w.velocitySum += v;
+				ahead = x;
+				k++;
+			}
+		}
+	}
+}
+
+/// \brief Advances every lane by one step.
+///
+/// The vehicles that ran past the end of their lane are left at the front
+/// of its queue off the cells, and listed in getExits() for the caller to
+/// move on with push() and pop() or keep with hold().
+void CellularModel::step(){
+	int n = vehicles < parallelThreshold ? 1 : workers;
+	workerState.resize(n);
+	for(int i = 0; i < n; i++){
+		workerState[i].exits.clear();
+		workerState[i].moving = workerState[i].velocitySum = 0;
+	}
+	if(n <= 1)
+		stepLanes(0, lanes.size(), workerState[0]);
+	else{
+		// Contiguous ranges, so the exits come out by lane when joined in order.
+		size_t chunk = (lanes.size() + n - 1) / n;
+		std::vector<std::thread> threads;
+		for(int i = 0; i < n; i++)
+			threads.push_back(std::thread(&CellularModel::stepLanes, this, std::min(lanes.size(), i * chunk),
+				std::min(lanes.size(), (i + 1) * chunk), std::ref(workerState[i])));
+		for(size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+	exits.clear();
+	lastMoving = lastVelocitySum = 0;
+	for(int i = 0; i < n; i++){
+		exits.insert(exits.end(), workerState[i].exits.begin(), workerState[i].exits.end());
+		lastMoving += workerState[i].moving;
+		lastVelocitySum += workerState[i].velocitySum;
+	}
+	steps++;
+}
+
+/// \brief Appends every vehicle on the lanes to out, by lane and then front first.
+void CellularModel::collect(std::vector<Vehicle*> &out)const{
+	for(size_t i = 0; i < lanes.size(); i++){
+		const Lane &l = lanes[i];
+		for(uint32_t j = 0; j < l.count; j++)
+			out.push_back(l.ring[(l.head + j) & (l.ring.size() - 1)]);
+	}
+}
+
+/// \brief Appends every vehicle on the lanes to out in the order of collect(), at the middle of its cell.
+///
+/// Only between steps does every vehicle hold a cell; the front vehicle holds
+/// the farthest one.
+void CellularModel::collect(std::vector<VehiclePosition> &out)const{
+	for(size_t i = 0; i < lanes.size(); i++){
+		const Lane &l = lanes[i];
+		double scale = l.edge->getLength() / l.cells;
+		uint32_t k = 0;
+		for(uint32_t wi = (l.cells + 63) / 64; 0 < wi-- && k < l.count;){
+			uint64_t word = occupancy[l.occupancy + wi];
+			while(word && k < l.count){
+				int bit = highestBit(word);
+				word &= ~(uint64_t(1) << bit);
+				VehiclePosition p = {l.ring[(l.head + k++) & (l.ring.size() - 1)], (wi * 64 + bit + .5) * scale};
+				out.push_back(p);
+			}
+		}
+	}
+}
+
+/// \brief Appends the cells and the step count to out, leaving the vehicles to the caller in the order of collect().
+void CellularModel::save(StateBuffer &out)const{
+	out.put(uint32_t(lanes.size()));
+	for(size_t i = 0; i < lanes.size(); i++)
+		out.put(lanes[i].count);
+	out.putVector(occupancy);
+	out.putVector(velocity);
+	out.put(steps);
+	out.put(uint64_t(lastMoving));
+	out.put(uint64_t(lastVelocitySum));
+}
+
+/// \brief Reads back what save() wrote onto the same lanes, putting vehicles, count of them in the order of collect(), on them.
+/// \returns false if the state does not fit, leaving the lanes empty.
+bool CellularModel::load(StateBuffer &in, Vehicle *const *vehicles, size_t count){
+	clear();
+	if(in.get<uint32_t>() != lanes.size())
+		return false;
+	for(size_t i = 0; i < lanes.size() && in.isOk(); i++){
+		Lane &l = lanes[i];
+		uint32_t length = in.get<uint32_t>();
+		if(count - this->vehicles < length){
+			clear();
+			return false;
+		}
+		reserve(l, length);
+		for(uint32_t j = 0; j < length; j++)
+			l.ring[j] = vehicles[this->vehicles++];
+		l.count = length;
+	}
+	size_t words = occupancy.size(), nibbleWords = velocity.size();
+	in.getVector(occupancy);
+	in.getVector(velocity);
+	steps = in.get<uint64_t>();
+	lastMoving = size_t(in.get<uint64_t>());
+	lastVelocitySum = size_t(in.get<uint64_t>());
+	if(!in.isOk() || this->vehicles != count || occupancy.size() != words || velocity.size() != nibbleWords){
+		occupancy.resize(words);
+		velocity.resize(nibbleWords);
+		clear();
+		return false;
+	}
+	return true;
+}
+
+size_t CellularModel::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(lanes) + MemoryReport::vectorBytes(occupancy) + MemoryReport::vectorBytes(velocity)
+		+ MemoryReport::vectorBytes(workerState) + MemoryReport::vectorBytes(exits);
+	for(size_t i = 0; i < lanes.size(); i++)
+		ret += MemoryReport::vectorBytes(lanes[i].ring);
+	for(size_t i = 0; i < workerState.size(); i++)
+		ret += MemoryReport::vectorBytes(workerState[i].exits);
+	return ret;
+}
@@ -0,0 +1,129 @@
+/** \file CellularModel.h
+ * \brief Nagel-Schreckenberg cellular automaton on the edges of the network
+ *
+ * Each direction of an edge is a lane of cells one vehicle long.  A lane
+ * keeps its occupancy as a bitset and the velocities, in cells per step, as
+ * packed 4-bit integers, so a step of all the cells of a lane touches a few
+ * machine words.  Every step applies the rules of the model to each
+ * vehicle at once:
+ *
+ * - accelerate by one, up to the lane's maximum velocity,
+ * - slow down to the gap to the vehicle ahead,
+ * - slow down by one at random with the slowdown probability,
+ * - move ahead by the velocity.
+ *
+ * The random slowdowns are what makes jams appear out of nowhere on a busy
+ * lane and travel back against the traffic.  Acceleration is done for 16
+ * cells at a time within a word and gaps are found by scanning 64 cells at a
+ * time, so the cost follows the vehicles rather than the cells.  Lanes are
+ * stepped in parallel; the random numbers hash the vehicle id and the step,
+ * so the result does not depend on the number of workers.
+ *
+ * Vehicles leaving the end of a lane are handed to the Graph, which moves
+ * them along their routes one by one in lane order.
+ */
+#ifndef CELLULARMODEL_H
+#define CELLULARMODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+class Graph;
+class GraphEdge;
+class GraphVertex;
+class Vehicle;
+struct VehiclePosition;
+class StateBuffer;
+
+class CellularModel{
+public:
+	/// \brief A vehicle that ran past the end of its lane in the last step.
+	struct Exit{
+		uint32_t lane;
+		uint32_t from; ///< Cell it left
+		uint32_t velocity;
+		uint32_t ahead; ///< Cells it wants to drive into the next lane, counting the first as 0
+	};
+	static const double defaultCellLength;
+	static const int defaultMaxVelocity = 5;
+	static const double defaultSlowdown;
+protected:
+	struct Lane{
+		const GraphEdge *edge;
+		uint32_t cells;
+		uint32_t occupancy; ///< Offset of the lane's first word in occupancy
+		uint32_t velocity; ///< Offset of the lane's first word in velocity
+		std::vector<Vehicle*> ring; ///< Vehicles front first; capacity is a power of two, or zero
+		uint32_t head;
+		uint32_t count;
+	};
+	/// \brief What a worker collects while stepping its share of the lanes.
+	struct Worker{
+		std::vector<Exit> exits;
+		size_t moving;
+		size_t velocitySum;
+	};
+	std::vector<Lane> lanes; ///< Two per edge, toward its end at edge id * 2 and toward its start at edge id * 2 + 1
+	std::vector<uint64_t> occupancy; ///< One bit per cell, cell 0 in the lowest bit
+	std::vector<uint64_t> velocity; ///< Four bits per cell, zero where empty
+	std::vector<Worker> workerState;
+	std::vector<Exit> exits; ///< Exits of the last step, by lane
+	double cellLength;
+	double slowdown;
+	uint32_t slowdownThreshold; ///< slowdown scaled to the range of a 32-bit random number
+	int workers;
+	size_t parallelThreshold; ///< Fewest vehicles worth splitting the lanes among the workers for
+	uint64_t steps;
+	size_t vehicles;
+	size_t lastMoving; ///< Vehicles that moved in the last step
+	size_t lastVelocitySum;
+	bool enabled;
+	static uint64_t spread[256]; ///< Spreads 8 bits to the lowest bit of 8 nibbles
+	static bool spreadReady;
+	void stepLanes(size_t begin, size_t end, Worker &w);
+	void reserve(Lane &l, uint32_t count);
+	void setCell(Lane &l, uint32_t cell, uint64_t v){
+		occupancy[l.occupancy + cell / 64] |= uint64_t(1) << (cell % 64);
+		velocity[l.velocity + cell / 16] |= v << (cell % 16 * 4);
+	}
+public:
+	CellularModel();
+	bool isEnabled()const{return enabled;}
+	void setEnabled(bool enabled){this->enabled = enabled;}
+	double getCellLength()const{return cellLength;}
+	void setCellLength(double length){cellLength = length;}
+	double getSlowdown()const{return slowdown;}
+	void setSlowdown(double p);
+	int getWorkers()const{return workers;}
+	void setWorkers(int workers){this->workers = workers < 1 ? 1 : workers;}
+	double getStepTime()const;
+	void layout(const Graph &graph);
+	void clear();
+	void dropLanes();
+	static uint32_t getLane(const GraphEdge *e, const GraphVertex *next);
+	size_t getLaneCount()const{return lanes.size();}
+	uint32_t getCells(uint32_t lane)const{return lanes[lane].cells;}
+	uint32_t getCount(uint32_t lane)const{return lanes[lane].count;}
+	uint32_t getVelocitySum(uint32_t lane)const;
+	int getEntryCell(uint32_t lane, uint32_t ahead)const;
+	void push(uint32_t lane, uint32_t cell, uint32_t velocity, Vehicle *v);
+	Vehicle *front(uint32_t lane)const{const Lane &l = lanes[lane]; return l.ring[l.head];}
+	void pop(uint32_t lane);
+	void hold(uint32_t lane);
+	void step();
+	const std::vector<Exit> &getExits()const{return exits;}
+	size_t size()const{return vehicles;}
+	uint64_t getSteps()const{return steps;}
+	size_t getLastMoving()const{return lastMoving;}
+	double getLastMeanVelocity()const{return vehicles ? double(lastVelocitySum) / vehicles : 0.;}
+	void collect(std::vector<Vehicle*> &out)const;
+	void collect(std::vector<VehiclePosition> &out)const;
+	void save(StateBuffer &out)const;
+	bool load(StateBuffer &in, Vehicle *const *vehicles, size_t count);
+	size_t getMemoryUsage()const;
+};
+
+#endif
@@ -0,0 +1,564 @@
+/** \file ContractionHierarchy.cpp
+ * \brief Implementation of ContractionHierarchy class
+ */
+
+#include "ContractionHierarchy.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "MemoryReport.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+
+typedef std::pair<double, int> HeapEntry;
+
+static void pushHeap(std::vector<HeapEntry> &heap, double dist, int vertex){
+	heap.push_back(HeapEntry(dist, vertex));
+	std::push_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+}
+
+static HeapEntry popHeap(std::vector<HeapEntry> &heap){
+	std::pop_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+	HeapEntry ret = heap.back();
+	heap.pop_back();
+	return ret;
+}
+
+
+/// The remaining graph during preprocessing; arcs to the same neighbour are merged.
+typedef std::vector<std::vector<ContractionHierarchy::Arc> > WorkGraph;
+
+struct Shortcut{
+	int from;
+	ContractionHierarchy::Arc arc;
+};
+
+/// \brief How far a witness search looks before it gives up and keeps the shortcut.
+///
+/// Once the remaining graph gets dense, a search bounded only by distance
+/// wanders through the whole core for every pair of neighbours.  Witnesses
+/// are nearly always a few arcs long; missing a longer one only adds a
+/// shortcut that is never the shortest, which costs an arc but does not
+/// change any route.  Simulating a contraction to rank a vertex looks less
+/// far than the contraction itself, since it runs several times as often.
+struct WitnessLimits{
+	int settled; ///< Vertices settled
+	int hops; ///< Arcs on a path
+};
+static const WitnessLimits simulateLimits = {100, 3};
+static const WitnessLimits contractLimits = {500, 5};
+
+/// \brief Per-thread scratch for the local searches that decide which shortcuts a contraction needs.
+class WitnessSearch{
+	std::vector<double> dist;
+	std::vector<int> hops; ///< Arcs on the path dist was found along
+	std::vector<char> target; ///< Neighbours of the contracted vertex the search still looks for
+	std::vector<int> touched;
+	std::vector<HeapEntry> heap;
+public:
+	WitnessSearch(size_t n) : dist(n, DBL_MAX), hops(n, 0), target(n, 0){}
+	int contract(const WorkGraph &g, const std::vector<char> &excluded, int x, const WitnessLimits &limits, std::vector<Shortcut> *out);
+};
+
+/// \brief Finds the shortcuts that removing x from g requires.
+///
+/// Vertices flagged in excluded are treated as already gone, which lets a
+/// whole independent set be contracted against the same snapshot of g.
+/// \returns Number of shortcuts; they are appended to out unless it is NULL.
+int WitnessSearch::contract(const WorkGraph &g, const std::vector<char> &excluded, int x, const WitnessLimits &limits, std::vector<Shortcut> *out){
+	const std::vector<ContractionHierarchy::Arc> &adj = g[x];
+	int count = 0;
+	for(size_t i = 0; i + 1 < adj.size(); i++){
+		// Only the neighbours after u are looked for from u, so the search can stop at the farthest of them.
+		int u = adj[i].to;
+		int targets = 0;
+		double maxOut = 0.;
+		for(size_t j = i + 1; j < adj.size(); j++){
+			maxOut = std::max(maxOut, adj[j].weight);
+			target[adj[j].to] = 1;
+			targets++;
+		}
+		double limit = adj[i].weight + maxOut;
+		dist[u] = 0.;
+		hops[u] = 0;
+		touched.push_back(u);
+		pushHeap(heap, 0., u);
+		int settled = 0;
+		while(!heap.empty() && settled < limits.settled){
+			HeapEntry top = popHeap(heap);
+			int v = top.second;
+			if(dist[v] < top.first)
+				continue;
+			if(limit < top.first)
+				break;
+			settled++;
+			if(target[v]){
+				target[v] = 0;
+				if(--targets == 0)
+					break;
+			}
+			if(limits.hops <= hops[v])
+				continue;
+			const std::vector<ContractionHierarchy::Arc> &a = g[v];
+			for(size_t k = 0; k < a.size(); k++){
+				int y = a[k].to;
+				if(y == x || excluded[y])
+					continue;
+				double nd = top.first + a[k].weight;
+				if(nd < dist[y] && nd <= limit){
+					if(dist[y] == DBL_MAX)
+						touched.push_back(y);
+					dist[y] = nd;
+					hops[y] = hops[v] + 1;
+					pushHeap(heap, nd, y);
+				}
+			}
+		}
+		for(size_t j = i + 1; j < adj.size(); j++){
+			target[adj[j].to] = 0;
+			double via = adj[i].weight + adj[j].weight;
+			if(dist[adj[j].to] <= via)
+				continue; // A witness path is at least as short
+			count++;
+			if(out){
+				Shortcut s = {u, {adj[j].to, x, via}};
+				out->push_back(s);
+			}
+		}
+		for(size_t k = 0; k < touched.size(); k++)
+			dist[touched[k]] = DBL_MAX;
+		touched.clear();
+		heap.clear();
+	}
+	return count;
+}
+
+/// \brief Runs func(search, i) for every i in [0, count) split across threads.
+template<typename Func>
+static void parallelFor(std::vector<WitnessSearch> &searches, size_t count, Func func){
+	size_t threads = std::min(searches.size(), count);
+	if(threads <= 1){
+		for(size_t i = 0; i < count; i++)
+			func(searches[0], i);
+		return;
+	}
+	std::vector<std::thread> workers;
+	for(size_t t = 0; t < threads; t++){
+		workers.push_back(std::thread([&, t](){
+			for(size_t i = t; i < count; i += threads)
+				func(searches[t], i);
+		}));
+	}
+	for(size_t t = 0; t < threads; t++)
+		workers[t].join();
+}
+
+static void addArc(std::vector<ContractionHierarchy::Arc> &adj, const ContractionHierarchy::Arc &arc){
+	for(size_t i = 0; i < adj.size(); i++){
+		if(adj[i].to == arc.to){
+			if(arc.weight < adj[i].weight)
+				adj[i] = arc;
+			return;
+		}
+	}
+	adj.push_back(arc);
+}
+
+/// \brief Preprocesses the network of graph.
+///
+/// Each round contracts an independent set of vertices whose priority (edge
+/// difference plus contracted neighbours) is a local minimum.  No two of them
+/// are adjacent, so their witness searches run in parallel on the same
+/// snapshot and the shortcuts are merged afterwards.
+///
+/// Priorities are updated lazily: contracting a vertex only marks its
+/// neighbours stale, and a stale vertex is simulated again when its old
+/// priority makes it a candidate for the next round.  It joins the round only
+/// if it is still a local minimum then.  Most neighbours are touched many
+/// times before their turn comes, so this saves most of the simulations.
+/// \param threads Worker count, 0 for one per hardware thread.
+void ContractionHierarchy::build(const Graph &graph, int threads){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	int n = int(vertices.size());
+	if(threads <= 0)
+		threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+	WorkGraph g(n);
+	for(size_t i = 0; i < edges.size(); i++){
+		int a = edges[i]->getStart()->getId(), b = edges[i]->getEnd()->getId();
+		if(a == b)
+			continue; // connect() lets a vertex loop back to itself; useless for routing
+		Arc ab = {b, -1, edges[i]->getLength()};
+		Arc ba = {a, -1, edges[i]->getLength()};
+		addArc(g[a], ab);
+		addArc(g[b], ba);
+	}
+
+	std::vector<WitnessSearch> searches(threads, WitnessSearch(n));
+	std::vector<char> excluded(n, 0);
+	std::vector<int> deletedNeighbors(n, 0);
+	std::vector<int> priority(n, 0);
+	std::vector<std::vector<Arc> > upward(n);
+	std::vector<int> remaining(n);
+	for(int i = 0; i < n; i++)
+		remaining[i] = i;
+	std::vector<char> isStale(n, 1); // Whether the priority needs simulating again
+	rank.assign(n, -1);
+	int nextRank = 0;
+	auto isMinimal = [&](int x){
+		for(size_t k = 0; k < g[x].size(); k++){
+			int y = g[x][k].to;
+			if(priority[y] < priority[x] || (priority[y] == priority[x] && y < x))
+				return false;
+		}
+		return true;
+	};
+	auto simulate = [&](const std::vector<int> &stale){
+		parallelFor(searches, stale.size(), [&](WitnessSearch &search, size_t i){
+			int x = stale[i];
+			priority[x] = search.contract(g, excluded, x, simulateLimits, NULL) - int(g[x].size()) + deletedNeighbors[x];
+		});
+		for(size_t i = 0; i < stale.size(); i++)
+			isStale[stale[i]] = 0;
+	};
+	simulate(remaining);
+
+	std::vector<int> candidates, stale, batch;
+	while(!remaining.empty()){
+		candidates.clear();
+		stale.clear();
+		for(size_t i = 0; i < remaining.size(); i++){
+			int x = remaining[i];
+			if(isMinimal(x)){
+				candidates.push_back(x);
+				if(isStale[x])
+					stale.push_back(x);
+			}
+		}
+		simulate(stale);
+
+		// Checked against the priorities as they are after all the candidates were brought up to date,
+		// so no two neighbours are both chosen.
+		batch.clear();
+		for(size_t i = 0; i < candidates.size(); i++){
+			if(isMinimal(candidates[i]))
+				batch.push_back(candidates[i]);
+		}
+		for(size_t i = 0; i < batch.size(); i++)
+			excluded[batch[i]] = 1;
+
+		std::vector<std::vector<Shortcut> > shortcuts(batch.size());
+		parallelFor(searches, batch.size(), [&](WitnessSearch &search, size_t i){
+			search.contract(g, excluded, batch[i], contractLimits, &shortcuts[i]);
+		});
+
+		for(size_t i = 0; i < batch.size(); i++){
+			int x = batch[i];
+			rank[x] = nextRank++;
+			upward[x] = g[x];
+			for(size_t k = 0; k < g[x].size(); k++){
+				int y = g[x][k].to;
+				std::vector<Arc> &adj = g[y];
+				for(size_t j = 0; j < adj.size(); j++){
+					if(adj[j].to == x){
+						adj.erase(adj.begin() + j);
+						break;
+					}
+				}
+				deletedNeighbors[y]++;
+				isStale[y] = 1;
+			}
+			g[x].clear();
+		}
+		for(size_t i = 0; i < shortcuts.size(); i++){
+			for(size_t j = 0; j < shortcuts[i].size(); j++){
+				const Shortcut &s = shortcuts[i][j];
+				Arc back = {s.from, s.arc.mid, s.arc.weight};
+				addArc(g[s.from], s.arc);
+				addArc(g[s.arc.to], back);
+			}
+		}
+
+		size_t kept = 0;
+		for(size_t i = 0; i < remaining.size(); i++){
+			if(rank[remaining[i]] < 0)
+				remaining[kept++] = remaining[i];
+		}
+		remaining.resize(kept);
+	}
+
+	vertexCount = n;
+	arcBegin.assign(n + 1, 0);
+	arcs.clear();
+	for(int x = 0; x < n; x++){
+		arcBegin[x] = int(arcs.size());
+		arcs.insert(arcs.end(), upward[x].begin(), upward[x].end());
+	}
+	arcBegin[n] = int(arcs.size());
+	fingerprint = computeFingerprint(graph);
+}
+
+/// \brief Hashes the vertex count and every edge's endpoints and length with FNV-1a.
+uint32_t ContractionHierarchy::computeFingerprint(const Graph &graph){
+	uint32_t h = 2166136261u;
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	uint32_t words[4] = {uint32_t(graph.getVertices().size()), uint32_t(edges.size()), 0, 0};
+	for(size_t i = 0; i <= edges.size(); i++){
+		if(i){
+			words[0] = uint32_t(edges[i - 1]->getStart()->getId());
+			words[1] = uint32_t(edges[i - 1]->getEnd()->getId());
+			words[2] = uint32_t(edges[i - 1]->getLength() * 1e6);
+		}
+		for(int k = 0; k < 3; k++){
+			for(int b = 0; b < 4; b++){
+				h ^= (words[k] >> (b * 8)) & 0xff;
+				h *= 16777619u;
+			}
+		}
+	}
+	return h;
+}
+
+static const char chMagic[4] = {'T', 'R', 'C', 'H'};
+static const uint32_t chVersion = 1;
+
+/// \brief Writes the index to a binary file in host byte order.
+bool ContractionHierarchy::save(const char *fileName)const{
+	FILE *fp = fopen(fileName, "wb");
+	if(!fp)
+		return false;
+	uint32_t header[4] = {chVersion, uint32_t(vertexCount), fingerprint, uint32_t(arcs.size())};
+	bool ok = fwrite(chMagic, sizeof chMagic, 1, fp) == 1
+		&& fwrite(header, sizeof header, 1, fp) == 1
+		&& fwrite(&rank.front(), sizeof(int), rank.size(), fp) == rank.size()
+		&& fwrite(&arcBegin.front(), sizeof(int), arcBegin.size(), fp) == arcBegin.size()
+		&& (arcs.empty() || fwrite(&arcs.front(), sizeof(Arc), arcs.size(), fp) == arcs.size());
+	fclose(fp);
+	return ok;
+}
+
+/// \brief Reads an index written by save().
+/// \returns false if the file is missing, corrupt or was built for another network.
+bool ContractionHierarchy::load(const char *fileName, const Graph &graph){
+	FILE *fp = fopen(fileName, "rb");
+	if(!fp)
+		return false;
+	char magic[4];
+	uint32_t header[4];
+	bool ok = fread(magic, sizeof magic, 1, fp) == 1 && !memcmp(magic, chMagic, sizeof magic)
+		&& fread(header, sizeof header, 1, fp) == 1 && header[0] == chVersion
+		&& header[1] == graph.getVertices().size() && header[2] == computeFingerprint(graph);
+	if(ok){
+		// The arc count must account for the rest of the file exactly before anything is allocated for it.
+		long at = ftell(fp);
+		ok = 0 <= at && !fseek(fp, 0, SEEK_END);
+		long end = ok ? ftell(fp) : -1;
+		ok = ok && !fseek(fp, at, SEEK_SET) && at <= end
+			&& uint64_t(end - at) == (2 * uint64_t(header[1]) + 1) * sizeof(int) + uint64_t(header[3]) * sizeof(Arc);
+	}
+	if(ok){
+		int n = int(header[1]);
+		std::vector<int> newRank(n), newBegin(n + 1);
+		std::vector<Arc> newArcs(header[3]);
+		ok = fread(&newRank.front(), sizeof(int), n, fp) == size_t(n)
+			&& fread(&newBegin.front(), sizeof(int), n + 1, fp) == size_t(n + 1)
+			&& (newArcs.empty() || fread(&newArcs.front(), sizeof(Arc), newArcs.size(), fp) == newArcs.size())
+			&& newBegin[n] == int(newArcs.size());
+		if(ok){
+			std::swap(vertexCount, n);
+			rank.swap(newRank);
+			arcBegin.swap(newBegin);
+			arcs.swap(newArcs);
+			ok = isConsistent();
+			if(ok)
+				fingerprint = header[2];
+			else{
+				// Put the previous index back
+				std::swap(vertexCount, n);
+				rank.swap(newRank);
+				arcBegin.swap(newBegin);
+				arcs.swap(newArcs);
+			}
+		}
+	}
+	fclose(fp);
+	return ok;
+}
+
+size_t RouteQuery::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(chain) + MemoryReport::vectorBytes(route);
+	for(int i = 0; i < 2; i++){
+		ret += MemoryReport::vectorBytes(dist[i]) + MemoryReport::vectorBytes(parent[i]) + MemoryReport::vectorBytes(touched[i])
+			+ MemoryReport::vectorBytes(heap[i]);
+	}
+	return ret;
+}
+
+size_t ContractionHierarchy::getMemoryUsage()const{
+	return MemoryReport::vectorBytes(rank) + MemoryReport::vectorBytes(arcBegin) + MemoryReport::vectorBytes(arcs);
+}
+
+void RouteQuery::resize(size_t n, size_t arcCount){
+	for(int side = 0; side < 2; side++){
+		dist[side].assign(n, DBL_MAX);
+		parent[side].assign(n, -1);
+		touched[side].reserve(n);
+		// A side settles each vertex once, pushing once per arc out of it.
+		heap[side].reserve(arcCount + 1);
+	}
+	chain.reserve(n);
+	route.reserve(n);
+}
+
+const ContractionHierarchy::Arc *ContractionHierarchy::findArc(int from, int to)const{
+	if(rank[to] < rank[from])
+		std::swap(from, to);
+	for(int i = arcBegin[from]; i < arcBegin[from + 1]; i++){
+		if(arcs[i].to == to)
+			return &arcs[i];
+	}
+	return NULL;
+}
+
+/// \brief Checks that every arc leads upward to a vertex in range and every shortcut can be unpacked.
+///
+/// A file can match the fingerprint of the network and still be damaged in
+/// its arcs, which would send unpack() after arcs that do not exist.
+bool ContractionHierarchy::isConsistent()const{
+	std::vector<char> seen(vertexCount, 0);
+	for(int x = 0; x < vertexCount; x++){
+		if(rank[x] < 0 || vertexCount <= rank[x] || seen[rank[x]])
+			return false;
+		seen[rank[x]] = 1;
+	}
+	if(arcBegin[0] != 0)
+		return false;
+	for(int x = 0; x < vertexCount; x++){
+		if(arcBegin[x + 1] < arcBegin[x])
+			return false;
+	}
+	for(int x = 0; x < vertexCount; x++){
+		for(int i = arcBegin[x]; i < arcBegin[x + 1]; i++){
+			int to = arcs[i].to, mid = arcs[i].mid;
+			if(to < 0 || vertexCount <= to || rank[to] <= rank[x])
+				return false;
+			if(mid < 0)
+				continue;
+			// The bypassed vertex ranks below both ends, so unpacking always terminates.
+			if(vertexCount <= mid || rank[x] <= rank[mid] || !findArc(x, mid) || !findArc(mid, to))
+				return false;
+		}
+	}
+	return true;
+}
+
+/// \brief Appends the original vertices between a and b, excluding a, to route.
+/// \returns false if an arc the shortcuts refer to is missing.
+bool ContractionHierarchy::unpack(int a, int b, std::vector<int> &route)const{
+	const Arc *arc = findArc(a, b);
+	if(!arc)
+		return false;
+	if(arc->mid < 0){
+		route.push_back(b);
+		return true;
+	}
+	return unpack(a, arc->mid, route) && unpack(arc->mid, b, route);
+}
+
+/// \brief Sizes query for this index, so that findPath() does not allocate with it.
+void ContractionHierarchy::reserve(RouteQuery &query)const{
+	if(query.dist[0].size() != size_t(vertexCount))
+		query.resize(vertexCount, arcs.size());
+}
+
+/// \brief Finds the shortest route from start to dest.
+///
+/// Fills path destination first like Vehicle::findPath() does.
+/// \returns false if dest is unreachable or the same as start.
+bool ContractionHierarchy::findPath(const Graph &graph, RouteQuery &query, GraphVertex *start, const GraphVertex *dest, Vehicle::Path &path)const{
+	int s = start->getId(), t = dest->getId();
+	if(s == t || s >= vertexCount || t >= vertexCount)
+		return false;
+	reserve(query);
+
+	query.dist[0][s] = 0.;
+	query.dist[1][t] = 0.;
+	query.touched[0].push_back(s);
+	query.touched[1].push_back(t);
+	pushHeap(query.heap[0], 0., s);
+	pushHeap(query.heap[1], 0., t);
+	double best = DBL_MAX;
+	int meet = -1;
+	while(!query.heap[0].empty() || !query.heap[1].empty()){
+		for(int side = 0; side < 2; side++){
+			std::vector<HeapEntry> &heap = query.heap[side];
+			if(heap.empty())
+				continue;
+			if(best <= heap.front().first){
+				heap.clear(); // Nothing left on this side can beat best
+				continue;
+			}
+			HeapEntry top = popHeap(heap);
+			int x = top.second;
+			std::vector<double> &dist = query.dist[side];
+			if(dist[x] < top.first)
+				continue;
+			double other = query.dist[1 - side][x];
+			if(other != DBL_MAX && dist[x] + other < best){
+				best = dist[x] + other;
+				meet = x;
+			}
+			for(int i = arcBegin[x]; i < arcBegin[x + 1]; i++){
+				int y = arcs[i].to;
+				double nd = dist[x] + arcs[i].weight;
+				if(nd < dist[y]){
+					if(dist[y] == DBL_MAX)
+						query.touched[side].push_back(y);
+					dist[y] = nd;
+					query.parent[side][y] = x;
+					pushHeap(heap, nd, y);
+				}
+			}
+		}
+	}
+
+	bool found = 0 <= meet;
+	if(found){
+		// Climb from meet down to start, then unpack the shortcuts forward.
+		std::vector<int> &chain = query.chain, &route = query.route;
+		chain.clear();
+		for(int x = meet; x != -1; x = query.parent[0][x])
+			chain.push_back(x);
+		route.clear();
+		route.push_back(s);
+		for(size_t i = chain.size() - 1; found && 0 < i; i--)
+			found = unpack(chain[i], chain[i - 1], route);
+		for(int x = meet; found && query.parent[1][x] != -1; x = query.parent[1][x])
+			found = unpack(x, query.parent[1][x], route);
+
+		if(found){
+			const std::vector<GraphVertex*> &vertices = graph.getVertices();
+			path.clear();
+			for(size_t i = route.size(); 0 < i--;)
+				path.push_back(vertices[route[i]]);
+		}
+	}
+
+	for(int side = 0; side < 2; side++){
+		for(size_t i = 0; i < query.touched[side].size(); i++){
+			query.dist[side][query.touched[side][i]] = DBL_MAX;
+			query.parent[side][query.touched[side][i]] = -1;
+		}
+		query.touched[side].clear();
+		query.heap[side].clear();
+	}
+	return found;
+}
@@ -0,0 +1,72 @@
+/** \file ContractionHierarchy.h
+ * \brief Definition of ContractionHierarchy class
+ */
+#ifndef CONTRACTIONHIERARCHY_H
+#define CONTRACTIONHIERARCHY_H
+
+#include "Vehicle.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+
+class Graph;
+
+/// \brief Scratch space for ContractionHierarchy queries.
+///
+/// Queries do not modify the hierarchy, so threads may share one as long as
+/// each uses its own RouteQuery.
+class RouteQuery{
+	friend class ContractionHierarchy;
+	std::vector<double> dist[2];
+	std::vector<int> parent[2]; ///< Previous vertex on the upward search from each end
+	std::vector<int> touched[2];
+	std::vector<std::pair<double, int> > heap[2];
+	std::vector<int> chain;
+	std::vector<int> route;
+	void resize(size_t n, size_t arcCount);
+public:
+	size_t getMemoryUsage()const;
+};
+
+/// \brief Contraction hierarchy route index over the edge lengths of a Graph.
+///
+/// Preprocessing contracts vertices from least to most important, adding
+/// shortcut arcs that preserve shortest distances among the vertices left.
+/// A query then only ever walks upward in rank from both ends, touching a few
+/// hundred vertices even on very large networks.
+class ContractionHierarchy{
+public:
+	/// \brief Arc toward a higher ranked vertex.
+	struct Arc{
+		int to;
+		int mid; ///< Vertex the shortcut bypasses, -1 for an original edge
+		double weight;
+	};
+
+protected:
+	int vertexCount;
+	std::vector<int> rank;
+	std::vector<int> arcBegin; ///< Upward arcs of v are arcs[arcBegin[v]] .. arcs[arcBegin[v+1]-1]
+	std::vector<Arc> arcs;
+	uint32_t fingerprint; ///< Hash of the network the index was built for
+
+	static uint32_t computeFingerprint(const Graph &graph);
+	const Arc *findArc(int from, int to)const;
+	bool isConsistent()const;
+	bool unpack(int a, int b, std::vector<int> &route)const;
+
+public:
+	ContractionHierarchy() : vertexCount(0), fingerprint(0){}
+	void build(const Graph &graph, int threads = 0);
+	bool save(const char *fileName)const;
+	bool load(const char *fileName, const Graph &graph);
+	bool isBuilt()const{return 0 < vertexCount;}
+	size_t getArcCount()const{return arcs.size();}
+	size_t getMemoryUsage()const;
+	void reserve(RouteQuery &query)const;
+	bool findPath(const Graph &graph, RouteQuery &query, GraphVertex *start, const GraphVertex *dest, Vehicle::Path &path)const;
+};
+
+#endif
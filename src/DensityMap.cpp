@@ -0,0 +1,209 @@
+/** \file DensityMap.cpp
+ * \brief Implementation of DensityMap class
+ */
+
+#include "DensityMap.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "MemoryReport.h"
+
+#include <math.h>
+
+#include <thread>
+#include <algorithm>
+
+
+DensityMap::DensityMap(int size) : size(size), workers(1), quantity(quantityDensity), meanEdgeLength(0.),
+	sum(size * size), weight(size * size), pixels(size * size * 4)
+{
+	setWorkers(0);
+}
+
+const char *DensityMap::getQuantityName(int quantity){
+	static const char *names[quantityCount] = {"density", "slowness", "pass count"};
+	return 0 <= quantity && quantity < quantityCount ? names[quantity] : "";
+}
+
+/// \param workers Threads to build with; 0 for one per hardware thread.
+void DensityMap::setWorkers(int workers){
+	this->workers = 0 < workers ? workers : std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+/// \brief Calls f(begin, end, worker) for the workers' shares of count items, in parallel if there are several.
+template<typename F> void DensityMap::parallel(size_t count, F f){
+	if(workers <= 1 || count < size_t(workers)){
+		f(size_t(0), count, 0);
+		return;
+	}
+	size_t chunk = (count + workers - 1) / workers;
+	std::vector<std::thread> threads;
+	for(int i = 0; i < workers; i++)
+		threads.push_back(std::thread(f, std::min(count, i * chunk), std::min(count, (i + 1) * chunk), i));
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+void DensityMap::sumSpeeds(const Graph &graph, size_t begin, size_t end, Worker &w){
+	const KinematicsArrays &kin = graph.getKinematics();
+	for(size_t i = begin; i < end; i++){
+		int edge = kin.vehicles[i]->getEdge()->getId();
+		w.speedSum[edge] += kin.getVelocity(i);
+		w.speedCount[edge]++;
+	}
+}
+
+/// \brief Turns the edges of graph into segments with the value of the quantity shown.
+///
+/// Apart from the speeds of the vehicles in lanes, which are summed by the
+/// workers, this reads per edge counters, so it costs the same however many
+/// vehicles there are.
+void DensityMap::gather(const Graph &graph){
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	segments.resize(edges.size());
+	meanEdgeLength = 0.;
+	double maxValue = 0.;
+	if(quantity == quantitySpeed){
+		workerState.resize(workers);
+		for(int i = 0; i < workers; i++){
+			workerState[i].speedSum.assign(edges.size(), 0.);
+			workerState[i].speedCount.assign(edges.size(), 0);
+		}
+		parallel(graph.getKinematics().size(), [&](size_t begin, size_t end, int i){
+			sumSpeeds(graph, begin, end, workerState[i]);
+		});
+	}
+	const CellularModel &cellular = graph.getCellular();
+	for(size_t i = 0; i < edges.size(); i++){
+		const GraphEdge *e = edges[i];
+		Segment &s = segments[i];
+		double pos[2];
+		e->getStart()->getPos(pos);
+		s.start[0] = float((pos[0] + 1.) / 2. * size);
+		s.start[1] = float((pos[1] + 1.) / 2. * size);
+		e->getEnd()->getPos(pos);
+		s.end[0] = float((pos[0] + 1.) / 2. * size);
+		s.end[1] = float((pos[1] + 1.) / 2. * size);
+		meanEdgeLength += e->getLength();
+		double value = 0.;
+		switch(quantity){
+			case quantityDensity:
+				value = 0. < e->getLength() ? graph.getEdgeLoad(int(i)) / e->getLength() : 0.;
+				break;
+			case quantitySpeed:{
+				double speedSum = 0.;
+				int count = 0;
+				for(int j = 0; j < workers; j++){
+					speedSum += workerState[j].speedSum[i];
+					count += workerState[j].speedCount[i];
+				}
+				if(int queued = int(graph.getMeso().getQueueLength(int(i)))){
+					int load = graph.getEdgeLoad(int(i));
+					speedSum += queued * e->getLength() / MesoModel::travelTime(e, std::max(0, load - 1), graph.getJamDensity());
+					count += queued;
+				}
+				if(cellular.isEnabled() && i * 2 + 1 < cellular.getLaneCount()){
+					double cellSpeed = cellular.getCellLength() / cellular.getStepTime();
+					for(int dir = 0; dir < 2; dir++){
+						speedSum += cellular.getVelocitySum(uint32_t(i * 2 + dir)) * cellSpeed;
+						count += int(cellular.getCount(uint32_t(i * 2 + dir)));
+					}
+				}
+				if(count && 0. < e->getSpeedLimit())
+					value = 1. - speedSum / count / e->getSpeedLimit();
+				break;
+			}
+			case quantityPassCount:
+				value = graph.getPassCount(int(i));
+				break;
+		}
+		s.value = float(value);
+		maxValue = std::max(maxValue, value);
+	}
+	if(!edges.empty())
+		meanEdgeLength /= edges.size();
+
+	// Scale to [0, 1]; slowness already is.
+	double scale = 1.;
+	if(quantity == quantityDensity)
+		scale = 0. < graph.getJamDensity() ? graph.getJamDensity() : maxValue;
+	else if(quantity == quantityPassCount)
+		scale = graph.getMaxPassCount();
+	for(size_t i = 0; i < segments.size(); i++)
+		segments[i].value = 0. < scale ? std::min(1.f, std::max(0.f, float(segments[i].value / scale))) : 0.f;
+}
+
+/// \brief Colors value in [0, 1] from blue through green and yellow to red.
+static void heatColor(float value, unsigned char rgba[4]){
+	static const float ramp[4][3] = {{0.f, .4f, 1.f}, {0.f, 1.f, .3f}, {1.f, 1.f, 0.f}, {1.f, 0.f, 0.f}};
+	float x = value * 3.f;
+	int i = std::min(2, int(x));
+	float f = x - i;
+	for(int c = 0; c < 3; c++)
+		rgba[c] = (unsigned char)((ramp[i][c] + (ramp[i + 1][c] - ramp[i][c]) * f) * 255.f + .5f);
+	rgba[3] = 224;
+}
+
+/// \brief Sums the segments into the cells of rows row0 to row1 and colors them.
+///
+/// Each segment is sampled every half cell, and only the samples falling in
+/// the rows are visited, so the workers' bands of rows split the work without
+/// sharing any cell.
+void DensityMap::rasterize(int row0, int row1){
+	std::fill(sum.begin() + row0 * size, sum.begin() + row1 * size, 0.f);
+	std::fill(weight.begin() + row0 * size, weight.begin() + row1 * size, 0.f);
+	for(size_t i = 0; i < segments.size(); i++){
+		const Segment &s = segments[i];
+		float dx = s.end[0] - s.start[0], dy = s.end[1] - s.start[1];
+		float length = sqrtf(dx * dx + dy * dy);
+		int samples = int(length * 2.f) + 1;
+		float w = length / samples;
+		if(w <= 0.f)
+			w = 1.f;
+
+		// Range of samples whose row is in the band
+		float t0 = 0.f, t1 = 1.f;
+		if(dy != 0.f){
+			t0 = (row0 - s.start[1]) / dy;
+			t1 = (row1 - s.start[1]) / dy;
+			if(t1 < t0)
+				std::swap(t0, t1);
+		}
+		else if(s.start[1] < row0 || row1 <= s.start[1])
+			continue;
+		int k0 = std::max(0, int(floorf(t0 * samples - .5f)));
+		int k1 = std::min(samples - 1, int(ceilf(t1 * samples)));
+		for(int k = k0; k <= k1; k++){
+			float t = (k + .5f) / samples;
+			int x = int(floorf(s.start[0] + dx * t));
+			int y = int(floorf(s.start[1] + dy * t));
+			if(y < row0 || row1 <= y || x < 0 || size <= x)
+				continue;
+			sum[y * size + x] += s.value * w;
+			weight[y * size + x] += w;
+		}
+	}
+	for(int j = row0 * size; j < row1 * size; j++){
+		if(0.f < weight[j])
+			heatColor(sum[j] / weight[j], &pixels[j * 4]);
+		else
+			pixels[j * 4 + 3] = 0;
+	}
+}
+
+/// \brief Rebuilds the image from the current state of graph.
+void DensityMap::build(const Graph &graph){
+	gather(graph);
+	parallel(size_t(size), [this](size_t begin, size_t end, int){
+		rasterize(int(begin), int(end));
+	});
+}
+
+size_t DensityMap::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(segments) + MemoryReport::vectorBytes(workerState) + MemoryReport::vectorBytes(sum)
+		+ MemoryReport::vectorBytes(weight) + MemoryReport::vectorBytes(pixels);
+	for(size_t i = 0; i < workerState.size(); i++)
+		ret += MemoryReport::vectorBytes(workerState[i].speedSum) + MemoryReport::vectorBytes(workerState[i].speedCount);
+	return ret;
+}
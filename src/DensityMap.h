@@ -0,0 +1,76 @@
+/** \file DensityMap.h
+ * \brief Aggregation of the traffic into a grid, for views too far out to show single vehicles
+ *
+ * Zoomed out, the edges, labels and vehicles overlap into an unreadable
+ * blur, and drawing them one by one takes time with the size of the network
+ * and the fleet.  A DensityMap reads one value per edge from the counters
+ * the Graph already keeps, rasterizes the edges into a square grid over the
+ * network in parallel, and colors the grid into an RGBA image to be drawn as
+ * a single textured quad.
+ *
+ * The grid spans [-1, 1] on both axes in network coordinates, like the
+ * window's viewport at the default zoom.  Each cell shows the mean of the
+ * edges through it, weighted by the length of each inside the cell.
+ */
+#ifndef DENSITYMAP_H
+#define DENSITYMAP_H
+
+#include <stddef.h>
+
+#include <vector>
+
+
+class Graph;
+
+class DensityMap{
+public:
+	/// \brief What the map shows.
+	enum Quantity{
+		quantityDensity, ///< Vehicles per unit length, against the jam density or the densest edge
+		quantitySpeed, ///< Slowness, 1 minus the mean speed over the speed limit
+		quantityPassCount, ///< Vehicles that entered the edge so far, against the busiest edge
+		quantityCount
+	};
+	static const int defaultSize = 256;
+protected:
+	/// \brief An edge as rasterized, in grid coordinates.
+	struct Segment{
+		float start[2];
+		float end[2];
+		float value; ///< In [0, 1]
+	};
+	/// \brief What a worker collects before the grid is split among them.
+	struct Worker{
+		std::vector<double> speedSum; ///< Velocities of the lane vehicles by edge id
+		std::vector<int> speedCount;
+	};
+	int size; ///< Cells along each side
+	int workers;
+	int quantity;
+	double meanEdgeLength;
+	std::vector<Segment> segments;
+	std::vector<Worker> workerState;
+	std::vector<float> sum; ///< Weighted sum of the values through each cell, rows bottom to top
+	std::vector<float> weight;
+	std::vector<unsigned char> pixels; ///< RGBA, rows bottom to top
+	void sumSpeeds(const Graph &graph, size_t begin, size_t end, Worker &w);
+	void rasterize(int row0, int row1);
+	void gather(const Graph &graph);
+	template<typename F> void parallel(size_t count, F f);
+public:
+	DensityMap(int size = defaultSize);
+	int getSize()const{return size;}
+	int getQuantity()const{return quantity;}
+	void setQuantity(int quantity){this->quantity = quantity;}
+	static const char *getQuantityName(int quantity);
+	int getWorkers()const{return workers;}
+	void setWorkers(int workers);
+	/// \brief Mean length of the open edges at the last build(), in network units.
+	double getMeanEdgeLength()const{return meanEdgeLength;}
+	void build(const Graph &graph);
+	/// \brief The image of the last build(), size by size RGBA pixels with the bottom row first, as glTexImage2D() takes them.
+	const unsigned char *getPixels()const{return &pixels[0];}
+	size_t getMemoryUsage()const;
+};
+
+#endif
@@ -0,0 +1,402 @@
+/** \file DomainDecomposition.cpp
+ * \brief Implementation of the multi-process simulation
+ */
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#include "DomainDecomposition.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+
+extern "C"{
+#include <clib/timemeas.h>
+}
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+#define closeSocket closesocket
+static void sleepMilliseconds(int ms){Sleep(ms);}
+#else
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+static void sleepMilliseconds(int ms){usleep(ms * 1000);}
+#endif
+
+
+/// \brief Sorts ids[begin, end) by one coordinate and splits them between regions [first, first + count).
+static void bisect(const Graph &graph, std::vector<int> &ids, size_t begin, size_t end, int first, int count, std::vector<int> &vertexRegion){
+	if(count <= 1){
+		for(size_t i = begin; i < end; i++)
+			vertexRegion[ids[i]] = first;
+		return;
+	}
+	// Cut across the longer side of the bounding box.
+	double lo[2] = {1e300, 1e300}, hi[2] = {-1e300, -1e300};
+	for(size_t i = begin; i < end; i++){
+		double pos[2];
+		graph.getVertices()[ids[i]]->getPos(pos);
+		for(int k = 0; k < 2; k++){
+			lo[k] = std::min(lo[k], pos[k]);
+			hi[k] = std::max(hi[k], pos[k]);
+		}
+	}
+	int axis = hi[1] - lo[1] < hi[0] - lo[0] ? 0 : 1;
+	std::vector<std::pair<double, int> > keyed;
+	for(size_t i = begin; i < end; i++){
+		double pos[2];
+		graph.getVertices()[ids[i]]->getPos(pos);
+		keyed.push_back(std::make_pair(pos[axis], ids[i]));
+	}
+	std::sort(keyed.begin(), keyed.end());
+	for(size_t i = begin; i < end; i++)
+		ids[i] = keyed[i - begin].second;
+	int lower = count / 2;
+	size_t mid = begin + (end - begin) * lower / count;
+	bisect(graph, ids, begin, mid, first, lower, vertexRegion);
+	bisect(graph, ids, mid, end, first + lower, count - lower, vertexRegion);
+}
+
+/// \brief Splits the vertices of graph into regions of nearly equal size by recursive coordinate bisection.
+void partitionGraph(const Graph &graph, int regions, std::vector<int> &vertexRegion){
+	std::vector<int> ids(graph.getVertices().size());
+	for(size_t i = 0; i < ids.size(); i++)
+		ids[i] = int(i);
+	vertexRegion.assign(ids.size(), 0);
+	bisect(graph, ids, 0, ids.size(), 0, regions, vertexRegion);
+}
+
+
+static void putBytes(std::vector<char> &buf, const void *p, size_t size){
+	buf.insert(buf.end(), (const char*)p, (const char*)p + size);
+}
+
+template<typename T> static void put(std::vector<char> &buf, T value){
+	putBytes(buf, &value, sizeof value);
+}
+
+template<typename T> static T get(const char *&p){
+	T value;
+	memcpy(&value, p, sizeof value);
+	p += sizeof value;
+	return value;
+}
+
+/// \brief Appends a migrant to buf in host byte order; all regions run on one machine.
+static void serializeMigrant(std::vector<char> &buf, const Graph &graph, const Migrant &m){
+	Vehicle *v = m.vehicle;
+	put<int32_t>(buf, v->getDest()->getId());
+	put<uint32_t>(buf, v->getId());
+	put<int32_t>(buf, v->getDeparture());
+	put<int32_t>(buf, m.tick);
+	put<double>(buf, m.pos);
+	put<double>(buf, m.velocity);
+	put<double>(buf, m.accel);
+	const RouteArena &routes = graph.getRoutes();
+	uint32_t cursor = v->getCursor(), length = routes.getLength(v->getRoute());
+	put<int32_t>(buf, v->getEdge()->getOther(v->getNext())->getId());
+	put<int32_t>(buf, int32_t(length - cursor));
+	putBytes(buf, routes.getEdges(v->getRoute()) + cursor, (length - cursor) * sizeof(uint32_t));
+}
+
+/// \brief Reads a migrant back, interning the rest of its route in graph.
+static RouteArena::RouteId deserializeMigrant(Graph &graph, const char *&p, Migrant &m){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	GraphVertex *dest = vertices[get<int32_t>(p)];
+	uint32_t id = get<uint32_t>(p);
+	Vehicle *v = graph.newVehicle(dest, id);
+	v->setDeparture(get<int32_t>(p));
+	m.vehicle = v;
+	m.tick = get<int32_t>(p);
+	m.pos = get<double>(p);
+	m.velocity = get<double>(p);
+	m.accel = get<double>(p);
+	uint32_t start = get<int32_t>(p);
+	int32_t n = get<int32_t>(p);
+	std::vector<uint32_t> edges(n);
+	memcpy(&edges[0], p, n * sizeof(uint32_t));
+	p += n * sizeof(uint32_t);
+	return graph.getRoutes().intern(start, &edges[0], n);
+}
+
+
+static bool sendAll(socket_t s, const char *p, size_t size){
+	while(size){
+		int n = send(s, p, int(size), 0);
+		if(n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool recvAll(socket_t s, char *p, size_t size){
+	while(size){
+		int n = recv(s, p, int(size), 0);
+		if(n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+/// \brief Sends out[i] to peers[i] and receives in[i] from it, for all peers at once.
+///
+/// Each message is a 32-bit length followed by the payload.  Sending and
+/// receiving are interleaved with select() so that large batches cannot
+/// deadlock two regions that both fill their socket buffers.
+static bool exchange(const std::vector<socket_t> &peers, std::vector<std::vector<char> > &out, std::vector<std::vector<char> > &in){
+	size_t n = peers.size();
+	std::vector<size_t> sent(n, 0), received(n, 0);
+	std::vector<uint32_t> inSize(n, 0);
+	for(size_t i = 0; i < n; i++){
+		uint32_t size = uint32_t(out[i].size());
+		out[i].insert(out[i].begin(), (char*)&size, (char*)&size + sizeof size);
+		in[i].resize(sizeof(uint32_t));
+	}
+	for(;;){
+		fd_set readSet, writeSet;
+		FD_ZERO(&readSet);
+		FD_ZERO(&writeSet);
+		int maxFd = 0;
+		bool pending = false;
+		for(size_t i = 0; i < n; i++){
+			if(sent[i] < out[i].size()){
+				FD_SET(peers[i], &writeSet);
+				pending = true;
+			}
+			if(received[i] < in[i].size()){
+				FD_SET(peers[i], &readSet);
+				pending = true;
+			}
+			maxFd = std::max(maxFd, int(peers[i]));
+		}
+		if(!pending)
+			break;
+		if(select(maxFd + 1, &readSet, &writeSet, NULL, NULL) < 0)
+			return false;
+		for(size_t i = 0; i < n; i++){
+			if(FD_ISSET(peers[i], &writeSet)){
+				int r = send(peers[i], &out[i][sent[i]], int(out[i].size() - sent[i]), 0);
+				if(r <= 0)
+					return false;
+				sent[i] += r;
+			}
+			if(FD_ISSET(peers[i], &readSet)){
+				int r = recv(peers[i], &in[i][received[i]], int(in[i].size() - received[i]), 0);
+				if(r <= 0)
+					return false;
+				received[i] += r;
+				if(received[i] == sizeof(uint32_t) && in[i].size() == sizeof(uint32_t)){
+					memcpy(&inSize[i], &in[i][0], sizeof(uint32_t));
+					in[i].resize(sizeof(uint32_t) + inSize[i]);
+				}
+			}
+		}
+	}
+	for(size_t i = 0; i < n; i++){
+		in[i].erase(in[i].begin(), in[i].begin() + sizeof(uint32_t));
+		out[i].clear();
+	}
+	return true;
+}
+
+/// \brief Connects region to every other region on ports port, port + 1, ...
+///
+/// Each region listens on its own port, dials the regions below it and
+/// accepts the ones above it, so regions can be started in any order.
+static bool connectPeers(int region, int regions, int port, std::vector<socket_t> &peers){
+	peers.assign(regions, INVALID_SOCKET);
+	socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof one);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port + region);
+	if(bind(listener, (sockaddr*)&addr, sizeof addr) < 0 || listen(listener, regions) < 0){
+		printf("Region %d: cannot listen on port %d\n", region, port + region);
+		closeSocket(listener);
+		return false;
+	}
+	for(int j = 0; j < region; j++){
+		socket_t s = INVALID_SOCKET;
+		addr.sin_port = htons(port + j);
+		for(int retry = 0; retry < 200; retry++){
+			s = socket(AF_INET, SOCK_STREAM, 0);
+			if(connect(s, (sockaddr*)&addr, sizeof addr) == 0)
+				break;
+			closeSocket(s);
+			s = INVALID_SOCKET;
+			sleepMilliseconds(50);
+		}
+		int32_t id = region;
+		if(s == INVALID_SOCKET || !sendAll(s, (const char*)&id, sizeof id)){
+			printf("Region %d: cannot reach region %d\n", region, j);
+			closeSocket(listener);
+			return false;
+		}
+		peers[j] = s;
+	}
+	for(int j = region + 1; j < regions; j++){
+		socket_t s = accept(listener, NULL, NULL);
+		int32_t id;
+		if(s == INVALID_SOCKET || !recvAll(s, (char*)&id, sizeof id) || id <= region || regions <= id){
+			closeSocket(listener);
+			return false;
+		}
+		peers[id] = s;
+	}
+	closeSocket(listener);
+	for(int j = 0; j < regions; j++){
+		if(j != region)
+			setsockopt(peers[j], IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof one);
+	}
+	return true;
+}
+
+/// \brief Simulates one region of a decomposed run on graph for ticks steps of dt.
+///
+/// graph must be set up, network and settings, like in every other region.
+/// \returns Process exit status.
+int runRegion(Graph &graph, int region, int regions, int port, int ticks, double dt){
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	std::vector<int> vertexRegion;
+	partitionGraph(graph, regions, vertexRegion);
+	graph.setRegions(vertexRegion, region);
+
+	// The conservative window: no vehicle at free speed gets across a boundary
+	// edge before its new region hears about it.
+	double lookahead = 1e300;
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	for(size_t i = 0; i < edges.size(); i++){
+		if(vertexRegion[edges[i]->getStart()->getId()] != vertexRegion[edges[i]->getEnd()->getId()])
+			lookahead = std::min(lookahead, edges[i]->getLength() / Router::freeSpeed);
+	}
+	int window = int(std::max(1., std::min(100., lookahead / dt)));
+
+	std::vector<socket_t> all;
+	if(!connectPeers(region, regions, port, all))
+		return 1;
+	std::vector<socket_t> peers;
+	std::vector<int> peerRegion;
+	for(int j = 0; j < regions; j++){
+		if(j != region){
+			peers.push_back(all[j]);
+			peerRegion.push_back(j);
+		}
+	}
+
+	std::vector<std::vector<char> > out(peers.size()), in(peers.size());
+	std::vector<int> slotOfRegion(regions, -1);
+	for(size_t i = 0; i < peerRegion.size(); i++)
+		slotOfRegion[peerRegion[i]] = int(i);
+	std::vector<Migrant> migrants;
+	int sent = 0, received = 0;
+	timemeas_t tm;
+	TimeMeasStart(&tm);
+	for(int done = 0; done < ticks;){
+		int steps = std::min(window, ticks - done);
+		for(int k = 0; k < steps; k++)
+			graph.update(dt);
+		done += steps;
+
+		graph.takeEmigrants(migrants);
+		for(size_t i = 0; i < migrants.size(); i++){
+			Vehicle *v = migrants[i].vehicle;
+			int to = vertexRegion[v->getNext()->getId()];
+			serializeMigrant(out[slotOfRegion[to]], graph, migrants[i]);
+			v->leaveRoute(graph.getRoutes());
+			graph.deleteVehicle(v);
+		}
+		sent += int(migrants.size());
+		if(!exchange(peers, out, in)){
+			printf("Region %d: lost connection\n", region);
+			return 1;
+		}
+		for(size_t i = 0; i < in.size(); i++){
+			for(const char *p = in[i].empty() ? NULL : &in[i][0], *end = p + in[i].size(); p < end;){
+				Migrant m;
+				RouteArena::RouteId route = deserializeMigrant(graph, p, m);
+				graph.immigrate(m, route, dt);
+				received++;
+			}
+		}
+	}
+
+	int32_t stats[4] = {int32_t(graph.getVehicles().size()), graph.getArrivals(), sent, received};
+	if(region != 0)
+		sendAll(all[0], (const char*)stats, sizeof stats);
+	else{
+		int32_t total[4];
+		memcpy(total, stats, sizeof total);
+		for(int j = 1; j < regions; j++){
+			int32_t s[4];
+			if(recvAll(all[j], (char*)s, sizeof s)){
+				for(int k = 0; k < 4; k++)
+					total[k] += s[k];
+			}
+		}
+		printf("%d regions, %d ticks, window %d ticks: %d vehicles in flight, %d arrived, %d migrations in %lg s\n",
+			regions, ticks, window, total[0], total[1], total[2], TimeMeasLap(&tm));
+	}
+	for(int j = 0; j < regions; j++){
+		if(j != region)
+			closeSocket(all[j]);
+	}
+	return 0;
+}
+
+/// \brief Runs every region in its own child process, each on its copy of graph, and waits for them.
+int runDecomposed(Graph &graph, int regions, int port, int ticks, double dt){
+#ifdef _WIN32
+	printf("Forking regions is not supported on Windows; start each one with --region i/%d\n", regions);
+	return 1;
+#else
+	std::vector<pid_t> children;
+	for(int i = 0; i < regions; i++){
+		pid_t pid = fork();
+		if(pid == 0){
+			int ret = runRegion(graph, i, regions, port, ticks, dt);
+			fflush(stdout); // _exit() skips stdio cleanup
+			_exit(ret);
+		}
+		children.push_back(pid);
+	}
+	int ret = 0;
+	for(size_t i = 0; i < children.size(); i++){
+		int status;
+		waitpid(children[i], &status, 0);
+		if(!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+	}
+	return ret;
+#endif
+}
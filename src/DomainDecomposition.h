@@ -0,0 +1,23 @@
+/** \file DomainDecomposition.h
+ * \brief Multi-process simulation with the network split into regions
+ *
+ * Every process builds the same network from the same options, but only steps
+ * the vehicles heading into vertices of its own region.  A vehicle crossing a
+ * boundary edge is serialized and sent to the region that owns the far end.
+ * Processes exchange migrants over localhost TCP every few ticks; the window
+ * is short enough that no vehicle can cross a boundary edge inside it, so the
+ * receiver can catch a migrant up without changing the result.
+ */
+#ifndef DOMAINDECOMPOSITION_H
+#define DOMAINDECOMPOSITION_H
+
+#include <vector>
+
+
+class Graph;
+
+void partitionGraph(const Graph &graph, int regions, std::vector<int> &vertexRegion);
+int runRegion(Graph &graph, int region, int regions, int port, int ticks, double dt);
+int runDecomposed(Graph &graph, int regions, int port, int ticks, double dt);
+
+#endif
@@ -0,0 +1,109 @@
+/** \file EditScript.cpp
+ * \brief Implementation of EditScript class
+ */
+
+#include "EditScript.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "EventLog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+/// \brief Reads the script from fileName.
+/// \returns false if the file cannot be read or has a malformed line, which is reported.
+bool EditScript::load(const char *fileName){
+	FILE *fp = fopen(fileName, "r");
+	if(!fp){
+		fprintf(stderr, "Cannot open edit script %s\n", fileName);
+		return false;
+	}
+	char line[256];
+	int lineNo = 0;
+	bool ok = true;
+	while(fgets(line, sizeof line, fp)){
+		lineNo++;
+		char *comment = strchr(line, '#');
+		if(comment)
+			*comment = '\0';
+		char op[16];
+		Edit e = {0, Close, 0, 0, 0.};
+		int n = sscanf(line, "%d %15s", &e.tick, op);
+		if(n <= 0)
+			continue; // Blank line
+		const char *args = strstr(line, op) + strlen(op);
+		if(n == 2 && !strcmp(op, "close"))
+			n = sscanf(args, "%d", &e.a) == 1;
+		else if(n == 2 && !strcmp(op, "open"))
+			e.op = Open, n = sscanf(args, "%d", &e.a) == 1;
+		else if(n == 2 && !strcmp(op, "add"))
+			e.op = Add, n = sscanf(args, "%d %d", &e.a, &e.b) == 2;
+		else if(n == 2 && !strcmp(op, "length"))
+			e.op = Length, n = sscanf(args, "%d %lg", &e.a, &e.value) == 2 && 0. < e.value;
+		else if(n == 2 && !strcmp(op, "speed"))
+			e.op = Speed, n = sscanf(args, "%d %lg", &e.a, &e.value) == 2 && 0. < e.value;
+		else
+			n = 0;
+		if(!n){
+			fprintf(stderr, "%s(%d): malformed edit\n", fileName, lineNo);
+			ok = false;
+			continue;
+		}
+		edits.push_back(e);
+	}
+	fclose(fp);
+	std::stable_sort(edits.begin(), edits.end());
+	next = 0;
+	return ok;
+}
+
+/// \brief Skips the edits before tick, for a run restored to the state it had then, which they are part of.
+void EditScript::skipTo(int tick){
+	for(next = 0; next < edits.size() && edits[next].tick < tick; next++);
+}
+
+/// \brief Applies the edits due by the graph's current tick.
+void EditScript::apply(Graph &graph){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	for(; next < edits.size() && edits[next].tick <= graph.getTicks(); next++){
+		const Edit &e = edits[next];
+		if(EventLog *log = graph.getEventLog())
+			log->edit(e.op, e.a, e.b, e.value);
+		bool edgeOk = 0 <= e.a && e.a < int(edges.size());
+		int rerouted = 0;
+		switch(e.op){
+			case Close:
+				if(edgeOk)
+					rerouted = graph.closeEdge(edges[e.a]);
+				break;
+			case Open:
+				if(edgeOk)
+					rerouted = graph.openEdge(edges[e.a]);
+				break;
+			case Add:
+				edgeOk = 0 <= e.a && e.a < int(vertices.size()) && 0 <= e.b && e.b < int(vertices.size())
+					&& graph.addRoad(vertices[e.a], vertices[e.b]);
+				break;
+			case Length:
+				if(edgeOk)
+					rerouted = graph.setEdgeLength(edges[e.a], e.value);
+				break;
+			case Speed:
+				if(edgeOk)
+					rerouted = graph.setSpeedLimit(edges[e.a], e.value);
+				break;
+		}
+		static const char *const names[] = {"close edge", "open edge", "add road from vertex", "set length of edge", "set speed limit of edge"};
+		char what[64];
+		sprintf(what, e.op == Add ? "%s %d to %d" : "%s %d", names[e.op], e.a, e.b);
+		if(!edgeOk)
+			fprintf(stderr, "Tick %d: cannot %s\n", graph.getTicks(), what);
+		else
+			fprintf(stderr, "Tick %d: %s, rerouted %d vehicles\n", graph.getTicks(), what, rerouted);
+	}
+}
@@ -0,0 +1,47 @@
+/** \file EditScript.h
+ * \brief Definition of EditScript class
+ */
+#ifndef EDITSCRIPT_H
+#define EDITSCRIPT_H
+
+#include <stddef.h>
+
+#include <vector>
+
+
+class Graph;
+
+/// \brief Road edits scheduled by tick, for incident and roadwork scenarios.
+///
+/// The script is a text file with one edit per line:
+/// \code
+/// # tick  edit    arguments
+/// 300     close   12          # edge id
+/// 900     open    12
+/// 400     add     3 57        # vertex ids
+/// 500     length  40 0.8
+/// 500     speed   41 0.05
+/// \endcode
+/// Lengths and speed limits must be positive.
+class EditScript{
+	enum Op{Close, Open, Add, Length, Speed};
+	struct Edit{
+		int tick;
+		Op op;
+		int a;
+		int b;
+		double value;
+		bool operator<(const Edit &o)const{return tick < o.tick;}
+	};
+	std::vector<Edit> edits;
+	size_t next;
+public:
+	EditScript() : next(0){}
+	bool load(const char *fileName);
+	void apply(Graph &graph);
+	void rewind(){next = 0;} ///< Applies the edits again from the first, for a run starting over
+	void skipTo(int tick);
+	bool empty()const{return edits.empty();}
+};
+
+#endif
@@ -0,0 +1,130 @@
+/** \file Ensemble.cpp
+ * \brief Implementation of the ensemble runner
+ */
+
+#include "Ensemble.h"
+#include "Graph.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+
+/// \brief The seed of the given replica.  Replica 0 gets baseSeed itself, so
+/// it reproduces a single run with the same seed.
+uint32_t replicaSeed(uint32_t baseSeed, int replica){
+	return baseSeed + uint32_t(replica) * 2654435761u;
+}
+
+/// \brief Simulates the traffic of one replica on the network of another graph.
+void runReplica(const Graph &network, uint32_t seed, int ticks, double dt, ReplicaResult &result){
+	// TimeMeasLap() counts processor time on some platforms, which adds up over all the threads.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Graph replica(network, seed);
+	for(int t = 0; t < ticks; t++)
+		replica.update(dt);
+	result.seed = seed;
+	result.arrivals = replica.getArrivals();
+	result.vehicles = int(replica.getVehicleCount());
+	result.stranded = replica.getStranded();
+	result.stalled = replica.getStalledCount();
+	result.gridlocks = replica.getGridlockCount();
+	result.meanTripTime = replica.getMeanTripTime();
+	const int *stepStats = replica.getStepStats();
+	int spawned = 0, steps = 0;
+	for(int i = 0; i < Graph::stepStatCount; i++){
+		spawned += stepStats[i];
+		steps += i * stepStats[i];
+	}
+	result.meanPathLength = spawned ? double(steps) / spawned : 0.;
+	result.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// \brief Two sided 95% quantile of Student's t distribution with the given degrees of freedom.
+static double tQuantile95(int dof){
+	static const double table[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+	const int tableSize = sizeof table / sizeof *table;
+	if(dof < 1)
+		return 0.;
+	if(dof <= tableSize)
+		return table[dof - 1];
+	if(dof <= 60)
+		return 2.000;
+	if(dof <= 120)
+		return 1.980;
+	return 1.960;
+}
+
+/// \brief Prints the mean, the half width of its 95% confidence interval and the range of a measure.
+static void printMeasure(const char *name, const std::vector<double> &values){
+	size_t n = values.size();
+	double sum = 0.;
+	for(size_t i = 0; i < n; i++)
+		sum += values[i];
+	double mean = sum / n;
+	double var = 0.;
+	for(size_t i = 0; i < n; i++)
+		var += (values[i] - mean) * (values[i] - mean);
+	double halfWidth = 1 < n ? tQuantile95(int(n - 1)) * sqrt(var / (n - 1) / n) : 0.;
+	printf("%-18s %12.3f +- %-10.3f [%.3f, %.3f]\n", name, mean, halfWidth,
+		*std::min_element(values.begin(), values.end()), *std::max_element(values.begin(), values.end()));
+}
+
+/// \brief Runs replicas of the traffic on network with threads workers and prints the statistics.
+///
+/// The network and its route index are shared read only by all the replicas,
+/// so they must not be edited while the ensemble runs.
+int runEnsemble(const Graph &network, int replicas, int threads, uint32_t baseSeed, int ticks, double dt){
+	if(replicas < 1)
+		return 1;
+	if(threads < 1)
+		threads = std::max(1, int(std::thread::hardware_concurrency()));
+	threads = std::min(threads, replicas);
+
+	std::vector<ReplicaResult> results(replicas);
+	std::atomic<int> nextReplica(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for(int i = 0; i < threads; i++)
+		workers.push_back(std::thread([&](){
+			for(int r; (r = nextReplica++) < replicas;)
+				runReplica(network, replicaSeed(baseSeed, r), ticks, dt, results[r]);
+		}));
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%d replicas of %d ticks on %d threads in %lg s\n", replicas, ticks, threads, wall);
+	printf("%8s %10s %8s %8s %10s %8s %8s\n", "replica", "seed", "arrived", "on road", "trip", "path", "wall");
+	for(int r = 0; r < replicas; r++){
+		const ReplicaResult &res = results[r];
+		printf("%8d %10u %8d %8d %10.2f %8.3f %8.3f\n", r, res.seed, res.arrivals, res.vehicles,
+			res.meanTripTime, res.meanPathLength, res.wallTime);
+	}
+
+	std::vector<double> values(replicas);
+	printf("%-18s %12s    %-10s %s\n", "measure", "mean", "95% CI", "range");
+#define MEASURE(name, member) \
+	for(int r = 0; r < replicas; r++) \
+		values[r] = double(results[r].member); \
+	printMeasure(name, values);
+	MEASURE("arrivals", arrivals)
+	MEASURE("vehicles on road", vehicles)
+	MEASURE("stranded", stranded)
+	MEASURE("stalled", stalled)
+	MEASURE("gridlocks", gridlocks)
+	MEASURE("trip time (ticks)", meanTripTime)
+	MEASURE("path length", meanPathLength)
+	MEASURE("wall time (s)", wallTime)
+#undef MEASURE
+	return 0;
+}
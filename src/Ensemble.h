@@ -0,0 +1,35 @@
+/** \file Ensemble.h
+ * \brief Running many replicas of the simulation for statistics
+ *
+ * A single run only tells one story of a random process.  An ensemble runs
+ * replicas with different traffic seeds on the same network and route index,
+ * each on its own Graph, and reports the mean of each measure with a 95%
+ * confidence interval.  Replicas are independent, so they run on a pool of
+ * threads without any locking.
+ */
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <stdint.h>
+
+
+class Graph;
+
+/// \brief What one replica ended with.
+struct ReplicaResult{
+	uint32_t seed;
+	int arrivals;
+	int vehicles; ///< Vehicles still on the road
+	int stranded;
+	int stalled; ///< Vehicles waiting longer than the stall time at the end
+	int gridlocks;
+	double meanTripTime; ///< In ticks
+	double meanPathLength; ///< In vertices, from the spawn histogram
+	double wallTime; ///< Seconds
+};
+
+uint32_t replicaSeed(uint32_t baseSeed, int replica);
+void runReplica(const Graph &network, uint32_t seed, int ticks, double dt, ReplicaResult &result);
+int runEnsemble(const Graph &network, int replicas, int threads, uint32_t baseSeed, int ticks, double dt);
+
+#endif
@@ -0,0 +1,300 @@
+/** \file EventLog.cpp
+ * \brief Implementation of EventLog, ReplayWriter and ReplayReader classes
+ */
+
+#include "EventLog.h"
+#include "Graph.h"
+
+#include <string.h>
+
+
+static const char replayMagic[4] = {'T', 'R', 'P', 'L'};
+static const uint32_t replayVersion = 2;
+
+/// Spawn id every block codes its first spawn against, so that blocks decode on their own.
+static const uint32_t noSpawn = 0xffffffff;
+
+
+void EventLog::print(FILE *fp, const Event &e){
+	static const char *const kinds[kindCount] = {"tick", "spawn", "enter", "arrive", "edit"};
+	fprintf(fp, "%s", e.kind < kindCount ? kinds[e.kind] : "?");
+	switch(e.kind){
+		case eventTick: fprintf(fp, " dt %g", e.value); break;
+		case eventSpawn: fprintf(fp, " vehicle %u from %d to %d outcome %d", e.vehicle, e.a, e.b, e.detail); break;
+		case eventEnter: fprintf(fp, " vehicle %u edge %d heading to its %s", e.vehicle, e.a / 2, e.a % 2 ? "end" : "start"); break;
+		case eventArrive: fprintf(fp, " vehicle %u", e.vehicle); break;
+		case eventEdit: fprintf(fp, " op %d %d %d %g", e.detail, e.a, e.b, e.value); break;
+	}
+}
+
+
+static void putVarint(std::vector<unsigned char> &out, uint32_t v){
+	while(0x80 <= v){
+		out.push_back((unsigned char)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((unsigned char)v);
+}
+
+static void putSigned(std::vector<unsigned char> &out, int32_t v){
+	putVarint(out, (uint32_t(v) << 1) ^ uint32_t(v >> 31));
+}
+
+static void putDouble(std::vector<unsigned char> &out, double v){
+	unsigned char bytes[sizeof v];
+	memcpy(bytes, &v, sizeof v);
+	out.insert(out.end(), bytes, bytes + sizeof v);
+}
+
+/// \brief Reads a varint at pos, moving pos past it; sets ok false if it runs off the end.
+static uint32_t getVarint(const std::vector<unsigned char> &in, size_t &pos, bool &ok){
+	uint32_t v = 0;
+	for(int shift = 0; shift < 35; shift += 7){
+		if(in.size() <= pos){
+			ok = false;
+			return 0;
+		}
+		unsigned char c = in[pos++];
+		v |= uint32_t(c & 0x7f) << shift;
+		if(!(c & 0x80))
+			return v;
+	}
+	ok = false;
+	return v;
+}
+
+static int32_t getSigned(const std::vector<unsigned char> &in, size_t &pos, bool &ok){
+	uint32_t v = getVarint(in, pos, ok);
+	return int32_t(v >> 1) ^ -int32_t(v & 1);
+}
+
+static double getDouble(const std::vector<unsigned char> &in, size_t &pos, bool &ok){
+	double v = 0.;
+	if(in.size() - pos < sizeof v){
+		ok = false;
+		return v;
+	}
+	memcpy(&v, &in[pos], sizeof v);
+	pos += sizeof v;
+	return v;
+}
+
+
+/// \brief Starts a replay file with a keyframe of graph as it is now.
+/// \param dt Time step most ticks take; others cost eight bytes more.
+/// \param interval Ticks between keyframes.
+bool ReplayWriter::open(const char *fileName, const Graph &graph, double dt, int interval){
+	close();
+	fp = fopen(fileName, "wb");
+	if(!fp)
+		return false;
+	this->dt = dt;
+	this->interval = interval < 1 ? 1 : interval;
+	uint32_t header[2] = {replayVersion, uint32_t(this->interval)};
+	fwrite(replayMagic, sizeof replayMagic, 1, fp);
+	fwrite(header, sizeof header, 1, fp);
+	fwrite(&dt, sizeof dt, 1, fp);
+	keyframes = 0;
+	keyframeBytes = eventBytes = 0;
+	state.clear();
+	graph.saveState(state);
+	writeBlock('K', graph.getTicks(), &state.getData()[0], state.getData().size());
+	keyframeBytes += state.getData().size();
+	keyframes++;
+	block.clear();
+	blockTick = graph.getTicks();
+	lastSpawn = noSpawn;
+	return !ferror(fp);
+}
+
+void ReplayWriter::writeBlock(char type, int tick, const void *data, size_t bytes){
+	uint32_t header[2] = {uint32_t(tick), uint32_t(bytes)};
+	fwrite(&type, 1, 1, fp);
+	fwrite(header, sizeof header, 1, fp);
+	if(bytes)
+		fwrite(data, 1, bytes, fp);
+}
+
+/// \brief Writes the events encoded since the last keyframe as one block.
+void ReplayWriter::flush(){
+	if(block.empty())
+		return;
+	writeBlock('E', blockTick, &block[0], block.size());
+	eventBytes += block.size();
+	block.clear();
+	lastSpawn = noSpawn;
+}
+
+void ReplayWriter::close(){
+	if(!fp)
+		return;
+	flush();
+	fclose(fp);
+	fp = NULL;
+}
+
+/// \brief Encodes the events log collected over the tick graph just ran, and saves a keyframe if one is due.
+///
+/// The log is emptied for the next tick.  It must end with the tick's
+/// eventTick.
+void ReplayWriter::record(const Graph &graph, EventLog &log){
+	const std::vector<EventLog::Event> &events = log.getEvents();
+	for(size_t i = 0; i < events.size(); i++){
+		const EventLog::Event &e = events[i];
+		bool otherDt = e.kind == EventLog::eventTick && e.value != dt;
+		block.push_back((unsigned char)(e.kind | (otherDt ? 1 : e.detail) << 4));
+		switch(e.kind){
+			case EventLog::eventTick:
+				if(otherDt)
+					putDouble(block, e.value);
+				break;
+			case EventLog::eventSpawn:
+				putSigned(block, int32_t(e.vehicle - (lastSpawn + 1)));
+				putVarint(block, uint32_t(e.a));
+				putVarint(block, uint32_t(e.b));
+				lastSpawn = e.vehicle;
+				break;
+			case EventLog::eventEnter:
+				putVarint(block, e.vehicle);
+				putVarint(block, uint32_t(e.a));
+				break;
+			case EventLog::eventArrive:
+				putVarint(block, e.vehicle);
+				break;
+			case EventLog::eventEdit:
+				putSigned(block, e.a);
+				putSigned(block, e.b);
+				putDouble(block, e.value);
+				break;
+		}
+	}
+	log.clear();
+	if(graph.getTicks() % interval)
+		return;
+	flush();
+	state.clear();
+	graph.saveState(state);
+	writeBlock('K', graph.getTicks(), &state.getData()[0], state.getData().size());
+	keyframeBytes += state.getData().size();
+	keyframes++;
+	blockTick = graph.getTicks();
+}
+
+
+/// \brief Opens a replay file and lists its blocks.
+bool ReplayReader::open(const char *fileName){
+	fp = fopen(fileName, "rb");
+	if(!fp)
+		return false;
+	char magic[4];
+	uint32_t header[2];
+	if(fread(magic, sizeof magic, 1, fp) != 1 || memcmp(magic, replayMagic, sizeof magic)
+		|| fread(header, sizeof header, 1, fp) != 1 || header[0] != replayVersion || fread(&dt, sizeof dt, 1, fp) != 1)
+		return false;
+	interval = int(header[1]);
+	blocks.clear();
+	for(;;){
+		Block b;
+		uint32_t h[2];
+		if(fread(&b.type, 1, 1, fp) != 1 || fread(h, sizeof h, 1, fp) != 1)
+			break;
+		b.tick = int(h[0]);
+		b.bytes = h[1];
+		b.offset = ftell(fp);
+		if(fseek(fp, long(b.bytes), SEEK_CUR))
+			break;
+		blocks.push_back(b);
+	}
+	// A file cut short while being written loses its last block.
+	if(!blocks.empty()){
+		fseek(fp, 0, SEEK_END);
+		if(ftell(fp) < blocks.back().offset + long(blocks.back().bytes))
+			blocks.pop_back();
+	}
+	return !blocks.empty() && blocks.front().type == 'K';
+}
+
+/// \brief Returns the index of the last keyframe at or before tick, for loadKeyframe().
+int ReplayReader::findKeyframe(int tick)const{
+	int ret = -1;
+	for(size_t i = 0; i < blocks.size() && blocks[i].tick <= tick; i++){
+		if(blocks[i].type == 'K')
+			ret = int(i);
+	}
+	return ret;
+}
+
+/// \brief Reads keyframe into state and makes nextTick() continue from it.
+bool ReplayReader::loadKeyframe(int keyframe, StateBuffer &state){
+	if(keyframe < 0 || int(blocks.size()) <= keyframe || blocks[keyframe].type != 'K')
+		return false;
+	const Block &b = blocks[keyframe];
+	state.clear();
+	state.getData().resize(b.bytes);
+	if(fseek(fp, b.offset, SEEK_SET) || (b.bytes && fread(&state.getData()[0], 1, b.bytes, fp) != b.bytes))
+		return false;
+	tick = b.tick;
+	nextBlock = keyframe + 1;
+	data.clear();
+	readPos = 0;
+	return true;
+}
+
+bool ReplayReader::loadBlock(size_t i){
+	const Block &b = blocks[i];
+	data.resize(b.bytes);
+	readPos = 0;
+	lastSpawn = noSpawn;
+	return !fseek(fp, b.offset, SEEK_SET) && (!b.bytes || fread(&data[0], 1, b.bytes, fp) == b.bytes);
+}
+
+/// \brief Decodes the events of the next tick, ending with its eventTick, into events.
+/// \returns false at the end of the log.
+bool ReplayReader::nextTick(std::vector<EventLog::Event> &events, double &dt){
+	events.clear();
+	for(;;){
+		while(data.size() <= readPos){
+			while(nextBlock < blocks.size() && blocks[nextBlock].type != 'E')
+				nextBlock++;
+			if(blocks.size() <= nextBlock || !loadBlock(nextBlock++))
+				return false;
+		}
+		bool ok = true;
+		unsigned char c = data[readPos++];
+		EventLog::Event e = {uint8_t(c & 0xf), uint8_t(c >> 4), 0, 0, 0, 0.};
+		switch(e.kind){
+			case EventLog::eventTick:
+				e.value = e.detail ? getDouble(data, readPos, ok) : this->dt;
+				e.detail = 0;
+				break;
+			case EventLog::eventSpawn:
+				e.vehicle = lastSpawn + 1 + uint32_t(getSigned(data, readPos, ok));
+				e.a = int32_t(getVarint(data, readPos, ok));
+				e.b = int32_t(getVarint(data, readPos, ok));
+				lastSpawn = e.vehicle;
+				break;
+			case EventLog::eventEnter:
+				e.vehicle = getVarint(data, readPos, ok);
+				e.a = int32_t(getVarint(data, readPos, ok));
+				break;
+			case EventLog::eventArrive:
+				e.vehicle = getVarint(data, readPos, ok);
+				break;
+			case EventLog::eventEdit:
+				e.a = getSigned(data, readPos, ok);
+				e.b = getSigned(data, readPos, ok);
+				e.value = getDouble(data, readPos, ok);
+				break;
+			default:
+				ok = false;
+		}
+		if(!ok)
+			return false;
+		events.push_back(e);
+		if(e.kind == EventLog::eventTick){
+			dt = e.value;
+			tick++;
+			return true;
+		}
+	}
+}
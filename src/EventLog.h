@@ -0,0 +1,134 @@
+/** \file EventLog.h
+ * \brief Recording a run as a compact event log with keyframes, for replaying it and seeking in it
+ *
+ * The simulation is deterministic, so a run is fully told by its random
+ * draws and edits, which the event log records tick by tick along with the
+ * edge transitions and arrivals they led to.  Every interval ticks the full
+ * state of the graph is saved as a keyframe.  A player seeks to any tick by
+ * loading the nearest keyframe at or before it and simulating only the
+ * ticks after that, with the time steps of the log, and checks on the way
+ * that the events it gets are those of the log.
+ *
+ * A replay file is a header followed by blocks:
+ * \code
+ * "TRPL" version dt interval
+ * 'K' tick bytes <state saved by Graph::saveState() after tick ticks>
+ * 'E' tick bytes <events of the ticks from tick on, up to the next keyframe>
+ * \endcode
+ * An event is a byte of its kind and detail followed by variable length
+ * integers, so a vehicle entering an edge takes about five bytes.  Like the
+ * golden traces, a replay must be played with the same options it was
+ * recorded with; the state only holds what changes with the traffic and the
+ * edits.
+ */
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include "StateBuffer.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+class Graph;
+
+/// \brief Collects the events of the tick being run, for a ReplayWriter to write or a player to check.
+class EventLog{
+public:
+	enum Kind{
+		eventTick, ///< End of a tick; value is its time step
+		eventSpawn, ///< A trip was drawn; detail is its SpawnOutcome, a and b the start and end vertex
+		eventEnter, ///< A vehicle entered an edge; a is the edge id * 2, plus 1 when heading to its end
+		eventArrive, ///< A vehicle reached its destination
+		eventEdit, ///< The road network was edited; detail is the EditScript operation, a and b its operands
+		kindCount
+	};
+	enum SpawnOutcome{spawnPlaced, spawnNoRoute, spawnBlocked, spawnRemote};
+	struct Event{
+		uint8_t kind;
+		uint8_t detail;
+		uint32_t vehicle;
+		int32_t a;
+		int32_t b;
+		double value;
+		bool operator==(const Event &o)const{
+			return kind == o.kind && detail == o.detail && vehicle == o.vehicle && a == o.a && b == o.b && value == o.value;
+		}
+		bool operator!=(const Event &o)const{return !(*this == o);}
+	};
+protected:
+	std::vector<Event> events;
+	void add(int kind, int detail, uint32_t vehicle, int a, int b, double value){
+		Event e = {uint8_t(kind), uint8_t(detail), vehicle, a, b, value};
+		events.push_back(e);
+	}
+public:
+	void spawn(uint32_t vehicle, int start, int end, int outcome){add(eventSpawn, outcome, vehicle, start, end, 0.);}
+	void enter(uint32_t vehicle, uint32_t edgeCode){add(eventEnter, 0, vehicle, int(edgeCode), 0, 0.);}
+	void arrive(uint32_t vehicle){add(eventArrive, 0, vehicle, 0, 0, 0.);}
+	void edit(int op, int a, int b, double value){add(eventEdit, op, 0, a, b, value);}
+	void endTick(double dt){add(eventTick, 0, 0, 0, 0, dt);}
+	const std::vector<Event> &getEvents()const{return events;}
+	void clear(){events.clear();}
+	static void print(FILE *fp, const Event &e);
+};
+
+/// \brief Writes the events of a run and its keyframes to a replay file.
+class ReplayWriter{
+	FILE *fp;
+	double dt;
+	int interval;
+	int blockTick; ///< Tick the pending block of events starts at
+	std::vector<unsigned char> block; ///< Encoded events not written yet
+	uint32_t lastSpawn; ///< Id of the last spawn encoded, which the next is coded against
+	StateBuffer state;
+	size_t keyframeBytes;
+	size_t eventBytes;
+	int keyframes;
+	void flush();
+	void writeBlock(char type, int tick, const void *data, size_t bytes);
+public:
+	ReplayWriter() : fp(NULL), dt(0.), interval(1000), blockTick(0), lastSpawn(0), keyframeBytes(0), eventBytes(0), keyframes(0){}
+	~ReplayWriter(){close();}
+	bool open(const char *fileName, const Graph &graph, double dt, int interval);
+	void close();
+	bool isOpen()const{return fp != NULL;}
+	void record(const Graph &graph, EventLog &log);
+	int getKeyframeCount()const{return keyframes;}
+	size_t getKeyframeBytes()const{return keyframeBytes;}
+	size_t getEventBytes()const{return eventBytes;}
+};
+
+/// \brief Reads a replay file, seeking through its keyframes.
+class ReplayReader{
+	struct Block{
+		char type;
+		int tick;
+		long offset; ///< Of the payload in the file
+		uint32_t bytes;
+	};
+	FILE *fp;
+	double dt;
+	int interval;
+	std::vector<Block> blocks;
+	size_t nextBlock; ///< Block of events to decode after the current one
+	std::vector<unsigned char> data; ///< Payload of the current block of events
+	size_t readPos;
+	uint32_t lastSpawn;
+	int tick; ///< Tick the next call to nextTick() returns the events of
+	bool loadBlock(size_t i);
+public:
+	ReplayReader() : fp(NULL), dt(0.), interval(1), nextBlock(0), readPos(0), lastSpawn(0), tick(0){}
+	~ReplayReader(){if(fp) fclose(fp);}
+	bool open(const char *fileName);
+	double getDt()const{return dt;}
+	int getInterval()const{return interval;}
+	int findKeyframe(int tick)const;
+	bool loadKeyframe(int keyframe, StateBuffer &state);
+	bool nextTick(std::vector<EventLog::Event> &events, double &dt);
+	int getTick()const{return tick;}
+};
+
+#endif
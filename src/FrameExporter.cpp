@@ -0,0 +1,292 @@
+/** \file FrameExporter.cpp
+ * \brief Implementation of the offscreen renderer and FrameExporter class
+ */
+
+#include "FrameExporter.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979
+#endif
+
+
+/// \brief Copies the positions of everything drawn in a frame out of graph.
+void FrameSnapshot::capture(const Graph &graph){
+	tick = graph.getTicks();
+	maxPassCount = graph.getMaxPassCount();
+
+	const std::vector<GraphVertex*> &gvertices = graph.getVertices();
+	vertices.resize(gvertices.size() * 2);
+	for(size_t i = 0; i < gvertices.size(); i++){
+		double pos[2];
+		gvertices[i]->getPos(pos);
+		vertices[i * 2] = float(pos[0]);
+		vertices[i * 2 + 1] = float(pos[1]);
+	}
+
+	const std::vector<GraphEdge*> &gedges = graph.getEdges();
+	edges.resize(gedges.size());
+	for(size_t i = 0; i < gedges.size(); i++){
+		double pos[2];
+		gedges[i]->getStart()->getPos(pos);
+		edges[i].start[0] = float(pos[0]);
+		edges[i].start[1] = float(pos[1]);
+		gedges[i]->getEnd()->getPos(pos);
+		edges[i].end[0] = float(pos[0]);
+		edges[i].end[1] = float(pos[1]);
+		edges[i].passCount = graph.getPassCount(int(i));
+	}
+
+	std::vector<VehiclePosition> positions;
+	graph.getVehiclePositions(positions);
+	vehicles.resize(positions.size());
+	for(size_t i = 0; i < positions.size(); i++){
+		double pos[2], angle;
+		positions[i].vehicle->getPlacement(positions[i].pos, pos, angle);
+		vehicles[i].pos[0] = float(pos[0]);
+		vehicles[i].pos[1] = float(pos[1]);
+		vehicles[i].angle = float(angle);
+		positions[i].vehicle->getColor(vehicles[i].color);
+	}
+}
+
+
+static unsigned char toByte(float f){
+	return f <= 0.f ? 0 : 1.f <= f ? 255 : (unsigned char)(f * 255.f + .5f);
+}
+
+void Canvas::clear(const float color[3]){
+	unsigned char rgb[3] = {toByte(color[0]), toByte(color[1]), toByte(color[2])};
+	for(size_t i = 0; i < pixels.size(); i += 3)
+		memcpy(&pixels[i], rgb, 3);
+}
+
+/// \brief Fills a polygon given in pixel coordinates with the even-odd rule.
+///
+/// Pixels are sampled at their centers, so polygons sharing an edge neither
+/// overlap nor leave gaps.
+void Canvas::fillPolygon(const double (*points)[2], int count, const float color[3]){
+	unsigned char rgb[3] = {toByte(color[0]), toByte(color[1]), toByte(color[2])};
+	double miny = points[0][1], maxy = points[0][1];
+	for(int i = 1; i < count; i++){
+		miny = std::min(miny, points[i][1]);
+		maxy = std::max(maxy, points[i][1]);
+	}
+	int y0 = std::max(0, int(ceil(miny - .5)));
+	int y1 = std::min(height - 1, int(floor(maxy - .5)));
+	for(int y = y0; y <= y1; y++){
+		double yc = y + .5;
+		spans.clear();
+		for(int i = 0; i < count; i++){
+			const double *a = points[i], *b = points[(i + 1) % count];
+			if((a[1] <= yc) != (b[1] <= yc))
+				spans.push_back(a[0] + (yc - a[1]) * (b[0] - a[0]) / (b[1] - a[1]));
+		}
+		std::sort(spans.begin(), spans.end());
+		for(size_t i = 0; i + 1 < spans.size(); i += 2){
+			int x0 = std::max(0, int(ceil(spans[i] - .5)));
+			int x1 = std::min(width - 1, int(ceil(spans[i + 1] - .5)) - 1);
+			for(int x = x0; x <= x1; x++)
+				memcpy(&pixels[(y * width + x) * 3], rgb, 3);
+		}
+	}
+}
+
+/// \brief Draws a one pixel wide line between points in pixel coordinates.
+void Canvas::drawLine(const double a[2], const double b[2], const float color[3]){
+	unsigned char rgb[3] = {toByte(color[0]), toByte(color[1]), toByte(color[2])};
+	double dx = b[0] - a[0], dy = b[1] - a[1];
+	int steps = int(std::max(fabs(dx), fabs(dy))) + 1;
+	for(int i = 0; i <= steps; i++){
+		int x = int(floor(a[0] + dx * i / steps));
+		int y = int(floor(a[1] + dy * i / steps));
+		if(0 <= x && x < width && 0 <= y && y < height)
+			memcpy(&pixels[(y * width + x) * 3], rgb, 3);
+	}
+}
+
+/// \brief Draws frame the way draw_func() does, without the text labels and the chart.
+///
+/// Network coordinates span [-1, 1] on both axes, stretched over the whole
+/// canvas like the window's viewport.
+void Canvas::render(const FrameSnapshot &frame){
+	const float background[3] = {0.f, .2f, .1f};
+	const float asphalt[3] = {.5f, .5f, .5f};
+	const float white[3] = {1.f, 1.f, 1.f};
+	const float red[3] = {1.f, 0.f, 0.f};
+	const float black[3] = {0.f, 0.f, 0.f};
+	const double sx = width / 2., sy = -height / 2.;
+	const double size = vertexRadius / 200.;
+	const double dashedLineLength = 0.07;
+	const double lineHalfWidth = 0.003;
+
+	clear(background);
+
+	// Map network coordinates to pixels.
+	double quad[4][2];
+#define TOPIXEL(p, x, y) ((p)[0] = ((x) + 1.) * sx, (p)[1] = ((y) - 1.) * sy)
+
+	for(size_t i = 0; i < frame.edges.size(); i++){
+		const FrameSnapshot::Edge &e = frame.edges[i];
+		double pos[2] = {e.start[0], e.start[1]}, dpos[2] = {e.end[0], e.end[1]};
+		double para[2], perp[2];
+		const double length = calcPerp(para, perp, pos, dpos);
+		if(length == 0.)
+			continue;
+
+		TOPIXEL(quad[0], pos[0] - perp[0] * size, pos[1] - perp[1] * size);
+		TOPIXEL(quad[1], dpos[0] - perp[0] * size, dpos[1] - perp[1] * size);
+		TOPIXEL(quad[2], dpos[0] + perp[0] * size, dpos[1] + perp[1] * size);
+		TOPIXEL(quad[3], pos[0] + perp[0] * size, pos[1] + perp[1] * size);
+		fillPolygon(quad, 4, asphalt);
+
+		const int dashedLines = int(length / dashedLineLength + 0.5);
+		for(int j = 0; j < dashedLines; j++){
+			double s = j * dashedLineLength, t = (j + 0.5) * dashedLineLength;
+			TOPIXEL(quad[0], pos[0] + para[0] * s + perp[0] * lineHalfWidth, pos[1] + para[1] * s + perp[1] * lineHalfWidth);
+			TOPIXEL(quad[1], pos[0] + para[0] * s - perp[0] * lineHalfWidth, pos[1] + para[1] * s - perp[1] * lineHalfWidth);
+			TOPIXEL(quad[2], pos[0] + para[0] * t - perp[0] * lineHalfWidth, pos[1] + para[1] * t - perp[1] * lineHalfWidth);
+			TOPIXEL(quad[3], pos[0] + para[0] * t + perp[0] * lineHalfWidth, pos[1] + para[1] * t + perp[1] * lineHalfWidth);
+			fillPolygon(quad, 4, white);
+		}
+
+		// The edge color indicates traffic amount
+		const float traffic[3] = {frame.maxPassCount ? float(e.passCount) / frame.maxPassCount : 0.f, 0.f, 1.f};
+		for(int k = -1; k <= 1; k++){
+			TOPIXEL(quad[0], pos[0] + k * perp[0] * size, pos[1] + k * perp[1] * size);
+			TOPIXEL(quad[1], dpos[0] + k * perp[0] * size, dpos[1] + k * perp[1] * size);
+			drawLine(quad[0], quad[1], traffic);
+		}
+	}
+
+	for(size_t i = 0; i + 1 < frame.vertices.size(); i += 2){
+		double prev[2], cur[2];
+		for(int j = 0; j <= 16; j++){
+			TOPIXEL(cur, frame.vertices[i] + size * cos(j * 2. * M_PI / 16.), frame.vertices[i + 1] + size * sin(j * 2. * M_PI / 16.));
+			if(j)
+				drawLine(prev, cur, red);
+			prev[0] = cur[0], prev[1] = cur[1];
+		}
+	}
+
+	// Same outline as Vehicle::draw(), in its 1/200 scale units.
+	static const double shape[4][2] = {{-5, -2}, {-5, 2}, {5, 2.5}, {5, -2.5}};
+	for(size_t i = 0; i < frame.vehicles.size(); i++){
+		const FrameSnapshot::Vehicle &v = frame.vehicles[i];
+		double c = cos(v.angle) / 200., s = sin(v.angle) / 200.;
+		for(int j = 0; j < 4; j++)
+			TOPIXEL(quad[j], v.pos[0] + shape[j][0] * c - shape[j][1] * s, v.pos[1] + shape[j][0] * s + shape[j][1] * c);
+		fillPolygon(quad, 4, v.color);
+		for(int j = 0; j < 4; j++)
+			drawLine(quad[j], quad[(j + 1) % 4], black);
+	}
+#undef TOPIXEL
+}
+
+
+/// \param threads Number of encoder threads; 0 to use one per hardware thread.
+FrameExporter::FrameExporter(const char *target, int width, int height, int threads) :
+	target(target), stream(NULL), width(width), height(height), submitted(0), nextWrite(0), failures(0), closing(false)
+{
+	size_t len = this->target.size();
+	if(this->target == "-")
+		stream = stdout;
+	else if(4 <= len && this->target.compare(len - 4, 4, ".rgb") == 0)
+		stream = fopen(target, "wb");
+	if(!isOpen())
+		return;
+	if(threads <= 0)
+		threads = std::max(1, int(std::thread::hardware_concurrency()));
+	for(int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&FrameExporter::work, this));
+}
+
+FrameExporter::~FrameExporter(){
+	finish();
+}
+
+/// \brief Queues frame for rendering, taking ownership of it.
+///
+/// Blocks while the encoders are more than a couple of frames behind so that
+/// a fast simulation cannot pile up snapshots without bound.
+void FrameExporter::submit(FrameSnapshot *frame){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(2 * workers.size() <= jobs.size())
+		written.wait(lock);
+	jobs.push_back(std::make_pair(submitted++, frame));
+	queued.notify_one();
+}
+
+/// \brief Waits for every queued frame to be written and closes the output.
+/// \returns Number of frames that could not be written.
+int FrameExporter::finish(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	queued.notify_all();
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	if(stream == stdout)
+		fflush(stream);
+	else if(stream)
+		fclose(stream);
+	stream = NULL;
+	return failures;
+}
+
+void FrameExporter::work(){
+	Canvas canvas(width, height);
+	for(;;){
+		std::pair<int, FrameSnapshot*> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while(jobs.empty() && !closing)
+				queued.wait(lock);
+			if(jobs.empty())
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		written.notify_all();
+
+		canvas.render(*job.second);
+		delete job.second;
+
+		if(stream){
+			// The raw stream has no frame numbers, so frames go out in order.
+			std::unique_lock<std::mutex> lock(mutex);
+			while(nextWrite != job.first)
+				written.wait(lock);
+			if(fwrite(canvas.getPixels(), canvas.getSize(), 1, stream) != 1)
+				failures++;
+			nextWrite++;
+			written.notify_all();
+		}
+		else if(!writeImage(job.first, canvas)){
+			std::lock_guard<std::mutex> lock(mutex);
+			failures++;
+		}
+	}
+}
+
+/// \brief Writes canvas as a binary PPM file named after the target pattern.
+bool FrameExporter::writeImage(int frame, const Canvas &canvas){
+	char name[512];
+	snprintf(name, sizeof name, target.c_str(), frame);
+	FILE *fp = fopen(name, "wb");
+	if(!fp)
+		return false;
+	fprintf(fp, "P6\n%d %d\n255\n", canvas.getWidth(), canvas.getHeight());
+	bool ok = fwrite(canvas.getPixels(), canvas.getSize(), 1, fp) == 1;
+	return fclose(fp) == 0 && ok;
+}
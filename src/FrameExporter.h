@@ -0,0 +1,94 @@
+/** \file FrameExporter.h
+ * \brief Offscreen rendering of simulation snapshots into video frames
+ *
+ * The simulation thread only copies what a frame shows into a FrameSnapshot,
+ * which is cheap.  Rasterizing and writing the frames is done by a pool of
+ * encoder threads with a small software rasterizer, so no GPU or display is
+ * needed and a long run can be exported much faster than real time.
+ */
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include <stdio.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+class Graph;
+
+/// \brief What one frame shows, copied out of the graph so it can be drawn on another thread.
+struct FrameSnapshot{
+	struct Edge{
+		float start[2];
+		float end[2];
+		int passCount;
+	};
+	struct Vehicle{
+		float pos[2];
+		float angle;
+		float color[3];
+	};
+	int tick;
+	int maxPassCount;
+	std::vector<float> vertices; ///< Vertex positions as x, y pairs
+	std::vector<Edge> edges;
+	std::vector<Vehicle> vehicles;
+
+	void capture(const Graph &graph);
+};
+
+/// \brief An RGB image with just enough drawing primitives to render the network.
+class Canvas{
+	int width;
+	int height;
+	std::vector<unsigned char> pixels; ///< Rows top to bottom, 3 bytes per pixel
+	std::vector<double> spans; ///< Scratch buffer for fillPolygon()
+public:
+	Canvas(int width, int height) : width(width), height(height), pixels(width * height * 3){}
+	int getWidth()const{return width;}
+	int getHeight()const{return height;}
+	const unsigned char *getPixels()const{return &pixels[0];}
+	size_t getSize()const{return pixels.size();}
+	void clear(const float color[3]);
+	void fillPolygon(const double (*points)[2], int count, const float color[3]);
+	void drawLine(const double a[2], const double b[2], const float color[3]);
+	void render(const FrameSnapshot &frame);
+};
+
+/// \brief Renders snapshots on a pool of threads and writes them out in order.
+///
+/// The target is either a printf pattern with one integer conversion, which
+/// writes a sequence of binary PPM files, or a file name ending in ".rgb" (or
+/// "-" for standard output) which receives a raw rgb24 video stream suitable
+/// for piping into an encoder.
+class FrameExporter{
+	std::string target;
+	FILE *stream; ///< Raw video output, NULL when writing an image sequence
+	int width;
+	int height;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable queued; ///< Signalled when a job is queued or the exporter closes
+	std::condition_variable written; ///< Signalled when a frame is written or a job is taken
+	std::deque<std::pair<int, FrameSnapshot*> > jobs;
+	int submitted;
+	int nextWrite; ///< Frame number the raw stream is waiting for
+	int failures;
+	bool closing;
+	void work();
+	bool writeImage(int frame, const Canvas &canvas);
+public:
+	FrameExporter(const char *target, int width, int height, int threads = 0);
+	~FrameExporter();
+	bool isOpen()const{return stream || target.find('%') != std::string::npos;}
+	void submit(FrameSnapshot *frame);
+	int finish();
+	int getFrameCount()const{return submitted;}
+};
+
+#endif
@@ -0,0 +1,1292 @@
+/** \file Graph.cpp
+ * \brief Implementation of Graph class
+ */
+
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "AllocationAudit.h"
+#include "MemoryReport.h"
+#include "EventLog.h"
+#include "StateBuffer.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <new>
+#include <algorithm>
+
+
+/// Seed of the spawn sequence of a single run.
+const uint32_t Graph::defaultTrafficSeed = 87657444;
+
+/// Seed of the network every graph is built with unless rebuilt.
+const uint32_t Graph::defaultNetworkSeed = 342125;
+
+
+/// \brief Builds the network and prepares to run traffic drawn from trafficSeed on it.
+Graph::Graph(uint32_t trafficSeed) : maxPassCount(0), vehicleSlots(0), routeIndex(NULL), rerouteInterval(2.), waitTicks(0),
+	jamDensity(0.), stallTime(30.), stalled(0), gridlockPolicy(gridlockLog), gridlocks(0), blockedSpawns(0), unreachableSpawns(0), localRegion(-1), tickEnd(0.), stranded(0), spawns(0), placement(0), counters(NULL),
+	eventLog(NULL), ticks(0), arrivals(0), tripTicks(0.), global_time(0)
+{
+	init_rseq(&trafficRs, trafficSeed);
+	memset(stepStats, 0, sizeof stepStats);
+	buildNetwork(defaultNetworkSeed, defaultVertexCount);
+}
+
+/// \brief Builds a random network of vertexCount vertices into the arenas, which must be empty.
+void Graph::buildNetwork(uint32_t networkSeed, int vertexCount){
+	int n = vertexCount;
+	random_sequence rs;
+	init_rseq(&rs, networkSeed);
+	for(int i = 0; i < n; i++){
+		double x = drseq(&rs) * 2 - 1, y = drseq(&rs) * 2 - 1;
+		GraphVertex *v = vertexArena.create(x, y, i);
+		vertices.push_back(v);
+	}
+
+	int m = n * 10;
+	for(int i = 0; i < m; i++){
+		int s = rseq(&rs) % n, e = rseq(&rs) % n;
+		GraphEdge *edge = vertices[s]->connect(vertices[e], edgeArena);
+		if(edge){
+			edge->setId(int(edges.size()));
+			edges.push_back(edge);
+		}
+	}
+	EdgeTraffic empty = {0, 0};
+	traffic.assign(edges.size(), empty);
+}
+
+/// \brief Runs another replica of traffic on the network of another graph.
+///
+/// The vertices and edges are shared, not copied, so the network must not be
+/// edited while graphs share it.  Everything that changes with the traffic
+/// is this graph's own, so replicas can run on different threads.
+Graph::Graph(const Graph &network, uint32_t trafficSeed) : vertices(network.vertices), edges(network.edges), maxPassCount(0), vehicleSlots(0),
+	routeIndex(network.routeIndex), rerouteInterval(network.rerouteInterval),
+	waitTicks(0), jamDensity(network.jamDensity),
+	stallTime(network.stallTime), stalled(0), gridlockPolicy(network.gridlockPolicy), gridlocks(0), blockedSpawns(0), unreachableSpawns(0),
+	localRegion(-1), tickEnd(0.), stranded(0), spawns(0), placement(0), counters(NULL),
+	eventLog(NULL), ticks(0), arrivals(0), tripTicks(0.), global_time(0)
+{
+	init_rseq(&trafficRs, trafficSeed);
+	memset(stepStats, 0, sizeof stepStats);
+	EdgeTraffic empty = {0, 0};
+	traffic.assign(edges.size(), empty);
+	junctions.setTiming(network.junctions.getCrossingTime(), network.junctions.getYieldTime());
+	junctions.setWorkers(network.junctions.getWorkers());
+	for(size_t i = 0; i < edges.size(); i++){
+		if(network.meso.isMeso(int(i)))
+			meso.setMeso(int(i), true);
+	}
+	cellular.setCellLength(network.cellular.getCellLength());
+	cellular.setSlowdown(network.cellular.getSlowdown());
+	setCellular(network.cellular.isEnabled());
+}
+
+/// \brief Frees the vehicles, and the network unless it belongs to the graph this one replicates.
+///
+/// Replicas share the network, so they must be destroyed before its owner.
+Graph::~Graph(){
+	routing.stop();
+	for(size_t i = 0; i < vehicleBlocks.size(); i++)
+		delete[] vehicleBlocks[i];
+}
+
+/// \brief Takes every vehicle off the road and starts over from tick 0 with trafficSeed, on the same network.
+///
+/// The vehicles are simply forgotten, since their storage belongs to this
+/// graph, and every buffer keeps its size, so a scenario that follows takes
+/// no time to start and allocates no more than the last one did.  Edits to
+/// the network stay, as do the settings.  A run after a reset matches a run
+/// of a new graph with the same network.
+void Graph::resetTraffic(uint32_t trafficSeed){
+	// Vehicle has a trivial destructor, so the blocks are handed out again from the start.
+	routing.clear();
+	freeVehicles.clear();
+	vehicleSlots = 0;
+	kinematics.clear();
+	meso.clear();
+	cellular.clear();
+	routes.clear();
+	router.clear();
+	waiting.clear();
+	emigrants.clear();
+	gridlockCandidates.clear();
+	std::fill(gridlockStamp.begin(), gridlockStamp.end(), -1);
+	waitFor.clear();
+	junctions.clear();
+	EdgeTraffic empty = {0, 0};
+	std::fill(traffic.begin(), traffic.end(), empty);
+	maxPassCount = 0;
+	memset(stepStats, 0, sizeof stepStats);
+	init_rseq(&trafficRs, trafficSeed);
+	waitTicks = 0;
+	stalled = 0;
+	gridlocks = 0;
+	blockedSpawns = 0;
+	unreachableSpawns = 0;
+	stranded = 0;
+	spawns = 0;
+	placement = 0;
+	ticks = 0;
+	arrivals = 0;
+	tripTicks = 0.;
+	global_time = 0.;
+}
+
+/// \brief Replaces the network with a random one of vertexCount vertices drawn from networkSeed, with no traffic on it.
+///
+/// The old vertices and edges are destroyed, so no replica may share them
+/// any more.  The route index and the regions describe the old network and
+/// are dropped; build them again for the new one if they are wanted.
+void Graph::rebuild(uint32_t networkSeed, int vertexCount){
+	resetTraffic();
+	vertices.clear();
+	edges.clear();
+	edgeArena.clear();
+	vertexArena.clear();
+	buildNetwork(networkSeed, vertexCount);
+	routeIndex = NULL;
+	vertexRegion.clear();
+	localRegion = -1;
+	// The per-edge buffers of the admission are sized again on the next tick.
+	entering.clear();
+	gridlockStamp.clear();
+	junctions.refresh(*this);
+	meso = MesoModel();
+	analysis.invalidate();
+	cellular.dropLanes();
+	if(cellular.isEnabled())
+		cellular.layout(*this);
+}
+
+/// \brief Renumbers the network in order, with no traffic on it, and builds its vertices and edges again in that order.
+///
+/// order[i] is the id of the vertex to become vertex i; NetworkOrder computes
+/// one.  The edges are numbered after their ends, so that the roads out of a
+/// patch of the map lie together as well.  Like rebuild(), the old objects
+/// are destroyed, so no replica may share them, and the route index and the
+/// regions are dropped.  The edits and the mesoscopic edges are kept.
+void Graph::reorder(const std::vector<int> &order){
+	resetTraffic();
+	size_t n = vertices.size();
+	std::vector<int> newId(n);
+	for(size_t i = 0; i < n; i++)
+		newId[order[i]] = int(i);
+	std::vector<int> edgeOrder(edges.size());
+	for(size_t i = 0; i < edges.size(); i++)
+		edgeOrder[i] = int(i);
+	std::stable_sort(edgeOrder.begin(), edgeOrder.end(), [&](int a, int b){
+		int a0 = newId[edges[a]->getStart()->getId()], a1 = newId[edges[a]->getEnd()->getId()];
+		int b0 = newId[edges[b]->getStart()->getId()], b1 = newId[edges[b]->getEnd()->getId()];
+		return std::make_pair(std::min(a0, a1), std::max(a0, a1)) < std::make_pair(std::min(b0, b1), std::max(b0, b1));
+	});
+
+	ObjectArena<GraphVertex> newVertexArena;
+	ObjectArena<GraphEdge> newEdgeArena;
+	std::vector<GraphVertex*> newVertices(n);
+	for(size_t i = 0; i < n; i++){
+		double pos[2];
+		vertices[order[i]]->getPos(pos);
+		newVertices[i] = newVertexArena.create(pos[0], pos[1], int(i));
+	}
+	std::vector<GraphEdge*> newEdges(edges.size());
+	std::vector<bool> wasMeso(edges.size());
+	for(size_t i = 0; i < edges.size(); i++){
+		const GraphEdge *old = edges[edgeOrder[i]];
+		GraphEdge *e = newVertices[newId[old->getStart()->getId()]]->connect(newVertices[newId[old->getEnd()->getId()]], newEdgeArena);
+		e->setLength(old->getLength());
+		e->setSpeedLimit(old->getSpeedLimit());
+		e->setClosed(old->isClosed());
+		e->setId(int(i));
+		newEdges[i] = e;
+		wasMeso[i] = meso.isMeso(edgeOrder[i]);
+	}
+	// The old objects go with the temporaries.
+	vertexArena.swap(newVertexArena);
+	edgeArena.swap(newEdgeArena);
+	vertices.swap(newVertices);
+	edges.swap(newEdges);
+
+	meso = MesoModel();
+	for(size_t i = 0; i < edges.size(); i++){
+		if(wasMeso[i])
+			meso.setMeso(int(i), true);
+	}
+	routeIndex = NULL;
+	vertexRegion.clear();
+	localRegion = -1;
+	entering.clear();
+	gridlockStamp.clear();
+	junctions.refresh(*this);
+	analysis.invalidate();
+	cellular.dropLanes();
+	if(cellular.isEnabled())
+		cellular.layout(*this);
+}
+
+/// \brief Number of vehicles the roads hold when they are jammed.
+///
+/// That is the cells of the lanes when the cellular automaton runs, or
+/// the capacity of the edges under jamDensity.  Without a jam density
+/// nothing stops more vehicles piling onto an edge, and the density at which
+/// the router considers it jammed is taken instead.
+size_t Graph::getRoadCapacity()const{
+	double density = 0. < jamDensity ? jamDensity : Router::jamDensity;
+	size_t ret = 0;
+	for(size_t i = 0; i < edges.size(); i++){
+		if(cellular.isEnabled())
+			ret += cellular.getCells(uint32_t(i * 2)) + cellular.getCells(uint32_t(i * 2 + 1));
+		else
+			ret += std::max(1, int(edges[i]->getLength() * density));
+	}
+	return ret;
+}
+
+/// \brief Sizes everything that grows with the traffic for getRoadCapacity() vehicles, so that update() does not allocate as it builds up.
+///
+/// Call it once the network and the settings are final.  The vehicle blocks
+/// are carved out up front; the buffers are only reserved.  The router gets
+/// its spare trees.  Nothing keeps a mesoscopic queue under the jam density,
+/// neither with no limit nor for a head held past stallTime, so each queue
+/// gets room for its edge packed bumper to bumper, a vehicle being a cell
+/// long.
+void Graph::reservePools(){
+	for(size_t i = 0; i < edges.size(); i++){
+		if(meso.isMeso(int(i)))
+			meso.reserve(int(i), uint32_t(std::max(1., edges[i]->getLength() / cellular.getCellLength())));
+	}
+	size_t count = getRoadCapacity();
+	while(vehicleBlocks.size() * vehicleBlockSize < count)
+		vehicleBlocks.push_back(new char[vehicleBlockSize * sizeof(Vehicle)]);
+	// Room for as many blocks again, so that running over the capacity only allocates the blocks.
+	vehicleBlocks.reserve(2 * vehicleBlocks.size());
+	freeVehicles.reserve(vehicleBlocks.size() * vehicleBlockSize);
+	kinematics.reserve(count);
+	exitMask.reserve((count + 63) / 64);
+	routed.reserve(count);
+	routes.reserve(count, count * routeLengthEstimate, vertices.size());
+	waiting.reserve(count);
+	admissions.reserve(count);
+	junctionRequests.reserve(count);
+	junctionAdmission.reserve(count);
+	slotWaiting.reserve(count);
+	admitted.reserve(count);
+	enteringTouched.reserve(edges.size());
+	cycleScratch.reserve(edges.size());
+	// An edge becomes a candidate as a vehicle leaves it or starts waiting on it.
+	gridlockCandidates.reserve(2 * count);
+	pathScratch.reserve(vertices.size() + 1);
+	pathSearch.reserve(vertices.size());
+	if(routeIndex)
+		routeIndex->reserve(routeQuery);
+	router.reserve(*this);
+}
+
+/// \brief Allocates a vehicle from this graph's own blocks, which keeps them
+/// close together in memory and off the shared heap.
+Vehicle *Graph::newVehicle(GraphVertex *dest, uint32_t id){
+	Vehicle *v;
+	if(!freeVehicles.empty()){
+		v = freeVehicles.back();
+		freeVehicles.pop_back();
+	}
+	else{
+		if(vehicleSlots == vehicleBlocks.size() * vehicleBlockSize)
+			vehicleBlocks.push_back(new char[vehicleBlockSize * sizeof(Vehicle)]);
+		v = reinterpret_cast<Vehicle*>(vehicleBlocks[vehicleSlots / vehicleBlockSize] + vehicleSlots % vehicleBlockSize * sizeof(Vehicle));
+		vehicleSlots++;
+	}
+	return new(v) Vehicle(dest, id);
+}
+
+void Graph::deleteVehicle(Vehicle *v){
+	v->~Vehicle();
+	freeVehicles.push_back(v);
+}
+
+/// \brief Puts v on e.
+/// \param countPass Whether this is a new pass over the edge rather than a
+///        vehicle moved here from another region mid-pass.
+void Graph::enterEdge(Vehicle *v, GraphEdge *e, bool countPass){
+	v->setEdge(e);
+	uint32_t code = e->getId() * 2 + (v->getNext() == e->getEnd());
+	placement += placementDigest(v->getId(), code);
+	EdgeTraffic &t = traffic[e->getId()];
+	t.vehicles++;
+	if(!countPass)
+		return;
+	if(eventLog)
+		eventLog->enter(v->getId(), code);
+	t.passCount++;
+	if(maxPassCount < t.passCount)
+		maxPassCount = t.passCount;
+}
+
+/// \brief Restricts this graph to simulating the vehicles heading into localRegion.
+///
+/// Spawns are still drawn for the whole network so every region consumes the
+/// same random sequence, but only the region owning the start vertex keeps them.
+void Graph::setRegions(const std::vector<int> &vertexRegion, int localRegion){
+	this->vertexRegion = vertexRegion;
+	this->localRegion = localRegion;
+}
+
+bool Graph::isLocal(const GraphVertex *v)const{
+	return localRegion < 0 || vertexRegion[v->getId()] == localRegion;
+}
+
+/// \brief Takes the vehicle in slot off this graph and queues it for another region.
+void Graph::emigrate(size_t slot, int tick){
+	Vehicle *v = kinematics.vehicles[slot];
+	Migrant m = {v, kinematics.getPos(slot), kinematics.getVelocity(slot), kinematics.getAccel(slot), tick};
+	emigrants.push_back(m);
+	leaveEdge(v);
+	kinematics.remove(slot);
+	v->setSlot(NULL, 0);
+}
+
+/// \brief Places a vehicle that arrived from another region on the first edge of route.
+///
+/// The vehicle is stepped alone through the ticks this graph has run since the
+/// sender last stepped it, using the same arithmetic as the kernel, so the
+/// result matches an undecomposed run exactly.
+void Graph::immigrate(const Migrant &m, RouteArena::RouteId route, double dt){
+	Vehicle *v = m.vehicle;
+	v->place(*this, route, false);
+	size_t slot = kinematics.add(v, m.velocity, v->getEdge()->getLength());
+	kinematics.setPos(slot, m.pos);
+	kinematics.setAccel(slot, m.accel);
+	// It may have left in the middle of crossing several edges in one tick.
+	if(kinematics.isPast(slot) && !passEdges(slot, m.tick))
+		return;
+	for(int t = m.tick; t < ticks; t++){
+		kinematics.stepLane(slot, dt);
+		if(kinematics.isPast(slot) && !passEdges(slot, t + 1))
+			return;
+	}
+}
+
+/// \brief Hands the vehicle in slot off through as many edges as its pos has run past.
+///
+/// A long time step can carry a fast vehicle over several short edges; each
+/// hand-off carries the rest of the distance onto the next edge.
+/// \returns false if the vehicle left the lanes, by arriving or emigrating at
+///          tick or by entering a mesoscopic edge.
+bool Graph::passEdges(size_t slot, int tick){
+	Vehicle *v = kinematics.vehicles[slot];
+	do{
+		if(!v->handOff(*this)){
+			arrive(slot, tick);
+			return false;
+		}
+		if(!isLocal(v->getNext())){
+			emigrate(slot, tick);
+			return false;
+		}
+		if(meso.isMeso(v->getEdge()->getId())){
+			enterMeso(slot);
+			return false;
+		}
+		// The crossing at the end of this edge has not been admitted.
+		if(hasAdmission() && kinematics.isPast(slot) && !v->isOnLastEdge(routes)){
+			holdAtStopLine(slot, 0);
+			break;
+		}
+	} while(kinematics.isPast(slot));
+	return true;
+}
+
+/// \brief Whether e has room for one more vehicle under jamDensity.
+bool Graph::hasRoom(const GraphEdge *e)const{
+	return !(0. < jamDensity) || traffic[e->getId()].vehicles < getCapacity(e);
+}
+
+/// \brief Moves the vehicle in slot from its lane into the queue of the mesoscopic edge it was just handed onto.
+///
+/// The distance it already drove onto the edge dates its entry back to
+/// within the tick, so its exit time does not depend on the step size.
+void Graph::enterMeso(size_t slot){
+	Vehicle *v = kinematics.vehicles[slot];
+	GraphEdge *e = v->getEdge();
+	double entryTime = tickEnd - kinematics.getPos(slot) / e->getSpeedLimit();
+	kinematics.remove(slot);
+	v->setSlot(NULL, 0);
+	meso.push(e->getId(), v, entryTime + MesoModel::travelTime(e, traffic[e->getId()].vehicles - 1, jamDensity));
+}
+
+/// \brief Lets out the heads of the mesoscopic queues that are due by the end of this tick.
+///
+/// A head leaves only when the next edge of its route has room, unless it
+/// has been held for longer than stallTime, which keeps a ring of full
+/// queues from locking up for good.  Junction reservations only apply to
+/// vehicles coming off microscopic edges.  A vehicle going on to a
+/// microscopic edge gets a lane as far along as it could have driven since
+/// it left the queue.
+void Graph::advanceMeso(int tick){
+	meso.beginTick();
+	int edge;
+	while(meso.nextDue(tickEnd, edge)){
+		const MesoModel::Entry &head = meso.front(edge);
+		Vehicle *v = head.vehicle;
+		double exitTime = head.exitTime;
+		if(!v->isOnLastEdge(routes) && tickEnd - head.dueTime < stallTime
+			&& !hasRoom(edges[routes.getEdge(v->getRoute(), v->getCursor() + 1)]))
+		{
+			meso.block(edge, tickEnd);
+			continue;
+		}
+		meso.pop(edge);
+		if(!v->advance(*this)){
+			finishTrip(v, tick);
+			continue;
+		}
+		GraphEdge *e = v->getEdge();
+		if(meso.isMeso(e->getId())){
+			meso.push(e->getId(), v, exitTime + MesoModel::travelTime(e, traffic[e->getId()].vehicles - 1, jamDensity));
+			continue;
+		}
+		size_t slot = kinematics.add(v, e->getSpeedLimit(), e->getLength());
+		kinematics.setPos(slot, (tickEnd - exitTime) * e->getSpeedLimit());
+		if(kinematics.isPast(slot))
+			passEdges(slot, tick);
+	}
+}
+
+/// \brief Runs the cellular automaton instead of the lanes and the mesoscopic queues.
+///
+/// Only switch with no traffic on the road, before a run or after resetTraffic().
+void Graph::setCellular(bool enabled){
+	cellular.setEnabled(enabled);
+	if(enabled)
+		cellular.layout(*this);
+}
+
+/// \brief Moves the vehicles that ran off the end of their cellular lane in the last step along their routes.
+///
+/// They go in lane order, each into the cells left free behind the last
+/// vehicle of its next lane after the step.  One that finds the first cell
+/// of its next lane taken stops in the last cell of its own.
+void Graph::advanceCellular(int tick){
+	const std::vector<CellularModel::Exit> &exits = cellular.getExits();
+	for(size_t i = 0; i < exits.size(); i++){
+		const CellularModel::Exit &x = exits[i];
+		Vehicle *v = cellular.front(x.lane);
+		if(v->isOnLastEdge(routes)){
+			cellular.pop(x.lane);
+			v->advance(*this);
+			finishTrip(v, tick);
+			continue;
+		}
+		const GraphEdge *e = edges[routes.getEdge(v->getRoute(), v->getCursor() + 1)];
+		uint32_t lane = CellularModel::getLane(e, e->getOther(v->getNext()));
+		int cell = cellular.getEntryCell(lane, x.ahead);
+		if(cell < 0){
+			cellular.hold(x.lane);
+			continue;
+		}
+		cellular.pop(x.lane);
+		v->advance(*this);
+		cellular.push(lane, cell, std::min(x.velocity, cellular.getCells(x.lane) - x.from + cell), v);
+	}
+}
+
+/// \brief Returns every vehicle with a route, those in the lanes, the mesoscopic queues and the cells.
+const std::vector<Vehicle*> &Graph::getRoutedVehicles(){
+	if(!meso.size() && !cellular.size())
+		return kinematics.vehicles;
+	routed.assign(kinematics.vehicles.begin(), kinematics.vehicles.end());
+	meso.collect(routed);
+	cellular.collect(routed);
+	return routed;
+}
+
+/// \brief Fills out with every vehicle on the road and how far along its edge it is.
+///
+/// The vehicles in the lanes come first in the order of getVehicles(), then
+/// those in the mesoscopic queues and in the cells, placed by their models.
+void Graph::getVehiclePositions(std::vector<VehiclePosition> &out)const{
+	out.resize(kinematics.size());
+	for(size_t i = 0; i < kinematics.size(); i++){
+		out[i].vehicle = kinematics.vehicles[i];
+		out[i].pos = kinematics.getPos(i);
+	}
+	meso.collect(out, global_time);
+	cellular.collect(out);
+}
+
+/// \brief Switches e between mesoscopic and microscopic resolution.
+///
+/// Vehicles already on e keep the resolution they entered it with until they
+/// leave it.
+void Graph::setMesoscopic(GraphEdge *e, bool meso){
+	this->meso.setMeso(e->getId(), meso);
+}
+
+/// \brief Simulates the edges within radius of center microscopically and the rest mesoscopically.
+///
+/// An edge is in focus if either end is.  A negative radius puts every edge
+/// back to microscopic.
+/// \returns The number of mesoscopic edges.
+int Graph::setFocus(const double center[2], double radius){
+	for(size_t i = 0; i < edges.size(); i++){
+		bool near = radius < 0.;
+		const GraphVertex *ends[2] = {edges[i]->getStart(), edges[i]->getEnd()};
+		for(int j = 0; j < 2 && !near; j++){
+			double pos[2];
+			ends[j]->getPos(pos);
+			near = (pos[0] - center[0]) * (pos[0] - center[0]) + (pos[1] - center[1]) * (pos[1] - center[1]) <= radius * radius;
+		}
+		setMesoscopic(edges[i], !near);
+	}
+	return int(meso.getMesoEdgeCount());
+}
+
+/// \brief Stops the vehicle in slot at the end of its edge to wait for the junction or the edge ahead.
+void Graph::holdAtStopLine(size_t slot, int wait){
+	kinematics.setPos(slot, kinematics.getLength(slot));
+	kinematics.setVelocity(slot, 0.);
+	Waiter w = {kinematics.vehicles[slot], wait, -1, false};
+	waiting.push_back(w);
+}
+
+/// \brief Number of vehicles e holds at most when jamDensity is set.
+int Graph::getCapacity(const GraphEdge *e)const{
+	return std::max(1, int(e->getLength() * jamDensity));
+}
+
+/// \brief Decides which of the vehicles waiting at the stop line and those about to reach it may go on.
+///
+/// A vehicle may go if the next edge of its route has room for it and, when
+/// junctions are managed, it gets the junction.  Those that may get their exit
+/// bit set, so the hand-off pass takes them on; the rest are held at the stop
+/// line until the next tick.  Vehicles waiting longest are considered first.
+/// Vehicles arriving at their destination leave the road there and need
+/// neither.
+void Graph::admitCrossings(double dt){
+	if(entering.size() != edges.size()){
+		entering.resize(edges.size(), 0);
+		gridlockStamp.resize(edges.size(), -1);
+		waitFor.resize(*this);
+	}
+	if(junctions.isEnabled())
+		junctions.prepare(*this, dt);
+	admissions.swap(waiting);
+	waiting.clear();
+	// Resized and filled rather than assigned, so that the buffers grow geometrically.
+	slotWaiting.resize(kinematics.size());
+	std::fill(slotWaiting.begin(), slotWaiting.end(), 0);
+	for(size_t i = 0; i < admissions.size(); i++)
+		slotWaiting[admissions[i].vehicle->getSlot()] = 1;
+	for(size_t w = 0; w < exitMask.size(); w++){
+		for(uint64_t word = exitMask[w]; word; word &= word - 1){
+			size_t slot = w * 64 + lowestBit(word);
+			Vehicle *v = kinematics.vehicles[slot];
+			// A waiting vehicle may have been set moving by a new speed limit; it has asked already.
+			if(!slotWaiting[slot] && !v->isOnLastEdge(routes)){
+				Waiter a = {v, 0, -1, false};
+				admissions.push_back(a);
+			}
+		}
+	}
+
+	// Room on the next edge, counting the vehicles let onto it this tick.
+	admitted.resize(admissions.size());
+	std::fill(admitted.begin(), admitted.end(), 1);
+	junctionRequests.clear();
+	junctionAdmission.clear();
+	for(size_t i = 0; i < admissions.size(); i++){
+		Waiter &a = admissions[i];
+		Vehicle *v = a.vehicle;
+		int from = v->getEdge()->getId();
+		int target = routes.getEdge(v->getRoute(), v->getCursor() + 1);
+		int full = -1;
+		if(0. < jamDensity && !a.force && getCapacity(edges[target]) <= traffic[target].vehicles + entering[target])
+			full = target;
+		if(full != a.blockedOn){
+			if(0 <= a.blockedOn)
+				waitFor.removeWait(from, a.blockedOn);
+			// A new waiter may close a cycle, or leave its edge with nobody moving.
+			if(0 <= full){
+				waitFor.addWait(from, full);
+				gridlockCandidates.push_back(from);
+			}
+			a.blockedOn = full;
+		}
+		if(0 <= full){
+			admitted[i] = 0;
+			continue;
+		}
+		if(!entering[target]++)
+			enteringTouched.push_back(target);
+		if(junctions.isEnabled()){
+			junctionRequests.push_back(junctions.makeRequest(v, a.wait));
+			junctionAdmission.push_back(int(i));
+		}
+	}
+
+	if(junctions.isEnabled()){
+		junctions.book(junctionRequests, uint32_t(ticks + 1));
+		for(size_t j = 0; j < junctionRequests.size(); j++){
+			if(!junctionRequests[j].granted)
+				admitted[junctionAdmission[j]] = 0;
+		}
+	}
+	for(size_t i = 0; i < enteringTouched.size(); i++)
+		entering[enteringTouched[i]] = 0;
+	enteringTouched.clear();
+
+	int stallTicks = std::max(1, int(stallTime / dt));
+	stalled = 0;
+	for(size_t i = 0; i < admissions.size(); i++){
+		const Waiter &a = admissions[i];
+		size_t slot = a.vehicle->getSlot();
+		uint64_t bit = uint64_t(1) << (slot & 63);
+		if(admitted[i]){
+			exitMask[slot >> 6] |= bit;
+			continue;
+		}
+		exitMask[slot >> 6] &= ~bit;
+		holdAtStopLine(slot, a.wait + 1);
+		waiting.back().blockedOn = a.blockedOn;
+		waitTicks++;
+		if(stallTicks <= a.wait + 1)
+			stalled++;
+	}
+}
+
+/// \brief Looks for a gridlock through edge, which just got a new arc in the
+/// wait-for graph or lost a vehicle, and deals with it.
+void Graph::checkGridlock(int edge){
+	if(gridlockStamp[edge] == ticks || !waitFor.findCycle(edge, traffic, cycleScratch))
+		return;
+	// The other edges of the cycle would find it again this tick.
+	for(size_t i = 0; i < cycleScratch.size(); i++)
+		gridlockStamp[cycleScratch[i]] = ticks;
+	resolveGridlock(cycleScratch);
+}
+
+/// \brief Reports a gridlock and, depending on gridlockPolicy, frees one vehicle on it.
+///
+/// One vehicle leaving a cycle of full edges makes room for the rest of it
+/// to move up, so freeing one is enough.
+void Graph::resolveGridlock(const std::vector<int> &cycle){
+	gridlocks++;
+	fprintf(stderr, "Tick %d: gridlock on %d edges:", ticks, int(cycle.size()));
+	for(size_t i = 0; i < cycle.size(); i++)
+		fprintf(stderr, " %d", cycle[i]);
+	fprintf(stderr, "\n");
+	if(gridlockPolicy == gridlockLog)
+		return;
+
+	Waiter *w = NULL;
+	int target = cycle[1 % cycle.size()];
+	for(size_t i = 0; i < waiting.size() && !w; i++){
+		if(waiting[i].vehicle->getEdge()->getId() == cycle[0] && waiting[i].blockedOn == target)
+			w = &waiting[i];
+	}
+	if(!w)
+		return;
+	if(gridlockPolicy == gridlockReroute){
+		// The cheapest other edge out of the junction that has room and leads to the destination
+		Vehicle *v = w->vehicle;
+		GraphVertex *next = vertices[v->getNext()->getId()];
+		RouteTree *tree = router.getTree(*this, v->getDest()->getId());
+		GraphEdge *best = NULL;
+		double bestCost = HUGE_VAL;
+		const GraphVertex::EdgeMap &out = next->getEdges();
+		for(GraphVertex::EdgeMap::const_iterator it = out.begin(); it != out.end(); ++it){
+			GraphEdge *e = it->second;
+			GraphVertex *far = it->first;
+			if(e->getId() == target || e->isClosed() || far == next || getCapacity(e) <= traffic[e->getId()].vehicles)
+				continue;
+			double cost = Router::travelTime(e, traffic[e->getId()].vehicles) + tree->getDistance(far->getId());
+			if(cost < bestCost && tree->getNextEdge(far->getId()) != e->getId()){
+				best = e;
+				bestCost = cost;
+			}
+		}
+		if(best && tree->buildPath(*this, best->getOther(next), pathScratch)){
+			pathScratch.push_back(next);
+			v->reroute(routes, routes.intern(pathScratch, v->getEdge()));
+			return;
+		}
+	}
+	w->force = true;
+}
+
+/// \brief Closes e to entering traffic and reroutes the vehicles planning to use it.
+/// \returns Number of vehicles rerouted.
+int Graph::closeEdge(GraphEdge *e){
+	if(e->isClosed())
+		return 0;
+	RouteService::EditScope edit(routing);
+	e->setClosed(true);
+	return edgeChanged(e);
+}
+
+/// \brief Opens a closed edge again.
+///
+/// Nobody is routed over a closed edge, so no vehicle is rerouted now; the
+/// next periodic reroute lets them take advantage of it.
+int Graph::openEdge(GraphEdge *e){
+	if(!e->isClosed())
+		return 0;
+	RouteService::EditScope edit(routing);
+	e->setClosed(false);
+	return edgeChanged(e);
+}
+
+/// \brief Builds a new road between a and b.
+/// \returns The new edge, or NULL if they were already connected.
+GraphEdge *Graph::addRoad(GraphVertex *a, GraphVertex *b){
+	RouteService::EditScope edit(routing);
+	GraphEdge *e = a->connect(b, edgeArena);
+	if(!e)
+		return NULL;
+	e->setId(int(edges.size()));
+	edges.push_back(e);
+	EdgeTraffic empty = {0, 0};
+	traffic.push_back(empty);
+	if(cellular.isEnabled())
+		cellular.layout(*this);
+	edgeChanged(e);
+	return e;
+}
+
+/// \brief Changes the length of e, which the vehicles on it take at once.
+///
+/// The route costs grow with the length, so it must be positive; e is left
+/// as it is otherwise.
+/// \returns Number of vehicles rerouted.
+int Graph::setEdgeLength(GraphEdge *e, double length){
+	if(!(0. < length))
+		return 0;
+	e->setLength(length);
+	for(size_t i = 0; i < kinematics.size(); i++){
+		if(kinematics.vehicles[i]->getEdge() == e)
+			kinematics.setLength(i, length);
+	}
+	return edgeChanged(e);
+}
+
+/// \brief Changes the speed limit of e, which the vehicles on it take at once.
+/// \returns Number of vehicles rerouted; none if limit is not positive, which leaves e as it is.
+int Graph::setSpeedLimit(GraphEdge *e, double limit){
+	if(!(0. < limit))
+		return 0;
+	e->setSpeedLimit(limit);
+	for(size_t i = 0; i < kinematics.size(); i++){
+		if(kinematics.vehicles[i]->getEdge() == e)
+			kinematics.setVelocity(i, limit);
+	}
+	return edgeChanged(e);
+}
+
+/// \brief Brings the cached route trees up to date with e and reroutes the vehicles that will drive on it.
+int Graph::edgeChanged(GraphEdge *e){
+	analysis.invalidate();
+	if(junctions.isEnabled())
+		junctions.refresh(*this);
+	router.updateCost(*this, e->getId());
+	return rerouteUsers(e->getId());
+}
+
+/// \brief Gives a new route to every vehicle that has edge ahead of it.
+///
+/// Vehicles sharing a route share the search through it, so the cost is one
+/// scan per distinct route plus a route tree lookup per affected vehicle.
+/// A vehicle with no way left to its destination finishes its current edge
+/// and leaves the network.
+int Graph::rerouteUsers(int edge){
+	lastUse.assign(routes.getIdLimit(), -2);
+	affected.clear();
+	const std::vector<Vehicle*> &vehicles = getRoutedVehicles();
+	for(size_t i = 0; i < vehicles.size(); i++){
+		Vehicle *v = vehicles[i];
+		int &last = lastUse[v->getRoute()];
+		if(last == -2){
+			const uint32_t *p = routes.getEdges(v->getRoute());
+			last = -1;
+			for(int j = int(routes.getLength(v->getRoute())) - 1; 0 <= j; j--){
+				if(p[j] == uint32_t(edge)){
+					last = j;
+					break;
+				}
+			}
+		}
+		if(int(v->getCursor()) < last)
+			affected.push_back(v);
+	}
+
+	// Routes are only interned after the scan, since that may recycle route ids.
+	for(size_t i = 0; i < affected.size(); i++){
+		Vehicle *v = affected[i];
+		GraphVertex *next = vertices[v->getNext()->getId()];
+		RouteTree *tree = router.getTree(*this, v->getDest()->getId());
+		RouteArena::RouteId route;
+		if(tree->buildPath(*this, next, pathScratch))
+			route = routes.intern(pathScratch, v->getEdge());
+		else{
+			uint32_t current = v->getEdge()->getId();
+			route = routes.intern(v->getEdge()->getOther(next)->getId(), &current, 1);
+			stranded++;
+		}
+		v->reroute(routes, route);
+	}
+	return int(affected.size());
+}
+
+void Graph::leaveEdge(Vehicle *v){
+	int edge = v->getEdge()->getId();
+	placement -= placementDigest(v->getId(), edge * 2 + (v->getNext() == v->getEdge()->getEnd()));
+	traffic[edge].vehicles--;
+	// The vehicles left behind may all be waiting now.
+	if(waitFor.getWaiters(edge))
+		gridlockCandidates.push_back(edge);
+}
+
+/// \brief Takes the vehicle in slot, which has reached its destination at tick, off the network.
+void Graph::arrive(size_t slot, int tick){
+	Vehicle *v = kinematics.vehicles[slot];
+	kinematics.remove(slot);
+	finishTrip(v, tick);
+}
+
+/// \brief Counts the trip of v, which has left the road at its destination at tick, and frees it.
+void Graph::finishTrip(Vehicle *v, int tick){
+	tripTicks += tick - v->getDeparture();
+	arrivals++;
+	if(eventLog)
+		eventLog->arrive(v->getId());
+	deleteVehicle(v);
+}
+
+/// \brief Finds the path of v from start into pathScratch, using the route index if there is one.
+bool Graph::findRoute(Vehicle *v, GraphVertex *start){
+	int phase = enterPhase(PerfCounters::phaseRoute);
+	bool found = routeIndex ? Vehicle::findPath(this, *routeIndex, routeQuery, pathSearch, start, v->getDest(), pathScratch)
+		: Vehicle::findPath(this, pathSearch, start, v->getDest(), pathScratch);
+	enterPhase(phase);
+	return found;
+}
+
+/// \brief Spawns trips at once until count vehicles are on the road, for sizing runs.
+///
+/// Gives up after drawing four trips per vehicle wanted, in case few of them
+/// have a route.
+/// \returns The number of vehicles on the road.
+size_t Graph::populate(size_t count){
+	for(size_t tries = 0; getVehicleCount() < count && tries < 4 * count; tries++)
+		spawn(true);
+	return getVehicleCount();
+}
+
+/// \brief Removes the roads added after the first count edges, for a state saved before they were built.
+void Graph::truncateRoads(size_t count){
+	for(size_t i = edges.size(); count < i--;)
+		edges[i]->getStart()->disconnect(edges[i]->getEnd());
+	edges.resize(count);
+	edgeArena.truncate(count);
+	traffic.resize(count);
+	entering.clear();
+	gridlockStamp.clear();
+	router.clear();
+	junctions.refresh(*this);
+	cellular.dropLanes();
+	if(cellular.isEnabled())
+		cellular.layout(*this);
+}
+
+/// \brief Appends everything that changes with the traffic and the edits to out, for loadState() to go back to.
+///
+/// The settings, the route index and the regions are not saved, so the graph
+/// loading the state must be set up like this one.  Vehicles on their way to
+/// another region are not saved either.
+void Graph::saveState(StateBuffer &out)const{
+	// The network as edited
+	out.put(uint32_t(vertices.size()));
+	out.put(uint32_t(edges.size()));
+	for(size_t i = 0; i < edges.size(); i++){
+		const GraphEdge *e = edges[i];
+		out.put(e->getStart()->getId());
+		out.put(e->getEnd()->getId());
+		out.put(e->getLength());
+		out.put(e->getSpeedLimit());
+		out.put(e->isClosed());
+	}
+
+	out.put(trafficRs);
+	out.put(ticks);
+	out.put(global_time);
+	out.put(spawns);
+	out.put(placement);
+	out.put(maxPassCount);
+	out.put(uint64_t(waitTicks));
+	out.put(stalled);
+	out.put(gridlocks);
+	out.put(blockedSpawns);
+	out.put(unreachableSpawns);
+	out.put(stranded);
+	out.put(arrivals);
+	out.put(tripTicks);
+	out.write(stepStats, sizeof stepStats);
+	out.putVector(traffic);
+	out.putVector(gridlockStamp);
+
+	// The vehicles, those in the lanes by slot first, then the queued and
+	// those in the cells in the order their models collect them.
+	std::vector<Vehicle*> all(kinematics.vehicles);
+	meso.collect(all);
+	cellular.collect(all);
+	out.put(uint32_t(kinematics.size()));
+	out.put(uint32_t(meso.size()));
+	out.put(uint32_t(cellular.size()));
+	for(size_t i = 0; i < all.size(); i++){
+		const Vehicle *v = all[i];
+		out.put(v->getId());
+		out.put(v->getDeparture());
+		out.put(v->getDest()->getId());
+		out.put(routes.getStart(v->getRoute()));
+		out.put(routes.getLength(v->getRoute()));
+		out.write(routes.getEdges(v->getRoute()), routes.getLength(v->getRoute()) * sizeof(uint32_t));
+		out.put(v->getCursor());
+		out.put(v->getNext()->getId());
+		out.put(v->getEdge()->getId());
+	}
+	out.putVector(kinematics.pos);
+	out.putVector(kinematics.velocity);
+	out.putVector(kinematics.accel);
+	out.putVector(kinematics.length);
+	out.put(uint32_t(waiting.size()));
+	for(size_t i = 0; i < waiting.size(); i++){
+		const Waiter &w = waiting[i];
+		out.put(uint32_t(w.vehicle->getSlot()));
+		out.put(w.wait);
+		out.put(w.blockedOn);
+		out.put(w.force);
+	}
+
+	meso.save(out);
+	cellular.save(out);
+	junctions.save(out);
+	router.save(out);
+	waitFor.save(out);
+	routing.save(out);
+}
+
+/// \brief Takes the graph back to a state saveState() wrote, with the network edited as it was then.
+///
+/// Roads added since are removed, which needs the graph to own its network.
+/// \returns false if the state does not fit this network, leaving no traffic on it.
+bool Graph::loadState(StateBuffer &in){
+	resetTraffic();
+	analysis.invalidate();
+	if(loadNetworkAndTraffic(in))
+		return true;
+	resetTraffic();
+	return false;
+}
+
+bool Graph::loadNetworkAndTraffic(StateBuffer &in){
+	int n = int(vertices.size());
+	uint32_t vertexCount = in.get<uint32_t>();
+	uint32_t edgeCount = in.get<uint32_t>();
+	if(!in.isOk() || vertexCount != uint32_t(n))
+		return false;
+	if(edgeCount < edges.size()){
+		if(edgeArena.size() != edges.size())
+			return false;
+		truncateRoads(edgeCount);
+	}
+	for(uint32_t i = 0; i < edgeCount; i++){
+		int start = in.get<int>();
+		int end = in.get<int>();
+		double length = in.get<double>();
+		double limit = in.get<double>();
+		bool closed = in.get<bool>();
+		if(!in.isOk() || start < 0 || n <= start || end < 0 || n <= end || !(0. <= length) || !(0. < limit))
+			return false;
+		if(i == edges.size() && !addRoad(vertices[start], vertices[end]))
+			return false;
+		GraphEdge *e = edges[i];
+		if(e->getStart()->getId() != start || e->getEnd()->getId() != end)
+			return false;
+		e->setLength(length);
+		e->setSpeedLimit(limit);
+		e->setClosed(closed);
+	}
+
+	trafficRs = in.get<random_sequence>();
+	ticks = in.get<int>();
+	global_time = in.get<double>();
+	spawns = in.get<uint32_t>();
+	placement = in.get<uint64_t>();
+	maxPassCount = in.get<int>();
+	waitTicks = size_t(in.get<uint64_t>());
+	stalled = in.get<int>();
+	gridlocks = in.get<int>();
+	blockedSpawns = in.get<int>();
+	unreachableSpawns = in.get<int>();
+	stranded = in.get<int>();
+	arrivals = in.get<int>();
+	tripTicks = in.get<double>();
+	in.read(stepStats, sizeof stepStats);
+	in.getVector(traffic);
+	in.getVector(gridlockStamp);
+	if(!in.isOk() || traffic.size() != edges.size())
+		return false;
+
+	uint32_t lanes = in.get<uint32_t>();
+	uint32_t queued = in.get<uint32_t>();
+	uint32_t cells = in.get<uint32_t>();
+	std::vector<Vehicle*> all;
+	std::vector<uint32_t> path;
+	for(size_t i = 0; in.isOk() && i < size_t(lanes) + queued + cells; i++){
+		uint32_t id = in.get<uint32_t>();
+		int departure = in.get<int>();
+		int dest = in.get<int>();
+		uint32_t start = in.get<uint32_t>();
+		uint32_t length = in.get<uint32_t>();
+		if(!in.isOk() || dest < 0 || n <= dest || uint32_t(n) <= start || length < 1 || edges.size() < length)
+			return false;
+		path.resize(length);
+		in.read(&path[0], length * sizeof(uint32_t));
+		uint32_t cursor = in.get<uint32_t>();
+		int next = in.get<int>();
+		int edge = in.get<int>();
+		if(!in.isOk() || length <= cursor || next < 0 || n <= next || edge < 0 || int(edges.size()) <= edge)
+			return false;
+		for(uint32_t j = 0; j < length; j++){
+			if(edges.size() <= path[j])
+				return false;
+		}
+		Vehicle *v = newVehicle(vertices[dest], id);
+		v->setDeparture(departure);
+		v->restore(routes.intern(start, &path[0], length), cursor, vertices[next], edges[edge]);
+		all.push_back(v);
+	}
+	if(!in.isOk())
+		return false;
+	for(uint32_t i = 0; i < lanes; i++)
+		kinematics.add(all[i], 0., 0.);
+	in.getVector(kinematics.pos);
+	in.getVector(kinematics.velocity);
+	in.getVector(kinematics.accel);
+	in.getVector(kinematics.length);
+	if(!in.isOk() || kinematics.pos.size() != lanes || kinematics.velocity.size() != lanes
+		|| kinematics.accel.size() != lanes || kinematics.length.size() != lanes)
+		return false;
+	uint32_t waiters = in.get<uint32_t>();
+	for(uint32_t i = 0; in.isOk() && i < waiters; i++){
+		uint32_t slot = in.get<uint32_t>();
+		Waiter w;
+		w.wait = in.get<int>();
+		w.blockedOn = in.get<int>();
+		w.force = in.get<bool>();
+		if(lanes <= slot)
+			return false;
+		w.vehicle = kinematics.vehicles[slot];
+		waiting.push_back(w);
+	}
+
+	Vehicle *const *rest = all.empty() ? NULL : &all[0] + lanes;
+	return in.isOk() && meso.load(in, rest, queued) && cellular.load(in, rest + queued, cells)
+		&& junctions.load(in, *this) && router.load(in, *this) && waitFor.load(in, *this) && routing.load(in, *this) && in.isOk();
+}
+
+/// \brief Adds the bytes held by each part of the simulation to report, with the number of vehicles, edges and vertices.
+///
+/// The route index is not owned by the graph and is left to its owner.
+void Graph::reportMemory(MemoryReport &report)const{
+	typedef MemoryReport M;
+	report.setCount(M::perVehicle, getVehicleCount());
+	report.setCount(M::perEdge, edges.size());
+	report.setCount(M::perVertex, vertices.size());
+
+	report.add("vehicle objects", vehicleBlocks.size() * M::heapBytes(vehicleBlockSize * sizeof(Vehicle))
+		+ M::vectorBytes(vehicleBlocks) + M::vectorBytes(freeVehicles), M::perVehicle);
+	report.add("kinematics lanes", kinematics.getMemoryUsage() + M::vectorBytes(exitMask), M::perVehicle);
+	report.add("routes", routes.getMemoryUsage(), M::perVehicle);
+	report.add("mesoscopic queues", meso.getMemoryUsage() + M::vectorBytes(routed), M::perEdge);
+	report.add("cellular lanes", cellular.getMemoryUsage(), M::perEdge);
+	report.add("admission", M::vectorBytes(waiting) + M::vectorBytes(admissions) + M::vectorBytes(junctionRequests)
+		+ M::vectorBytes(junctionAdmission) + M::vectorBytes(slotWaiting) + M::vectorBytes(admitted), M::perVehicle);
+
+	size_t vertexBytes = M::vectorBytes(vertices) + vertexArena.getBlockCount() * M::heapBytes(vertexArena.getBlockBytes());
+	for(size_t i = 0; i < vertices.size(); i++)
+		vertexBytes += vertices[i]->getEdges().size() * M::treeNodeBytes(sizeof(GraphVertex::EdgeMap::value_type));
+	report.add("vertices", vertexBytes, M::perVertex);
+	report.add("edges", M::vectorBytes(edges) + edgeArena.getBlockCount() * M::heapBytes(edgeArena.getBlockBytes()) + M::vectorBytes(traffic), M::perEdge);
+	report.add("rerouting trees", router.getMemoryUsage(), M::perVertex);
+	report.add("route search", M::vectorBytes(pathScratch) + pathSearch.getMemoryUsage() + routeQuery.getMemoryUsage() + routing.getMemoryUsage(),
+		M::perVertex);
+	report.add("junctions", junctions.getMemoryUsage(), M::perVertex);
+	report.add("network analysis", analysis.getMemoryUsage(), M::perVertex);
+	report.add("gridlock detection", waitFor.getMemoryUsage() + M::vectorBytes(cycleScratch) + M::vectorBytes(gridlockCandidates)
+		+ M::vectorBytes(gridlockStamp) + M::vectorBytes(entering) + M::vectorBytes(enteringTouched), M::perEdge);
+	report.add("graph", sizeof *this, M::fixed);
+}
+
+/// \brief Draws a trip and puts a vehicle on the road for it, if it has a route.
+///
+/// With route workers the route is searched on them, and the vehicle is
+/// placed by commitRoutes() on the next tick, unless routeNow.
+void Graph::spawn(bool routeNow){
+	int starti = rseq(&trafficRs) % vertices.size();
+	int endi = rseq(&trafficRs) % vertices.size();
+	Vehicle *v = newVehicle(vertices[endi], spawns++);
+	v->setDeparture(ticks);
+	if(!isLocal(vertices[starti])){
+		if(eventLog)
+			eventLog->spawn(v->getId(), starti, endi, EventLog::spawnRemote);
+		deleteVehicle(v); // Another region spawns this one
+	}
+	else if(!analysis.isConnected(*this, starti, endi)){
+		// No search could join them; spare it visiting the whole part of the network it starts in.
+		if(eventLog)
+			eventLog->spawn(v->getId(), starti, endi, EventLog::spawnNoRoute);
+		deleteVehicle(v);
+		unreachableSpawns++;
+	}
+	else if(routing.getWorkers() && !routeNow)
+		routing.submit(v, starti);
+	else
+		placeTrip(v, starti, findRoute(v, vertices[starti]));
+}
+
+/// \brief Puts v on the road at vertex id starti along the route in pathScratch, unless none was found or its first edge is full.
+void Graph::placeTrip(Vehicle *v, int starti, bool found){
+	int endi = v->getDest()->getId();
+	if(found){
+		if(pathScratch.size() < 10)
+			stepStats[pathScratch.size()]++;
+		RouteArena::RouteId route = routes.intern(pathScratch);
+		const GraphEdge *first = edges[routes.getEdge(route, 0)];
+		uint32_t lane = 0;
+		if(cellular.isEnabled()){
+			lane = CellularModel::getLane(first, first->getOther(vertices[starti]));
+			if(cellular.getEntryCell(lane, 0) < 0){
+				if(eventLog)
+					eventLog->spawn(v->getId(), starti, endi, EventLog::spawnBlocked);
+				routes.release(route);
+				deleteVehicle(v);
+				blockedSpawns++;
+				return;
+			}
+		}
+		else if(0. < jamDensity && getCapacity(first) <= traffic[first->getId()].vehicles){
+			if(eventLog)
+				eventLog->spawn(v->getId(), starti, endi, EventLog::spawnBlocked);
+			routes.release(route);
+			deleteVehicle(v);
+			blockedSpawns++;
+			return;
+		}
+		if(eventLog)
+			eventLog->spawn(v->getId(), starti, endi, EventLog::spawnPlaced);
+		v->place(*this, route);
+		GraphEdge *e = v->getEdge();
+		if(cellular.isEnabled()){
+			cellular.push(lane, 0, 0, v);
+			return;
+		}
+		if(meso.isMeso(e->getId())){
+			meso.push(e->getId(), v, global_time + MesoModel::travelTime(e, traffic[e->getId()].vehicles - 1, jamDensity));
+			return;
+		}
+		size_t slot = kinematics.add(v, e->getSpeedLimit(), e->getLength());
+		if(!isLocal(v->getNext()))
+			emigrate(slot, ticks);
+	}
+	else{
+		if(eventLog)
+			eventLog->spawn(v->getId(), starti, endi, EventLog::spawnNoRoute);
+		deleteVehicle(v);
+	}
+}
+
+/// \brief Places the vehicles of the trips whose routes were requested since the last call, in the order they were drawn.
+///
+/// The routes no worker has found yet are searched here rather than waited for.
+void Graph::commitRoutes(){
+	size_t n;
+	RouteService::Request *requests = routing.collect(n);
+	for(size_t i = 0; i < n; i++){
+		RouteService::Request &r = requests[i];
+		bool found;
+		if(r.state == RouteService::stateDone){
+			pathScratch.swap(r.path);
+			found = r.found;
+		}
+		else
+			found = findRoute(r.vehicle, vertices[r.start]);
+		placeTrip(r.vehicle, r.start, found);
+	}
+	routing.release();
+}
+
+void Graph::update(double dt){
+	AllocationAudit::Scope audit;
+	const double genInterval = 0.1;
+	tickEnd = global_time + dt;
+
+	// Spawn once for every interval boundary the step crosses, which may be
+	// several for a long step.  Counting boundaries since the start rather than
+	// testing each step keeps the total exact whatever dt is.
+	int spawnCount = int(floor((global_time + dt) / genInterval) - floor(global_time / genInterval));
+	int phase = enterPhase(PerfCounters::phaseSpawn);
+	if(routing.size())
+		commitRoutes();
+	for(int i = 0; i < spawnCount; i++)
+		spawn();
+	enterPhase(PerfCounters::phaseStep);
+	if(cellular.isEnabled()){
+		double stepTime = cellular.getStepTime();
+		int steps = int(floor((global_time + dt) / stepTime) - floor(global_time / stepTime));
+		for(int i = 0; i < steps; i++){
+			cellular.step();
+			enterPhase(PerfCounters::phaseHandOff);
+			advanceCellular(ticks + 1);
+			enterPhase(PerfCounters::phaseStep);
+		}
+	}
+
+	// Step every vehicle in one pass over the contiguous arrays, then hand off
+	// only the lanes that ran past the end of their edge.  Lanes are visited from
+	// the highest index down so that the swap-with-last removal never moves an
+	// unvisited lane into a visited slot.
+	size_t count = kinematics.size();
+	exitMask.resize((count + 63) / 64);
+	if(count)
+		kinematics.step(dt, &exitMask.front());
+	enterPhase(PerfCounters::phaseHandOff);
+	if(hasAdmission())
+		admitCrossings(dt);
+	for(size_t w = exitMask.size(); 0 < w--;){
+		uint64_t word = exitMask[w];
+		while(word){
+			int bit = highestBit(word);
+			word &= ~(uint64_t(1) << bit);
+			passEdges(w * 64 + bit, ticks + 1);
+		}
+	}
+	if(meso.isEnabled())
+		advanceMeso(ticks + 1);
+
+	enterPhase(PerfCounters::phaseStats);
+	for(size_t i = 0; i < gridlockCandidates.size(); i++)
+		checkGridlock(gridlockCandidates[i]);
+	gridlockCandidates.clear();
+
+	enterPhase(PerfCounters::phaseRoute);
+	if(0. < rerouteInterval && fmod(global_time + dt, rerouteInterval) < fmod(global_time, rerouteInterval))
+		router.refresh(*this, routes, getRoutedVehicles());
+	enterPhase(phase);
+
+	ticks++;
+	global_time += dt;
+}
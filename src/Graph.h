@@ -0,0 +1,242 @@
+/** \file Graph.h
+ * \brief Definition of Graph class
+ */
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "StepKernel.h"
+#include "Router.h"
+#include "ContractionHierarchy.h"
+#include "RouteArena.h"
+#include "IntersectionManager.h"
+#include "WaitForGraph.h"
+#include "StateTrace.h"
+#include "PerfCounters.h"
+#include "ObjectArena.h"
+#include "MesoModel.h"
+#include "CellularModel.h"
+#include "RouteService.h"
+#include "NetworkAnalysis.h"
+
+extern "C"{
+#include <clib/rseq.h>
+}
+
+#include <vector>
+#include <stdint.h>
+
+
+class GraphVertex;
+class GraphEdge;
+class Vehicle;
+class MemoryReport;
+class EventLog;
+class StateBuffer;
+
+/// \brief A vehicle that left the local region, with the state it left with.
+struct Migrant{
+	Vehicle *vehicle;
+	double pos;
+	double velocity;
+	double accel;
+	int tick; ///< Number of ticks already applied to pos
+};
+
+/// \brief The traffic on one edge.
+struct EdgeTraffic{
+	int vehicles; ///< Vehicles on the edge now
+	int passCount; ///< Vehicles that have entered the edge so far
+};
+
+class Graph{
+public:
+	typedef std::vector<Vehicle*> VehicleList;
+	static const uint32_t defaultTrafficSeed;
+	static const uint32_t defaultNetworkSeed;
+	static const int defaultVertexCount = 100;
+	static const int vehicleBlockSize = 256;
+	static const int routeLengthEstimate = 16; ///< Edges per route reservePools() makes room for, more than the routes on a random network of 1000 vertices average
+	static const int stepStatCount = 20;
+	/// \brief What to do about a gridlock.
+	enum GridlockPolicy{
+		gridlockLog, ///< Only report it
+		gridlockTeleport, ///< Let one vehicle on it into the full edge ahead
+		gridlockReroute, ///< Send one vehicle on it another way, or teleport if there is none
+	};
+protected:
+	std::vector<GraphVertex*> vertices;
+	std::vector<GraphEdge*> edges;
+	ObjectArena<GraphVertex> vertexArena; ///< The vertices this graph built; empty in a replica, which shares another's
+	ObjectArena<GraphEdge> edgeArena; ///< The edges this graph built or added; empty in a replica
+	std::vector<EdgeTraffic> traffic; ///< Indexed by edge id
+	int maxPassCount;
+	random_sequence trafficRs; ///< Draws the spawns
+	std::vector<char*> vehicleBlocks; ///< Storage for the vehicles of this graph
+	std::vector<Vehicle*> freeVehicles; ///< Released vehicles, reused first
+	size_t vehicleSlots; ///< Vehicles ever carved out of the blocks since the last reset
+	KinematicsArrays kinematics;
+	RouteArena routes; ///< Routes of the vehicles on this graph
+	std::vector<GraphVertex*> pathScratch; ///< Vertex path buffer for the route searches
+	std::vector<uint64_t> exitMask; ///< Scratch buffer for the stepping kernel
+	Router router;
+	const ContractionHierarchy *routeIndex; ///< Spawn routing index, not owned; NULL to search breadth-first
+	RouteQuery routeQuery;
+	PathSearch pathSearch;
+	double rerouteInterval; ///< Simulated seconds between reroutes, 0 to disable
+	IntersectionManager junctions;
+	/// \brief A vehicle held at the stop line, waiting for the junction or the edge ahead.
+	struct Waiter{
+		Vehicle *vehicle;
+		int wait; ///< Ticks waited so far
+		int blockedOn; ///< Full edge it waits for room on, -1 if none
+		bool force; ///< Let it in even if the edge ahead is full, to break a gridlock
+	};
+	std::vector<Waiter> waiting;
+	std::vector<Waiter> admissions; ///< Scratch buffer for admitCrossings()
+	std::vector<IntersectionManager::Request> junctionRequests; ///< Scratch buffer for admitCrossings()
+	std::vector<int> junctionAdmission; ///< Index into admissions of each junction request
+	std::vector<char> slotWaiting; ///< Scratch buffer for admitCrossings()
+	std::vector<int> entering; ///< Vehicles admitted onto each edge this tick
+	std::vector<int> enteringTouched; ///< Edges whose entering count is not zero
+	size_t waitTicks; ///< Vehicle ticks spent waiting at junctions
+	double jamDensity; ///< Vehicles per unit length an edge holds at most, 0 for no limit
+	double stallTime; ///< Seconds of waiting after which a vehicle counts as stalled
+	int stalled; ///< Vehicles that have waited longer than stallTime
+	WaitForGraph waitFor;
+	std::vector<int> cycleScratch;
+	std::vector<int> gridlockCandidates; ///< Edges to look for a gridlock through at the end of the tick
+	std::vector<int> gridlockStamp; ///< Tick each edge was last found in a gridlock
+	std::vector<char> admitted; ///< Scratch buffer for admitCrossings()
+	int gridlockPolicy;
+	int gridlocks; ///< Gridlocks found so far
+	int blockedSpawns; ///< Spawns dropped because their first edge was full
+	int unreachableSpawns; ///< Spawns dropped without a search because no road joins their ends
+	std::vector<int> vertexRegion; ///< Region owning each vertex id; empty when not decomposed
+	int localRegion;
+	std::vector<Migrant> emigrants; ///< Vehicles handed to other regions since the last takeEmigrants()
+	std::vector<int> lastUse; ///< Scratch for rerouteUsers(): last index of the edge in each route, -2 if unknown
+	std::vector<Vehicle*> affected; ///< Scratch for rerouteUsers()
+	MesoModel meso; ///< Queues of the mesoscopic edges
+	CellularModel cellular; ///< Lanes of cells when the cellular automaton runs instead of the lanes and queues
+	NetworkAnalysis analysis; ///< Components of the network, labelled again after it changes
+	std::vector<Vehicle*> routed; ///< Scratch for getRoutedVehicles()
+	double tickEnd; ///< Simulated time the tick being run by update() ends at
+	int stranded; ///< Vehicles cut off from their destination by closed roads
+	uint32_t spawns; ///< Vehicles drawn by the spawner, used as their ids
+	uint64_t placement; ///< Sum of placementDigest() of the vehicles on the road
+	PerfCounters *counters; ///< Counters of the phases of update(), or NULL
+	EventLog *eventLog; ///< Receives the spawns, edge transitions and arrivals, or NULL
+	int ticks;
+	int arrivals;
+	double tripTicks; ///< Sum of the trip times of the arrived vehicles
+	int stepStats[stepStatCount]; ///< Histogram of spawned path lengths in vertices
+	double global_time;
+	RouteService routing; ///< Searches the routes of the new trips when it has workers; last, so that it stops first
+	bool isLocal(const GraphVertex *v)const;
+	void emigrate(size_t slot, int tick);
+	void arrive(size_t slot, int tick);
+	void finishTrip(Vehicle *v, int tick);
+	bool passEdges(size_t slot, int tick);
+	void enterMeso(size_t slot);
+	void advanceMeso(int tick);
+	void advanceCellular(int tick);
+	bool hasRoom(const GraphEdge *e)const;
+	const std::vector<Vehicle*> &getRoutedVehicles();
+	bool findRoute(Vehicle *v, GraphVertex *start);
+	void spawn(bool routeNow = false);
+	void placeTrip(Vehicle *v, int start, bool found);
+	void commitRoutes();
+	int enterPhase(int phase){return counters ? counters->enter(phase) : phase;}
+	bool hasAdmission()const{return junctions.isEnabled() || 0. < jamDensity;}
+	void admitCrossings(double dt);
+	void holdAtStopLine(size_t slot, int wait);
+	int getCapacity(const GraphEdge *e)const;
+	void checkGridlock(int edge);
+	void resolveGridlock(const std::vector<int> &cycle);
+	int edgeChanged(GraphEdge *e);
+	int rerouteUsers(int edge);
+	void buildNetwork(uint32_t networkSeed, int vertexCount);
+	void truncateRoads(size_t count);
+	bool loadNetworkAndTraffic(StateBuffer &in);
+public:
+	Graph(uint32_t trafficSeed = defaultTrafficSeed);
+	Graph(const Graph &network, uint32_t trafficSeed);
+	~Graph();
+	void resetTraffic(uint32_t trafficSeed = defaultTrafficSeed);
+	void rebuild(uint32_t networkSeed, int vertexCount = defaultVertexCount);
+	void reorder(const std::vector<int> &order);
+	size_t getRoadCapacity()const;
+	void reservePools();
+	const std::vector<GraphVertex*> &getVertices()const{return vertices;}
+	const std::vector<GraphEdge*> &getEdges()const{return edges;}
+	/// \brief Vehicles in the lanes only; getVehiclePositions() has those in the mesoscopic queues and the cells too.
+	const VehicleList &getVehicles()const{return kinematics.vehicles;}
+	void getVehiclePositions(std::vector<VehiclePosition> &out)const;
+	const KinematicsArrays &getKinematics()const{return kinematics;}
+	Vehicle *newVehicle(GraphVertex *dest, uint32_t id);
+	void deleteVehicle(Vehicle *v);
+	void enterEdge(Vehicle *v, GraphEdge *e, bool countPass);
+	void leaveEdge(Vehicle *v);
+	int getEdgeLoad(int edge)const{return traffic[edge].vehicles;}
+	int getPassCount(int edge)const{return traffic[edge].passCount;}
+	int getMaxPassCount()const{return maxPassCount;}
+	const int *getStepStats()const{return stepStats;}
+	const Router &getRouter()const{return router;}
+	RouteArena &getRoutes(){return routes;}
+	const RouteArena &getRoutes()const{return routes;}
+	const ContractionHierarchy *getRouteIndex()const{return routeIndex;}
+	void setRouteIndex(const ContractionHierarchy *index){routeIndex = index;}
+	double getRerouteInterval()const{return rerouteInterval;}
+	void setRerouteInterval(double interval){rerouteInterval = interval;}
+	IntersectionManager &getJunctions(){return junctions;}
+	const IntersectionManager &getJunctions()const{return junctions;}
+	size_t getWaitingCount()const{return waiting.size();}
+	size_t getWaitTicks()const{return waitTicks;}
+	double getJamDensity()const{return jamDensity;}
+	void setJamDensity(double density){jamDensity = density;}
+	double getStallTime()const{return stallTime;}
+	void setStallTime(double seconds){stallTime = seconds;}
+	int getStalledCount()const{return stalled;}
+	int getGridlockPolicy()const{return gridlockPolicy;}
+	void setGridlockPolicy(int policy){gridlockPolicy = policy;}
+	int getGridlockCount()const{return gridlocks;}
+	int getBlockedSpawns()const{return blockedSpawns;}
+	int getUnreachableSpawns()const{return unreachableSpawns;}
+	NetworkAnalysis &getAnalysis(){return analysis;}
+	const NetworkAnalysis &getAnalysis()const{return analysis;}
+	void setTrafficSeed(uint32_t seed){init_rseq(&trafficRs, seed);}
+	int getTicks()const{return ticks;}
+	uint64_t getPlacementDigest()const{return placement;}
+	/// \brief Measures the phases of update() with counters, which must count on the thread calling update(); NULL stops.
+	void setPerfCounters(PerfCounters *counters){this->counters = counters;}
+	EventLog *getEventLog()const{return eventLog;}
+	void setEventLog(EventLog *log){eventLog = log;}
+	int getArrivals()const{return arrivals;}
+	double getMeanTripTime()const{return arrivals ? tripTicks / arrivals : 0.;}
+	int getStranded()const{return stranded;}
+	const RouteService &getRouting()const{return routing;}
+	void setRouteWorkers(int workers){routing.start(*this, workers);}
+	const MesoModel &getMeso()const{return meso;}
+	const CellularModel &getCellular()const{return cellular;}
+	CellularModel &getCellular(){return cellular;}
+	void setCellular(bool enabled);
+	size_t getVehicleCount()const{return kinematics.size() + meso.size() + cellular.size();}
+	void setMesoscopic(GraphEdge *e, bool meso);
+	int setFocus(const double center[2], double radius);
+	int closeEdge(GraphEdge *e);
+	int openEdge(GraphEdge *e);
+	GraphEdge *addRoad(GraphVertex *a, GraphVertex *b);
+	int setEdgeLength(GraphEdge *e, double length);
+	int setSpeedLimit(GraphEdge *e, double limit);
+	void setRegions(const std::vector<int> &vertexRegion, int localRegion);
+	int getLocalRegion()const{return localRegion;}
+	void takeEmigrants(std::vector<Migrant> &out){out.swap(emigrants); emigrants.clear();}
+	void immigrate(const Migrant &m, RouteArena::RouteId route, double dt);
+	void update(double dt);
+	size_t populate(size_t count);
+	void saveState(StateBuffer &out)const;
+	bool loadState(StateBuffer &in);
+	void reportMemory(MemoryReport &report)const;
+};
+
+#endif
@@ -1,20 +1,10 @@
-/** \file GraphEdge.cpp
- * \brief Implementation of GraphEdge class
- */
-
-#include "GraphEdge.h"
-#include "Vehicle.h"
-
-
-
-int GraphEdge::maxPassCount = 0;
-
-void GraphEdge::add(Vehicle *v){
-	v->setEdge(this);
-	vehicles.insert(v);
-	passCount++;
-	if(maxPassCount < passCount)
-		maxPassCount = passCount;
-}
-
-
+/** \file GraphEdge.cpp
+ * \brief Implementation of GraphEdge class
+ */
+
+#include "GraphEdge.h"
+
+
+
+/// Speed limit of a road nobody has edited, the same as Router::freeSpeed.
+const double GraphEdge::defaultSpeedLimit = 0.1;
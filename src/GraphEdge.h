@@ -1,36 +1,42 @@
-/** \file GraphEdge.h
- * \brief Definition of GraphEdge class
- */
-#ifndef GRAPHEDGE_H
-#define GRAPHEDGE_H
-#include "GraphVertex.h"
-	
-#include <set>
-
-class Vehicle;
-
-class GraphEdge{
-	typedef std::set<Vehicle*> VehicleSet;
-	GraphVertex *start;
-	GraphVertex *end;
-	VehicleSet vehicles;
-	double length;
-	mutable int passCount;
-	static int maxPassCount;
-public:
-	GraphEdge(GraphVertex *start, GraphVertex *end) : start(start), end(end), passCount(0){
-		length = start->measureDistance(*end);
-	}
-	GraphVertex *getStart()const{return start;}
-	GraphVertex *getEnd()const{return end;}
-	double getLength()const{return length;}
-	void add(Vehicle *v);
-	void remove(Vehicle *v){
-		vehicles.erase(v);
-	}
-	int getPassCount()const{return passCount;}
-	static int getMaxPassCount(){return maxPassCount;}
-};
-
-
-#endif
+/** \file GraphEdge.h
+ * \brief Definition of GraphEdge class
+ */
+#ifndef GRAPHEDGE_H
+#define GRAPHEDGE_H
+#include "GraphVertex.h"
+	
+
+/// \brief A road of the network.
+///
+/// Only describes the road; the traffic on it lives in the Graph simulating
+/// it, so several graphs can share one network.
+class GraphEdge{
+public:
+	static const double defaultSpeedLimit;
+private:
+	GraphVertex *start;
+	GraphVertex *end;
+	double length;
+	double speedLimit; ///< Speed vehicles drive at on this edge
+	bool closed; ///< Closed to entering vehicles; those already on it drive off
+	int id; ///< Index into Graph::getEdges()
+public:
+	GraphEdge(GraphVertex *start, GraphVertex *end) : start(start), end(end), speedLimit(defaultSpeedLimit), closed(false), id(-1){
+		length = start->measureDistance(*end);
+	}
+	GraphVertex *getStart()const{return start;}
+	GraphVertex *getEnd()const{return end;}
+	double getLength()const{return length;}
+	void setLength(double length){this->length = length;}
+	double getSpeedLimit()const{return speedLimit;}
+	void setSpeedLimit(double limit){speedLimit = limit;}
+	bool isClosed()const{return closed;}
+	void setClosed(bool closed){this->closed = closed;}
+	int getId()const{return id;}
+	void setId(int id){ this->id = id; }
+	/// \brief Returns the vertex at the other end from v.
+	GraphVertex *getOther(const GraphVertex *v)const{return v == start ? end : start;}
+};
+
+
+#endif
@@ -1,34 +1,34 @@
-/** \file GraphVertex.cpp
- * \brief Implementation of GraphVertex class
- */
-
-#include "GraphVertex.h"
-#include "GraphEdge.h"
-#include "Vehicle.h"
-
-
-
-const double vertexRadius = 5.;
-
-
-bool GraphVertex::connect(GraphVertex *other){
-	EdgeMap::iterator it = edges.find(other);
-	if(it != edges.end())
-		return false; // Already added
-
-	double length = measureDistance(*other);
-	if(0.6 < length)
-		return false; // Avoid adding long edges
-	GraphEdge *e = new GraphEdge(this, other);
-	edges[other] = e;
-	other->edges[this] = e;
-	return true;
-}
-
-void GraphVertex::add(Vehicle *v){
-	Vehicle::Path &path = v->getPath();
-	if(1 < path.size()){
-		edges[path[path.size() - 2]]->add(v);
-		path.pop_back();
-	}
-}
+/** \file GraphVertex.cpp
+ * \brief Implementation of GraphVertex class
+ */
+
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+
+
+
+const double vertexRadius = 5.;
+
+
+/// \brief Adds an edge between this and other, constructed in arena.
+/// \returns The new edge, or NULL if they were already connected or too far apart.
+GraphEdge *GraphVertex::connect(GraphVertex *other, ObjectArena<GraphEdge> &arena){
+	EdgeMap::iterator it = edges.find(other);
+	if(it != edges.end())
+		return NULL; // Already added
+
+	double length = measureDistance(*other);
+	if(0.6 < length)
+		return NULL; // Avoid adding long edges
+	GraphEdge *e = arena.create(this, other);
+	edges[other] = e;
+	other->edges[this] = e;
+	return e;
+}
+
+/// \brief Forgets the edge to other at both ends, leaving the edge object to its arena.
+void GraphVertex::disconnect(GraphVertex *other){
+	edges.erase(other);
+	other->edges.erase(this);
+}
@@ -0,0 +1,209 @@
+/** \file IntersectionManager.cpp
+ * \brief Implementation of IntersectionManager class
+ */
+
+#include "IntersectionManager.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "MemoryReport.h"
+#include "StateBuffer.h"
+
+#include <math.h>
+
+#include <thread>
+#include <algorithm>
+
+
+IntersectionManager::IntersectionManager() : crossingTime(0.), yieldTime(0.), crossingTicks(0), yieldTicks(0),
+	ringSize(0), vertexCount(0), table(NULL), workers(1), parallelThreshold(4096), grants(0), denials(0)
+{
+}
+
+IntersectionManager::~IntersectionManager(){
+	delete[] table;
+}
+
+size_t IntersectionManager::getMemoryUsage()const{
+	return (table ? MemoryReport::heapBytes(vertexCount * ringSize * sizeof *table) : 0) + MemoryReport::vectorBytes(major);
+}
+
+/// \brief Sets how long a crossing holds the junction and the gap a minor approach needs after it, in seconds.
+void IntersectionManager::setTiming(double crossingTime, double yieldTime){
+	this->crossingTime = crossingTime;
+	this->yieldTime = yieldTime;
+	crossingTicks = 0; // Worked out again by prepare()
+}
+
+/// \brief Finds the major approaches of every vertex again, after the network changed.
+void IntersectionManager::refresh(const Graph &graph){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	std::vector<double> fastest(vertices.size(), 0.);
+	for(size_t i = 0; i < edges.size(); i++){
+		const GraphEdge *e = edges[i];
+		if(e->isClosed())
+			continue;
+		double &s = fastest[e->getStart()->getId()];
+		s = std::max(s, e->getSpeedLimit());
+		double &t = fastest[e->getEnd()->getId()];
+		t = std::max(t, e->getSpeedLimit());
+	}
+	major.assign(edges.size() * 2, 0);
+	for(size_t i = 0; i < edges.size(); i++){
+		const GraphEdge *e = edges[i];
+		major[i * 2] = fastest[e->getStart()->getId()] <= e->getSpeedLimit();
+		major[i * 2 + 1] = fastest[e->getEnd()->getId()] <= e->getSpeedLimit();
+	}
+}
+
+/// \brief Releases every booking and zeroes the counts, for a run starting over from tick 0.
+void IntersectionManager::clear(){
+	for(size_t i = 0; i < vertexCount * ringSize; i++)
+		table[i].store(0, std::memory_order_relaxed);
+	grants = denials = 0;
+}
+
+/// \brief Appends the bookings and the counts to out.
+void IntersectionManager::save(StateBuffer &out)const{
+	out.put(crossingTicks);
+	out.put(yieldTicks);
+	out.put(ringSize);
+	out.put(uint64_t(vertexCount));
+	for(size_t i = 0; i < vertexCount * ringSize; i++)
+		out.put(uint64_t(table[i].load(std::memory_order_relaxed)));
+	out.put(uint64_t(grants));
+	out.put(uint64_t(denials));
+}
+
+/// \brief Reads back what save() wrote, for graph with the same network.
+bool IntersectionManager::load(StateBuffer &in, const Graph &graph){
+	refresh(graph);
+	crossingTicks = in.get<int>();
+	yieldTicks = in.get<int>();
+	uint32_t size = in.get<uint32_t>();
+	size_t count = size_t(in.get<uint64_t>());
+	if(!in.isOk() || (count && count != graph.getVertices().size()))
+		return false;
+	if(size != ringSize || count != vertexCount){
+		delete[] table;
+		ringSize = size;
+		vertexCount = count;
+		table = vertexCount ? new std::atomic<uint64_t>[vertexCount * ringSize] : NULL;
+	}
+	for(size_t i = 0; i < vertexCount * ringSize; i++)
+		table[i].store(in.get<uint64_t>(), std::memory_order_relaxed);
+	grants = size_t(in.get<uint64_t>());
+	denials = size_t(in.get<uint64_t>());
+	return in.isOk();
+}
+
+/// \brief Converts the timing to ticks of dt and makes sure the table covers the network.
+void IntersectionManager::prepare(const Graph &graph, double dt){
+	if(major.size() != graph.getEdges().size() * 2)
+		refresh(graph);
+	int ticks = std::max(1, int(ceil(crossingTime / dt - 1e-9)));
+	if(ticks == crossingTicks && vertexCount == graph.getVertices().size())
+		return;
+	crossingTicks = ticks;
+	yieldTicks = std::max(0, int(ceil(yieldTime / dt - 1e-9)));
+	// The ring must hold the longest booking plus the tick it starts from.
+	uint32_t size = 2;
+	while(size < uint32_t(crossingTicks + yieldTicks + 1))
+		size *= 2;
+	if(size != ringSize || vertexCount != graph.getVertices().size()){
+		delete[] table;
+		ringSize = size;
+		vertexCount = graph.getVertices().size();
+		table = new std::atomic<uint64_t>[vertexCount * ringSize];
+		for(size_t i = 0; i < vertexCount * ringSize; i++)
+			table[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+/// \brief Works out what v needs to cross the junction ahead and how strong its claim is.
+///
+/// The key holds the priority in bits 24 to 30 and a tie break in the rest
+/// that favours the older vehicle, so no two vehicles at a junction claim
+/// with the same key.
+IntersectionManager::Request IntersectionManager::makeRequest(Vehicle *v, int wait)const{
+	const GraphEdge *e = v->getEdge();
+	bool isMajor = major[e->getId() * 2 + (v->getNext() == e->getEnd())] != 0;
+	int priority = std::min(127, (isMajor ? 32 : 0) + wait / crossingTicks);
+	Request r;
+	r.vehicle = v;
+	r.vertex = v->getNext()->getId();
+	r.slots = crossingTicks + (isMajor ? 0 : yieldTicks);
+	r.key = (uint32_t(priority) << 24) | (0xffffff - (v->getId() & 0xffffff));
+	r.wait = wait;
+	r.granted = false;
+	return r;
+}
+
+/// \brief Raises every slot a request needs to its claim, unless a stronger one holds it.
+///
+/// The tick in the upper half makes a slot left over from an earlier round
+/// of the ring weaker than any claim on it now.
+void IntersectionManager::claim(Request *begin, Request *end, uint32_t tick){
+	for(Request *r = begin; r != end; r++){
+		for(uint32_t s = 0; s < r->slots; s++){
+			uint64_t want = (uint64_t(tick + s) << 32) | r->key;
+			std::atomic<uint64_t> &cell = slot(r->vertex, tick + s);
+			uint64_t cur = cell.load(std::memory_order_relaxed);
+			while(cur < want && !cell.compare_exchange_weak(cur, want, std::memory_order_relaxed));
+		}
+	}
+}
+
+/// \brief Grants the requests that hold all their slots, and gives back the slots of the rest.
+///
+/// Only the owner of a slot changes it here, so this may run alongside
+/// itself on other requests once every claim is made.
+void IntersectionManager::settle(Request *begin, Request *end, uint32_t tick){
+	for(Request *r = begin; r != end; r++){
+		r->granted = true;
+		for(uint32_t s = 0; s < r->slots && r->granted; s++){
+			uint64_t want = (uint64_t(tick + s) << 32) | r->key;
+			r->granted = slot(r->vertex, tick + s).load(std::memory_order_relaxed) == want;
+		}
+		for(uint32_t s = 0; s < r->slots; s++){
+			uint64_t want = (uint64_t(tick + s) << 32) | r->key;
+			slot(r->vertex, tick + s).compare_exchange_strong(want, r->granted ? want | committed : 0, std::memory_order_relaxed);
+		}
+	}
+}
+
+/// \brief Decides which requests may cross, starting at tick.
+///
+/// Large batches are split among the workers, with every claim made before
+/// any is settled.
+void IntersectionManager::book(std::vector<Request> &requests, uint32_t tick){
+	if(requests.empty())
+		return;
+	Request *first = &requests.front(), *last = first + requests.size();
+	int n = requests.size() < parallelThreshold ? 1 : workers;
+	if(n <= 1){
+		claim(first, last, tick);
+		settle(first, last, tick);
+	}
+	else{
+		size_t chunk = (requests.size() + n - 1) / n;
+		for(int phase = 0; phase < 2; phase++){
+			std::vector<std::thread> threads;
+			for(size_t i = 0; i < requests.size(); i += chunk){
+				Request *b = first + i, *e = first + std::min(requests.size(), i + chunk);
+				threads.push_back(phase == 0 ? std::thread(&IntersectionManager::claim, this, b, e, tick)
+					: std::thread(&IntersectionManager::settle, this, b, e, tick));
+			}
+			for(size_t i = 0; i < threads.size(); i++)
+				threads[i].join();
+		}
+	}
+	for(size_t i = 0; i < requests.size(); i++){
+		if(requests[i].granted)
+			grants++;
+		else
+			denials++;
+	}
+}
@@ -0,0 +1,84 @@
+/** \file IntersectionManager.h
+ * \brief Right of way at junctions by time slot reservations
+ *
+ * Without it, vehicles meeting at a vertex pass straight through each other.
+ * With it, a vehicle reaching the end of its edge must hold the junction for
+ * a few ticks before it may enter the next edge, and waits at the stop line
+ * until it gets them.  One vehicle crosses a junction at a time, so its
+ * throughput is limited by the crossing time.
+ *
+ * Each vertex has a ring of slots, one per tick, that requests claim with an
+ * atomic compare-and-swap.  A slot keeps the strongest claim on it, so which
+ * request wins does not depend on the order they were made in, and workers
+ * can book in parallel without a lock and still get the same result.
+ *
+ * Unsignalized junctions follow two rules.  Approaches on the fastest road
+ * meeting at the vertex are major and win over minor ones.  A minor approach
+ * must also find a gap of the yield time after its own crossing.  The
+ * priority of a waiting vehicle grows with its wait, so a minor road is not
+ * starved forever.
+ */
+#ifndef INTERSECTIONMANAGER_H
+#define INTERSECTIONMANAGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+#include <atomic>
+
+
+class Graph;
+class Vehicle;
+class StateBuffer;
+
+class IntersectionManager{
+public:
+	/// \brief A vehicle asking to cross the vertex at the end of its edge from the next tick on.
+	struct Request{
+		Vehicle *vehicle;
+		uint32_t vertex;
+		uint32_t slots; ///< Ticks to hold the junction for
+		uint32_t key; ///< Strength of the claim; the higher wins
+		int wait; ///< Ticks already waited at the stop line
+		bool granted;
+	};
+	static const uint64_t committed = uint64_t(1) << 31; ///< Flags a slot that was granted
+protected:
+	double crossingTime; ///< Seconds a crossing holds the junction, 0 to disable
+	double yieldTime; ///< Extra gap in seconds a minor approach needs
+	int crossingTicks;
+	int yieldTicks;
+	uint32_t ringSize; ///< Slots per vertex, a power of two
+	size_t vertexCount;
+	std::atomic<uint64_t> *table; ///< ringSize slots per vertex, holding the tick in the upper half and a claim key in the lower
+	std::vector<char> major; ///< Indexed by edge id * 2, plus 1 for the approach toward its end
+	int workers;
+	size_t parallelThreshold; ///< Fewest requests worth splitting among the workers
+	size_t grants;
+	size_t denials;
+	std::atomic<uint64_t> &slot(uint32_t vertex, uint32_t tick){return table[vertex * ringSize + (tick & (ringSize - 1))];}
+	void claim(Request *begin, Request *end, uint32_t tick);
+	void settle(Request *begin, Request *end, uint32_t tick);
+public:
+	IntersectionManager();
+	~IntersectionManager();
+	bool isEnabled()const{return 0. < crossingTime;}
+	size_t getMemoryUsage()const;
+	double getCrossingTime()const{return crossingTime;}
+	double getYieldTime()const{return yieldTime;}
+	void setTiming(double crossingTime, double yieldTime);
+	int getWorkers()const{return workers;}
+	void setWorkers(int workers){this->workers = workers < 1 ? 1 : workers;}
+	size_t getGrantCount()const{return grants;}
+	size_t getDenialCount()const{return denials;}
+	void refresh(const Graph &graph);
+	void clear();
+	void save(StateBuffer &out)const;
+	bool load(StateBuffer &in, const Graph &graph);
+	void prepare(const Graph &graph, double dt);
+	Request makeRequest(Vehicle *v, int wait)const;
+	void book(std::vector<Request> &requests, uint32_t tick);
+};
+
+#endif
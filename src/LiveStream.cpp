@@ -0,0 +1,492 @@
+/** \file LiveStream.cpp
+ * \brief Implementation of LiveStream class
+ */
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+#include "LiveStream.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define closeSocket closesocket
+#define MSG_NOSIGNAL 0
+static bool wouldBlock(){return WSAGetLastError() == WSAEWOULDBLOCK;}
+static void setNonBlocking(LiveStream::socket_t s){u_long on = 1; ioctlsocket(s, FIONBIO, &on);}
+#else
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+static bool wouldBlock(){return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;}
+static void setNonBlocking(LiveStream::socket_t s){fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);}
+#endif
+
+
+/// A client further behind than this many bytes is dropped rather than buffered.
+const size_t LiveStream::maxBacklog = 16 << 20;
+
+
+/// \brief SHA-1 of a short string, only used for the WebSocket handshake.
+static void sha1(const std::string &text, unsigned char digest[20]){
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	std::string msg = text;
+	uint64_t bits = uint64_t(text.size()) * 8;
+	msg += char(0x80);
+	while(msg.size() % 64 != 56)
+		msg += char(0);
+	for(int i = 7; 0 <= i; i--)
+		msg += char(bits >> (i * 8));
+	for(size_t chunk = 0; chunk < msg.size(); chunk += 64){
+		uint32_t w[80];
+		for(int i = 0; i < 16; i++)
+			w[i] = uint32_t((unsigned char)msg[chunk + i * 4]) << 24 | uint32_t((unsigned char)msg[chunk + i * 4 + 1]) << 16
+				| uint32_t((unsigned char)msg[chunk + i * 4 + 2]) << 8 | uint32_t((unsigned char)msg[chunk + i * 4 + 3]);
+		for(int i = 16; i < 80; i++){
+			uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+			w[i] = x << 1 | x >> 31;
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for(int i = 0; i < 80; i++){
+			uint32_t f, k;
+			if(i < 20)
+				f = (b & c) | (~b & d), k = 0x5A827999;
+			else if(i < 40)
+				f = b ^ c ^ d, k = 0x6ED9EBA1;
+			else if(i < 60)
+				f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+			else
+				f = b ^ c ^ d, k = 0xCA62C1D6;
+			uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+			e = d, d = c, c = b << 30 | b >> 2, b = a, a = t;
+		}
+		h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e;
+	}
+	for(int i = 0; i < 20; i++)
+		digest[i] = (unsigned char)(h[i / 4] >> (24 - i % 4 * 8));
+}
+
+static std::string base64(const unsigned char *p, size_t size){
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string ret;
+	for(size_t i = 0; i < size; i += 3){
+		uint32_t n = uint32_t(p[i]) << 16 | (i + 1 < size ? uint32_t(p[i + 1]) << 8 : 0) | (i + 2 < size ? p[i + 2] : 0);
+		ret += table[n >> 18 & 63];
+		ret += table[n >> 12 & 63];
+		ret += i + 1 < size ? table[n >> 6 & 63] : '=';
+		ret += i + 2 < size ? table[n & 63] : '=';
+	}
+	return ret;
+}
+
+static void putVarint(std::vector<char> &buf, uint32_t value){
+	while(0x80 <= value){
+		buf.push_back(char((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	buf.push_back(char(value));
+}
+
+static void putFloat(std::vector<char> &buf, float value){
+	char bytes[sizeof value];
+	memcpy(bytes, &value, sizeof value);
+	buf.insert(buf.end(), bytes, bytes + sizeof value);
+}
+
+static void putUint16(std::vector<char> &buf, uint16_t value){
+	buf.push_back(char(value & 0xff));
+	buf.push_back(char(value >> 8));
+}
+
+
+LiveStream::LiveStream() : listener(INVALID_SOCKET), frames(0), bytes(0){
+}
+
+LiveStream::~LiveStream(){
+	for(size_t i = 0; i < clients.size(); i++)
+		closeSocket(clients[i].s);
+	if(listener != INVALID_SOCKET)
+		closeSocket(listener);
+}
+
+/// \brief Starts accepting viewers on localhost:port.
+bool LiveStream::listen(int port){
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if(listener == INVALID_SOCKET)
+		return false;
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof on);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if(bind(listener, (sockaddr*)&addr, sizeof addr) != 0 || ::listen(listener, 8) != 0){
+		closeSocket(listener);
+		listener = INVALID_SOCKET;
+		return false;
+	}
+	setNonBlocking(listener);
+	return true;
+}
+
+/// \brief Services the viewers without blocking and sends them the current state of graph.
+///
+/// Call once per frame the viewers should see.
+void LiveStream::poll(const Graph &graph){
+	for(;;){
+		socket_t s = accept(listener, NULL, NULL);
+		if(s == INVALID_SOCKET)
+			break;
+		setNonBlocking(s);
+		Client c = {s, std::string(), std::vector<char>(), false, false, false};
+		clients.push_back(c);
+	}
+	for(size_t i = 0; i < clients.size(); i++)
+		readRequest(clients[i]);
+
+	bool upgraded = false, synced = false;
+	for(size_t i = 0; i < clients.size(); i++){
+		upgraded |= clients[i].upgraded && !clients[i].closing;
+		synced |= clients[i].synced;
+	}
+	if(upgraded){
+		capture(graph);
+		if(synced && curPass.size() < prevPass.size()){
+			// Roads were taken away, which the viewers only learn from the whole network again.
+			for(size_t i = 0; i < clients.size(); i++)
+				clients[i].synced = false;
+			synced = false;
+		}
+		if(synced){
+			if(curPass.size() != prevPass.size() || curClosed != prevClosed){
+				encodeEdges(graph);
+				for(size_t i = 0; i < clients.size(); i++){
+					if(clients[i].synced)
+						clients[i].out.insert(clients[i].out.end(), message.begin(), message.end());
+				}
+			}
+			encodeFrame(graph, false);
+			for(size_t i = 0; i < clients.size(); i++){
+				if(clients[i].synced)
+					clients[i].out.insert(clients[i].out.end(), message.begin(), message.end());
+			}
+		}
+		for(size_t i = 0; i < clients.size(); i++){
+			Client &c = clients[i];
+			if(!c.upgraded || c.synced || c.closing)
+				continue;
+			encodeNetwork(graph);
+			c.out.insert(c.out.end(), message.begin(), message.end());
+			encodeFrame(graph, true);
+			c.out.insert(c.out.end(), message.begin(), message.end());
+			c.synced = true;
+		}
+		prev.swap(cur);
+		prevPass.swap(curPass);
+		prevClosed.swap(curClosed);
+		frames++;
+	}
+
+	for(size_t i = 0; i < clients.size();){
+		Client &c = clients[i];
+		if(!flush(c) || (c.closing && c.out.empty()) || maxBacklog < c.out.size()){
+			closeSocket(c.s);
+			clients.erase(clients.begin() + i);
+		}
+		else
+			i++;
+	}
+}
+
+/// \brief Takes the quantized state of every vehicle and edge, sorted by id.
+void LiveStream::capture(const Graph &graph){
+	std::vector<VehiclePosition> positions;
+	graph.getVehiclePositions(positions);
+	cur.resize(positions.size());
+	for(size_t i = 0; i < positions.size(); i++){
+		const Vehicle *v = positions[i].vehicle;
+		const GraphEdge *e = v->getEdge();
+		VehicleState &s = cur[i];
+		s.id = v->getId();
+		s.edge = uint32_t(e->getId()) * 2 + (v->getNext() == e->getEnd() ? 1 : 0);
+		double f = e->getLength() ? positions[i].pos / e->getLength() : 0.;
+		s.pos = uint16_t(std::max(0., std::min(1., f)) * 65535. + .5);
+		float color[3];
+		v->getColor(color);
+		for(int j = 0; j < 3; j++)
+			s.color[j] = uint8_t(std::max(0.f, std::min(1.f, color[j])) * 255.f + .5f);
+	}
+	std::sort(cur.begin(), cur.end());
+
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	curPass.resize(edges.size());
+	curClosed.resize(edges.size());
+	for(size_t i = 0; i < edges.size(); i++){
+		curPass[i] = graph.getPassCount(int(i));
+		curClosed[i] = edges[i]->isClosed();
+	}
+}
+
+/// \brief Appends the ids of the closed edges captured, as differences from the previous one.
+void LiveStream::putClosed(std::vector<char> &buf)const{
+	uint32_t count = 0, last = 0;
+	for(size_t i = 0; i < curClosed.size(); i++)
+		count += curClosed[i] ? 1 : 0;
+	putVarint(buf, count);
+	for(size_t i = 0; i < curClosed.size(); i++){
+		if(curClosed[i]){
+			putVarint(buf, uint32_t(i) - last);
+			last = uint32_t(i);
+		}
+	}
+}
+
+/// \brief Encodes the vertex positions and edge end points into message.
+void LiveStream::encodeNetwork(const Graph &graph){
+	payload.clear();
+	payload.push_back('N');
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	putVarint(payload, uint32_t(vertices.size()));
+	for(size_t i = 0; i < vertices.size(); i++){
+		double pos[2];
+		vertices[i]->getPos(pos);
+		putFloat(payload, float(pos[0]));
+		putFloat(payload, float(pos[1]));
+	}
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	putVarint(payload, uint32_t(edges.size()));
+	for(size_t i = 0; i < edges.size(); i++){
+		putVarint(payload, edges[i]->getStart()->getId());
+		putVarint(payload, edges[i]->getEnd()->getId());
+	}
+	putClosed(payload);
+	frameMessage(payload);
+}
+
+/// \brief Encodes the edges added since the last frame and every closed edge into message.
+void LiveStream::encodeEdges(const Graph &graph){
+	payload.clear();
+	payload.push_back('E');
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	putVarint(payload, uint32_t(prevPass.size()));
+	putVarint(payload, uint32_t(edges.size()));
+	for(size_t i = prevPass.size(); i < edges.size(); i++){
+		putVarint(payload, edges[i]->getStart()->getId());
+		putVarint(payload, edges[i]->getEnd()->getId());
+	}
+	putClosed(payload);
+	frameMessage(payload);
+}
+
+/// \brief Encodes the difference between the last frame and the captured state into message.
+/// \param full Encode against an empty network instead, for a viewer that just joined.
+///
+/// Ids in each list are ascending and sent as differences from the previous
+/// one, which keeps most of them to a single byte.
+void LiveStream::encodeFrame(const Graph &graph, bool full){
+	payload.clear();
+	payload.push_back('F');
+	putVarint(payload, uint32_t(graph.getTicks()));
+	putVarint(payload, uint32_t(graph.getMaxPassCount()));
+
+	removed.clear();
+	added.clear();
+	moved.clear();
+	uint32_t changedEdges = 0, lastEdge = 0;
+	for(size_t i = 0; i < curPass.size(); i++){
+		if(curPass[i] != (!full && i < prevPass.size() ? prevPass[i] : 0)){
+			putVarint(added, uint32_t(i) - lastEdge);
+			putVarint(added, uint32_t(curPass[i]));
+			lastEdge = uint32_t(i);
+			changedEdges++;
+		}
+	}
+	putVarint(payload, changedEdges);
+	payload.insert(payload.end(), added.begin(), added.end());
+	added.clear();
+
+	// Merge the sorted lists of the last and the current frame.
+	uint32_t removedCount = 0, addedCount = 0, movedCount = 0;
+	uint32_t lastRemoved = 0, lastAdded = 0, lastMoved = 0;
+	size_t prevSize = full ? 0 : prev.size();
+	size_t i = 0, j = 0;
+	while(i < prevSize || j < cur.size()){
+		if(j == cur.size() || (i < prevSize && prev[i].id < cur[j].id)){
+			putVarint(removed, prev[i].id - lastRemoved);
+			lastRemoved = prev[i].id;
+			removedCount++;
+			i++;
+		}
+		else if(i == prevSize || cur[j].id < prev[i].id){
+			const VehicleState &s = cur[j];
+			putVarint(added, s.id - lastAdded);
+			added.insert(added.end(), s.color, s.color + 3);
+			putVarint(added, s.edge);
+			putUint16(added, s.pos);
+			lastAdded = s.id;
+			addedCount++;
+			j++;
+		}
+		else{
+			const VehicleState &s = cur[j];
+			bool edgeChanged = s.edge != prev[i].edge;
+			if(edgeChanged || s.pos != prev[i].pos){
+				// The lowest bit tells whether the edge follows.
+				putVarint(moved, (s.id - lastMoved) * 2 + (edgeChanged ? 1 : 0));
+				if(edgeChanged)
+					putVarint(moved, s.edge);
+				putUint16(moved, s.pos);
+				lastMoved = s.id;
+				movedCount++;
+			}
+			i++;
+			j++;
+		}
+	}
+	putVarint(payload, removedCount);
+	payload.insert(payload.end(), removed.begin(), removed.end());
+	putVarint(payload, addedCount);
+	payload.insert(payload.end(), added.begin(), added.end());
+	putVarint(payload, movedCount);
+	payload.insert(payload.end(), moved.begin(), moved.end());
+	frameMessage(payload);
+}
+
+/// \brief Wraps payload into an unmasked binary WebSocket frame in message.
+void LiveStream::frameMessage(const std::vector<char> &payload){
+	message.clear();
+	message.push_back(char(0x82));
+	size_t size = payload.size();
+	if(size < 126)
+		message.push_back(char(size));
+	else if(size < 65536){
+		message.push_back(char(126));
+		message.push_back(char(size >> 8));
+		message.push_back(char(size & 0xff));
+	}
+	else{
+		message.push_back(char(127));
+		for(int i = 7; 0 <= i; i--)
+			message.push_back(char(uint64_t(size) >> (i * 8)));
+	}
+	message.insert(message.end(), payload.begin(), payload.end());
+	bytes += message.size();
+}
+
+/// \brief Reads whatever the client sent: the HTTP request, or a WebSocket close.
+void LiveStream::readRequest(Client &c){
+	char buf[4096];
+	for(;;){
+		int n = recv(c.s, buf, sizeof buf, 0);
+		if(n == 0 || (n < 0 && !wouldBlock())){
+			c.out.clear();
+			c.closing = true;
+			return;
+		}
+		if(n < 0)
+			return;
+		if(c.upgraded){
+			// Viewers send nothing but pings and the closing handshake.
+			if((buf[0] & 0x0f) == 8)
+				c.closing = true;
+			continue;
+		}
+		c.request.append(buf, n);
+		if(16384 < c.request.size()){
+			c.closing = true;
+			return;
+		}
+		if(c.request.find("\r\n\r\n") != std::string::npos)
+			break;
+	}
+
+	std::string lower = c.request;
+	for(size_t i = 0; i < lower.size(); i++)
+		lower[i] = char(tolower((unsigned char)lower[i]));
+	size_t key = lower.find("\r\nsec-websocket-key:");
+	if(key != std::string::npos){
+		size_t begin = c.request.find_first_not_of(" \t", key + 20);
+		size_t end = c.request.find("\r\n", begin);
+		unsigned char digest[20];
+		sha1(c.request.substr(begin, c.request.find_last_not_of(" \t", end - 1) + 1 - begin) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+		std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+			+ base64(digest, sizeof digest) + "\r\n\r\n";
+		c.out.insert(c.out.end(), response.begin(), response.end());
+		c.upgraded = true;
+	}
+	else{
+		size_t begin = c.request.find(' ') + 1;
+		size_t end = c.request.find_first_of(" ?", begin);
+		serveFile(c, c.request.substr(begin, end - begin));
+	}
+	c.request.clear();
+}
+
+/// \brief Answers a plain HTTP request with one of the viewer's files from the working directory.
+void LiveStream::serveFile(Client &c, const std::string &path){
+	static const char *const files[] = {"traffic.html", "traffic.js", "Graph.js", "xorshift.js", "stream.js"};
+	std::string name = path == "/" ? "traffic.html" : path.substr(1);
+	std::string response;
+	FILE *fp = NULL;
+	for(size_t i = 0; i < sizeof files / sizeof *files; i++){
+		if(name == files[i])
+			fp = fopen(files[i], "rb");
+	}
+	if(fp){
+		std::string body;
+		char buf[4096];
+		for(size_t n; 0 < (n = fread(buf, 1, sizeof buf, fp));)
+			body.append(buf, n);
+		fclose(fp);
+		char header[256];
+		sprintf(header, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+			name.find(".html") != std::string::npos ? "text/html" : "application/javascript", int(body.size()));
+		response = header + body;
+	}
+	else
+		response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	c.out.insert(c.out.end(), response.begin(), response.end());
+	c.closing = true;
+}
+
+/// \brief Sends as much of the client's backlog as the socket takes.
+/// \returns false if the connection is broken.
+bool LiveStream::flush(Client &c){
+	size_t sent = 0;
+	while(sent < c.out.size()){
+		int n = send(c.s, &c.out[sent], int(std::min(c.out.size() - sent, size_t(1 << 20))), MSG_NOSIGNAL);
+		if(n < 0){
+			if(!wouldBlock())
+				return false;
+			break;
+		}
+		sent += n;
+	}
+	c.out.erase(c.out.begin(), c.out.begin() + sent);
+	return true;
+}
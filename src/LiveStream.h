@@ -0,0 +1,81 @@
+/** \file LiveStream.h
+ * \brief Streaming the live simulation state to browsers over WebSocket
+ *
+ * A client first receives the network geometry and a full frame, then only
+ * deltas: vehicles that appeared, disappeared or moved, and edges whose pass
+ * count changed.  A frame after the roads were edited is preceded by the
+ * roads added since the last one and the roads now closed.  Vehicle positions are quantized to 16 bits along their edge
+ * and all integers are varints, so a frame costs a few bytes per moving
+ * vehicle.  See stream.js for the decoder.
+ *
+ * The same port also serves the viewer's HTML and scripts over plain HTTP,
+ * so pointing a browser at http://localhost:port/ is enough.
+ */
+#ifndef LIVESTREAM_H
+#define LIVESTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+#include <string>
+
+
+class Graph;
+
+class LiveStream{
+public:
+#ifdef _WIN32
+	typedef uintptr_t socket_t;
+#else
+	typedef int socket_t;
+#endif
+protected:
+	struct Client{
+		socket_t s;
+		std::string request; ///< HTTP request being received
+		std::vector<char> out; ///< Bytes not yet accepted by the socket
+		bool upgraded; ///< Switched to WebSocket
+		bool synced; ///< Has received the network and a full frame
+		bool closing; ///< Drop once out is flushed
+	};
+	/// \brief Quantized vehicle state, as the clients last saw it.
+	struct VehicleState{
+		uint32_t id;
+		uint32_t edge; ///< Edge id times 2, plus 1 when heading to the edge's end
+		uint16_t pos; ///< Fraction of the edge length in 1/65535
+		uint8_t color[3];
+		bool operator<(const VehicleState &o)const{return id < o.id;}
+	};
+	socket_t listener;
+	std::vector<Client> clients;
+	std::vector<VehicleState> prev, cur;
+	std::vector<int> prevPass, curPass; ///< Pass count per edge id; the size is the number of edges the clients know
+	std::vector<char> prevClosed, curClosed; ///< Whether each edge id is closed
+	std::vector<char> payload, message; ///< Scratch buffers
+	std::vector<char> removed, added, moved; ///< Sections of the frame being encoded
+	size_t frames;
+	size_t bytes;
+
+	void capture(const Graph &graph);
+	void encodeNetwork(const Graph &graph);
+	void encodeEdges(const Graph &graph);
+	void putClosed(std::vector<char> &buf)const;
+	void encodeFrame(const Graph &graph, bool full);
+	void frameMessage(const std::vector<char> &payload);
+	void readRequest(Client &c);
+	void serveFile(Client &c, const std::string &path);
+	bool flush(Client &c);
+public:
+	static const size_t maxBacklog;
+
+	LiveStream();
+	~LiveStream();
+	bool listen(int port);
+	void poll(const Graph &graph);
+	size_t getClientCount()const{return clients.size();}
+	size_t getFrameCount()const{return frames;}
+	size_t getByteCount()const{return bytes;}
+};
+
+#endif
@@ -0,0 +1,86 @@
+/** \file MemoryReport.cpp
+ * \brief Implementation of the memory accounting
+ */
+
+#include "MemoryReport.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+
+static const char *const scaleNames[MemoryReport::scaleCount] = {"", "vehicle", "edge", "vertex"};
+static const char *const scalePlurals[MemoryReport::scaleCount] = {"", "vehicles", "edges", "vertices"};
+
+void MemoryReport::clear(){
+	entries.clear();
+	for(int i = 0; i < scaleCount; i++)
+		counts[i] = 0;
+}
+
+void MemoryReport::add(const char *name, size_t bytes, int scale){
+	Entry e = {name, bytes, scale};
+	entries.push_back(e);
+}
+
+size_t MemoryReport::getTotal()const{
+	size_t ret = 0;
+	for(size_t i = 0; i < entries.size(); i++)
+		ret += entries[i].bytes;
+	return ret;
+}
+
+size_t MemoryReport::getTotal(int scale)const{
+	size_t ret = 0;
+	for(size_t i = 0; i < entries.size(); i++){
+		if(entries[i].scale == scale)
+			ret += entries[i].bytes;
+	}
+	return ret;
+}
+
+void MemoryReport::print(FILE *fp)const{
+	fprintf(fp, "%-20s %14s %14s\n", "subsystem", "bytes", "per entity");
+	for(size_t i = 0; i < entries.size(); i++){
+		const Entry &e = entries[i];
+		fprintf(fp, "%-20s %14.0f", e.name, double(e.bytes));
+		if(e.scale != fixed && counts[e.scale])
+			fprintf(fp, " %9.1f B/%s", double(e.bytes) / counts[e.scale], scaleNames[e.scale]);
+		fprintf(fp, "\n");
+	}
+	fprintf(fp, "%-20s %14.0f\n", "total", double(getTotal()));
+	for(int s = perVehicle; s < scaleCount; s++)
+		fprintf(fp, "%10.0f %-9s %9.1f B each\n", double(counts[s]), scalePlurals[s], getPerEntity(s));
+	size_t rss = getResidentBytes();
+	if(rss)
+		fprintf(fp, "Resident set size %.0f bytes\n", double(rss));
+}
+
+/// \brief Bytes a heap block of request bytes really takes, rounded the way glibc's malloc does.
+size_t MemoryReport::heapBytes(size_t request){
+	size_t chunk = (request + sizeof(size_t) + 15) & ~size_t(15);
+	return chunk < 32 ? 32 : chunk;
+}
+
+/// \brief The resident set size of the process, 0 where it cannot be told.
+size_t MemoryReport::getResidentBytes(){
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc))
+		return pmc.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if(!fp)
+		return 0;
+	unsigned long size, resident;
+	int n = fscanf(fp, "%lu %lu", &size, &resident);
+	fclose(fp);
+	return n == 2 ? resident * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
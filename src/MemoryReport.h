@@ -0,0 +1,53 @@
+/** \file MemoryReport.h
+ * \brief Accounting of the memory the simulation takes, by subsystem and per entity
+ *
+ * Each subsystem reports the bytes it holds and what they grow with: the
+ * vehicles on the road, the edges or the vertices of the network, or nothing.
+ * Dividing by the number of those gives the cost of one more of them, which is
+ * what capacity planning needs.  Container sizes are estimated from their
+ * capacity plus the allocator's rounding and the node headers of the trees,
+ * so they come close to what the process really takes; the resident set size
+ * is reported next to them to check.
+ */
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include <vector>
+
+
+class MemoryReport{
+public:
+	/// \brief What the bytes of an entry grow with.
+	enum Scale{fixed, perVehicle, perEdge, perVertex, scaleCount};
+	struct Entry{
+		const char *name;
+		size_t bytes;
+		int scale;
+	};
+protected:
+	std::vector<Entry> entries;
+	size_t counts[scaleCount];
+public:
+	MemoryReport(){clear();}
+	void clear();
+	void add(const char *name, size_t bytes, int scale);
+	void setCount(int scale, size_t count){counts[scale] = count;}
+	size_t getTotal()const;
+	size_t getTotal(int scale)const;
+	/// \brief Bytes per entity of scale, counting only the entries that grow with it.
+	double getPerEntity(int scale)const{return counts[scale] ? double(getTotal(scale)) / counts[scale] : 0.;}
+	void print(FILE *fp)const;
+
+	static size_t heapBytes(size_t request);
+	/// \brief Bytes a node of a std::map or std::set holding valueSize bytes takes.
+	static size_t treeNodeBytes(size_t valueSize){return heapBytes(4 * sizeof(void*) + valueSize);}
+	template<typename T> static size_t vectorBytes(const std::vector<T> &v){
+		return v.capacity() ? heapBytes(v.capacity() * sizeof(T)) : 0;
+	}
+	static size_t getResidentBytes();
+};
+
+#endif
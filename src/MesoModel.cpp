@@ -0,0 +1,235 @@
+/** \file MesoModel.cpp
+ * \brief Implementation of MesoModel class
+ */
+
+#include "MesoModel.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "MemoryReport.h"
+#include "StateBuffer.h"
+
+#include <algorithm>
+
+
+/// Fraction of the speed limit traffic keeps on a jammed edge, so that a queue always drains.
+const double MesoModel::minSpeedRatio = 0.05;
+
+
+/// \brief Makes room for edges edges, new ones being microscopic.
+void MesoModel::resize(size_t edges){
+	meso.resize(edges, 0);
+	Queue empty = {std::vector<Entry>(), 0, 0, false};
+	queues.resize(edges, empty);
+}
+
+/// \brief Empties every queue, keeping the resolutions and the buffers.
+void MesoModel::clear(){
+	for(size_t i = 0; i < queues.size(); i++){
+		queues[i].head = queues[i].count = 0;
+		queues[i].scheduled = false;
+	}
+	events.clear();
+	blocked.clear();
+	retry.clear();
+	retried = 0;
+	vehicles = 0;
+}
+
+void MesoModel::setMeso(int edge, bool meso){
+	if(this->meso.size() <= size_t(edge))
+		resize(edge + 1);
+	if(!this->meso[edge] != !meso)
+		mesoEdges += meso ? 1 : -1;
+	this->meso[edge] = meso;
+}
+
+/// \brief Seconds to traverse e with others vehicles on it, by Greenshields' linear speed-density relation.
+///
+/// Without a jam density vehicles do not hinder each other, as on the
+/// microscopic edges, so they drive at the speed limit.
+/// \param jamDensity Vehicles per unit length at which traffic stops, 0 for no limit
+double MesoModel::travelTime(const GraphEdge *e, int others, double jamDensity){
+	double ratio = 1.;
+	if(0. < jamDensity && 0. < e->getLength())
+		ratio = std::max(minSpeedRatio, 1. - others / e->getLength() / jamDensity);
+	return e->getLength() / (e->getSpeedLimit() * ratio);
+}
+
+/// \brief Makes the ring of q hold at least count entries, unwrapping it so the oldest entry is first again.
+void MesoModel::reserve(Queue &q, uint32_t count){
+	if(count <= q.ring.size())
+		return;
+	size_t size = q.ring.empty() ? 4 : q.ring.size() * 2;
+	while(size < count)
+		size *= 2;
+	std::vector<Entry> ring(size);
+	for(uint32_t i = 0; i < q.count; i++)
+		ring[i] = q.ring[(q.head + i) & (q.ring.size() - 1)];
+	q.ring.swap(ring);
+	q.head = 0;
+}
+
+/// \brief Makes the queue of edge hold count vehicles, and the schedule every queue, without allocating.
+void MesoModel::reserve(int edge, uint32_t count){
+	if(queues.size() <= size_t(edge))
+		resize(edge + 1);
+	reserve(queues[edge], count);
+	events.reserve(queues.size());
+	blocked.reserve(queues.size());
+	retry.reserve(queues.size());
+}
+
+/// \brief Queues v on edge to leave at exitTime, or after the vehicle ahead of it if that is later.
+void MesoModel::push(int edge, Vehicle *v, double exitTime){
+	Queue &q = queues[edge];
+	reserve(q, q.count + 1);
+	if(q.count)
+		exitTime = std::max(exitTime, q.ring[(q.head + q.count - 1) & (q.ring.size() - 1)].exitTime);
+	Entry e = {v, exitTime, exitTime};
+	q.ring[(q.head + q.count) & (q.ring.size() - 1)] = e;
+	q.count++;
+	vehicles++;
+	if(!q.scheduled)
+		schedule(edge);
+}
+
+void MesoModel::schedule(int edge){
+	Queue &q = queues[edge];
+	Event e = {q.ring[q.head].exitTime, edge};
+	events.push_back(e);
+	std::push_heap(events.begin(), events.end());
+	q.scheduled = true;
+}
+
+/// \brief Starts a tick, in which the heads blocked on the last one are tried again first.
+void MesoModel::beginTick(){
+	retry.swap(blocked);
+	blocked.clear();
+	retried = 0;
+}
+
+/// \brief Finds the next edge whose head may leave by now.
+///
+/// The caller must either pop() or block() the head before asking again.
+/// \returns false once no head is due before the next tick.
+bool MesoModel::nextDue(double now, int &edge){
+	if(retried < retry.size()){
+		edge = retry[retried++];
+		return true;
+	}
+	if(events.empty() || now < events.front().time)
+		return false;
+	edge = events.front().edge;
+	std::pop_heap(events.begin(), events.end());
+	events.pop_back();
+	return true;
+}
+
+/// \brief Takes the head of edge's queue off it.
+void MesoModel::pop(int edge){
+	Queue &q = queues[edge];
+	q.head = (q.head + 1) & (q.ring.size() - 1);
+	q.count--;
+	vehicles--;
+	q.scheduled = false;
+	if(q.count)
+		schedule(edge);
+}
+
+/// \brief Keeps the head of edge's queue, which found no room ahead at now, to be tried again next tick.
+void MesoModel::block(int edge, double now){
+	Queue &q = queues[edge];
+	q.ring[q.head].exitTime = now;
+	blocked.push_back(edge);
+}
+
+/// \brief Appends every queued vehicle to out, by edge and then in queue order.
+void MesoModel::collect(std::vector<Vehicle*> &out)const{
+	for(size_t i = 0; i < queues.size(); i++){
+		const Queue &q = queues[i];
+		for(uint32_t j = 0; j < q.count; j++)
+			out.push_back(q.ring[(q.head + j) & (q.ring.size() - 1)].vehicle);
+	}
+}
+
+/// \brief Appends every queued vehicle to out in the order of collect(), placed as of now.
+///
+/// A queue has no positions, so a vehicle is put as far from the end of its
+/// edge as it would drive at the speed limit until its exit time.  One that
+/// has to wait longer than that waits at the entry, and one that is due
+/// waits at the end; either way it stays behind those queued before it.
+void MesoModel::collect(std::vector<VehiclePosition> &out, double now)const{
+	for(size_t i = 0; i < queues.size(); i++){
+		const Queue &q = queues[i];
+		for(uint32_t j = 0; j < q.count; j++){
+			const Entry &e = q.ring[(q.head + j) & (q.ring.size() - 1)];
+			const GraphEdge *edge = e.vehicle->getEdge();
+			double length = edge->getLength();
+			VehiclePosition p = {e.vehicle, std::max(0., std::min(length, length - (e.exitTime - now) * edge->getSpeedLimit()))};
+			out.push_back(p);
+		}
+	}
+}
+
+/// \brief Appends the resolutions and the queues to out, leaving the vehicles to the caller in the order of collect().
+void MesoModel::save(StateBuffer &out)const{
+	out.putVector(meso);
+	out.put(uint32_t(queues.size()));
+	for(size_t i = 0; i < queues.size(); i++){
+		const Queue &q = queues[i];
+		out.put(q.count);
+		out.put(q.scheduled);
+		for(uint32_t j = 0; j < q.count; j++){
+			const Entry &e = q.ring[(q.head + j) & (q.ring.size() - 1)];
+			out.put(e.exitTime);
+			out.put(e.dueTime);
+		}
+	}
+	out.putVector(events);
+	out.putVector(blocked);
+}
+
+/// \brief Reads back what save() wrote, putting vehicles, count of them in the order of collect(), in the queues.
+/// \returns false if the state does not fit, leaving the queues empty.
+bool MesoModel::load(StateBuffer &in, Vehicle *const *vehicles, size_t count){
+	clear();
+	in.getVector(meso);
+	mesoEdges = 0;
+	for(size_t i = 0; i < meso.size(); i++)
+		mesoEdges += meso[i] != 0;
+	uint32_t n = in.get<uint32_t>();
+	resize(std::max(size_t(n), meso.size()));
+	for(uint32_t i = 0; i < n && in.isOk(); i++){
+		Queue &q = queues[i];
+		uint32_t length = in.get<uint32_t>();
+		q.scheduled = in.get<bool>();
+		if(count - this->vehicles < length){
+			clear();
+			return false;
+		}
+		reserve(q, length);
+		for(uint32_t j = 0; j < length; j++){
+			Entry e = {vehicles[this->vehicles], 0., 0.};
+			e.exitTime = in.get<double>();
+			e.dueTime = in.get<double>();
+			q.ring[j] = e;
+			this->vehicles++;
+		}
+		q.count = length;
+	}
+	in.getVector(events);
+	in.getVector(blocked);
+	if(!in.isOk() || this->vehicles != count){
+		clear();
+		return false;
+	}
+	return true;
+}
+
+size_t MesoModel::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(meso) + MemoryReport::vectorBytes(queues) + MemoryReport::vectorBytes(events)
+		+ MemoryReport::vectorBytes(blocked) + MemoryReport::vectorBytes(retry);
+	for(size_t i = 0; i < queues.size(); i++)
+		ret += MemoryReport::vectorBytes(queues[i].ring);
+	return ret;
+}
@@ -0,0 +1,87 @@
+/** \file MesoModel.h
+ * \brief Mesoscopic edges, where traffic is a queue rather than individual lanes
+ *
+ * A vehicle on a mesoscopic edge is not stepped.  It is given a time to
+ * leave the edge when it enters, from a speed-density relation of the edge
+ * at that moment, and waits in the edge's first in, first out queue until
+ * then.  So it only costs work when it enters and when it leaves, and the
+ * queue keeps the order vehicles entered in.
+ *
+ * Edges switch between mesoscopic and microscopic resolution independently;
+ * a switch applies to the vehicles entering the edge from then on, while
+ * those already on it finish it the way they started.
+ */
+#ifndef MESOMODEL_H
+#define MESOMODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+class GraphEdge;
+class Vehicle;
+struct VehiclePosition;
+class StateBuffer;
+
+class MesoModel{
+public:
+	/// \brief A vehicle in an edge's queue.
+	struct Entry{
+		Vehicle *vehicle;
+		double exitTime; ///< Simulated seconds when it may leave; moved up to the last try while it is blocked
+		double dueTime; ///< When it first could have left
+	};
+	static const double minSpeedRatio;
+protected:
+	/// \brief Ring buffer of the vehicles on one edge, oldest first.
+	struct Queue{
+		std::vector<Entry> ring; ///< Capacity is a power of two, or zero
+		uint32_t head;
+		uint32_t count;
+		bool scheduled; ///< The head has an event pending or is blocked
+	};
+	/// \brief The head of an edge's queue becoming due.
+	struct Event{
+		double time;
+		int edge;
+		/// Orders the heap earliest first, then by edge id, so the order never depends on the insertion order.
+		bool operator<(const Event &o)const{return o.time < time || (o.time == time && o.edge < edge);}
+	};
+	std::vector<char> meso; ///< Resolution by edge id, nonzero for mesoscopic
+	std::vector<Queue> queues; ///< By edge id
+	std::vector<Event> events; ///< Heap of the queue heads waiting for their exit time
+	std::vector<int> blocked; ///< Edges whose head could not leave this tick
+	std::vector<int> retry; ///< Edges whose head could not leave last tick, tried first
+	size_t retried; ///< Entries of retry tried so far
+	size_t mesoEdges;
+	size_t vehicles;
+	void schedule(int edge);
+	void reserve(Queue &q, uint32_t count);
+public:
+	MesoModel() : retried(0), mesoEdges(0), vehicles(0){}
+	void resize(size_t edges);
+	void reserve(int edge, uint32_t count);
+	void clear();
+	bool isEnabled()const{return 0 < mesoEdges || 0 < vehicles;}
+	bool isMeso(int edge)const{return size_t(edge) < meso.size() && meso[edge];}
+	void setMeso(int edge, bool meso);
+	size_t getMesoEdgeCount()const{return mesoEdges;}
+	size_t size()const{return vehicles;}
+	size_t getQueueLength(int edge)const{return size_t(edge) < queues.size() ? queues[edge].count : 0;}
+	static double travelTime(const GraphEdge *e, int others, double jamDensity);
+	void push(int edge, Vehicle *v, double exitTime);
+	void beginTick();
+	bool nextDue(double now, int &edge);
+	const Entry &front(int edge)const{const Queue &q = queues[edge]; return q.ring[q.head];}
+	void pop(int edge);
+	void block(int edge, double now);
+	void collect(std::vector<Vehicle*> &out)const;
+	void collect(std::vector<VehiclePosition> &out, double now)const;
+	void save(StateBuffer &out)const;
+	bool load(StateBuffer &in, Vehicle *const *vehicles, size_t count);
+	size_t getMemoryUsage()const;
+};
+
+#endif
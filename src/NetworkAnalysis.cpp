@@ -0,0 +1,208 @@
+/** \file NetworkAnalysis.cpp
+ * \brief Implementation of NetworkAnalysis class
+ */
+
+#include "NetworkAnalysis.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "MemoryReport.h"
+
+extern "C"{
+#include <clib/rseq.h>
+}
+
+#include <thread>
+#include <algorithm>
+
+
+/// \param workers Threads to compute the betweenness with; 0 for one per hardware thread.
+void NetworkAnalysis::setWorkers(int workers){
+	this->workers = 0 < workers ? workers : std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+/// \brief Flattens the open edges of graph into arcs both ways, by vertex id.
+void NetworkAnalysis::buildArcs(const Graph &graph){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	size_t n = vertices.size();
+	arcBegin.assign(n + 1, 0);
+	for(size_t i = 0; i < edges.size(); i++){
+		if(edges[i]->isClosed())
+			continue;
+		arcBegin[edges[i]->getStart()->getId() + 1]++;
+		arcBegin[edges[i]->getEnd()->getId() + 1]++;
+	}
+	for(size_t v = 0; v < n; v++)
+		arcBegin[v + 1] += arcBegin[v];
+	arcs.resize(arcBegin[n]);
+	scratch.assign(arcBegin.begin(), arcBegin.end() - 1);
+	for(size_t i = 0; i < edges.size(); i++){
+		const GraphEdge *e = edges[i];
+		if(e->isClosed())
+			continue;
+		int a = e->getStart()->getId(), b = e->getEnd()->getId();
+		Arc ab = {b, int(i)}, ba = {a, int(i)};
+		arcs[scratch[a]++] = ab;
+		arcs[scratch[b]++] = ba;
+	}
+}
+
+/// \brief Labels the vertices of graph by the part of the network over open roads they are in.
+void NetworkAnalysis::labelComponents(const Graph &graph){
+	buildArcs(graph);
+	size_t n = graph.getVertices().size();
+	component.assign(n, -1);
+	componentSize.clear();
+	std::vector<int> &stack = scratch;
+	for(size_t s = 0; s < n; s++){
+		if(0 <= component[s])
+			continue;
+		int label = int(componentSize.size());
+		int size = 0;
+		component[s] = label;
+		stack.assign(1, int(s));
+		while(!stack.empty()){
+			int v = stack.back();
+			stack.pop_back();
+			size++;
+			for(int j = arcBegin[v]; j < arcBegin[v + 1]; j++){
+				int w = arcs[j].to;
+				if(component[w] < 0){
+					component[w] = label;
+					stack.push_back(w);
+				}
+			}
+		}
+		componentSize.push_back(size);
+	}
+	labeled = true;
+}
+
+/// \brief Share of the trips the spawner draws, start and end uniformly among the vertices, that have a route.
+///
+/// A trip back to its start has none, like in Vehicle::findPath().
+double NetworkAnalysis::getRoutableShare()const{
+	double n = double(component.size()), pairs = 0.;
+	for(size_t i = 0; i < componentSize.size(); i++)
+		pairs += double(componentSize[i]) * (componentSize[i] - 1);
+	return 0. < n ? pairs / (n * n) : 0.;
+}
+
+/// \brief Adds the dependencies of every vertex on the shortest paths from source to w.sum.
+/// \param linear Whether to weigh each edge on a path by how far along it lies, for sampled sources.
+void NetworkAnalysis::accumulate(int source, Worker &w, bool linear)const{
+	w.order.clear();
+	w.dist[source] = 0;
+	w.sigma[source] = 1.;
+	w.order.push_back(source);
+	for(size_t head = 0; head < w.order.size(); head++){
+		int v = w.order[head];
+		for(int j = arcBegin[v]; j < arcBegin[v + 1]; j++){
+			int u = arcs[j].to;
+			if(w.dist[u] < 0){
+				w.dist[u] = w.dist[v] + 1;
+				w.order.push_back(u);
+			}
+			if(w.dist[u] == w.dist[v] + 1)
+				w.sigma[u] += w.sigma[v];
+		}
+	}
+
+	// Back from the farthest, handing each vertex's dependency to its predecessors.
+	// Linearly scaled, a path to u counts 1 / dist[u] in delta and each edge
+	// takes twice its share times how far along it lies, which over a pair
+	// and its reverse adds up to the same, but keeps the edges next to a
+	// sampled source from standing for the paths of every source.
+	for(size_t k = w.order.size(); 0 < k--;){
+		int u = w.order[k];
+		if(u == source)
+			continue;
+		double share = ((linear ? 1. / w.dist[u] : 1.) + w.delta[u]) / w.sigma[u];
+		for(int j = arcBegin[u]; j < arcBegin[u + 1]; j++){
+			int v = arcs[j].to;
+			if(w.dist[v] != w.dist[u] - 1)
+				continue;
+			double c = w.sigma[v] * share;
+			w.sum[arcs[j].edge] += linear ? c * (2. * w.dist[v] + 1.) : c;
+			w.delta[v] += c;
+		}
+	}
+
+	// Leave the scratch clean for the next source, touching only what was reached.
+	for(size_t k = 0; k < w.order.size(); k++){
+		int u = w.order[k];
+		w.dist[u] = -1;
+		w.sigma[u] = 0.;
+		w.delta[u] = 0.;
+	}
+}
+
+/// \brief Computes the edge betweenness over the open roads of graph, labelling its components as well.
+/// \param samples Sources to sum the paths from, drawn with seed and scaled up to all of them; 0 or more than the vertices for every vertex.
+void NetworkAnalysis::computeBetweenness(const Graph &graph, int samples, uint32_t seed){
+	labelComponents(graph);
+	int n = int(graph.getVertices().size());
+	sources.resize(n);
+	for(int i = 0; i < n; i++)
+		sources[i] = i;
+	double scale = 1.;
+	bool linear = false;
+	if(0 < samples && samples < n){
+		// The first samples of a partial shuffle
+		random_sequence rs;
+		init_rseq(&rs, seed);
+		for(int i = 0; i < samples; i++)
+			std::swap(sources[i], sources[i + rseq(&rs) % (n - i)]);
+		sources.resize(samples);
+		scale = double(n) / samples;
+		linear = true;
+	}
+
+	int threads = std::max(1, std::min(workers, int(sources.size())));
+	workerState.resize(threads);
+	for(int t = 0; t < threads; t++){
+		Worker &w = workerState[t];
+		w.dist.assign(n, -1);
+		w.sigma.assign(n, 0.);
+		w.delta.assign(n, 0.);
+		w.order.reserve(n);
+		w.sum.assign(graph.getEdges().size(), 0.);
+	}
+	size_t chunk = (sources.size() + threads - 1) / threads;
+	auto work = [this, chunk, linear](int t){
+		size_t end = std::min(sources.size(), (t + 1) * chunk);
+		for(size_t i = t * chunk; i < end; i++)
+			accumulate(sources[i], workerState[t], linear);
+	};
+	if(threads == 1)
+		work(0);
+	else{
+		std::vector<std::thread> pool;
+		for(int t = 0; t < threads; t++)
+			pool.push_back(std::thread(work, t));
+		for(size_t t = 0; t < pool.size(); t++)
+			pool[t].join();
+	}
+
+	// Summed in worker order, so a run with as many workers gives the same figures.
+	betweenness.assign(graph.getEdges().size(), 0.);
+	for(int t = 0; t < threads; t++){
+		for(size_t e = 0; e < betweenness.size(); e++)
+			betweenness[e] += workerState[t].sum[e];
+	}
+	for(size_t e = 0; e < betweenness.size(); e++)
+		betweenness[e] *= scale;
+}
+
+size_t NetworkAnalysis::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(component) + MemoryReport::vectorBytes(componentSize) + MemoryReport::vectorBytes(arcBegin)
+		+ MemoryReport::vectorBytes(arcs) + MemoryReport::vectorBytes(sources) + MemoryReport::vectorBytes(scratch)
+		+ MemoryReport::vectorBytes(betweenness) + MemoryReport::vectorBytes(workerState);
+	for(size_t i = 0; i < workerState.size(); i++){
+		const Worker &w = workerState[i];
+		ret += MemoryReport::vectorBytes(w.dist) + MemoryReport::vectorBytes(w.sigma) + MemoryReport::vectorBytes(w.delta)
+			+ MemoryReport::vectorBytes(w.order) + MemoryReport::vectorBytes(w.sum);
+	}
+	return ret;
+}
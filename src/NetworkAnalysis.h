@@ -0,0 +1,82 @@
+/** \file NetworkAnalysis.h
+ * \brief What the shape of the road network tells before any traffic runs on it
+ *
+ * The random network leaves some vertices cut off from the rest, and a trip
+ * between two parts that no road joins used to be found hopeless only after
+ * its search had visited the whole part it started in.  Labelling the
+ * connected components over the open roads lets the spawner reject such a
+ * trip by comparing two labels.
+ *
+ * Edge betweenness counts for each road the shortest paths between all
+ * ordered pairs of vertices that run over it, split evenly among ties, which
+ * is how busy the road gets when trips are drawn uniformly and routed by the
+ * fewest edges like the spawner does.  It is computed with Brandes'
+ * algorithm, one breadth-first search and one backward sweep per source,
+ * with the sources split among worker threads.  On a large network a sample
+ * of the sources, scaled up, gives much the same figures for a fraction of
+ * the time; the paths from a sampled source are weighed by how far along
+ * them each edge lies, after Geisberger, Sanders and Schultes, so that the
+ * roads next to the few sources drawn do not stand out.
+ */
+#ifndef NETWORKANALYSIS_H
+#define NETWORKANALYSIS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+class Graph;
+
+class NetworkAnalysis{
+protected:
+	/// \brief An open edge out of a vertex, in the flattened adjacency.
+	struct Arc{
+		int to;
+		int edge;
+	};
+	/// \brief What a worker keeps while summing the paths from its sources.
+	struct Worker{
+		std::vector<int> dist; ///< Edges from the source, -1 where not reached
+		std::vector<double> sigma; ///< Shortest paths from the source
+		std::vector<double> delta; ///< Dependency of the source on each vertex
+		std::vector<int> order; ///< Vertices in the order the search reached them
+		std::vector<double> sum; ///< Betweenness per edge id from this worker's sources
+	};
+	bool labeled; ///< Whether component still fits the network
+	std::vector<int> component; ///< Label of each vertex id, numbered in the order of their first vertex
+	std::vector<int> componentSize;
+	std::vector<int> arcBegin; ///< Arcs of vertex v are arcs[arcBegin[v]] .. arcs[arcBegin[v+1]-1]
+	std::vector<Arc> arcs;
+	std::vector<int> sources;
+	std::vector<int> scratch; ///< For buildArcs() and labelComponents(), which run again whenever the network changes
+	std::vector<double> betweenness; ///< Per edge id
+	std::vector<Worker> workerState;
+	int workers;
+	void buildArcs(const Graph &graph);
+	void accumulate(int source, Worker &w, bool linear)const;
+public:
+	NetworkAnalysis() : labeled(false), workers(1){}
+	int getWorkers()const{return workers;}
+	void setWorkers(int workers);
+	void labelComponents(const Graph &graph);
+	/// \brief Marks the labels out of date, after a road was opened, closed or added.
+	void invalidate(){labeled = false;}
+	/// \brief Whether any path joins vertex ids a and b, labelling the network first if it changed.
+	bool isConnected(const Graph &graph, int a, int b){
+		if(!labeled)
+			labelComponents(graph);
+		return component[a] == component[b];
+	}
+	int getComponent(int vertex)const{return component[vertex];}
+	int getComponentCount()const{return int(componentSize.size());}
+	int getComponentSize(int label)const{return componentSize[label];}
+	double getRoutableShare()const;
+	void computeBetweenness(const Graph &graph, int samples = 0, uint32_t seed = 1);
+	/// \brief Betweenness of each edge id at the last computeBetweenness(), over ordered pairs of vertices.
+	const std::vector<double> &getBetweenness()const{return betweenness;}
+	size_t getMemoryUsage()const;
+};
+
+#endif
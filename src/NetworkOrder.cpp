@@ -0,0 +1,167 @@
+/** \file NetworkOrder.cpp
+ * \brief Implementation of NetworkOrder class
+ */
+
+#include "NetworkOrder.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+
+/// \brief Distance of cell (x, y) along the Hilbert curve filling a side by side grid, side being a power of two.
+static uint64_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y){
+	uint64_t d = 0;
+	for(uint32_t s = side / 2; 0 < s; s /= 2){
+		uint32_t rx = (x & s) ? 1 : 0, ry = (y & s) ? 1 : 0;
+		d += uint64_t(s) * s * ((3 * rx) ^ ry);
+		// Turn the quadrant so that the curve inside it starts where it enters
+		if(!ry){
+			if(rx){
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+/// \brief Fills order with the vertex ids of graph along a Hilbert curve over their bounding box.
+///
+/// order[i] is the id of the vertex to become vertex i, as Graph::reorder() takes it.
+void NetworkOrder::hilbert(const Graph &graph, std::vector<int> &order){
+	static const uint32_t side = 1 << 16;
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	double lo[2] = {0., 0.}, hi[2] = {0., 0.};
+	for(size_t i = 0; i < vertices.size(); i++){
+		double pos[2];
+		vertices[i]->getPos(pos);
+		for(int j = 0; j < 2; j++){
+			if(i == 0 || pos[j] < lo[j])
+				lo[j] = pos[j];
+			if(i == 0 || hi[j] < pos[j])
+				hi[j] = pos[j];
+		}
+	}
+	double scale = std::max(hi[0] - lo[0], hi[1] - lo[1]);
+	scale = 0. < scale ? (side - 1) / scale : 0.;
+	std::vector<std::pair<uint64_t, int> > keys(vertices.size());
+	for(size_t i = 0; i < vertices.size(); i++){
+		double pos[2];
+		vertices[i]->getPos(pos);
+		keys[i].first = hilbertIndex(side, uint32_t((pos[0] - lo[0]) * scale), uint32_t((pos[1] - lo[1]) * scale));
+		keys[i].second = int(i);
+	}
+	std::sort(keys.begin(), keys.end());
+	order.resize(keys.size());
+	for(size_t i = 0; i < keys.size(); i++)
+		order[i] = keys[i].second;
+}
+
+/// \brief Fills buf with the neighbours of v, fewest roads first.
+static void sortedNeighbours(const GraphVertex *v, std::vector<const GraphVertex*> &buf){
+	buf.clear();
+	for(GraphVertex::EdgeMap::const_iterator it = v->getEdges().begin(); it != v->getEdges().end(); ++it){
+		if(it->first != v)
+			buf.push_back(it->first);
+	}
+	std::sort(buf.begin(), buf.end(), [](const GraphVertex *a, const GraphVertex *b){
+		size_t da = a->getEdges().size(), db = b->getEdges().size();
+		return da != db ? da < db : a->getId() < b->getId();
+	});
+}
+
+/// \brief Fills order with the vertex ids of graph in reverse Cuthill-McKee order.
+///
+/// Each component is numbered by breadth-first levels, the neighbours of a
+/// vertex fewest roads first, starting from a vertex found at the rim of the
+/// component by the George-Liu search.  Reversing the result keeps the
+/// bandwidth and lowers the fill, which matters little here, but it is the
+/// usual form.
+void NetworkOrder::reverseCuthillMcKee(const Graph &graph, std::vector<int> &order){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	size_t n = vertices.size();
+	std::vector<int> byDegree(n);
+	for(size_t i = 0; i < n; i++)
+		byDegree[i] = int(i);
+	std::stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b){
+		return vertices[a]->getEdges().size() < vertices[b]->getEdges().size();
+	});
+	std::vector<char> visited(n, 0);
+	std::vector<int> level(n, -1); // Distance from the candidate start, for finding the rim
+	std::vector<int> queue;
+	std::vector<const GraphVertex*> neighbours;
+	order.clear();
+	order.reserve(n);
+	for(size_t c = 0; c < n; c++){
+		int start = byDegree[c];
+		if(visited[start])
+			continue;
+
+		// Start again from the vertex of fewest roads on the last level while that gets farther.
+		int eccentricity = -1;
+		for(int tries = 0; tries < 8; tries++){
+			queue.assign(1, start);
+			level[start] = 0;
+			for(size_t head = 0; head < queue.size(); head++){
+				const GraphVertex *v = vertices[queue[head]];
+				for(GraphVertex::EdgeMap::const_iterator it = v->getEdges().begin(); it != v->getEdges().end(); ++it){
+					int w = it->first->getId();
+					if(level[w] < 0){
+						level[w] = level[v->getId()] + 1;
+						queue.push_back(w);
+					}
+				}
+			}
+			int depth = level[queue.back()];
+			int rim = queue.back();
+			for(size_t k = queue.size(); 0 < k-- && level[queue[k]] == depth;){
+				if(vertices[queue[k]]->getEdges().size() <= vertices[rim]->getEdges().size())
+					rim = queue[k];
+			}
+			for(size_t k = 0; k < queue.size(); k++)
+				level[queue[k]] = -1;
+			if(depth <= eccentricity)
+				break;
+			eccentricity = depth;
+			start = rim;
+		}
+
+		size_t head = order.size();
+		order.push_back(start);
+		visited[start] = 1;
+		for(; head < order.size(); head++){
+			sortedNeighbours(vertices[order[head]], neighbours);
+			for(size_t k = 0; k < neighbours.size(); k++){
+				int w = neighbours[k]->getId();
+				if(!visited[w]){
+					visited[w] = 1;
+					order.push_back(w);
+				}
+			}
+		}
+	}
+	std::reverse(order.begin(), order.end());
+}
+
+/// \brief Fills order for kind, one of Kind.
+void NetworkOrder::compute(const Graph &graph, int kind, std::vector<int> &order){
+	if(kind == orderCuthillMcKee)
+		reverseCuthillMcKee(graph, order);
+	else
+		hilbert(graph, order);
+}
+
+/// \brief Mean difference between the ids of the two ends of the roads of graph.
+double NetworkOrder::getMeanSpan(const Graph &graph){
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	double sum = 0.;
+	for(size_t i = 0; i < edges.size(); i++)
+		sum += abs(edges[i]->getStart()->getId() - edges[i]->getEnd()->getId());
+	return edges.empty() ? 0. : sum / edges.size();
+}
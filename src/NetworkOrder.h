@@ -0,0 +1,32 @@
+/** \file NetworkOrder.h
+ * \brief Orders of the vertices that keep neighbouring roads close in memory
+ *
+ * The random network numbers its vertices in the order they were drawn, so
+ * the ends of a road, and the arrays indexed by their ids, lie anywhere in
+ * memory.  Graph::reorder() renumbers the network in one of these orders and
+ * rebuilds its objects in it, so that a search or a sweep over a patch of
+ * the map touches a few cache lines instead of one per vertex.
+ *
+ * A Hilbert curve through the vertex positions keeps vertices near on the
+ * map near in the order.  Reverse Cuthill-McKee only looks at the roads: it
+ * numbers the vertices by breadth-first levels from a vertex at the rim of
+ * each component, which keeps the ids of the two ends of every road close.
+ */
+#ifndef NETWORKORDER_H
+#define NETWORKORDER_H
+
+#include <vector>
+
+
+class Graph;
+
+class NetworkOrder{
+public:
+	enum Kind{orderHilbert, orderCuthillMcKee};
+	static void hilbert(const Graph &graph, std::vector<int> &order);
+	static void reverseCuthillMcKee(const Graph &graph, std::vector<int> &order);
+	static void compute(const Graph &graph, int kind, std::vector<int> &order);
+	static double getMeanSpan(const Graph &graph);
+};
+
+#endif
@@ -0,0 +1,60 @@
+/** \file ObjectArena.h
+ * \brief Definition of ObjectArena class template
+ */
+#ifndef OBJECTARENA_H
+#define OBJECTARENA_H
+
+#include <stddef.h>
+
+#include <vector>
+#include <new>
+
+
+/// \brief Owns objects of type T, constructed in blocks of blockSize and destroyed all at once.
+///
+/// Objects never move, so pointers to them stay valid until clear().  The
+/// blocks are kept by clear(), so building as many objects again does not
+/// allocate.
+template<typename T, size_t blockSize = 256>
+class ObjectArena{
+	std::vector<char*> blocks;
+	size_t count; ///< Objects constructed, filling the blocks in order
+	ObjectArena(const ObjectArena&);
+	ObjectArena &operator=(const ObjectArena&);
+	T *slot(size_t i){return reinterpret_cast<T*>(blocks[i / blockSize] + i % blockSize * sizeof(T));}
+	T *allocate(){
+		if(count == blocks.size() * blockSize)
+			blocks.push_back(new char[blockSize * sizeof(T)]);
+		return slot(count++);
+	}
+public:
+	ObjectArena() : count(0){}
+	~ObjectArena(){
+		clear();
+		for(size_t i = 0; i < blocks.size(); i++)
+			delete[] blocks[i];
+	}
+	template<typename A, typename B>
+	T *create(A a, B b){T *p = allocate(); return new(p) T(a, b);}
+	template<typename A, typename B, typename C>
+	T *create(A a, B b, C c){T *p = allocate(); return new(p) T(a, b, c);}
+	/// \brief Destroys every object, latest first, and keeps the blocks.
+	void clear(){truncate(0);}
+	/// \brief Destroys the objects after the first count, latest first, and keeps the blocks.
+	void truncate(size_t count){
+		while(count < this->count)
+			slot(--this->count)->~T();
+	}
+	/// \brief Trades objects and blocks with o, whose pointers stay valid.
+	void swap(ObjectArena &o){
+		blocks.swap(o.blocks);
+		size_t c = count;
+		count = o.count;
+		o.count = c;
+	}
+	size_t size()const{return count;}
+	size_t getBlockCount()const{return blocks.size();}
+	static size_t getBlockBytes(){return blockSize * sizeof(T);}
+};
+
+#endif
@@ -0,0 +1,205 @@
+/** \file PerfCounters.cpp
+ * \brief Implementation of the hardware performance counters
+ */
+
+#include "PerfCounters.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+const char *const PerfCounters::phaseNames[phaseCount] = {"idle", "spawn", "route", "step", "handoff", "stats", "draw"};
+const char *const PerfCounters::counterNames[counterCount] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+PerfCounters::PerfCounters() : groupSize(0), lastEnabled(0), lastRunning(0), current(phaseIdle), fp(NULL), exportInterval(1){
+	for(int c = 0; c < counterCount; c++){
+		fds[c] = -1;
+		groupIndex[c] = -1;
+		last[c] = 0;
+	}
+	memset(interval, 0, sizeof interval);
+	memset(total, 0, sizeof total);
+	lastTime = std::chrono::steady_clock::now();
+}
+
+PerfCounters::~PerfCounters(){
+#ifdef __linux__
+	for(int c = 0; c < counterCount; c++)
+		if(0 <= fds[c])
+			close(fds[c]);
+#endif
+	if(fp)
+		fclose(fp);
+}
+
+/// \brief Starts counting in the calling thread.
+///
+/// Counters the processor or the kernel does not provide are left out.
+/// \returns Whether any counter could be opened; wall times are measured either way.
+bool PerfCounters::open(){
+#ifdef __linux__
+	static const uint32_t types[counterCount] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+	static const uint64_t configs[counterCount] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+	};
+	int leader = -1;
+	for(int c = 0; c < counterCount; c++){
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = types[c];
+		attr.config = configs[c];
+		attr.disabled = leader < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fds[c] = int(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+		if(fds[c] < 0)
+			continue;
+		if(leader < 0)
+			leader = fds[c];
+		groupIndex[c] = groupSize++;
+	}
+	if(leader < 0)
+		return false;
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	readGroup(last, lastEnabled, lastRunning);
+	lastTime = std::chrono::steady_clock::now();
+	return true;
+#else
+	return false;
+#endif
+}
+
+/// \brief Reads the raw counts of the group and how long it was enabled and running.
+bool PerfCounters::readGroup(uint64_t counts[counterCount], uint64_t &enabled, uint64_t &running){
+#ifdef __linux__
+	uint64_t buf[3 + counterCount];
+	int leader = -1;
+	for(int c = 0; c < counterCount && leader < 0; c++)
+		leader = fds[c];
+	if(leader < 0 || read(leader, buf, sizeof buf) < ssize_t(sizeof(uint64_t) * (3 + groupSize)))
+		return false;
+	enabled = buf[1];
+	running = buf[2];
+	for(int c = 0; c < counterCount; c++)
+		counts[c] = groupIndex[c] < 0 ? 0 : buf[3 + groupIndex[c]];
+	return true;
+#else
+	return false;
+#endif
+}
+
+/// \brief Writes a row for every phase every interval ticks into fileName, as comma separated values.
+///
+/// The counts are raw and per unit of work, a vehicle or an edge in a tick as
+/// isPerEdge() tells, so runs of different sizes can be compared.
+bool PerfCounters::exportTo(const char *fileName, int interval){
+	fp = fopen(fileName, "w");
+	if(!fp)
+		return false;
+	exportInterval = interval < 1 ? 1 : interval;
+	fprintf(fp, "tick,phase,seconds,unit,units");
+	for(int c = 0; c < counterCount; c++)
+		fprintf(fp, ",%s", counterNames[c]);
+	for(int c = 0; c < counterCount; c++)
+		fprintf(fp, ",%s_per_unit", counterNames[c]);
+	fprintf(fp, "\n");
+	return true;
+}
+
+/// \brief Charges everything since the last switch to the current phase and switches to phase.
+/// \returns The phase left, to enter again when phase is done.
+int PerfCounters::enter(int phase){
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - lastTime).count();
+	interval[current].seconds += seconds;
+	total[current].seconds += seconds;
+	lastTime = now;
+	uint64_t counts[counterCount], enabled, running;
+	if(isCounting() && readGroup(counts, enabled, running)){
+		// Scale up for the time the kernel had the group multiplexed out.
+		double scale = running == lastRunning ? 1. : double(enabled - lastEnabled) / double(running - lastRunning);
+		for(int c = 0; c < counterCount; c++){
+			uint64_t delta = uint64_t((counts[c] - last[c]) * scale);
+			interval[current].counts[c] += delta;
+			total[current].counts[c] += delta;
+			last[c] = counts[c];
+		}
+		lastEnabled = enabled;
+		lastRunning = running;
+	}
+	int left = current;
+	current = phase;
+	return left;
+}
+
+/// \brief Counts the units of work of the tick just finished and exports the phases if the interval is over.
+void PerfCounters::endTick(int tick, size_t vehicles, size_t edges){
+	for(int p = 0; p < phaseCount; p++){
+		double units = double(isPerEdge(p) ? edges : vehicles);
+		interval[p].units += units;
+		total[p].units += units;
+	}
+	if(fp && tick % exportInterval == 0)
+		writeRows(tick);
+}
+
+void PerfCounters::writeRows(int tick){
+	for(int p = phaseIdle + 1; p < phaseCount; p++){
+		const Totals &t = interval[p];
+		fprintf(fp, "%d,%s,%g,%s,%g", tick, phaseNames[p], t.seconds, isPerEdge(p) ? "edge" : "vehicle", t.units);
+		for(int c = 0; c < counterCount; c++){
+			if(hasCounter(c))
+				fprintf(fp, ",%llu", (unsigned long long)t.counts[c]);
+			else
+				fprintf(fp, ",");
+		}
+		for(int c = 0; c < counterCount; c++){
+			if(hasCounter(c) && 0. < t.units)
+				fprintf(fp, ",%g", t.counts[c] / t.units);
+			else
+				fprintf(fp, ",");
+		}
+		fprintf(fp, "\n");
+	}
+	memset(interval, 0, sizeof interval);
+}
+
+/// \brief Prints the totals of the whole run per unit of work.
+void PerfCounters::print(FILE *out)const{
+	fprintf(out, "%-8s %5s %10s %12s %8s %12s %12s %12s\n", "phase", "unit", "seconds", "cycles/unit", "IPC", "L1D miss", "LLC miss", "br miss");
+	for(int p = phaseIdle + 1; p < phaseCount; p++){
+		const Totals &t = total[p];
+		fprintf(out, "%-8s %5s %10.4f", phaseNames[p], isPerEdge(p) ? "edge" : "veh", t.seconds);
+		double units = 0. < t.units ? t.units : 1.;
+		if(hasCounter(cycles))
+			fprintf(out, " %12.2f", t.counts[cycles] / units);
+		else
+			fprintf(out, " %12s", "-");
+		if(hasCounter(cycles) && hasCounter(instructions) && t.counts[cycles])
+			fprintf(out, " %8.3f", double(t.counts[instructions]) / t.counts[cycles]);
+		else
+			fprintf(out, " %8s", "-");
+		for(int c = l1dMisses; c < counterCount; c++){
+			if(hasCounter(c))
+				fprintf(out, " %12.4f", t.counts[c] / units);
+			else
+				fprintf(out, " %12s", "-");
+		}
+		fprintf(out, "\n");
+	}
+	if(!isCounting())
+		fprintf(out, "No hardware counters available; wall time only\n");
+}
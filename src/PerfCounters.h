@@ -0,0 +1,64 @@
+/** \file PerfCounters.h
+ * \brief Hardware performance counters of the simulation phases
+ *
+ * Wall time alone cannot tell whether a phase is slow because of cache misses,
+ * mispredicted branches or plain work.  On Linux, PerfCounters reads cycles,
+ * instructions, L1 data and last level cache misses and branch misses with
+ * perf_event_open around each phase of a tick, so that layout changes can be
+ * checked against what they are meant to cut.  Elsewhere, or where the kernel
+ * does not allow it, only the wall time of the phases is measured.
+ *
+ * Time is charged to one phase at a time: enter() charges everything since
+ * the last switch to the phase being left, so a phase entered from inside
+ * another, like routing from inside a spawn, is not counted twice.
+ */
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+
+
+class PerfCounters{
+public:
+	enum Phase{phaseIdle, phaseSpawn, phaseRoute, phaseStep, phaseHandOff, phaseStats, phaseDraw, phaseCount};
+	enum Counter{cycles, instructions, l1dMisses, llcMisses, branchMisses, counterCount};
+	static const char *const phaseNames[phaseCount];
+	static const char *const counterNames[counterCount];
+protected:
+	/// \brief What a phase has taken over some ticks.
+	struct Totals{
+		double seconds;
+		double units; ///< Vehicle or edge ticks, see isPerEdge()
+		uint64_t counts[counterCount];
+	};
+	int fds[counterCount]; ///< -1 where the counter is not available
+	int groupIndex[counterCount]; ///< Position in the group read, -1 where not opened
+	int groupSize;
+	uint64_t last[counterCount]; ///< Raw counts at the last switch
+	uint64_t lastEnabled, lastRunning; ///< Time the group was enabled and counting at the last switch
+	std::chrono::steady_clock::time_point lastTime;
+	int current;
+	Totals interval[phaseCount]; ///< Since the last exported row
+	Totals total[phaseCount];
+	FILE *fp;
+	int exportInterval;
+	bool readGroup(uint64_t counts[counterCount], uint64_t &enabled, uint64_t &running);
+	void writeRows(int tick);
+public:
+	PerfCounters();
+	~PerfCounters();
+	bool open();
+	bool isCounting()const{return 0 < groupSize;}
+	bool hasCounter(int c)const{return 0 <= fds[c];}
+	bool exportTo(const char *fileName, int interval);
+	int enter(int phase);
+	void endTick(int tick, size_t vehicles, size_t edges);
+	void print(FILE *out)const;
+	/// \brief Whether a phase's work scales with the edges rather than the vehicles.
+	static bool isPerEdge(int phase){return phase == phaseRoute || phase == phaseDraw;}
+};
+
+#endif
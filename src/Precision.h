@@ -0,0 +1,72 @@
+/** \file Precision.h
+ * \brief Number formats of the vehicle kinematics, chosen at compile time
+ *
+ * The stepping loop streams over every vehicle's position, velocity,
+ * acceleration and edge length each tick, so their width decides its memory
+ * traffic.  Define TRAFFIC_PRECISION to one of the policies below to build
+ * the simulator with it; the default is DoublePrecision.  Whatever the
+ * policy, the rest of the simulator sees positions as distances in double
+ * through KinematicsArraysT's accessors.
+ *
+ * Run with --validate-precision to see how far the narrower formats drift
+ * from double on the lanes of a live run.
+ */
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/// \brief Everything in double; the reference the others are checked against.
+struct DoublePrecision{
+	typedef double Real; ///< Velocity, acceleration and edge length
+	typedef double Pos; ///< Distance along the edge
+	static const char *getName(){return "double";}
+	static double toDistance(Pos pos, Real length){return pos;}
+	static Pos fromDistance(double distance, Real length){return distance;}
+	static bool isPast(Pos pos, Real length){return length < pos;}
+	static void step(Pos *pos, Real *velocity, const Real *accel, const Real *length,
+		size_t count, double dt, uint64_t *exitMask);
+};
+
+/// \brief Everything in float, which halves the bytes per vehicle.
+///
+/// Positions keep about 7 significant digits, which is plenty for the
+/// distance along one edge since it restarts from zero at every hand-off.
+struct FloatPrecision{
+	typedef float Real;
+	typedef float Pos;
+	static const char *getName(){return "float";}
+	static double toDistance(Pos pos, Real length){return pos;}
+	static Pos fromDistance(double distance, Real length){return Pos(distance);}
+	static bool isPast(Pos pos, Real length){return length < pos;}
+	static void step(Pos *pos, Real *velocity, const Real *accel, const Real *length,
+		size_t count, double dt, uint64_t *exitMask);
+};
+
+/// \brief Position as a 32 bit fixed point fraction of the edge length, the rest in float.
+///
+/// The resolution is the same on every edge, 2^-30 of its length, and adding
+/// a step is an exact integer addition.  The two spare bits let a long step
+/// run up to three edge lengths past the end; it saturates beyond that.
+struct FixedPrecision{
+	typedef float Real;
+	typedef uint32_t Pos;
+	static const uint32_t one = uint32_t(1) << 30; ///< Pos of the end of the edge
+	static const char *getName(){return "fixed";}
+	static double toDistance(Pos pos, Real length){return double(pos) / one * length;}
+	static Pos fromDistance(double distance, Real length){
+		double f = distance / length * one + .5;
+		return f <= 0. ? 0 : f < 4294967295. ? Pos(f) : Pos(4294967295u);
+	}
+	static bool isPast(Pos pos, Real length){return one < pos;}
+	static void step(Pos *pos, Real *velocity, const Real *accel, const Real *length,
+		size_t count, double dt, uint64_t *exitMask);
+};
+
+#ifndef TRAFFIC_PRECISION
+#define TRAFFIC_PRECISION DoublePrecision
+#endif
+
+#endif
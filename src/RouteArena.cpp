@@ -0,0 +1,182 @@
+/** \file RouteArena.cpp
+ * \brief Implementation of RouteArena class
+ */
+
+#include "RouteArena.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "MemoryReport.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include <algorithm>
+
+
+uint64_t RouteArena::hashRoute(uint32_t start, const uint32_t *edges, size_t count){
+	uint64_t h = 14695981039346656037ULL;
+	h = (h ^ start) * 1099511628211ULL;
+	for(size_t i = 0; i < count; i++)
+		h = (h ^ edges[i]) * 1099511628211ULL;
+	return h;
+}
+
+/// \brief Returns the id of the route entering edges[0] from vertex start, adding it if it is new.
+///
+/// The caller owns one reference to the returned route.
+RouteArena::RouteId RouteArena::intern(uint32_t start, const uint32_t *edges, size_t count){
+	uint64_t hash = hashRoute(start, edges, count);
+	size_t mask = index.size() - 1;
+	for(size_t i = hash & mask; !index.empty() && index[i] != none; i = (i + 1) & mask){
+		Route &r = routes[index[i]];
+		if(r.hash == hash && r.start == start && r.length == count && !memcmp(&pool[r.offset], edges, count * sizeof *edges)){
+			r.refs++;
+			return index[i];
+		}
+	}
+
+	RouteId id;
+	if(freeIds.empty()){
+		id = RouteId(routes.size());
+		routes.push_back(Route());
+	}
+	else{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	Route &r = routes[id];
+	r.offset = uint32_t(pool.size());
+	r.length = uint32_t(count);
+	r.start = start;
+	r.refs = 1;
+	r.hash = hash;
+	pool.insert(pool.end(), edges, edges + count);
+	addIndex(id);
+	return id;
+}
+
+/// \brief Rebuilds the index as a table of size entries, a power of two.
+void RouteArena::resizeIndex(size_t size){
+	std::vector<RouteId> old(size, RouteId(none));
+	old.swap(index);
+	indexed = 0;
+	for(size_t i = 0; i < old.size(); i++){
+		if(old[i] != none)
+			addIndex(old[i]);
+	}
+}
+
+/// \brief Adds route to the index, doubling the table when it would be more than half full.
+void RouteArena::addIndex(RouteId route){
+	if(index.size() < 2 * (indexed + 1))
+		resizeIndex(std::max(size_t(64), index.size() * 2));
+	size_t mask = index.size() - 1;
+	size_t i = routes[route].hash & mask;
+	while(index[i] != none)
+		i = (i + 1) & mask;
+	index[i] = route;
+	indexed++;
+}
+
+/// \brief Takes route out of the index, moving back the entries that probed past it.
+void RouteArena::removeIndex(RouteId route){
+	size_t mask = index.size() - 1;
+	size_t i = routes[route].hash & mask;
+	while(index[i] != route)
+		i = (i + 1) & mask;
+	for(size_t j = (i + 1) & mask; index[j] != none; j = (j + 1) & mask){
+		// An entry can fill the hole only if the hole lies between its home slot and j.
+		size_t home = routes[index[j]].hash & mask;
+		if(((j - home) & mask) >= ((j - i) & mask)){
+			index[i] = index[j];
+			i = j;
+		}
+	}
+	index[i] = none;
+	indexed--;
+}
+
+/// \brief Interns a vertex path as produced by the route searches, destination first.
+/// \param firstEdge If given, an edge leading into path.back() that is prepended to the route.
+RouteArena::RouteId RouteArena::intern(const std::vector<GraphVertex*> &path, const GraphEdge *firstEdge){
+	scratch.clear();
+	uint32_t start = path.back()->getId();
+	if(firstEdge){
+		scratch.push_back(firstEdge->getId());
+		start = firstEdge->getOther(path.back())->getId();
+	}
+	for(size_t i = path.size() - 1; 0 < i; i--){
+		GraphVertex::EdgeMap::const_iterator it = path[i]->getEdges().find(path[i - 1]);
+		assert(it != path[i]->getEdges().end());
+		scratch.push_back(it->second->getId());
+	}
+	return intern(start, scratch.empty() ? NULL : &scratch.front(), scratch.size());
+}
+
+/// \brief Drops a reference to route, freeing it when nobody uses it any more.
+void RouteArena::release(RouteId route){
+	Route &r = routes[route];
+	if(--r.refs)
+		return;
+	removeIndex(route);
+	garbage += r.length;
+	r.length = 0;
+	freeIds.push_back(route);
+	if(4096 < pool.size() && pool.size() < 2 * garbage)
+		compact();
+}
+
+/// \brief Makes room for routeCount live routes of edgeCount edges in all, none longer than longest, so that interning up to that does not allocate.
+///
+/// The pool is only compacted once its holes make up half of it, so it is
+/// given room for twice edgeCount.
+void RouteArena::reserve(size_t routeCount, size_t edgeCount, size_t longest){
+	routes.reserve(routeCount);
+	freeIds.reserve(routeCount);
+	live.reserve(routeCount);
+	pool.reserve(std::max(size_t(4096), 2 * edgeCount) + longest);
+	scratch.reserve(longest);
+	size_t size = 64;
+	while(size < 2 * (routeCount + 1))
+		size *= 2;
+	if(index.size() < size)
+		resizeIndex(size);
+}
+
+static bool offsetLess(const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b){
+	return a.first < b.first;
+}
+
+/// \brief Slides the live routes down over the holes, keeping their order in the pool.
+void RouteArena::compact(){
+	live.clear(); // (offset, id)
+	for(size_t i = 0; i < routes.size(); i++){
+		if(routes[i].refs)
+			live.push_back(std::make_pair(routes[i].offset, uint32_t(i)));
+	}
+	std::sort(live.begin(), live.end(), offsetLess);
+	uint32_t used = 0;
+	for(size_t i = 0; i < live.size(); i++){
+		Route &r = routes[live[i].second];
+		memmove(&pool[used], &pool[r.offset], r.length * sizeof(uint32_t));
+		r.offset = used;
+		used += r.length;
+	}
+	pool.resize(used);
+	garbage = 0;
+}
+
+size_t RouteArena::getMemoryUsage()const{
+	return MemoryReport::vectorBytes(routes) + MemoryReport::vectorBytes(freeIds) + MemoryReport::vectorBytes(pool)
+		+ MemoryReport::vectorBytes(index) + MemoryReport::vectorBytes(scratch) + MemoryReport::vectorBytes(live);
+}
+
+void RouteArena::clear(){
+	routes.clear();
+	freeIds.clear();
+	pool.clear();
+	// The table keeps its size, so that interning as many routes again does not allocate.
+	std::fill(index.begin(), index.end(), RouteId(none));
+	indexed = 0;
+	garbage = 0;
+}
@@ -0,0 +1,69 @@
+/** \file RouteArena.h
+ * \brief Definition of RouteArena class
+ */
+#ifndef ROUTEARENA_H
+#define ROUTEARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+class GraphVertex;
+class GraphEdge;
+
+/// \brief Shared store of vehicle routes as sequences of 32-bit edge ids.
+///
+/// Identical routes are interned once and reference counted, so vehicles
+/// only carry a route id and a cursor into it.  Released routes leave holes
+/// in the pool that are squeezed out once they make up half of it; ids stay
+/// valid across compaction.
+///
+/// Once the pool, the route table and the index have grown to the traffic
+/// they carry, interning and releasing routes does not allocate.
+class RouteArena{
+public:
+	typedef uint32_t RouteId;
+	static const RouteId none = 0xffffffff;
+protected:
+	struct Route{
+		uint32_t offset;
+		uint32_t length;
+		uint32_t start; ///< Vertex id the first edge is entered from
+		uint32_t refs;
+		uint64_t hash;
+	};
+	std::vector<Route> routes;
+	std::vector<RouteId> freeIds;
+	std::vector<uint32_t> pool;
+	size_t garbage; ///< Pool entries belonging to released routes
+	std::vector<RouteId> index; ///< Live route ids by hash, open addressed with linear probing; none where empty
+	size_t indexed; ///< Ids in index
+	std::vector<uint32_t> scratch;
+	std::vector<std::pair<uint32_t, uint32_t> > live; ///< Scratch for compact()
+
+	static uint64_t hashRoute(uint32_t start, const uint32_t *edges, size_t count);
+	void resizeIndex(size_t size);
+	void addIndex(RouteId route);
+	void removeIndex(RouteId route);
+	void compact();
+public:
+	RouteArena() : garbage(0), indexed(0){}
+	RouteId intern(uint32_t start, const uint32_t *edges, size_t count);
+	RouteId intern(const std::vector<GraphVertex*> &path, const GraphEdge *firstEdge = NULL);
+	void addRef(RouteId route){routes[route].refs++;}
+	void release(RouteId route);
+	void reserve(size_t routeCount, size_t edgeCount, size_t longest);
+	uint32_t getStart(RouteId route)const{return routes[route].start;}
+	uint32_t getLength(RouteId route)const{return routes[route].length;}
+	uint32_t getEdge(RouteId route, uint32_t i)const{return pool[routes[route].offset + i];}
+	const uint32_t *getEdges(RouteId route)const{return &pool[routes[route].offset];}
+	size_t getRouteCount()const{return routes.size() - freeIds.size();}
+	size_t getIdLimit()const{return routes.size();} ///< One past the largest id in use
+	size_t getPoolSize()const{return pool.size();}
+	size_t getMemoryUsage()const;
+	void clear();
+};
+
+#endif
@@ -0,0 +1,187 @@
+/** \file RouteService.cpp
+ * \brief Implementation of RouteService class
+ */
+
+#include "RouteService.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "ContractionHierarchy.h"
+#include "MemoryReport.h"
+#include "StateBuffer.h"
+
+
+/// \brief Starts workers threads searching the requests of graph, after stopping those running.
+void RouteService::start(const Graph &graph, int workers){
+	stop();
+	this->graph = &graph;
+	for(int i = 0; i < workers; i++)
+		this->workers.push_back(std::thread(&RouteService::work, this));
+}
+
+/// \brief Stops the workers once their searches end; the requests stay for collect().
+void RouteService::stop(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queued.notify_all();
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = false;
+}
+
+void RouteService::work(){
+	PathSearch search;
+	RouteQuery query;
+	Vehicle::Path path;
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;){
+		while(!stopping && (editing || count <= nextPending))
+			queued.wait(lock);
+		if(stopping)
+			return;
+		size_t i = nextPending++;
+		Request &r = requests[i];
+		r.state = stateSearching;
+		uint32_t s = r.serial = ++serial;
+		const GraphVertex *dest = r.dest;
+		GraphVertex *start = graph->getVertices()[r.start];
+		const ContractionHierarchy *index = graph->getRouteIndex();
+		searching++;
+		lock.unlock();
+
+		// The buffer goes on to the stepping thread, whose own searches then need not grow it.
+		path.reserve(graph->getVertices().size() + 1);
+		bool found = index ? Vehicle::findPath(graph, *index, query, search, start, dest, path)
+			: Vehicle::findPath(graph, search, start, dest, path);
+
+		lock.lock();
+		searching--;
+		idle.notify_all();
+		// Unless it was taken over, collected or handed out again meanwhile
+		if(i < count && requests[i].serial == s && requests[i].state == stateSearching){
+			requests[i].path.swap(path);
+			requests[i].found = found;
+			requests[i].state = stateDone;
+			workerSearches++;
+		}
+	}
+}
+
+/// \brief Queues the search of a route for vehicle from vertex id start to its destination.
+void RouteService::submit(Vehicle *vehicle, int start){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(count == requests.size())
+			requests.push_back(Request());
+		Request &r = requests[count++];
+		r.vehicle = vehicle;
+		r.dest = vehicle->getDest();
+		r.start = start;
+		r.state = statePending;
+		r.serial = ++serial;
+		r.found = false;
+	}
+	queued.notify_one();
+}
+
+/// \brief Returns the requests made so far in the order they were made, taking them from the workers.
+///
+/// Those not stateDone are stateTaken and left for the caller to search.
+/// They stay valid until release(), and no request may be made before.
+/// \param n Receives the number of requests.
+RouteService::Request *RouteService::collect(size_t &n){
+	std::lock_guard<std::mutex> lock(mutex);
+	for(size_t i = 0; i < count; i++){
+		if(requests[i].state != stateDone){
+			requests[i].state = stateTaken;
+			lateSearches++;
+		}
+	}
+	nextPending = count;
+	n = count;
+	return count ? &requests[0] : NULL;
+}
+
+/// \brief Forgets the requests returned by collect(), keeping their buffers.
+void RouteService::release(){
+	std::lock_guard<std::mutex> lock(mutex);
+	count = nextPending = 0;
+}
+
+/// \brief Drops every request once the searches in flight end, leaving their vehicles to the caller.
+void RouteService::clear(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(searching)
+		idle.wait(lock);
+	count = nextPending = 0;
+}
+
+void RouteService::beginEdit(){
+	std::unique_lock<std::mutex> lock(mutex);
+	editing++;
+	while(searching)
+		idle.wait(lock);
+}
+
+/// \brief Lets the workers back to the network, searching every request again on it as edited.
+void RouteService::endEdit(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		editing--;
+		for(size_t i = 0; i < count; i++){
+			requests[i].state = statePending;
+			requests[i].serial = ++serial;
+		}
+		nextPending = 0;
+	}
+	queued.notify_all();
+}
+
+/// \brief Appends the trips waiting for their route to out, which load() requests again.
+void RouteService::save(StateBuffer &out)const{
+	std::lock_guard<std::mutex> lock(mutex);
+	out.put(uint32_t(count));
+	for(size_t i = 0; i < count; i++){
+		const Vehicle *v = requests[i].vehicle;
+		out.put(v->getId());
+		out.put(v->getDeparture());
+		out.put(v->getDest()->getId());
+		out.put(requests[i].start);
+	}
+}
+
+/// \brief Requests again the trips save() wrote, with vehicles of graph.
+bool RouteService::load(StateBuffer &in, Graph &graph){
+	clear();
+	uint32_t n = in.get<uint32_t>();
+	int vertexCount = int(graph.getVertices().size());
+	for(uint32_t i = 0; in.isOk() && i < n; i++){
+		uint32_t id = in.get<uint32_t>();
+		int departure = in.get<int>();
+		int dest = in.get<int>();
+		int start = in.get<int>();
+		if(!in.isOk() || dest < 0 || vertexCount <= dest || start < 0 || vertexCount <= start)
+			return false;
+		Vehicle *v = graph.newVehicle(graph.getVertices()[dest], id);
+		v->setDeparture(departure);
+		submit(v, start);
+	}
+	return in.isOk();
+}
+
+size_t RouteService::getWorkerSearches()const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return workerSearches;
+}
+
+/// \brief Bytes held by the requests and their path buffers; the workers' own scratch is not counted.
+size_t RouteService::getMemoryUsage()const{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t ret = MemoryReport::vectorBytes(requests) + MemoryReport::vectorBytes(workers);
+	for(size_t i = 0; i < requests.size(); i++)
+		ret += MemoryReport::vectorBytes(requests[i].path);
+	return ret;
+}
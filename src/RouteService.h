@@ -0,0 +1,101 @@
+/** \file RouteService.h
+ * \brief Searching the routes of new trips on worker threads while the ticks go on
+ *
+ * A trip drawn by Graph::spawn() is queued as a request, and a pool of
+ * workers runs the path searches while the stepping thread carries on with
+ * the rest of the tick.  At the start of the next tick the graph collects
+ * every request in the order they were made and places the vehicles whose
+ * route was found, so a vehicle enters the network on the first tick after
+ * it was drawn whichever worker finished first.
+ *
+ * The stepping thread never waits for a worker: a request no worker has
+ * finished by then is searched by the stepping thread itself, and the result
+ * of a worker still busy with it is thrown away.  Either way the route is the
+ * one the search finds on the network as it is at the collection, so a run
+ * does not depend on how many workers there are or how fast they were.  The
+ * workers read the network, so an edit to it waits for the searches in
+ * flight, which takes no longer than one search, and has the requests
+ * searched again.
+ */
+#ifndef ROUTESERVICE_H
+#define ROUTESERVICE_H
+
+#include "Vehicle.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+class Graph;
+class StateBuffer;
+
+class RouteService{
+public:
+	enum State{
+		statePending, ///< Waiting for a worker
+		stateSearching, ///< Being searched by a worker
+		stateDone, ///< Searched by a worker; path holds the route if found
+		stateTaken ///< Left to the thread that collected it
+	};
+	/// \brief A trip waiting for its route.
+	struct Request{
+		Vehicle *vehicle; ///< Only the thread making requests may touch it
+		const GraphVertex *dest; ///< Copied from vehicle, which may be gone by the time a worker searches
+		int start; ///< Vertex id the trip starts from
+		int state;
+		uint32_t serial; ///< Given whenever the request is handed to a worker, so that a late result is told apart
+		bool found;
+		Vehicle::Path path;
+	};
+
+	/// \brief Keeps the workers off the network while it lives, for editing it.
+	class EditScope{
+		RouteService &service;
+	public:
+		EditScope(RouteService &service) : service(service){service.beginEdit();}
+		~EditScope(){service.endEdit();}
+	};
+protected:
+	const Graph *graph;
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable queued; ///< Signalled when a request is made or the workers are stopped
+	std::condition_variable idle; ///< Signalled when a search ends
+	std::vector<Request> requests; ///< The first count are not collected yet; the rest keep their buffers for reuse
+	size_t count;
+	size_t nextPending; ///< Requests before this one are not pending
+	int searching; ///< Workers inside a search
+	int editing; ///< Edits of the network going on, during which nobody searches
+	uint32_t serial;
+	bool stopping;
+	size_t workerSearches; ///< Requests whose worker's route was used
+	size_t lateSearches; ///< Requests searched by the collecting thread
+	void work();
+	void beginEdit();
+	void endEdit();
+public:
+	RouteService() : graph(NULL), count(0), nextPending(0), searching(0), editing(0), serial(0), stopping(false),
+		workerSearches(0), lateSearches(0){}
+	~RouteService(){stop();}
+	void start(const Graph &graph, int workers);
+	void stop();
+	int getWorkers()const{return int(workers.size());}
+	/// \brief Number of requests not collected yet; only the thread making them may ask.
+	size_t size()const{return count;}
+	void submit(Vehicle *vehicle, int start);
+	Request *collect(size_t &n);
+	void release();
+	void clear();
+	void save(StateBuffer &out)const;
+	bool load(StateBuffer &in, Graph &graph);
+	size_t getWorkerSearches()const;
+	size_t getLateSearches()const{return lateSearches;}
+	size_t getMemoryUsage()const;
+};
+
+#endif
@@ -0,0 +1,190 @@
+/** \file RouteTree.cpp
+ * \brief Implementation of RouteTree class
+ */
+
+#include "RouteTree.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "MemoryReport.h"
+
+#include <float.h>
+
+#include <algorithm>
+#include <functional>
+
+
+typedef std::pair<double, int> HeapEntry;
+
+static void pushHeap(std::vector<HeapEntry> &heap, double dist, int vertex){
+	heap.push_back(HeapEntry(dist, vertex));
+	std::push_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+}
+
+/// \brief Makes this the tree toward dest from scratch, reusing its buffers.
+void RouteTree::build(const Graph &graph, int dest, const std::vector<double> &cost, Scratch &scratch){
+	size_t n = graph.getVertices().size();
+	this->dest = dest;
+	dist.assign(n, DBL_MAX);
+	nextEdge.assign(n, int(none));
+	marked.assign(n, 0);
+	bool changed;
+	dist[dest] = 0.;
+	scratch.heap.clear();
+	pushHeap(scratch.heap, 0., dest);
+	propagate(graph, cost, scratch.heap, changed);
+}
+
+/// \brief Makes room for a network of vertices vertices, so that build() does not allocate for it.
+void RouteTree::reserve(size_t vertices){
+	dist.reserve(vertices);
+	nextEdge.reserve(vertices);
+	marked.reserve(vertices);
+}
+
+size_t RouteTree::getMemoryUsage()const{
+	return MemoryReport::heapBytes(sizeof *this) + MemoryReport::vectorBytes(dist) + MemoryReport::vectorBytes(nextEdge)
+		+ MemoryReport::vectorBytes(marked);
+}
+
+/// \brief Runs Dijkstra's relaxation from the vertices already in heap.
+void RouteTree::propagate(const Graph &graph, const std::vector<double> &cost, std::vector<HeapEntry> &heap, bool &changed){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	while(!heap.empty()){
+		std::pop_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+		HeapEntry top = heap.back();
+		heap.pop_back();
+		int x = top.second;
+		if(dist[x] < top.first)
+			continue; // Stale entry
+		const GraphVertex::EdgeMap &edges = vertices[x]->getEdges();
+		for(GraphVertex::EdgeMap::const_iterator it = edges.begin(); it != edges.end(); ++it){
+			int y = it->first->getId();
+			int f = it->second->getId();
+			double nd = dist[x] + cost[f];
+			if(nd < dist[y]){
+				dist[y] = nd;
+				if(nextEdge[y] != f){
+					nextEdge[y] = f;
+					changed = true;
+				}
+				pushHeap(heap, nd, y);
+			}
+		}
+	}
+}
+
+/// \brief Brings the tree up to date after the edges in changes got new costs.
+///
+/// An increased tree edge orphans the subtree hanging below it; those vertices
+/// are reset and reseeded from their unaffected neighbours.  A decreased edge
+/// seeds its endpoints.  Ordinary Dijkstra relaxation from the seeds then fixes
+/// everything downstream, so work is proportional to the part of the tree that
+/// really changed.
+/// \returns true if the first hop of any vertex changed.
+bool RouteTree::repair(const Graph &graph, const std::vector<double> &cost, const std::vector<EdgeCostChange> &changes, Scratch &scratch){
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	std::vector<HeapEntry> &heap = scratch.heap;
+	std::vector<int> &affected = scratch.affected;
+	heap.clear();
+	affected.clear();
+	bool changed = false;
+
+	for(size_t i = 0; i < changes.size(); i++){
+		const EdgeCostChange &c = changes[i];
+		if(cost[c.edge] <= c.oldCost)
+			continue;
+		const GraphEdge *e = edges[c.edge];
+		int child = nextEdge[e->getStart()->getId()] == c.edge ? e->getStart()->getId()
+			: nextEdge[e->getEnd()->getId()] == c.edge ? e->getEnd()->getId() : none;
+		if(child == none || marked[child])
+			continue;
+		size_t first = affected.size();
+		marked[child] = 1;
+		affected.push_back(child);
+		for(size_t j = first; j < affected.size(); j++){
+			const GraphVertex::EdgeMap &adj = vertices[affected[j]]->getEdges();
+			for(GraphVertex::EdgeMap::const_iterator it = adj.begin(); it != adj.end(); ++it){
+				int y = it->first->getId();
+				if(!marked[y] && nextEdge[y] == it->second->getId()){
+					marked[y] = 1;
+					affected.push_back(y);
+				}
+			}
+		}
+	}
+
+	std::vector<int> &oldNext = scratch.oldNext;
+	oldNext.resize(affected.size());
+	for(size_t i = 0; i < affected.size(); i++){
+		oldNext[i] = nextEdge[affected[i]];
+		dist[affected[i]] = DBL_MAX;
+		nextEdge[affected[i]] = none;
+	}
+	for(size_t i = 0; i < affected.size(); i++){
+		int x = affected[i];
+		const GraphVertex::EdgeMap &adj = vertices[x]->getEdges();
+		for(GraphVertex::EdgeMap::const_iterator it = adj.begin(); it != adj.end(); ++it){
+			int y = it->first->getId();
+			if(marked[y] || dist[y] == DBL_MAX)
+				continue;
+			double nd = dist[y] + cost[it->second->getId()];
+			if(nd < dist[x]){
+				dist[x] = nd;
+				nextEdge[x] = it->second->getId();
+			}
+		}
+		if(dist[x] != DBL_MAX)
+			pushHeap(heap, dist[x], x);
+	}
+
+	for(size_t i = 0; i < changes.size(); i++){
+		const EdgeCostChange &c = changes[i];
+		if(c.oldCost <= cost[c.edge])
+			continue;
+		int a = edges[c.edge]->getStart()->getId(), b = edges[c.edge]->getEnd()->getId();
+		for(int k = 0; k < 2; k++){
+			int x = k ? b : a, y = k ? a : b;
+			if(dist[y] != DBL_MAX && dist[y] + cost[c.edge] < dist[x]){
+				dist[x] = dist[y] + cost[c.edge];
+				if(nextEdge[x] != c.edge){
+					nextEdge[x] = c.edge;
+					changed = true;
+				}
+				pushHeap(heap, dist[x], x);
+			}
+		}
+	}
+
+	propagate(graph, cost, heap, changed);
+
+	for(size_t i = 0; i < affected.size(); i++){
+		if(nextEdge[affected[i]] != oldNext[i])
+			changed = true;
+		marked[affected[i]] = 0;
+	}
+	return changed;
+}
+
+/// \brief Fills path with the route from from to the destination.
+///
+/// The path is stored destination first, the same way Vehicle::findPath()
+/// leaves it, so that the vehicle consumes it with pop_back().
+/// \returns false if the destination is unreachable from from.
+bool RouteTree::buildPath(const Graph &graph, GraphVertex *from, Vehicle::Path &path)const{
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	if(dist[from->getId()] == DBL_MAX)
+		return false;
+	path.clear();
+	GraphVertex *v = from;
+	path.push_back(v);
+	while(v->getId() != dest){
+		v = edges[nextEdge[v->getId()]]->getOther(v);
+		path.push_back(v);
+		if(graph.getVertices().size() < path.size())
+			return false; // A broken tree would loop forever
+	}
+	std::reverse(path.begin(), path.end());
+	return true;
+}
@@ -0,0 +1,53 @@
+/** \file RouteTree.h
+ * \brief Definition of RouteTree class
+ */
+#ifndef ROUTETREE_H
+#define ROUTETREE_H
+
+#include "Vehicle.h"
+
+#include <vector>
+
+
+class Graph;
+
+/// \brief Records an edge whose travel time changed, with the value it had before.
+struct EdgeCostChange{
+	int edge;
+	double oldCost;
+};
+
+/// \brief Shortest-path tree toward a single destination vertex.
+///
+/// Every vertex knows its travel time to the destination and the edge of its
+/// first hop, so any vehicle heading there can read its route off the tree
+/// without a search.  When edge costs change, repair() only revisits the
+/// vertices whose shortest path actually went through a changed edge.
+class RouteTree{
+public:
+	static const int none = -1;
+	/// \brief Buffers for building and repairing trees, shared by the trees of a Router so they do not allocate.
+	struct Scratch{
+		std::vector<std::pair<double, int> > heap;
+		std::vector<int> affected;
+		std::vector<int> oldNext;
+	};
+protected:
+	int dest;
+	std::vector<double> dist; ///< Travel time to dest per vertex id
+	std::vector<int> nextEdge; ///< Edge id of the first hop toward dest per vertex id
+	std::vector<char> marked; ///< Scratch flags used by repair()
+	void propagate(const Graph &graph, const std::vector<double> &cost, std::vector<std::pair<double, int> > &heap, bool &changed);
+public:
+	RouteTree() : dest(none){}
+	void build(const Graph &graph, int dest, const std::vector<double> &cost, Scratch &scratch);
+	void reserve(size_t vertices);
+	int getDest()const{return dest;}
+	size_t getMemoryUsage()const;
+	double getDistance(int vertex)const{return dist[vertex];}
+	int getNextEdge(int vertex)const{return nextEdge[vertex];}
+	bool repair(const Graph &graph, const std::vector<double> &cost, const std::vector<EdgeCostChange> &changes, Scratch &scratch);
+	bool buildPath(const Graph &graph, GraphVertex *from, Vehicle::Path &path)const;
+};
+
+#endif
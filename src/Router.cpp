@@ -0,0 +1,248 @@
+/** \file Router.cpp
+ * \brief Implementation of Router class
+ */
+
+#include "Router.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "MemoryReport.h"
+#include "StateBuffer.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+
+/// Speed of a vehicle on an empty road that nobody edited.
+const double Router::freeSpeed = 0.1;
+
+/// Vehicles per unit length an edge holds when it is jammed.
+const double Router::jamDensity = 20.;
+
+/// Relative change in travel time below which an edge is not reported to the trees.
+const double Router::changeThreshold = 0.05;
+
+/// Most bytes reserve() spends on spare trees.
+const size_t Router::treeReserveBytes = size_t(64) << 20;
+
+
+Router::~Router(){
+	dropTrees();
+	for(size_t i = 0; i < spareTrees.size(); i++)
+		delete spareTrees[i];
+}
+
+/// \brief Moves every cached tree to the spares.
+void Router::dropTrees(){
+	for(size_t i = 0; i < treeDests.size(); i++){
+		spareTrees.push_back(trees[treeDests[i]]);
+		trees[treeDests[i]] = NULL;
+	}
+	treeDests.clear();
+}
+
+/// \brief Forgets the travel times and the cached trees, which are kept as spares.
+void Router::clear(){
+	dropTrees();
+	cost.clear();
+	reroutes = 0;
+}
+
+/// \brief Appends the travel times and the destinations with a cached tree to out.
+///
+/// The trees are not saved; load() builds them again from the travel times.
+void Router::save(StateBuffer &out)const{
+	out.putVector(cost);
+	out.putVector(treeDests);
+	out.put(reroutes);
+}
+
+/// \brief Reads back what save() wrote and builds the trees it had cached.
+bool Router::load(StateBuffer &in, const Graph &graph){
+	clear();
+	std::vector<int> dests;
+	in.getVector(cost);
+	in.getVector(dests);
+	reroutes = in.get<int>();
+	if(!in.isOk() || (!cost.empty() && cost.size() != graph.getEdges().size())){
+		clear();
+		return false;
+	}
+	for(size_t i = 0; i < dests.size(); i++){
+		if(dests[i] < 0 || int(graph.getVertices().size()) <= dests[i]){
+			clear();
+			return false;
+		}
+		if(cost.empty())
+			continue;
+		getTree(graph, dests[i]);
+	}
+	return true;
+}
+
+/// \brief Estimated time to traverse e at its current load.
+///
+/// Uses the BPR volume-delay function, which stays at free flow time on light
+/// traffic and climbs steeply as the edge approaches its capacity.  A closed
+/// edge takes forever, which keeps it out of every tree.
+double Router::travelTime(const GraphEdge *e, int vehicles){
+	if(e->isClosed())
+		return HUGE_VAL;
+	double capacity = e->getLength() * jamDensity;
+	double ratio = capacity < 1. ? double(vehicles) : vehicles / capacity;
+	return e->getLength() / e->getSpeedLimit() * (1. + 0.15 * pow(ratio, 4));
+}
+
+/// \brief Returns the tree toward dest, building it with current costs if it is not cached.
+RouteTree *Router::getTree(const Graph &graph, int dest){
+	if(cost.size() != graph.getEdges().size()){
+		cost.resize(graph.getEdges().size());
+		for(size_t i = 0; i < cost.size(); i++)
+			cost[i] = travelTime(graph.getEdges()[i], graph.getEdgeLoad(int(i)));
+	}
+	if(trees.size() < graph.getVertices().size()){
+		// There is never more than a tree per vertex, cached or spare.
+		trees.resize(graph.getVertices().size(), NULL);
+		treeDests.reserve(trees.size());
+		spareTrees.reserve(trees.size());
+	}
+	if(trees[dest])
+		return trees[dest];
+	RouteTree *tree;
+	if(spareTrees.empty())
+		tree = new RouteTree;
+	else{
+		tree = spareTrees.back();
+		spareTrees.pop_back();
+	}
+	tree->build(graph, dest, cost, scratch);
+	trees[dest] = tree;
+	treeDests.push_back(dest);
+	return tree;
+}
+
+/// \brief Sizes the scratch buffers for the network of graph and builds spare trees for its destinations ahead of time.
+///
+/// There is a spare tree for every vertex as long as they fit in
+/// treeReserveBytes.  On a larger network, a refresh() heading vehicles to
+/// more destinations than that still allocates the trees past those.
+void Router::reserve(const Graph &graph){
+	size_t n = graph.getVertices().size(), m = graph.getEdges().size();
+	if(trees.size() < n)
+		trees.resize(n, NULL);
+	treeDests.reserve(n);
+	spareTrees.reserve(n);
+	treeStates.resize(n, 0);
+	cost.reserve(m);
+	changes.reserve(m);
+	path.reserve(n + 1);
+	// A repair seeds each vertex and both ends of each edge at most once, and
+	// Dijkstra's relaxation pushes a vertex at most once per edge into it.
+	scratch.heap.reserve(n + 4 * m);
+	scratch.affected.reserve(n);
+	scratch.oldNext.reserve(n);
+	size_t count = std::min(n, treeReserveBytes / std::max(size_t(1), n * (sizeof(double) + sizeof(int) + sizeof(char))));
+	for(size_t i = 0; i < spareTrees.size(); i++)
+		spareTrees[i]->reserve(n);
+	while(treeDests.size() + spareTrees.size() < count){
+		RouteTree *tree = new RouteTree;
+		tree->reserve(n);
+		spareTrees.push_back(tree);
+	}
+}
+
+/// \brief Updates edge travel times, repairs the cached trees and reroutes vehicles.
+///
+/// Only vehicles whose destination tree changed shape get their path rebuilt,
+/// and trees nobody is heading to any more are dropped.
+void Router::refresh(const Graph &graph, RouteArena &routes, const std::vector<Vehicle*> &vehicles){
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	changes.clear();
+	if(cost.size() != edges.size()){
+		// The network grew; start over with fresh trees.
+		dropTrees();
+		cost.clear();
+	}
+	else{
+		for(size_t i = 0; i < edges.size(); i++){
+			double t = travelTime(edges[i], graph.getEdgeLoad(int(i)));
+			if(changeThreshold * cost[i] < fabs(t - cost[i])){
+				EdgeCostChange c = {int(i), cost[i]};
+				changes.push_back(c);
+				cost[i] = t;
+			}
+		}
+	}
+
+	// Destinations in use, and whether their tree changed
+	treeStates.resize(graph.getVertices().size(), 0);
+	for(size_t i = 0; i < treeDests.size(); i++){
+		int dest = treeDests[i];
+		treeStates[dest] = !changes.empty() && trees[dest]->repair(graph, cost, changes, scratch) ? treeDirty : treeClean;
+	}
+
+	reroutes = 0;
+	for(size_t i = 0; i < vehicles.size(); i++){
+		Vehicle *v = vehicles[i];
+		int dest = v->getDest()->getId();
+		char &state = treeStates[dest];
+		state |= treeUsed;
+		if(state & treeClean)
+			continue;
+		RouteArena::RouteId old = v->getRoute();
+		if(routes.getLength(old) <= v->getCursor() + 1)
+			continue; // Already on the last edge
+		RouteTree *tree = getTree(graph, dest);
+		state |= treeDirty; // Freshly built if it was not cached; every vehicle may do better
+		GraphVertex *next = graph.getVertices()[v->getNext()->getId()];
+		if(!tree->buildPath(graph, next, path))
+			continue;
+		RouteArena::RouteId route = routes.intern(path, v->getEdge());
+		if(routes.getEdge(route, 1) != routes.getEdge(old, v->getCursor() + 1))
+			reroutes++;
+		v->reroute(routes, route);
+	}
+
+	size_t kept = 0;
+	for(size_t i = 0; i < treeDests.size(); i++){
+		int dest = treeDests[i];
+		if(treeStates[dest] & treeUsed)
+			treeDests[kept++] = dest;
+		else{
+			spareTrees.push_back(trees[dest]);
+			trees[dest] = NULL;
+		}
+		treeStates[dest] = 0;
+	}
+	treeDests.resize(kept);
+	for(size_t i = 0; i < vehicles.size(); i++)
+		treeStates[vehicles[i]->getDest()->getId()] = 0;
+}
+
+/// \brief Bytes held by the costs and the trees, cached or spare.
+size_t Router::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(cost) + MemoryReport::vectorBytes(trees) + MemoryReport::vectorBytes(treeDests)
+		+ MemoryReport::vectorBytes(spareTrees) + MemoryReport::vectorBytes(treeStates) + MemoryReport::vectorBytes(changes)
+		+ MemoryReport::vectorBytes(path) + MemoryReport::vectorBytes(scratch.heap) + MemoryReport::vectorBytes(scratch.affected)
+		+ MemoryReport::vectorBytes(scratch.oldNext);
+	for(size_t i = 0; i < treeDests.size(); i++)
+		ret += trees[treeDests[i]]->getMemoryUsage();
+	for(size_t i = 0; i < spareTrees.size(); i++)
+		ret += spareTrees[i]->getMemoryUsage();
+	return ret;
+}
+
+/// \brief Takes the new travel time of an edited or added edge into the cached trees right away.
+void Router::updateCost(const Graph &graph, int edge){
+	if(cost.empty())
+		return; // Nothing cached; getTree() starts from current costs
+	EdgeCostChange c = {edge, edge < int(cost.size()) ? cost[edge] : HUGE_VAL};
+	cost.resize(graph.getEdges().size(), HUGE_VAL);
+	cost[edge] = travelTime(graph.getEdges()[edge], graph.getEdgeLoad(edge));
+	changes.clear();
+	changes.push_back(c);
+	for(size_t i = 0; i < treeDests.size(); i++)
+		trees[treeDests[i]]->repair(graph, cost, changes, scratch);
+}
@@ -0,0 +1,62 @@
+/** \file Router.h
+ * \brief Definition of Router class
+ */
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "RouteTree.h"
+#include "RouteArena.h"
+
+#include <vector>
+
+
+class Graph;
+class GraphVertex;
+class GraphEdge;
+class Vehicle;
+class StateBuffer;
+
+/// \brief Congestion-aware rerouting of in-flight vehicles.
+///
+/// Keeps the current travel time of every edge and one RouteTree per
+/// destination that some vehicle is heading to.  Each refresh() only hands the
+/// edges whose travel time moved noticeably to the trees, which repair
+/// themselves locally instead of being rebuilt.  Trees nobody heads to any
+/// more are kept for reuse, so a refresh does not allocate once the cache has
+/// grown to the destinations in use.
+class Router{
+protected:
+	/// \brief Flags of a destination during refresh().
+	enum TreeState{treeClean = 1, treeDirty = 2, treeUsed = 4};
+	std::vector<double> cost; ///< Travel time per edge id
+	std::vector<RouteTree*> trees; ///< Cached tree per destination vertex id, NULL where there is none
+	std::vector<int> treeDests; ///< Destinations that have a cached tree
+	std::vector<RouteTree*> spareTrees; ///< Dropped trees whose buffers are reused by getTree()
+	std::vector<char> treeStates; ///< Scratch for refresh(), TreeState bits per destination vertex id
+	RouteTree::Scratch scratch;
+	std::vector<EdgeCostChange> changes; ///< Scratch buffer for refresh()
+	std::vector<GraphVertex*> path; ///< Scratch buffer for refresh()
+	int reroutes; ///< Vehicles that took a different route on the last refresh
+	void dropTrees();
+public:
+	static const double freeSpeed;
+	static const double jamDensity;
+	static const double changeThreshold;
+	static const size_t treeReserveBytes;
+
+	Router() : reroutes(0){}
+	~Router();
+	static double travelTime(const GraphEdge *e, int vehicles);
+	const std::vector<double> &getCosts()const{return cost;}
+	RouteTree *getTree(const Graph &graph, int dest);
+	void reserve(const Graph &graph);
+	void refresh(const Graph &graph, RouteArena &routes, const std::vector<Vehicle*> &vehicles);
+	void updateCost(const Graph &graph, int edge);
+	void clear();
+	void save(StateBuffer &out)const;
+	bool load(StateBuffer &in, const Graph &graph);
+	int getReroutes()const{return reroutes;}
+	size_t getMemoryUsage()const;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/** \file StateBuffer.h
+ * \brief Definition of StateBuffer class
+ */
+#ifndef STATEBUFFER_H
+#define STATEBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+
+/// \brief Bytes of a saved simulation state, written and read back in the same order.
+///
+/// Values are copied as they lie in memory, so a state only loads into the
+/// same build it was saved by.  Reading past the end leaves the values
+/// zero and marks the buffer failed rather than throwing, and the caller
+/// checks isOk() once at the end.
+class StateBuffer{
+	std::vector<char> data;
+	size_t readPos;
+	bool ok;
+public:
+	StateBuffer() : readPos(0), ok(true){}
+	void clear(){data.clear(); readPos = 0; ok = true;}
+	std::vector<char> &getData(){return data;}
+	const std::vector<char> &getData()const{return data;}
+	/// \brief Starts reading from the first byte again.
+	void rewind(){readPos = 0; ok = true;}
+	bool isOk()const{return ok && readPos <= data.size();}
+	void write(const void *p, size_t bytes){data.insert(data.end(), (const char*)p, (const char*)p + bytes);}
+	void read(void *p, size_t bytes){
+		if(!ok || data.size() - readPos < bytes){
+			memset(p, 0, bytes);
+			ok = false;
+			return;
+		}
+		memcpy(p, &data[readPos], bytes);
+		readPos += bytes;
+	}
+	template<typename T> void put(const T &v){write(&v, sizeof v);}
+	template<typename T> T get(){T v; read(&v, sizeof v); return v;}
+	template<typename T> void putVector(const std::vector<T> &v){
+		put(uint32_t(v.size()));
+		if(!v.empty())
+			write(&v[0], v.size() * sizeof(T));
+	}
+	template<typename T> void getVector(std::vector<T> &v){
+		uint32_t n = get<uint32_t>();
+		if(!ok || (data.size() - readPos) / sizeof(T) < n){
+			ok = false;
+			v.clear();
+			return;
+		}
+		v.resize(n);
+		if(n)
+			read(&v[0], n * sizeof(T));
+	}
+};
+
+#endif
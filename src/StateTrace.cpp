@@ -0,0 +1,227 @@
+/** \file StateTrace.cpp
+ * \brief Implementation of the state digests and traces
+ */
+
+#include "StateTrace.h"
+#include "Graph.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+
+/// \brief Takes the digests of graph now.
+/// \param posBits Bits of the quantized position; positions closer than 2^-posBits of the edge length count as equal
+/// \param detail Whether to keep the record of every vehicle too
+void TraceFrame::capture(const Graph &graph, int posBits, bool detail){
+	std::vector<VehiclePosition> positions;
+	graph.getVehiclePositions(positions);
+	const double scale = ldexp(1., posBits);
+	tick = graph.getTicks();
+	this->vehicles = int(positions.size());
+	placement = graph.getPlacementDigest();
+	digest = placement;
+	records.clear();
+	for(size_t i = 0; i < positions.size(); i++){
+		const Vehicle *v = positions[i].vehicle;
+		const GraphEdge *e = v->getEdge();
+		double f = floor(positions[i].pos / e->getLength() * scale + .5);
+		TraceRecord r = {v->getId(), uint32_t(e->getId() * 2 + (v->getNext() == e->getEnd())),
+			f <= 0. ? 0 : f < 4294967295. ? uint32_t(f) : 0xffffffffu};
+		digest += mixDigest(placementDigest(r.id, r.edge) ^ r.pos);
+		if(detail)
+			records.push_back(r);
+	}
+	std::sort(records.begin(), records.end());
+}
+
+bool TraceWriter::open(const char *fileName, int interval, int posBits, bool detail){
+	close();
+	fp = fopen(fileName, "w");
+	if(!fp)
+		return false;
+	this->interval = interval < 1 ? 1 : interval;
+	this->posBits = posBits;
+	this->detail = detail;
+	frames = 0;
+	fprintf(fp, "traffic-trace 1 interval %d posbits %d detail %d\n", this->interval, posBits, int(detail));
+	return true;
+}
+
+void TraceWriter::close(){
+	if(fp)
+		fclose(fp);
+	fp = NULL;
+}
+
+/// \brief Writes a frame if graph has just finished a tick the trace is taken at.
+void TraceWriter::record(const Graph &graph){
+	if(!fp || graph.getTicks() % interval)
+		return;
+	frame.capture(graph, posBits, detail);
+	fprintf(fp, "T %d %d %016llx %016llx\n", frame.tick, frame.vehicles,
+		(unsigned long long)frame.placement, (unsigned long long)frame.digest);
+	for(size_t i = 0; i < frame.records.size(); i++){
+		const TraceRecord &r = frame.records[i];
+		fprintf(fp, "V %u %u %u\n", r.id, r.edge, r.pos);
+	}
+	frames++;
+}
+
+bool TraceReader::open(const char *fileName){
+	fp = fopen(fileName, "r");
+	if(!fp){
+		fprintf(stderr, "Cannot open trace %s\n", fileName);
+		return false;
+	}
+	int version, d;
+	if(!fgets(line, sizeof line, fp)
+		|| sscanf(line, "traffic-trace %d interval %d posbits %d detail %d", &version, &interval, &posBits, &d) != 4
+		|| version != 1)
+	{
+		fprintf(stderr, "%s is not a trace\n", fileName);
+		fclose(fp);
+		fp = NULL;
+		return false;
+	}
+	detail = d != 0;
+	pending = false;
+	return true;
+}
+
+/// \brief Reads the next frame.
+/// \returns false at the end of the file.
+bool TraceReader::next(TraceFrame &frame){
+	if(!fp)
+		return false;
+	if(!pending && !fgets(line, sizeof line, fp))
+		return false;
+	unsigned long long placement, digest;
+	if(sscanf(line, "T %d %d %llx %llx", &frame.tick, &frame.vehicles, &placement, &digest) != 4)
+		return false;
+	frame.placement = placement;
+	frame.digest = digest;
+	frame.records.clear();
+	pending = false;
+	while(fgets(line, sizeof line, fp)){
+		TraceRecord r;
+		if(sscanf(line, "V %u %u %u", &r.id, &r.edge, &r.pos) != 3){
+			pending = true;
+			break;
+		}
+		frame.records.push_back(r);
+	}
+	return true;
+}
+
+static void printRecord(const char *name, const TraceRecord *r, int posBits){
+	if(r)
+		printf("  %s: edge %u toward its %s, %.6f of the way\n", name, r->edge / 2, r->edge & 1 ? "end" : "start", ldexp(double(r->pos), -posBits));
+	else
+		printf("  %s: not on the road\n", name);
+}
+
+/// \brief Prints where frames a and b of the same tick differ.
+/// \returns Whether they differ.
+bool reportDivergence(const TraceFrame &a, const TraceFrame &b, int posBits, const char *nameA, const char *nameB){
+	if(a.digest == b.digest && a.placement == b.placement && a.vehicles == b.vehicles)
+		return false;
+	printf("First divergence at tick %d: ", a.tick);
+	if(a.vehicles != b.vehicles)
+		printf("%d vehicles in %s, %d in %s\n", a.vehicles, nameA, b.vehicles, nameB);
+	else if(a.placement != b.placement)
+		printf("vehicles are on different edges\n");
+	else
+		printf("vehicles are at different positions\n");
+	if(a.records.empty() && b.records.empty() && (a.vehicles || b.vehicles)){
+		printf("Record the trace with --trace-detail to find the vehicle\n");
+		return true;
+	}
+	size_t i = 0, j = 0;
+	while(i < a.records.size() || j < b.records.size()){
+		const TraceRecord *ra = i < a.records.size() ? &a.records[i] : NULL;
+		const TraceRecord *rb = j < b.records.size() ? &b.records[j] : NULL;
+		if(ra && rb && ra->id == rb->id){
+			if(ra->edge != rb->edge || ra->pos != rb->pos){
+				printf("Vehicle %u\n", ra->id);
+				printRecord(nameA, ra, posBits);
+				printRecord(nameB, rb, posBits);
+				return true;
+			}
+			i++;
+			j++;
+			continue;
+		}
+		// The one with the lower id is missing from the other.
+		bool inA = ra && (!rb || ra->id < rb->id);
+		printf("Vehicle %u\n", inA ? ra->id : rb->id);
+		printRecord(nameA, inA ? ra : NULL, posBits);
+		printRecord(nameB, inA ? NULL : rb, posBits);
+		return true;
+	}
+	printf("No vehicle differs; a collision of the digest\n");
+	return true;
+}
+
+/// \brief Compares two traces frame by frame and reports the first divergence.
+///
+/// One that ends before the other, with frames left over at ticks it would
+/// have recorded too, was cut off and does not match, nor do two traces that
+/// share no tick.
+/// \returns 0 if they match, 1 if they differ or cannot be read.
+int compareTraces(const char *fileA, const char *fileB){
+	TraceReader a, b;
+	if(!a.open(fileA) || !b.open(fileB))
+		return 1;
+	if(a.getPosBits() != b.getPosBits()){
+		printf("The traces quantize positions to %d and %d bits\n", a.getPosBits(), b.getPosBits());
+		return 1;
+	}
+	TraceFrame fa, fb;
+	int frames = 0;
+	int lastA = -1, lastB = -1; ///< Tick of the last frame read from each
+	bool moreA = a.next(fa), moreB = b.next(fb);
+	while(moreA && moreB){
+		// Traces taken at different intervals are compared at the ticks they share.
+		if(fa.tick < fb.tick){
+			lastA = fa.tick;
+			moreA = a.next(fa);
+		}
+		else if(fb.tick < fa.tick){
+			lastB = fb.tick;
+			moreB = b.next(fb);
+		}
+		else{
+			if(reportDivergence(fa, fb, a.getPosBits(), fileA, fileB))
+				return 1;
+			frames++;
+			lastA = lastB = fa.tick;
+			moreA = a.next(fa);
+			moreB = b.next(fb);
+		}
+	}
+
+	// Whatever is left of the longer one lies past the end of the shorter.
+	const char *shortName = moreA ? fileB : fileA, *longName = moreA ? fileA : fileB;
+	int shortEnd = moreA ? lastB : lastA, shortInterval = moreA ? b.getInterval() : a.getInterval();
+	TraceReader &rest = moreA ? a : b;
+	TraceFrame &f = moreA ? fa : fb;
+	for(bool more = moreA || moreB; more; more = rest.next(f)){
+		if(f.tick % shortInterval == 0){
+			if(shortEnd < 0)
+				printf("%s has no frames, %s has one at tick %d\n", shortName, longName, f.tick);
+			else
+				printf("%s ends at tick %d, %s goes on to tick %d\n", shortName, shortEnd, longName, f.tick);
+			return 1;
+		}
+	}
+	if(!frames){
+		printf("The traces share no tick\n");
+		return 1;
+	}
+	printf("%d frames match\n", frames);
+	return 0;
+}
@@ -0,0 +1,103 @@
+/** \file StateTrace.h
+ * \brief Digests of the simulation state, and golden traces to check engines against
+ *
+ * A digest sums a scrambled hash of every vehicle's id, edge, direction and
+ * position quantized along the edge.  A sum does not depend on the order the
+ * vehicles are stored in, so an engine that steps them in another order,
+ * on other threads or in other lanes still gives the same digest for the
+ * same state.  The id, edge and direction part is kept up to date by Graph
+ * as vehicles enter and leave edges; only the positions are summed when a
+ * digest is taken.
+ *
+ * A trace is a text file of digests taken every interval ticks, optionally
+ * with every vehicle's record, so that a run can be checked against a golden
+ * trace of a trusted engine and the first tick and vehicle where they part
+ * can be reported:
+ * \code
+ * traffic-trace 1 interval 100 posbits 16 detail 1
+ * T 100 152 3f0c...  9a41...   # tick, vehicles, placement digest, full digest
+ * V 17 235 40000               # id, edge * 2 + 1 if heading to its end, position
+ * \endcode
+ */
+#ifndef STATETRACE_H
+#define STATETRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+class Graph;
+
+/// \brief Scrambles a key so that sums of them do not cancel out (the splitmix64 finalizer).
+inline uint64_t mixDigest(uint64_t x){
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+/// \brief Digest term of vehicle id being on an edge, coded as edge id * 2 plus 1 when heading to its end.
+inline uint64_t placementDigest(uint32_t id, uint32_t edgeCode){
+	return mixDigest((uint64_t(id) << 32) | edgeCode);
+}
+
+struct TraceRecord{
+	uint32_t id;
+	uint32_t edge; ///< Edge id * 2, plus 1 when heading to its end
+	uint32_t pos; ///< Fraction of the edge length in 2^-posBits
+	bool operator<(const TraceRecord &o)const{return id < o.id;}
+};
+
+/// \brief The digests of one tick, with the vehicle records when they are traced.
+struct TraceFrame{
+	int tick;
+	int vehicles;
+	uint64_t placement; ///< Digest of the ids, edges and directions only
+	uint64_t digest; ///< Digest including the positions
+	std::vector<TraceRecord> records; ///< Sorted by id; empty without detail
+	void capture(const Graph &graph, int posBits, bool detail);
+};
+
+/// \brief Appends a frame to a trace file every interval ticks.
+class TraceWriter{
+	FILE *fp;
+	int interval;
+	int posBits;
+	bool detail;
+	int frames;
+	TraceFrame frame;
+public:
+	TraceWriter() : fp(NULL), interval(1), posBits(16), detail(false), frames(0){}
+	~TraceWriter(){close();}
+	bool open(const char *fileName, int interval, int posBits, bool detail);
+	void close();
+	bool isOpen()const{return fp != NULL;}
+	void record(const Graph &graph);
+	int getFrameCount()const{return frames;}
+};
+
+class TraceReader{
+	FILE *fp;
+	int interval;
+	int posBits;
+	bool detail;
+	char line[256];
+	bool pending; ///< line holds the start of the next frame
+public:
+	TraceReader() : fp(NULL), interval(1), posBits(16), detail(false), pending(false){}
+	~TraceReader(){if(fp) fclose(fp);}
+	bool open(const char *fileName);
+	bool next(TraceFrame &frame);
+	int getInterval()const{return interval;}
+	int getPosBits()const{return posBits;}
+	bool hasDetail()const{return detail;}
+};
+
+bool reportDivergence(const TraceFrame &a, const TraceFrame &b, int posBits, const char *nameA, const char *nameB);
+int compareTraces(const char *fileA, const char *fileB);
+
+#endif
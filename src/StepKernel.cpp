@@ -0,0 +1,453 @@
+/** \file StepKernel.cpp
+ * \brief Implementation of the batched vehicle kinematics kernel
+ */
+
+#include "StepKernel.h"
+#include "Vehicle.h"
+#include "MemoryReport.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STEPKERNEL_X86 1
+#define STEPKERNEL_TARGET(isa) __attribute__((target(isa)))
+// Keep the vector and scalar paths bit-identical; a contracted multiply-add
+// in one of them would make runs depend on the CPU they happened to use.
+#ifndef __clang__
+#pragma GCC optimize("fp-contract=off")
+#endif
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define STEPKERNEL_X86 1
+#define STEPKERNEL_TARGET(isa)
+#include <intrin.h>
+#endif
+
+#ifdef STEPKERNEL_X86
+#include <immintrin.h>
+// AVX-512 intrinsics arrived with Visual Studio 2017.
+#if !defined(_MSC_VER) || 1910 <= _MSC_VER
+#define STEPKERNEL_AVX512 1
+#endif
+#endif
+
+
+/// \brief Tells v where its state lives.
+///
+/// Only the precision the simulator is built with carries vehicles; the others
+/// hold copied lanes for comparePrecision(), so there is nothing to tell.
+static void attach(Vehicle *v, KinematicsArrays *kin, size_t slot){
+	v->setSlot(kin, slot);
+}
+
+template<typename Arrays>
+static void attach(Vehicle *v, Arrays *kin, size_t slot){
+}
+
+template<typename Precision>
+size_t KinematicsArraysT<Precision>::add(Vehicle *v, double velocity, double length){
+	size_t slot = vehicles.size();
+	vehicles.push_back(v);
+	pos.push_back(0);
+	this->velocity.push_back(Real(velocity));
+	accel.push_back(0);
+	this->length.push_back(Real(length));
+	if(v)
+		attach(v, this, slot);
+	return slot;
+}
+
+template<typename Precision>
+void KinematicsArraysT<Precision>::remove(size_t slot){
+	size_t last = vehicles.size() - 1;
+	if(slot != last){
+		vehicles[slot] = vehicles[last];
+		pos[slot] = pos[last];
+		velocity[slot] = velocity[last];
+		accel[slot] = accel[last];
+		length[slot] = length[last];
+		if(vehicles[slot])
+			attach(vehicles[slot], this, slot);
+	}
+	vehicles.pop_back();
+	pos.pop_back();
+	velocity.pop_back();
+	accel.pop_back();
+	length.pop_back();
+}
+
+/// \brief Changes the length of the lane's edge, keeping the distance it has driven along it.
+template<typename Precision>
+void KinematicsArraysT<Precision>::setLength(size_t slot, double length){
+	double distance = getPos(slot);
+	this->length[slot] = Real(length);
+	setPos(slot, distance);
+}
+
+/// \brief Steps lanes [begin, count) one at a time and ORs their exit bits into exitMask.
+static inline void stepTail(double *pos, double *velocity, const double *accel,
+	const double *length, size_t begin, size_t count, double dt, uint64_t *exitMask)
+{
+	for(size_t i = begin; i < count; i++){
+		double v = velocity[i] + accel[i] * dt;
+		if(v < 0.)
+			v = 0.;
+		velocity[i] = v;
+		pos[i] += v * dt;
+		if(length[i] < pos[i])
+			exitMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+}
+
+static inline void clearMask(uint64_t *exitMask, size_t count){
+	for(size_t w = 0; w < (count + 63) / 64; w++)
+		exitMask[w] = 0;
+}
+
+void stepKinematicsScalar(double *pos, double *velocity, const double *accel,
+	const double *length, size_t count, double dt, uint64_t *exitMask)
+{
+	clearMask(exitMask, count);
+	stepTail(pos, velocity, accel, length, 0, count, dt, exitMask);
+}
+
+static inline void stepFloatTail(float *pos, float *velocity, const float *accel,
+	const float *length, size_t begin, size_t count, float dt, uint64_t *exitMask)
+{
+	for(size_t i = begin; i < count; i++){
+		float v = velocity[i] + accel[i] * dt;
+		if(v < 0.f)
+			v = 0.f;
+		velocity[i] = v;
+		pos[i] += v * dt;
+		if(length[i] < pos[i])
+			exitMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+}
+
+/// Largest step in fixed point units, kept below 2^31 so the vector path can
+/// convert it with a signed conversion.
+static const float fixedMaxAdvance = 2147483520.f;
+
+/// The step is worked out in float as a fraction of the edge and rounded to
+/// the fixed point unit, so the error does not grow with the distance driven.
+static inline void stepFixedTail(uint32_t *pos, float *velocity, const float *accel,
+	const float *length, size_t begin, size_t count, float dt, uint64_t *exitMask)
+{
+	for(size_t i = begin; i < count; i++){
+		float v = velocity[i] + accel[i] * dt;
+		if(v < 0.f)
+			v = 0.f;
+		velocity[i] = v;
+		float advance = v * dt / length[i] * float(FixedPrecision::one) + .5f;
+		if(!(advance < fixedMaxAdvance))
+			advance = fixedMaxAdvance;
+		uint32_t p = pos[i] + uint32_t(int32_t(advance));
+		pos[i] = p < pos[i] ? 0xffffffffu : p;
+		if(FixedPrecision::one < pos[i])
+			exitMask[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+}
+
+#ifdef STEPKERNEL_X86
+STEPKERNEL_TARGET("avx2")
+static void stepKinematicsAvx2(double *pos, double *velocity, const double *accel,
+	const double *length, size_t count, double dt, uint64_t *exitMask)
+{
+	clearMask(exitMask, count);
+	const __m256d vdt = _mm256_set1_pd(dt);
+	const __m256d zero = _mm256_setzero_pd();
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4){
+		__m256d v = _mm256_add_pd(_mm256_loadu_pd(velocity + i), _mm256_mul_pd(_mm256_loadu_pd(accel + i), vdt));
+		v = _mm256_max_pd(v, zero);
+		_mm256_storeu_pd(velocity + i, v);
+		__m256d p = _mm256_add_pd(_mm256_loadu_pd(pos + i), _mm256_mul_pd(v, vdt));
+		_mm256_storeu_pd(pos + i, p);
+		int exits = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(length + i), p, _CMP_LT_OQ));
+		exitMask[i >> 6] |= uint64_t(exits) << (i & 63);
+	}
+	stepTail(pos, velocity, accel, length, i, count, dt, exitMask);
+}
+
+STEPKERNEL_TARGET("avx2")
+static void stepFloatAvx2(float *pos, float *velocity, const float *accel,
+	const float *length, size_t count, float dt, uint64_t *exitMask)
+{
+	const __m256 vdt = _mm256_set1_ps(dt);
+	const __m256 zero = _mm256_setzero_ps();
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m256 v = _mm256_add_ps(_mm256_loadu_ps(velocity + i), _mm256_mul_ps(_mm256_loadu_ps(accel + i), vdt));
+		v = _mm256_max_ps(v, zero);
+		_mm256_storeu_ps(velocity + i, v);
+		__m256 p = _mm256_add_ps(_mm256_loadu_ps(pos + i), _mm256_mul_ps(v, vdt));
+		_mm256_storeu_ps(pos + i, p);
+		int exits = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(length + i), p, _CMP_LT_OQ));
+		exitMask[i >> 6] |= uint64_t(exits) << (i & 63);
+	}
+	stepFloatTail(pos, velocity, accel, length, i, count, dt, exitMask);
+}
+
+/// AVX2 has no unsigned comparison, so the overflow and exit tests compare
+/// against the unsigned maximum instead.
+STEPKERNEL_TARGET("avx2")
+static void stepFixedAvx2(uint32_t *pos, float *velocity, const float *accel,
+	const float *length, size_t count, float dt, uint64_t *exitMask)
+{
+	const __m256 vdt = _mm256_set1_ps(dt);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 unit = _mm256_set1_ps(float(FixedPrecision::one));
+	const __m256 half = _mm256_set1_ps(.5f);
+	const __m256 maxAdvance = _mm256_set1_ps(fixedMaxAdvance);
+	const __m256i pastEnd = _mm256_set1_epi32(int(FixedPrecision::one + 1));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m256 v = _mm256_add_ps(_mm256_loadu_ps(velocity + i), _mm256_mul_ps(_mm256_loadu_ps(accel + i), vdt));
+		v = _mm256_max_ps(v, zero);
+		_mm256_storeu_ps(velocity + i, v);
+		__m256 advance = _mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_mul_ps(v, vdt), _mm256_loadu_ps(length + i)), unit), half);
+		advance = _mm256_min_ps(advance, maxAdvance);
+		__m256i p0 = _mm256_loadu_si256((const __m256i*)(pos + i));
+		__m256i p = _mm256_add_epi32(p0, _mm256_cvttps_epi32(advance));
+		__m256i fits = _mm256_cmpeq_epi32(_mm256_max_epu32(p, p0), p);
+		p = _mm256_or_si256(p, _mm256_xor_si256(fits, _mm256_set1_epi32(-1)));
+		_mm256_storeu_si256((__m256i*)(pos + i), p);
+		__m256i past = _mm256_cmpeq_epi32(_mm256_max_epu32(p, pastEnd), p);
+		int exits = _mm256_movemask_ps(_mm256_castsi256_ps(past));
+		exitMask[i >> 6] |= uint64_t(exits) << (i & 63);
+	}
+	stepFixedTail(pos, velocity, accel, length, i, count, dt, exitMask);
+}
+
+#ifdef STEPKERNEL_AVX512
+STEPKERNEL_TARGET("avx512f")
+static void stepKinematicsAvx512(double *pos, double *velocity, const double *accel,
+	const double *length, size_t count, double dt, uint64_t *exitMask)
+{
+	clearMask(exitMask, count);
+	const __m512d vdt = _mm512_set1_pd(dt);
+	const __m512d zero = _mm512_setzero_pd();
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8){
+		__m512d v = _mm512_add_pd(_mm512_loadu_pd(velocity + i), _mm512_mul_pd(_mm512_loadu_pd(accel + i), vdt));
+		v = _mm512_max_pd(v, zero);
+		_mm512_storeu_pd(velocity + i, v);
+		__m512d p = _mm512_add_pd(_mm512_loadu_pd(pos + i), _mm512_mul_pd(v, vdt));
+		_mm512_storeu_pd(pos + i, p);
+		__mmask8 exits = _mm512_cmp_pd_mask(_mm512_loadu_pd(length + i), p, _CMP_LT_OQ);
+		exitMask[i >> 6] |= uint64_t(exits) << (i & 63);
+	}
+	stepTail(pos, velocity, accel, length, i, count, dt, exitMask);
+}
+#endif
+
+#ifdef _MSC_VER
+static bool cpuHasXsaveState(unsigned long long mask){
+	int info[4];
+	__cpuid(info, 1);
+	if(!(info[2] & (1 << 27))) // OSXSAVE
+		return false;
+	return (_xgetbv(0) & mask) == mask;
+}
+#endif
+
+static bool cpuHasAvx2(){
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) && cpuHasXsaveState(0x6);
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool cpuHasAvx512(){
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 16)) && cpuHasXsaveState(0xe6);
+#else
+	return __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+
+/// \brief The kernels the processor runs, chosen once.
+struct StepKernelChoice{
+	StepKernelFunc func;
+	const char *name;
+	bool narrowAvx2; ///< Whether the float and fixed point kernels may use AVX2
+};
+
+static StepKernelChoice selectStepKernel(){
+	StepKernelChoice ret = {stepKinematicsScalar, "scalar", false};
+#ifdef STEPKERNEL_X86
+	ret.narrowAvx2 = cpuHasAvx2();
+#ifdef STEPKERNEL_AVX512
+	if(cpuHasAvx512()){
+		ret.func = stepKinematicsAvx512;
+		ret.name = "avx512";
+		return ret;
+	}
+#endif
+	if(ret.narrowAvx2){
+		ret.func = stepKinematicsAvx2;
+		ret.name = "avx2";
+	}
+#endif
+	return ret;
+}
+
+/// \brief Returns the kernels for this processor.
+///
+/// Replicas step on several threads at once, so the choice is made by the
+/// initializer of a local static, which runs once however many ask.
+static const StepKernelChoice &getStepKernelChoice(){
+	static const StepKernelChoice choice = selectStepKernel();
+	return choice;
+}
+
+StepKernelFunc getStepKernel(){
+	return getStepKernelChoice().func;
+}
+
+const char *getStepKernelName(){
+	return getStepKernelChoice().name;
+}
+
+void DoublePrecision::step(Pos *pos, Real *velocity, const Real *accel, const Real *length,
+	size_t count, double dt, uint64_t *exitMask)
+{
+	getStepKernel()(pos, velocity, accel, length, count, dt, exitMask);
+}
+
+void FloatPrecision::step(Pos *pos, Real *velocity, const Real *accel, const Real *length,
+	size_t count, double dt, uint64_t *exitMask)
+{
+	clearMask(exitMask, count);
+#ifdef STEPKERNEL_X86
+	if(getStepKernelChoice().narrowAvx2){
+		stepFloatAvx2(pos, velocity, accel, length, count, float(dt), exitMask);
+		return;
+	}
+#endif
+	stepFloatTail(pos, velocity, accel, length, 0, count, float(dt), exitMask);
+}
+
+void FixedPrecision::step(Pos *pos, Real *velocity, const Real *accel, const Real *length,
+	size_t count, double dt, uint64_t *exitMask)
+{
+	clearMask(exitMask, count);
+#ifdef STEPKERNEL_X86
+	if(getStepKernelChoice().narrowAvx2){
+		stepFixedAvx2(pos, velocity, accel, length, count, float(dt), exitMask);
+		return;
+	}
+#endif
+	stepFixedTail(pos, velocity, accel, length, 0, count, float(dt), exitMask);
+}
+
+int highestBit(uint64_t word){
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(word);
+#elif defined(_MSC_VER) && defined(STEPKERNEL_X86)
+	unsigned long index;
+	if(_BitScanReverse(&index, (unsigned long)(word >> 32)))
+		return int(index) + 32;
+	_BitScanReverse(&index, (unsigned long)word);
+	return int(index);
+#else
+	int ret = 0;
+	while(word >>= 1)
+		ret++;
+	return ret;
+#endif
+}
+
+int lowestBit(uint64_t word){
+#if defined(__GNUC__)
+	return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(STEPKERNEL_X86)
+	unsigned long index;
+	if(_BitScanForward(&index, (unsigned long)word))
+		return int(index);
+	_BitScanForward(&index, (unsigned long)(word >> 32));
+	return int(index) + 32;
+#else
+	int ret = 0;
+	while(!(word & 1)){
+		word >>= 1;
+		ret++;
+	}
+	return ret;
+#endif
+}
+
+
+/// \brief Steps a copy of lanes in Precision and in double side by side and reports how far it drifts.
+///
+/// A lane that runs past its edge goes on along another edge of the same
+/// length, as if it drove round a ring road, so hand-offs are covered without
+/// needing the network.  The distance compared includes the laps driven.
+template<typename Precision>
+PrecisionReport comparePrecision(const KinematicsArraysT<DoublePrecision> &lanes, int ticks, double dt){
+	KinematicsArraysT<DoublePrecision> ref;
+	KinematicsArraysT<Precision> test;
+	size_t count = lanes.size();
+	for(size_t i = 0; i < count; i++){
+		ref.add(NULL, lanes.getVelocity(i), lanes.getLength(i));
+		ref.setPos(i, lanes.getPos(i));
+		ref.setAccel(i, lanes.getAccel(i));
+		test.add(NULL, lanes.getVelocity(i), lanes.getLength(i));
+		test.setPos(i, lanes.getPos(i));
+		test.setAccel(i, lanes.getAccel(i));
+	}
+	std::vector<double> refLaps(count, 0.), testLaps(count, 0.);
+	std::vector<uint64_t> refExits((count + 63) / 64), testExits((count + 63) / 64);
+	PrecisionReport report = {Precision::getName(), int(count), ticks, 0., 0., 0., 0, 0.};
+	if(!count)
+		return report;
+	for(int t = 0; t < ticks; t++){
+		ref.step(dt, &refExits.front());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		test.step(dt, &testExits.front());
+		report.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double sum = 0.;
+		for(size_t i = 0; i < count; i++){
+			uint64_t bit = uint64_t(1) << (i & 63);
+			if((refExits[i >> 6] & bit) != (testExits[i >> 6] & bit))
+				report.exitMismatches++;
+			while(ref.isPast(i)){
+				refLaps[i] += ref.getLength(i);
+				ref.setPos(i, ref.getPos(i) - ref.getLength(i));
+			}
+			while(test.isPast(i)){
+				testLaps[i] += test.getLength(i);
+				test.setPos(i, test.getPos(i) - test.getLength(i));
+			}
+			double error = fabs((testLaps[i] - refLaps[i]) + (test.getPos(i) - ref.getPos(i)));
+			sum += error;
+			report.maxError = std::max(report.maxError, error);
+			report.maxRelativeError = std::max(report.maxRelativeError, error / ref.getLength(i));
+		}
+		report.meanError = sum / count;
+	}
+	return report;
+}
+
+/// \brief Bytes held by the lanes, counting the capacity they have grown to.
+template<typename Precision>
+size_t KinematicsArraysT<Precision>::getMemoryUsage()const{
+	return MemoryReport::vectorBytes(vehicles) + MemoryReport::vectorBytes(pos) + MemoryReport::vectorBytes(velocity)
+		+ MemoryReport::vectorBytes(accel) + MemoryReport::vectorBytes(length);
+}
+
+template class KinematicsArraysT<DoublePrecision>;
+template class KinematicsArraysT<FloatPrecision>;
+template class KinematicsArraysT<FixedPrecision>;
+template PrecisionReport comparePrecision<DoublePrecision>(const KinematicsArraysT<DoublePrecision>&, int, double);
+template PrecisionReport comparePrecision<FloatPrecision>(const KinematicsArraysT<DoublePrecision>&, int, double);
+template PrecisionReport comparePrecision<FixedPrecision>(const KinematicsArraysT<DoublePrecision>&, int, double);
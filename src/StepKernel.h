@@ -0,0 +1,103 @@
+/** \file StepKernel.h
+ * \brief Definition of the batched vehicle kinematics kernel
+ */
+#ifndef STEPKERNEL_H
+#define STEPKERNEL_H
+
+#include "Precision.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class Vehicle;
+
+/// \brief Structure-of-arrays storage for the vehicle state stepped every tick.
+///
+/// Slot i of every array belongs to vehicles[i].  Removing a vehicle moves the
+/// last slot into the hole, so the arrays stay dense and the kernel can stream
+/// over them without following a pointer per vehicle.  The number formats are
+/// those of the Precision policy; see Precision.h.
+template<typename Precision>
+class KinematicsArraysT{
+public:
+	typedef typename Precision::Pos Pos;
+	typedef typename Precision::Real Real;
+	std::vector<Vehicle*> vehicles;
+	std::vector<Pos> pos; ///< Progress along the current edge
+	std::vector<Real> velocity;
+	std::vector<Real> accel;
+	std::vector<Real> length; ///< Length of the current edge, refreshed on hand-off
+
+	size_t size()const{return vehicles.size();}
+	size_t add(Vehicle *v, double velocity, double length);
+	void remove(size_t slot);
+	void clear(){vehicles.clear(); pos.clear(); velocity.clear(); accel.clear(); length.clear();}
+	void reserve(size_t count){vehicles.reserve(count); pos.reserve(count); velocity.reserve(count); accel.reserve(count); length.reserve(count);}
+	double getPos(size_t slot)const{return Precision::toDistance(pos[slot], length[slot]);}
+	void setPos(size_t slot, double distance){pos[slot] = Precision::fromDistance(distance, length[slot]);}
+	double getVelocity(size_t slot)const{return velocity[slot];}
+	void setVelocity(size_t slot, double v){velocity[slot] = Real(v);}
+	double getAccel(size_t slot)const{return accel[slot];}
+	void setAccel(size_t slot, double a){accel[slot] = Real(a);}
+	double getLength(size_t slot)const{return length[slot];}
+	void setLength(size_t slot, double length);
+	bool isPast(size_t slot)const{return Precision::isPast(pos[slot], length[slot]);}
+	size_t getMemoryUsage()const;
+
+	/// \brief Steps every lane by dt and sets the exit bits of those that ran past their edge.
+	void step(double dt, uint64_t *exitMask){
+		Precision::step(&pos.front(), &velocity.front(), &accel.front(), &length.front(), size(), dt, exitMask);
+	}
+	/// \brief Steps the lane in slot alone.
+	void stepLane(size_t slot, double dt){
+		uint64_t exit;
+		Precision::step(&pos[slot], &velocity[slot], &accel[slot], &length[slot], 1, dt, &exit);
+	}
+};
+
+typedef KinematicsArraysT<TRAFFIC_PRECISION> KinematicsArrays;
+
+/// \brief How far lanes stepped with a narrower precision drifted from double.
+struct PrecisionReport{
+	const char *name;
+	int lanes;
+	int ticks;
+	double maxError; ///< Largest distance from the double position
+	double maxRelativeError; ///< Largest error in edge lengths
+	double meanError; ///< At the last tick
+	int exitMismatches; ///< Lane ticks where only one of the two ran past its edge
+	double seconds; ///< Time spent stepping in this precision
+};
+
+template<typename Precision>
+PrecisionReport comparePrecision(const KinematicsArraysT<DoublePrecision> &lanes, int ticks, double dt);
+
+/// \brief Signature of a kinematics stepping kernel.
+///
+/// Advances velocity by accel * dt (clamped at zero), then pos by velocity * dt,
+/// for count lanes, and sets bit i of exitMask for every lane whose pos went past
+/// length.  exitMask must hold (count + 63) / 64 words; the kernel overwrites them.
+typedef void (*StepKernelFunc)(double *pos, double *velocity, const double *accel,
+	const double *length, size_t count, double dt, uint64_t *exitMask);
+
+void stepKinematicsScalar(double *pos, double *velocity, const double *accel,
+	const double *length, size_t count, double dt, uint64_t *exitMask);
+
+/// \brief Returns the fastest kernel the running CPU supports.
+///
+/// The choice is made once on first call; AVX-512 and AVX2 variants are only
+/// compiled in on x86 targets.
+StepKernelFunc getStepKernel();
+
+/// \brief Name of the kernel getStepKernel() returns, for diagnostics.
+const char *getStepKernelName();
+
+/// \brief Returns the index of the highest set bit in a nonzero word.
+int highestBit(uint64_t word);
+
+/// \brief Returns the index of the lowest set bit in a nonzero word.
+int lowestBit(uint64_t word);
+
+#endif
@@ -1,152 +1,245 @@
-/** \file Vehicle.cpp
- * \brief Implementation of Vehicle class
- */
-
-#include "Vehicle.h"
-#include "GraphVertex.h"
-#include "GraphEdge.h"
-
-#include <GL/glut.h>
-#include <GL/gl.h>
-#define exit something_meanless
-extern "C"{
-#include <clib/rseq.h>
-#include <clib/timemeas.h>
-}
-
-#include <stddef.h>
-#include <stdio.h>
-#include <math.h>
-#include <assert.h>
-#include <stdlib.h>
-
-#include <vector>
-#include <map>
-#include <set>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979
-#endif
-
-#ifndef M_2PI
-#define M_2PI (2. * M_PI)
-#endif
-
-
-int Vehicle::stepStats[Vehicle::stepStatCount] = {0};
-
-
-bool Vehicle::findPath(Graph *g, GraphVertex *start){
-	VertexSet visited;
-	visited.insert(start);
-
-	VertexMap first;
-	first[start] = NULL;
-
-	if(findPathInt(g, start, first, visited)){
-		if(path.size() <= 1){
-			path.clear();
-			return false;
-		}
-//		path.push_back(start);
-		// Make sure the path is reachable
-		for(int i = 0; i < path.size()-1; i++){
-			auto edges = path[i+1]->getEdges();
-			assert(edges.find(path[i]) != edges.end());
-		}
-		if(path.size() < 10)
-			stepStats[path.size()]++;
-		return true;
-	}
-	else
-		return false;
-}
-
-bool Vehicle::findPathInt(Graph *g, GraphVertex *start, VertexMap &prevMap, VertexSet &visited){
-	VertexMap levelMap;
-	for(VertexMap::iterator it = prevMap.begin(); it != prevMap.end(); ++it){
-		GraphVertex *v = it->first;
-		for(GraphVertex::EdgeMap::const_iterator it2 = v->getEdges().begin(); it2 != v->getEdges().end(); ++it2){
-			if(visited.find(it2->first) != visited.end())
-				continue;
-			visited.insert(it2->first);
-			levelMap[it2->first] = v;
-			if(it2->first == dest){
-				path.push_back(it2->first);
-				path.push_back(v); // We know the path came via v.
-				return true;
-			}
-		}
-	}
-	if(!levelMap.empty()){
-		if(findPathInt(g, start, levelMap, visited)){
-			GraphVertex *v = levelMap[path.back()];
-			assert(v);
-			path.push_back(v);
-			return true;
-		}
-	}
-	return false;
-}
-
-bool Vehicle::update(double dt){
-	pos += velocity * dt;
-	if(edge->getLength() < pos){
-		pos -= edge->getLength();
-		if(1 < path.size()){
-			GraphVertex *lastVertex = path.back();
-			path.pop_back();
-			auto it = lastVertex->getEdges().find(path.back());
-			assert(it != lastVertex->getEdges().end());
-			edge->remove(this);
-			edge = it->second;
-			edge->add(this);
-		}
-		else{
-			edge->remove(this);
-			delete this;
-			return false;
-		}
-	}
-	return true;
-}
-
-
-void Vehicle::draw(){
-	double spos[2];
-	double epos[2];
-	double pos[2];
-	if(getPath().back() == getEdge()->getStart()){
-		getEdge()->getEnd()->getPos(spos);
-		getEdge()->getStart()->getPos(epos);
-	}
-	else{
-		getEdge()->getStart()->getPos(spos);
-		getEdge()->getEnd()->getPos(epos);
-	}
-
-	double perp[2];
-	calcPerp(NULL, perp, spos, epos);
-
-	for(int i = 0; i < 2; i++)
-		pos[i] = epos[i] * getPos() / getEdge()->getLength() + spos[i] * (getEdge()->getLength() - getPos()) / getEdge()->getLength()
-			+ perp[i] * vertexRadius / 2. / 200.;
-	glPushMatrix();
-	glTranslated(pos[0] * 200, pos[1] * 200, 0);
-	double angle = atan2((spos[1] - epos[1]), spos[0] - epos[0]);
-	glRotated(angle * 360 / M_2PI, 0, 0, 1);
-	for(int i = 0; i < 2; i++){
-		if(i == 0)
-			glColor3fv(color);
-		else
-			glColor4f(0,0,0,1);
-		glBegin(i == 0 ? GL_QUADS : GL_LINE_LOOP);
-		glVertex2d(-5, -2);
-		glVertex2d(-5,  2);
-		glVertex2d( 5,  2.5);
-		glVertex2d( 5, -2.5);
-		glEnd();
-	}
-	glPopMatrix();
-
-}
+/** \file Vehicle.cpp
+ * \brief Implementation of Vehicle class
+ */
+
+#include "Vehicle.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "StepKernel.h"
+#include "ContractionHierarchy.h"
+#include "Graph.h"
+#include "MemoryReport.h"
+
+extern "C"{
+#include <clib/rseq.h>
+#include <clib/timemeas.h>
+}
+
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+
+Vehicle::Vehicle(GraphVertex *dest, uint32_t id) : id(id), departure(0), route(RouteArena::none), cursor(0), slot(0),
+	dest(dest), edge(NULL), next(NULL), kin(NULL)
+{
+}
+
+/// \brief Returns the color derived from the vehicle's id, so that every run and region agrees on it.
+///
+/// It is worked out when asked rather than stored, which keeps it out of the
+/// per-vehicle state.
+void Vehicle::getColor(float color[3])const{
+	uint32_t h = id * 2654435761u;
+	for(int i = 0; i < 3; i++){
+		h ^= h >> 15;
+		h *= 2246822519u;
+		h ^= h >> 13;
+		color[i] = float(h & 0xffff) / 0xffff;
+	}
+}
+
+
+size_t PathSearch::getMemoryUsage()const{
+	return MemoryReport::vectorBytes(level) + MemoryReport::vectorBytes(nextLevel) + MemoryReport::vectorBytes(parent)
+		+ MemoryReport::vectorBytes(visited);
+}
+
+/// \brief Makes room for searches over vertices vertices; a level never holds more than all of them.
+void PathSearch::reserve(size_t vertices){
+	level.reserve(vertices);
+	nextLevel.reserve(vertices);
+	if(visited.size() < vertices){
+		visited.resize(vertices, 0);
+		parent.resize(vertices, NULL);
+	}
+}
+
+/// \brief Finds a path with the fewest edges by breadth-first search.
+///
+/// Each level is expanded in the order of the vertices' addresses, which is
+/// the order the search had when it kept its levels in maps, so that the same
+/// paths are chosen among equally short ones.
+/// \param search Scratch space, so that a search does not allocate once it has grown to the network
+/// It reads nothing of a vehicle, so that a route worker can search for a
+/// trip whose vehicle the stepping thread has meanwhile taken back.
+/// \param path Receives the path, destination first.
+bool Vehicle::findPath(const Graph *g, PathSearch &search, GraphVertex *start, const GraphVertex *dest, Path &path){
+	path.clear();
+	size_t n = g->getVertices().size();
+	if(search.visited.size() < n){
+		search.visited.resize(n, 0);
+		search.parent.resize(n, NULL);
+	}
+	if(!++search.serial){
+		std::fill(search.visited.begin(), search.visited.end(), 0);
+		search.serial = 1;
+	}
+	search.visited[start->getId()] = search.serial;
+	search.level.assign(1, start);
+	while(!search.level.empty()){
+		std::sort(search.level.begin(), search.level.end());
+		search.nextLevel.clear();
+		for(size_t i = 0; i < search.level.size(); i++){
+			GraphVertex *v = search.level[i];
+			for(GraphVertex::EdgeMap::const_iterator it = v->getEdges().begin(); it != v->getEdges().end(); ++it){
+				GraphVertex *w = it->first;
+				if(search.visited[w->getId()] == search.serial || it->second->isClosed())
+					continue;
+				search.visited[w->getId()] = search.serial;
+				search.parent[w->getId()] = v;
+				if(w == dest){
+					path.push_back(w);
+					for(GraphVertex *p = v; ; p = search.parent[p->getId()]){
+						path.push_back(p);
+						if(p == start)
+							break;
+					}
+					// Make sure the path is reachable
+					for(size_t j = 0; j + 1 < path.size(); j++)
+						assert(path[j + 1]->getEdges().count(path[j]));
+					return true;
+				}
+				search.nextLevel.push_back(w);
+			}
+		}
+		search.level.swap(search.nextLevel);
+	}
+	return false;
+}
+
+/// \brief Finds the shortest path by length with a route index instead of the breadth-first search.
+bool Vehicle::findPath(const Graph *g, const ContractionHierarchy &index, RouteQuery &query, PathSearch &search, GraphVertex *start,
+	const GraphVertex *dest, Path &path)
+{
+	if(!index.findPath(*g, query, start, dest, path))
+		return false;
+	// The index knows nothing about closed roads; search around them instead.
+	for(size_t i = 0; i + 1 < path.size(); i++){
+		if(path[i + 1]->getEdges().find(path[i])->second->isClosed())
+			return findPath(g, search, start, dest, path);
+	}
+	return true;
+}
+
+double Vehicle::getPos()const{
+	return kin ? kin->getPos(slot) : 0.;
+}
+
+double Vehicle::getVelocity()const{
+	return kin ? kin->getVelocity(slot) : 0.;
+}
+
+/// \brief Puts the vehicle on the first edge of route, taking over the caller's reference to it.
+/// \param countPass Whether entering the edge counts as a new pass over it.
+void Vehicle::place(Graph &graph, RouteArena::RouteId route, bool countPass){
+	const RouteArena &routes = graph.getRoutes();
+	this->route = route;
+	cursor = 0;
+	GraphEdge *first = graph.getEdges()[routes.getEdge(route, 0)];
+	next = first->getOther(graph.getVertices()[routes.getStart(route)]);
+	graph.enterEdge(this, first, countPass);
+}
+
+/// \brief Switches to route, which must start with the edge the vehicle is on.
+void Vehicle::reroute(RouteArena &routes, RouteArena::RouteId route){
+	routes.release(this->route);
+	this->route = route;
+	cursor = 0;
+}
+
+/// \brief Sets where the vehicle is from a saved state, taking over the caller's reference to route.
+///
+/// Unlike place(), the Graph's counts of the traffic on the edges are left
+/// alone, since they are restored with the rest of the state.
+void Vehicle::restore(RouteArena::RouteId route, uint32_t cursor, const GraphVertex *next, GraphEdge *edge){
+	this->route = route;
+	this->cursor = cursor;
+	this->next = next;
+	this->edge = edge;
+}
+
+/// \brief Gives the vehicle's reference to its route back to routes.
+void Vehicle::leaveRoute(RouteArena &routes){
+	if(route != RouteArena::none)
+		routes.release(route);
+	route = RouteArena::none;
+}
+
+/// \brief Moves the vehicle from its edge onto the next one of its route, leaving its lane alone.
+/// \returns false if the vehicle has arrived and was taken off the network.
+bool Vehicle::advance(Graph &graph){
+	RouteArena &routes = graph.getRoutes();
+	if(cursor + 1 < routes.getLength(route)){
+		cursor++;
+		GraphEdge *nextEdge = graph.getEdges()[routes.getEdge(route, cursor)];
+		assert(nextEdge->getStart() == next || nextEdge->getEnd() == next);
+		graph.leaveEdge(this);
+		next = nextEdge->getOther(next);
+		graph.enterEdge(this, nextEdge, true);
+		return true;
+	}
+	else{
+		graph.leaveEdge(this);
+		leaveRoute(routes);
+		return false;
+	}
+}
+
+/// \brief Moves the vehicle onto the next edge of its route once pos has run past the current one.
+///
+/// This is the scalar tail of the stepping kernel; it only runs for the lanes
+/// whose exit bit was set.  The distance driven past the end is converted to
+/// the time left in the step and driven again at the next edge's speed, so the
+/// hand-off is exact however long the step was.
+/// \returns false if the vehicle has arrived and was taken off the network.
+bool Vehicle::handOff(Graph &graph){
+	double pos = kin->getPos(slot) - kin->getLength(slot);
+	double velocity = kin->getVelocity(slot);
+	if(!advance(graph))
+		return false;
+	double limit = edge->getSpeedLimit();
+	if(velocity != limit && 0. < velocity)
+		pos *= limit / velocity;
+	kin->length[slot] = KinematicsArrays::Real(edge->getLength());
+	kin->setPos(slot, pos);
+	kin->setVelocity(slot, limit);
+	return true;
+}
+
+
+/// \brief Computes where the vehicle is drawn, in network coordinates.
+/// \param pos Receives the center, offset to the right-hand side of the road
+/// \param angle Receives the heading in radians
+void Vehicle::getPlacement(double pos[2], double &angle)const{
+	getPlacement(getPos(), pos, angle);
+}
+
+/// \brief Places the vehicle along distance into its edge, for one outside the lanes, which has no getPos().
+void Vehicle::getPlacement(double along, double pos[2], double &angle)const{
+	double spos[2];
+	double epos[2];
+	if(next == getEdge()->getStart()){
+		getEdge()->getEnd()->getPos(spos);
+		getEdge()->getStart()->getPos(epos);
+	}
+	else{
+		getEdge()->getStart()->getPos(spos);
+		getEdge()->getEnd()->getPos(epos);
+	}
+
+	double perp[2];
+	calcPerp(NULL, perp, spos, epos);
+
+	for(int i = 0; i < 2; i++)
+		pos[i] = epos[i] * along / getEdge()->getLength() + spos[i] * (getEdge()->getLength() - along) / getEdge()->getLength()
+			+ perp[i] * vertexRadius / 2. / 200.;
+	angle = atan2((spos[1] - epos[1]), spos[0] - epos[0]);
+}
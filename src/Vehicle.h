@@ -1,52 +1,86 @@
-/** \file Vehicle.h
- * \brief Definition of Vehicle class
- */
-#ifndef VEHICLE_H
-#define VEHICLE_H
-
-#include <GL/glut.h>
-#include <GL/gl.h>
-#define exit something_meanless
-
-
-#include <vector>
-#include <map>
-#include <set>
-
-
-class GraphVertex;
-class GraphEdge;
-class Vehicle;
-class Graph;
-
-class Vehicle{
-public:
-	typedef std::set<GraphVertex*> VertexSet;
-	typedef std::map<GraphVertex*, GraphVertex*> VertexMap;
-	typedef std::vector<GraphVertex*> Path;
-	static const int stepStatCount = 20;
-protected:
-	const GraphVertex *dest;
-	GraphEdge *edge;
-	Path path;
-	double pos; ///< [0,1)
-	double velocity;
-	GLfloat color[3];
-	static int stepStats[stepStatCount];
-	bool findPathInt(Graph *, GraphVertex *root, VertexMap &prevMap, VertexSet &visited);
-public:
-	Vehicle(GraphVertex *dest) : dest(dest), edge(NULL), pos(0), velocity(0.1){
-		for(int i = 0; i < 3; i++)
-			color[i] = (GLfloat)rand() / RAND_MAX;
-	}
-	bool findPath(Graph *, GraphVertex *start);
-	Path &getPath(){return path;}
-	double getPos()const{return pos;}
-	const GraphEdge *getEdge()const{return edge;}
-	void setEdge(GraphEdge *edge){ this->edge = edge; }
-	static const int *getStepStats(){return stepStats;}
-	bool update(double dt);
-	void draw();
-};
-
-#endif
+/** \file Vehicle.h
+ * \brief Definition of Vehicle class
+ */
+#ifndef VEHICLE_H
+#define VEHICLE_H
+
+#include "RouteArena.h"
+#include "StepKernel.h"
+
+#include <vector>
+#include <map>
+#include <set>
+
+
+class GraphVertex;
+class GraphEdge;
+class Vehicle;
+class Graph;
+class ContractionHierarchy;
+class RouteQuery;
+
+/// \brief Scratch space of the breadth-first path search, kept between searches so that they do not allocate.
+class PathSearch{
+	friend class Vehicle;
+	std::vector<GraphVertex*> level, nextLevel;
+	std::vector<GraphVertex*> parent; ///< Vertex each visited vertex was reached from, by vertex id
+	std::vector<uint32_t> visited; ///< Serial of the search that last visited each vertex id
+	uint32_t serial;
+public:
+	PathSearch() : serial(0){}
+	void reserve(size_t vertices);
+	size_t getMemoryUsage()const;
+};
+
+class Vehicle{
+public:
+	typedef std::vector<GraphVertex*> Path;
+protected:
+	// The 32 bit members come first so that the pointers pack without padding.
+	uint32_t id; ///< Serial number given at spawn, stable across regions
+	int departure; ///< Tick the vehicle spawned at
+	RouteArena::RouteId route; ///< Edges to drive, starting with one it was placed on
+	uint32_t cursor; ///< Index of edge in route
+	uint32_t slot; ///< Index into kin's arrays
+	const GraphVertex *dest;
+	GraphEdge *edge;
+	const GraphVertex *next; ///< The end of edge the vehicle is heading to
+	KinematicsArrays *kin; ///< Storage holding pos and velocity, NULL until placed on an edge
+public:
+	Vehicle(GraphVertex *dest, uint32_t id);
+	static bool findPath(const Graph *, PathSearch &search, GraphVertex *start, const GraphVertex *dest, Path &path);
+	static bool findPath(const Graph *, const ContractionHierarchy &index, RouteQuery &query, PathSearch &search, GraphVertex *start,
+		const GraphVertex *dest, Path &path);
+	void place(Graph &graph, RouteArena::RouteId route, bool countPass = true);
+	void reroute(RouteArena &routes, RouteArena::RouteId route);
+	void leaveRoute(RouteArena &routes);
+	void restore(RouteArena::RouteId route, uint32_t cursor, const GraphVertex *next, GraphEdge *edge);
+	uint32_t getId()const{return id;}
+	int getDeparture()const{return departure;}
+	void setDeparture(int tick){departure = tick;}
+	RouteArena::RouteId getRoute()const{return route;}
+	uint32_t getCursor()const{return cursor;}
+	bool isOnLastEdge(const RouteArena &routes)const{return routes.getLength(route) <= cursor + 1;}
+	const GraphVertex *getNext()const{return next;}
+	const GraphVertex *getDest()const{return dest;}
+	void getColor(float color[3])const;
+	double getPos()const;
+	double getVelocity()const;
+	const GraphEdge *getEdge()const{return edge;}
+	GraphEdge *getEdge(){return edge;}
+	void setEdge(GraphEdge *edge){ this->edge = edge; }
+	void setSlot(KinematicsArrays *kin, size_t slot){ this->kin = kin; this->slot = uint32_t(slot); }
+	size_t getSlot()const{return slot;}
+	bool advance(Graph &graph);
+	bool handOff(Graph &graph);
+	void getPlacement(double pos[2], double &angle)const;
+	void getPlacement(double along, double pos[2], double &angle)const;
+};
+
+/// \brief A vehicle on the road and how far along its edge it is, whichever model moves it.
+struct VehiclePosition{
+	const Vehicle *vehicle;
+	double pos; ///< Distance from the end of the edge the vehicle entered at, as Vehicle::getPos() has it in the lanes
+};
+
+#endif
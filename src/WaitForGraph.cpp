@@ -0,0 +1,140 @@
+/** \file WaitForGraph.cpp
+ * \brief Implementation of WaitForGraph class
+ */
+
+#include "WaitForGraph.h"
+#include "Graph.h"
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "MemoryReport.h"
+#include "StateBuffer.h"
+
+#include <algorithm>
+
+
+/// \brief Makes room for the edges of graph.
+///
+/// An edge can only wait for the edges at either of its ends, so that many
+/// arcs are reserved for it up front and adding a wait never allocates.  A
+/// search visits each edge once, so it never stacks more than all of them.
+void WaitForGraph::resize(const Graph &graph){
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	out.resize(edges.size());
+	waiters.resize(edges.size(), 0);
+	visited.resize(edges.size(), 0);
+	parent.resize(edges.size(), -1);
+	stack.reserve(edges.size());
+	for(size_t i = 0; i < edges.size(); i++)
+		out[i].reserve(edges[i]->getStart()->getEdges().size() + edges[i]->getEnd()->getEdges().size());
+}
+
+/// \brief Forgets every wait, keeping the buffers.
+void WaitForGraph::clear(){
+	for(size_t i = 0; i < out.size(); i++)
+		out[i].clear();
+	std::fill(waiters.begin(), waiters.end(), 0);
+	arcs = 0;
+}
+
+/// \brief Appends the arcs, in the order the searches follow them, to out.
+void WaitForGraph::save(StateBuffer &state)const{
+	state.put(uint32_t(out.size()));
+	for(size_t i = 0; i < out.size(); i++)
+		state.putVector(out[i]);
+}
+
+/// \brief Reads back what save() wrote, for graph with the same network.
+bool WaitForGraph::load(StateBuffer &in, const Graph &graph){
+	clear();
+	uint32_t n = in.get<uint32_t>();
+	if(!n)
+		return in.isOk();
+	if(n != graph.getEdges().size())
+		return false;
+	resize(graph);
+	for(uint32_t i = 0; i < n && in.isOk(); i++){
+		in.getVector(out[i]);
+		for(size_t j = 0; j < out[i].size(); j++)
+			waiters[i] += out[i][j].count;
+		arcs += out[i].size();
+	}
+	return in.isOk();
+}
+
+size_t WaitForGraph::getMemoryUsage()const{
+	size_t ret = MemoryReport::vectorBytes(out) + MemoryReport::vectorBytes(waiters) + MemoryReport::vectorBytes(visited)
+		+ MemoryReport::vectorBytes(parent) + MemoryReport::vectorBytes(stack);
+	for(size_t i = 0; i < out.size(); i++)
+		ret += MemoryReport::vectorBytes(out[i]);
+	return ret;
+}
+
+/// \brief Records a vehicle at the end of edge from waiting for room on edge to.
+/// \returns Whether this made a new arc.
+bool WaitForGraph::addWait(int from, int to){
+	waiters[from]++;
+	std::vector<Arc> &a = out[from];
+	for(size_t i = 0; i < a.size(); i++){
+		if(a[i].to == to){
+			a[i].count++;
+			return false;
+		}
+	}
+	Arc arc = {to, 1};
+	a.push_back(arc);
+	arcs++;
+	return true;
+}
+
+void WaitForGraph::removeWait(int from, int to){
+	waiters[from]--;
+	std::vector<Arc> &a = out[from];
+	for(size_t i = 0; i < a.size(); i++){
+		if(a[i].to == to){
+			if(!--a[i].count){
+				a[i] = a.back();
+				a.pop_back();
+				arcs--;
+			}
+			return;
+		}
+	}
+}
+
+bool WaitForGraph::isStuck(int edge, const std::vector<EdgeTraffic> &traffic)const{
+	return 0 < waiters[edge] && traffic[edge].vehicles <= waiters[edge];
+}
+
+/// \brief Looks for a cycle of stuck edges through start.
+/// \param cycle Receives the edges of the cycle in waiting order, starting with start.
+/// \returns Whether one was found.
+bool WaitForGraph::findCycle(int start, const std::vector<EdgeTraffic> &traffic, std::vector<int> &cycle){
+	if(!isStuck(start, traffic))
+		return false;
+	stamp++;
+	stack.clear();
+	stack.push_back(start);
+	visited[start] = stamp;
+	parent[start] = -1;
+	while(!stack.empty()){
+		int e = stack.back();
+		stack.pop_back();
+		const std::vector<Arc> &a = out[e];
+		for(size_t i = 0; i < a.size(); i++){
+			int to = a[i].to;
+			if(to == start){
+				cycle.clear();
+				for(int c = e; c != -1; c = parent[c])
+					cycle.push_back(c);
+				std::reverse(cycle.begin(), cycle.end());
+				return true;
+			}
+			if(visited[to] == stamp || !isStuck(to, traffic))
+				continue;
+			visited[to] = stamp;
+			parent[to] = e;
+			stack.push_back(to);
+		}
+	}
+	return false;
+}
@@ -0,0 +1,54 @@
+/** \file WaitForGraph.h
+ * \brief Definition of WaitForGraph class
+ */
+#ifndef WAITFORGRAPH_H
+#define WAITFORGRAPH_H
+
+#include <stddef.h>
+
+#include <vector>
+
+
+struct EdgeTraffic;
+class Graph;
+class StateBuffer;
+
+/// \brief Which edges wait for which, kept up to date as vehicles start and stop waiting.
+///
+/// There is an arc from edge a to edge b while a vehicle at the end of a waits
+/// for room on b.  An edge is stuck when every vehicle on it is waiting like
+/// that.  A cycle of stuck edges is a gridlock: nothing on it can move until
+/// something on it does.
+///
+/// Rather than searching the whole graph, a search only starts from an edge
+/// when it gets a new waiter or loses a vehicle, which are the only moments a
+/// new cycle of stuck edges can close, and only follows arcs out of stuck edges.
+class WaitForGraph{
+protected:
+	struct Arc{
+		int to;
+		int count; ///< Vehicles waiting along this arc
+	};
+	std::vector<std::vector<Arc> > out; ///< Arcs by the edge id they leave from
+	std::vector<int> waiters; ///< Vehicles waiting at the end of each edge
+	std::vector<int> visited; ///< Search stamp per edge
+	std::vector<int> parent; ///< Edge the search came from
+	std::vector<int> stack; ///< Scratch for findCycle()
+	int stamp;
+	size_t arcs;
+public:
+	WaitForGraph() : stamp(0), arcs(0){}
+	void resize(const Graph &graph);
+	void clear();
+	void save(StateBuffer &state)const;
+	bool load(StateBuffer &in, const Graph &graph);
+	bool addWait(int from, int to);
+	void removeWait(int from, int to);
+	int getWaiters(int edge)const{return edge < int(waiters.size()) ? waiters[edge] : 0;}
+	size_t getArcCount()const{return arcs;}
+	size_t getMemoryUsage()const;
+	bool isStuck(int edge, const std::vector<EdgeTraffic> &traffic)const;
+	bool findCycle(int start, const std::vector<EdgeTraffic> &traffic, std::vector<int> &cycle);
+};
+
+#endif
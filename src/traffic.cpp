@@ -1,427 +1,1251 @@
-/** \file traffic.cpp
- * \brief The simple traffic simulator
- */
-
-#include "GraphVertex.h"
-#include "GraphEdge.h"
-#include "Vehicle.h"
-
-#include <GL/glut.h>
-#include <GL/gl.h>
-#define exit something_meanless
-extern "C"{
-#include <clib/rseq.h>
-#include <clib/timemeas.h>
-}
-
-#include <stddef.h>
-#include <stdio.h>
-#include <math.h>
-#include <assert.h>
-#include <stdlib.h>
-
-#include <vector>
-#include <map>
-#include <set>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979
-#endif
-
-#ifndef M_2PI
-#define M_2PI (2. * M_PI)
-#endif
-
-
-class GraphEdge;
-class Vehicle;
-class Graph;
-
-
-
-class Graph{
-public:
-	typedef std::set<Vehicle*> VehicleSet;
-protected:
-	std::vector<GraphVertex*> vertices;
-	VehicleSet vehicles;
-	double global_time;
-public:
-	Graph();
-	const std::vector<GraphVertex*> &getVertices()const{return vertices;}
-	const VehicleSet &getVehicles()const{return vehicles;}
-	void update(double dt);
-};
-
-
-
-Graph::Graph() : global_time(0){
-	int n = 100;
-	random_sequence rs;
-	init_rseq(&rs, 342125);
-	for(int i = 0; i < n; i++){
-		double x = drseq(&rs) * 2 - 1, y = drseq(&rs) * 2 - 1;
-		GraphVertex *v = new GraphVertex(x, y);
-		vertices.push_back(v);
-	}
-
-	int m = n * 10;
-	for(int i = 0; i < m; i++){
-		int s = rseq(&rs) % n, e = rseq(&rs) % n;
-		vertices[s]->connect(vertices[e]);
-	}
-}
-
-void Graph::update(double dt){
-	static int invokes = 0;
-	static random_sequence rs;
-	if(invokes == 0)
-		init_rseq(&rs, 87657444);
-	const double genInterval = 0.1;
-	
-	if(fmod(global_time + dt, genInterval) < fmod(global_time, genInterval)){
-		int starti = rseq(&rs) % vertices.size();
-		int endi = rseq(&rs) % vertices.size();
-		Vehicle *v = new Vehicle(vertices[endi]);
-		if(v->findPath(this, vertices[starti])){
-			vertices[starti]->add(v);
-			vehicles.insert(v);
-		}
-		else
-			delete v;
-	}
-
-	for(VehicleSet::iterator it = vehicles.begin(); it != vehicles.end();){
-		VehicleSet::iterator next = it;
-		++next;
-		Vehicle *v = *it;
-		if(!v->update(dt))
-			vehicles.erase(it);
-		it = next;
-	}
-
-	invokes++;
-	global_time += dt;
-}
-
-static double gtime = 0.;
-static int rollview = 0;
-static double vscale = 1.;
-static int pause = 0;
-static int g_use_display_list = 1;
-
-Graph graph;
-
-static void register_lists(void);
-
-#define CPIECES 32
-
-void putstring(const char *s){
-	while(*s)
-		glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *s++);
-}
-
-
-/* indicators */
-static void drawindics(double height, const double view_trans[16], double dt){
-	int i;
-	{
-		glColor4ub(0,255,0,255);
-		glPushMatrix();
-
-		glLoadIdentity();
-		{
-			char buf[128];
-			GLint vp[4];
-			int w, h, m;
-			double left, bottom;
-			glGetIntegerv(GL_VIEWPORT, vp);
-			w = vp[2], h = vp[3];
-			m = w < h ? h : w;
-			left = -(double)w / m;
-			bottom = -(double)h / m;
-
-/*			glRasterPos3d(left, -.2, -1.);
-			sprintf(buf, "velo: %lg, %lg, %lg ", pl.velo[0], pl.velo[1], pl.velo[2]);
-			putstring(buf);*/
-			glRasterPos3d(left, bottom + 125. / m, -1.);
-			sprintf(buf, "Display List: %s", g_use_display_list ? "On" : "Off");
-			putstring(buf);
-			glRasterPos3d(left, bottom + 100. / m, -1.);
-			sprintf(buf, "Draw Time: %lg", dt);
-			putstring(buf);
-		}
-		glPopMatrix();
-	}
-}
-
-/// \brief Calculates parallel and perpendicular unit vectors against difference of given vectors.
-/// \param para Buffer for returning vector parallel to difference of pos and dpos and have a unit length
-/// \param perp Buffer for returning vector perpendicular to para and have a unit length
-/// \param pos Input vector for the starting point
-/// \param dpos Input vector for the destination point
-/// \returns Distance of the given vectors
-double calcPerp(double para[2], double perp[2], const double pos[2], const double dpos[2]){
-	perp[0] = pos[1] - dpos[1];
-	perp[1] = -(pos[0] - dpos[0]);
-	double norm = sqrt(perp[0] * perp[0] + perp[1] * perp[1]);
-	perp[0] /= norm;
-	perp[1] /= norm;
-	if(para){
-		para[0] = -(pos[0] - dpos[0]) / norm;
-		para[1] = -(pos[1] - dpos[1]) / norm;
-	}
-	return norm;
-}
-
-/// \brief Callback for drawing
-void draw_func(double dt)
-{
-	
-	glClearDepth(1.);
-	glClear(GL_DEPTH_BUFFER_BIT);
-
-	glClearColor(0.0, 0.2, 0.1, 0);
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	glLoadIdentity();
-	glScaled(0.005, 0.005, 1);
-
-	char buf[128];
-
-	// TODO: In this logic, we draw the road (edge) twice.
-	const std::vector<GraphVertex*> &vertices = graph.getVertices();
-	for(std::vector<GraphVertex*>::const_iterator it = vertices.begin(); it != vertices.end(); ++it){
-		double pos[2];
-		(*it)->getPos(pos);
-		glColor4f(1,0,0,1);
-
-		glPushMatrix();
-		glBegin(GL_LINE_LOOP);
-		for(int i = 0; i < 16; i++)
-			glVertex2d(pos[0] * 200 + vertexRadius * cos(i * M_2PI / 16.), pos[1] * 200 + vertexRadius * sin(i * M_2PI / 16.));
-		glEnd();
-		glPopMatrix();
-
-		glRasterPos3d(pos[0] * 200, pos[1] * 200., 0.);
-		sprintf(buf, "%d", &*it - &vertices.front());
-		putstring(buf);
-
-		for(GraphVertex::EdgeMap::const_iterator it2 = (*it)->getEdges().begin(); it2 != (*it)->getEdges().end(); ++it2){
-			double dpos[2];
-			int passCount = it2->second->getPassCount();
-			it2->first->getPos(dpos);
-
-			// Obtain vector perpendicular to the edige's direction.
-			double para[2], perp[2];
-			const double length = calcPerp(para, perp, pos, dpos);
-			const double dashedLineLength = 0.07;
-			const double lineHalfWidth = 0.003;
-			const int dashedLines = int(length / dashedLineLength + 0.5);
-
-			const double size = vertexRadius;
-
-			glBegin(GL_QUADS);
-			// Asphalt color
-			glColor4f(0.5, 0.5, 0.5, 1);
-			glVertex2d(pos[0] * 200 - perp[0] * size, pos[1] * 200 - perp[1] * size);
-			glVertex2d(dpos[0] * 200 - perp[0] * size, dpos[1] * 200 - perp[1] * size);
-			glVertex2d(pos[0] * 200 + perp[0] * size, pos[1] * 200 + perp[1] * size);
-			glVertex2d(dpos[0] * 200 + perp[0] * size, dpos[1] * 200 + perp[1] * size);
-			glEnd();
-
-			glPushMatrix();
-			glScaled(200, 200, 1);
-			glColor4f(1, 1, 1, 1);
-			glBegin(GL_QUADS);
-			for(int j = 0; j < dashedLines; j++){
-				glVertex2d(pos[0] + para[0] * j * dashedLineLength + perp[0] * lineHalfWidth, pos[1] + para[1] * j * dashedLineLength + perp[1] * lineHalfWidth);
-				glVertex2d(pos[0] + para[0] * j * dashedLineLength - perp[0] * lineHalfWidth, pos[1] + para[1] * j * dashedLineLength - perp[1] * lineHalfWidth);
-				glVertex2d(pos[0] + para[0] * (j + 0.5) * dashedLineLength - perp[0] * lineHalfWidth, pos[1] + para[1] * (j + 0.5) * dashedLineLength - perp[1] * lineHalfWidth);
-				glVertex2d(pos[0] + para[0] * (j + 0.5) * dashedLineLength + perp[0] * lineHalfWidth, pos[1] + para[1] * (j + 0.5) * dashedLineLength + perp[1] * lineHalfWidth);
-			}
-			glEnd();
-			glPopMatrix();
-
-			// The edge color indicates traffic amount
-			glColor4f(GLfloat(passCount) / GraphEdge::getMaxPassCount(),0,1,1);
-
-			glBegin(GL_LINES);
-			for(int k = -1; k <= 1; k++){
-				glVertex2d(pos[0] * 200 + k * perp[0] * size, pos[1] * 200 + k * perp[1] * size);
-				glVertex2d(dpos[0] * 200 + k * perp[0] * size, dpos[1] * 200 + k * perp[1] * size);
-			}
-			glEnd();
-
-			glRasterPos3d((pos[0] + dpos[0]) / 2. * 200, (pos[1] + dpos[1]) / 2. * 200., 0.);
-			sprintf(buf, "%d",/* it2->second->getLength(),*/ passCount);
-			putstring(buf);
-		}
-	}
-
-	glColor4f(0,1,1,1);
-	for(Graph::VehicleSet::const_iterator it2 = graph.getVehicles().begin(); it2 != graph.getVehicles().end(); ++it2){
-		Vehicle *v = *it2;
-		v->draw();
-	}
-
-
-	// Draw Vehicle's path length distribution chart.
-	glColor4f(1,1,1,1);
-	int maxStepCount = 0;
-	int stepSum = 0;
-	int stepMoment = 0;
-	const int *stepStats = Vehicle::getStepStats();
-	for(int i = 0; i < Vehicle::stepStatCount; i++){
-		if(maxStepCount < stepStats[i])
-			maxStepCount = stepStats[i];
-		stepSum += stepStats[i];
-		stepMoment += stepStats[i] * i;
-	}
-	if(maxStepCount){
-		for(int i = 0; i < Vehicle::stepStatCount; i++){
-			glRasterPos2d(-200., -180 + i * 16);
-			sprintf(buf, "%d:%d",/* it2->second->getLength(),*/ i, stepStats[i]);
-			putstring(buf);
-			glBegin(GL_LINES);
-			glVertex2d(-200, -180 + i * 16);
-			glVertex2d(-200 + stepStats[i] * 200 / maxStepCount, -180 + i * 16);
-			glEnd();
-		}
-		glRasterPos2d(-200., -180 + Vehicle::stepStatCount * 16);
-		sprintf(buf, "Avg: %lg", double(stepMoment) / stepSum);
-		putstring(buf);
-	}
-
-	glFlush();
-	glutSwapBuffers();
-
-/*	Sleep(1);*/
-}
-
-#define EPSILON 1e-5
-
-
-
-/// \brief Callback for updating screen
-void display_func(void){
-	static timemeas_t tm;
-	static int init = 0;
-	static double t = 0.;
-	double dt = 0.;
-	if(!init){
-		init = 1;
-		TimeMeasStart(&tm);
-	}
-	else{
-		double t1;
-		t1 = TimeMeasLap(&tm);
-		dt = init ? t1 - t : 0.;
-
-		if(!pause){
-			graph.update(dt);
-		}
-
-		gtime = t = t1;
-	}
-	draw_func(dt);
-/*	glViewport(dim[0], dim[1], dim[2], dim[3]);*/
-}
-
-void idle(void){
-	glutPostRedisplay();
-}
-
-/// \brief Callback for window size change
-void reshape_func(int w, int h)
-{
-	int m = w < h ? h : w;
-	glViewport(0, 0, w, h);
-}
-
-
-/// \brief Callback for key input
-static void key_func(unsigned char key, int x, int y){
-	switch(key){
-		case 'p': pause = !pause; break;
-
-		case 'i': g_use_display_list = !g_use_display_list;
-	}
-}
-
-int g_pressed = 0;
-
-int g_prevX = -1;
-int g_prevY = -1;
-int g_prevZ = -1;
-
-/// \brief Callback for mouse input
-static void mouse_func(int button, int state, int x, int y){
-	if (button == GLUT_LEFT_BUTTON) {
-		if (state == GLUT_DOWN) {
-			g_prevX = x;
-			g_prevY = y;
-			g_pressed = 1;
-		}
-		else if (state == GLUT_UP) {
-			g_pressed = 0;
-		}
-	}
-	else if(button == GLUT_RIGHT_BUTTON){
-		if(state == GLUT_DOWN) {
-			g_prevY = y;
-			g_pressed = 2;
-		}
-		else if(state == GLUT_UP) {
-			g_pressed = 0;
-		}
-	}
-}
-
-/// \brief Callback for mouse motion
-void motion_func(int x, int y){
-	if (g_pressed != 0) {
-
-		g_prevX = x;
-		g_prevY = y;
-
-		glutPostRedisplay();
-
-	}
-
-}
-
-
-int main(int argc, char *argv[])
-{
-
-	glutInit(&argc, argv);
-
-	glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
-
-	glutInitWindowSize(640,480);
-
-	glutCreateWindow(2 <= argc ? argv[1] : "No File");
-
-	glutDisplayFunc(display_func);
-
-	glutReshapeFunc(reshape_func);
-
-	glutMouseFunc(mouse_func);
-
-	glutMotionFunc(motion_func);
-
-	glutKeyboardFunc(key_func);
-	glutIdleFunc(idle);
-
-	register_lists();
-
-	glutMainLoop();
-
-	return 0;
-}
-
-static void register_lists(void){
-
-}
-
+/** \file traffic.cpp
+ * \brief The simple traffic simulator
+ */
+
+#include "GraphVertex.h"
+#include "GraphEdge.h"
+#include "Vehicle.h"
+#include "Graph.h"
+#include "StepKernel.h"
+#include "ContractionHierarchy.h"
+#include "DomainDecomposition.h"
+#include "FrameExporter.h"
+#include "LiveStream.h"
+#include "EditScript.h"
+#include "Ensemble.h"
+#include "StateTrace.h"
+#include "PerfCounters.h"
+#include "AllocationAudit.h"
+#include "MemoryReport.h"
+#include "DensityMap.h"
+#include "EventLog.h"
+#include "NetworkOrder.h"
+
+#include <GL/glut.h>
+#include <GL/gl.h>
+#define exit something_meanless
+extern "C"{
+#include <clib/rseq.h>
+#include <clib/timemeas.h>
+}
+
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979
+#endif
+
+#ifndef M_2PI
+#define M_2PI (2. * M_PI)
+#endif
+
+
+static double gtime = 0.;
+static int rollview = 0;
+static double vscale = 1.;
+static int pause = 0;
+static int g_use_display_list = 1;
+
+Graph graph;
+static ContractionHierarchy routeIndex;
+static EditScript editScript;
+static TraceWriter trace;
+static PerfCounters perfCounters;
+static bool countPhases = false;
+static DensityMap densityMap;
+static GLuint heatmapTexture = 0;
+static double viewCenter[2] = {0., 0.}; ///< Network coordinates at the center of the window
+static int networkOrder = -1; ///< NetworkOrder::Kind to renumber each new network in, -1 to keep the order it was drawn in
+
+/// \brief When the heatmap replaces the edges and vehicles.
+enum HeatmapMode{heatmapAuto, heatmapOn, heatmapOff, heatmapModeCount};
+static int heatmapMode = heatmapAuto;
+static const char *heatmapModeNames[heatmapModeCount] = {"auto", "on", "off"};
+
+/// Shortest on-screen mean edge length, in pixels, at which heatmapAuto still draws each object.
+static const double heatmapEdgePixels = 24.;
+
+static EventLog eventLog;
+static ReplayWriter replay;
+static ReplayReader *player = NULL; ///< Replay played in the window instead of a live run, if any
+static double replaySpeed = 1.; ///< Simulated seconds played per second of wall time
+static std::vector<EventLog::Event> replayEvents; ///< Of the tick being replayed, as logged
+
+static void register_lists(void);
+
+#define CPIECES 32
+
+void putstring(const char *s){
+	while(*s)
+		glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *s++);
+}
+
+
+/* indicators */
+static void drawindics(double height, const double view_trans[16], double dt){
+	int i;
+	{
+		glColor4ub(0,255,0,255);
+		glPushMatrix();
+
+		glLoadIdentity();
+		{
+			char buf[128];
+			GLint vp[4];
+			int w, h, m;
+			double left, bottom;
+			glGetIntegerv(GL_VIEWPORT, vp);
+			w = vp[2], h = vp[3];
+			m = w < h ? h : w;
+			left = -(double)w / m;
+			bottom = -(double)h / m;
+
+/*			glRasterPos3d(left, -.2, -1.);
+			sprintf(buf, "velo: %lg, %lg, %lg ", pl.velo[0], pl.velo[1], pl.velo[2]);
+			putstring(buf);*/
+			glRasterPos3d(left, bottom + 125. / m, -1.);
+			sprintf(buf, "Display List: %s", g_use_display_list ? "On" : "Off");
+			putstring(buf);
+			glRasterPos3d(left, bottom + 100. / m, -1.);
+			sprintf(buf, "Draw Time: %lg", dt);
+			putstring(buf);
+		}
+		glPopMatrix();
+	}
+}
+
+/// \brief Calculates parallel and perpendicular unit vectors against difference of given vectors.
+/// \param para Buffer for returning vector parallel to difference of pos and dpos and have a unit length
+/// \param perp Buffer for returning vector perpendicular to para and have a unit length
+/// \param pos Input vector for the starting point
+/// \param dpos Input vector for the destination point
+/// \returns Distance of the given vectors
+double calcPerp(double para[2], double perp[2], const double pos[2], const double dpos[2]){
+	perp[0] = pos[1] - dpos[1];
+	perp[1] = -(pos[0] - dpos[0]);
+	double norm = sqrt(perp[0] * perp[0] + perp[1] * perp[1]);
+	perp[0] /= norm;
+	perp[1] /= norm;
+	if(para){
+		para[0] = -(pos[0] - dpos[0]) / norm;
+		para[1] = -(pos[1] - dpos[1]) / norm;
+	}
+	return norm;
+}
+
+/// \brief Decides whether to draw the heatmap at the current zoom.
+///
+/// The mean edge length is that of the last build, which is close enough
+/// since the network rarely changes between frames.
+static bool useHeatmap(void){
+	if(heatmapMode != heatmapAuto)
+		return heatmapMode == heatmapOn;
+	if(densityMap.getMeanEdgeLength() <= 0.)
+		densityMap.build(graph);
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	double pixelsPerUnit = std::min(vp[2], vp[3]) / 2. * vscale;
+	return densityMap.getMeanEdgeLength() * pixelsPerUnit < heatmapEdgePixels;
+}
+
+/// \brief Draws v where it is on its edge, in its color.
+static void drawVehicle(const VehiclePosition &p){
+	const Vehicle *v = p.vehicle;
+	double pos[2];
+	double angle;
+	v->getPlacement(p.pos, pos, angle);
+	glPushMatrix();
+	glTranslated(pos[0] * 200, pos[1] * 200, 0);
+	glRotated(angle * 360 / M_2PI, 0, 0, 1);
+	GLfloat color[3];
+	v->getColor(color);
+	for(int i = 0; i < 2; i++){
+		if(i == 0)
+			glColor3fv(color);
+		else
+			glColor4f(0,0,0,1);
+		glBegin(i == 0 ? GL_QUADS : GL_LINE_LOOP);
+		glVertex2d(-5, -2);
+		glVertex2d(-5,  2);
+		glVertex2d( 5,  2.5);
+		glVertex2d( 5, -2.5);
+		glEnd();
+	}
+	glPopMatrix();
+}
+
+/// \brief Rebuilds the density map and draws it as one textured quad over the network.
+static void drawHeatmap(void){
+	densityMap.build(graph);
+	int size = densityMap.getSize();
+	glEnable(GL_TEXTURE_2D);
+	if(!heatmapTexture){
+		glGenTextures(1, &heatmapTexture);
+		glBindTexture(GL_TEXTURE_2D, heatmapTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, densityMap.getPixels());
+	}
+	else{
+		glBindTexture(GL_TEXTURE_2D, heatmapTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, densityMap.getPixels());
+	}
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBegin(GL_QUADS);
+	glTexCoord2d(0, 0); glVertex2d(-200, -200);
+	glTexCoord2d(1, 0); glVertex2d(200, -200);
+	glTexCoord2d(1, 1); glVertex2d(200, 200);
+	glTexCoord2d(0, 1); glVertex2d(-200, 200);
+	glEnd();
+	glDisable(GL_BLEND);
+	glDisable(GL_TEXTURE_2D);
+}
+
+/// \brief Callback for drawing
+void draw_func(double dt)
+{
+	
+	glClearDepth(1.);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	glClearColor(0.0, 0.2, 0.1, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glLoadIdentity();
+	glScaled(0.005 * vscale, 0.005 * vscale, 1);
+	glTranslated(-viewCenter[0] * 200, -viewCenter[1] * 200, 0);
+
+	char buf[128];
+
+	bool heatmap = useHeatmap();
+	if(heatmap)
+		drawHeatmap();
+
+	// TODO: In this logic, we draw the road (edge) twice.
+	const std::vector<GraphVertex*> &vertices = graph.getVertices();
+	if(!heatmap){
+		for(std::vector<GraphVertex*>::const_iterator it = vertices.begin(); it != vertices.end(); ++it){
+			double pos[2];
+			(*it)->getPos(pos);
+			glColor4f(1,0,0,1);
+
+			glPushMatrix();
+			glBegin(GL_LINE_LOOP);
+			for(int i = 0; i < 16; i++)
+				glVertex2d(pos[0] * 200 + vertexRadius * cos(i * M_2PI / 16.), pos[1] * 200 + vertexRadius * sin(i * M_2PI / 16.));
+			glEnd();
+			glPopMatrix();
+
+			glRasterPos3d(pos[0] * 200, pos[1] * 200., 0.);
+			sprintf(buf, "%d", &*it - &vertices.front());
+			putstring(buf);
+
+			for(GraphVertex::EdgeMap::const_iterator it2 = (*it)->getEdges().begin(); it2 != (*it)->getEdges().end(); ++it2){
+				double dpos[2];
+				int passCount = graph.getPassCount(it2->second->getId());
+				it2->first->getPos(dpos);
+
+				// Obtain vector perpendicular to the edige's direction.
+				double para[2], perp[2];
+				const double length = calcPerp(para, perp, pos, dpos);
+				const double dashedLineLength = 0.07;
+				const double lineHalfWidth = 0.003;
+				const int dashedLines = int(length / dashedLineLength + 0.5);
+
+				const double size = vertexRadius;
+
+				glBegin(GL_QUADS);
+				// Asphalt color
+				glColor4f(0.5, 0.5, 0.5, 1);
+				glVertex2d(pos[0] * 200 - perp[0] * size, pos[1] * 200 - perp[1] * size);
+				glVertex2d(dpos[0] * 200 - perp[0] * size, dpos[1] * 200 - perp[1] * size);
+				glVertex2d(pos[0] * 200 + perp[0] * size, pos[1] * 200 + perp[1] * size);
+				glVertex2d(dpos[0] * 200 + perp[0] * size, dpos[1] * 200 + perp[1] * size);
+				glEnd();
+
+				glPushMatrix();
+				glScaled(200, 200, 1);
+				glColor4f(1, 1, 1, 1);
+				glBegin(GL_QUADS);
+				for(int j = 0; j < dashedLines; j++){
+					glVertex2d(pos[0] + para[0] * j * dashedLineLength + perp[0] * lineHalfWidth, pos[1] + para[1] * j * dashedLineLength + perp[1] * lineHalfWidth);
+					glVertex2d(pos[0] + para[0] * j * dashedLineLength - perp[0] * lineHalfWidth, pos[1] + para[1] * j * dashedLineLength - perp[1] * lineHalfWidth);
+					glVertex2d(pos[0] + para[0] * (j + 0.5) * dashedLineLength - perp[0] * lineHalfWidth, pos[1] + para[1] * (j + 0.5) * dashedLineLength - perp[1] * lineHalfWidth);
+					glVertex2d(pos[0] + para[0] * (j + 0.5) * dashedLineLength + perp[0] * lineHalfWidth, pos[1] + para[1] * (j + 0.5) * dashedLineLength + perp[1] * lineHalfWidth);
+				}
+				glEnd();
+				glPopMatrix();
+
+				// The edge color indicates traffic amount
+				glColor4f(GLfloat(passCount) / graph.getMaxPassCount(),0,1,1);
+
+				glBegin(GL_LINES);
+				for(int k = -1; k <= 1; k++){
+					glVertex2d(pos[0] * 200 + k * perp[0] * size, pos[1] * 200 + k * perp[1] * size);
+					glVertex2d(dpos[0] * 200 + k * perp[0] * size, dpos[1] * 200 + k * perp[1] * size);
+				}
+				glEnd();
+
+				glRasterPos3d((pos[0] + dpos[0]) / 2. * 200, (pos[1] + dpos[1]) / 2. * 200., 0.);
+				sprintf(buf, "%d",/* it2->second->getLength(),*/ passCount);
+				putstring(buf);
+			}
+		}
+	}
+
+	glColor4f(0,1,1,1);
+	if(!heatmap){
+		static std::vector<VehiclePosition> positions;
+		graph.getVehiclePositions(positions);
+		for(size_t i = 0; i < positions.size(); i++)
+			drawVehicle(positions[i]);
+	}
+
+	// The chart and the status stay put whatever the zoom.
+	glLoadIdentity();
+	glScaled(0.005, 0.005, 1);
+
+
+	// Draw Vehicle's path length distribution chart.
+	glColor4f(1,1,1,1);
+	int maxStepCount = 0;
+	int stepSum = 0;
+	int stepMoment = 0;
+	const int *stepStats = graph.getStepStats();
+	for(int i = 0; i < Graph::stepStatCount; i++){
+		if(maxStepCount < stepStats[i])
+			maxStepCount = stepStats[i];
+		stepSum += stepStats[i];
+		stepMoment += stepStats[i] * i;
+	}
+	if(maxStepCount){
+		for(int i = 0; i < Graph::stepStatCount; i++){
+			glRasterPos2d(-200., -180 + i * 16);
+			sprintf(buf, "%d:%d",/* it2->second->getLength(),*/ i, stepStats[i]);
+			putstring(buf);
+			glBegin(GL_LINES);
+			glVertex2d(-200, -180 + i * 16);
+			glVertex2d(-200 + stepStats[i] * 200 / maxStepCount, -180 + i * 16);
+			glEnd();
+		}
+		glRasterPos2d(-200., -180 + Graph::stepStatCount * 16);
+		sprintf(buf, "Avg: %lg", double(stepMoment) / stepSum);
+		putstring(buf);
+	}
+	if(graph.getWaitingCount()){
+		glRasterPos2d(-200., -180 + (Graph::stepStatCount + 1) * 16);
+		sprintf(buf, "Waiting: %d  Stalled: %d  Gridlocks: %d", int(graph.getWaitingCount()), graph.getStalledCount(), graph.getGridlockCount());
+		putstring(buf);
+	}
+	glRasterPos2d(-200., -196.);
+	sprintf(buf, "Heatmap (h): %s%s  Shows (m): %s", heatmapModeNames[heatmapMode], heatmap ? "" : ", hidden",
+		DensityMap::getQuantityName(densityMap.getQuantity()));
+	putstring(buf);
+	if(player){
+		glRasterPos2d(-200., -212.);
+		sprintf(buf, "Replay tick %d  Speed ([ ]): %gx  Seek (j k): %d ticks", graph.getTicks(), replaySpeed, player->getInterval());
+		putstring(buf);
+	}
+
+	glFlush();
+	glutSwapBuffers();
+
+/*	Sleep(1);*/
+}
+
+#define EPSILON 1e-5
+
+/// \brief Advances the simulation by one tick, applying the road edits due first.
+static void step(double dt){
+	editScript.apply(graph);
+	graph.update(dt);
+	if(replay.isOpen()){
+		eventLog.endTick(dt);
+		replay.record(graph, eventLog);
+	}
+	if(!countPhases){
+		trace.record(graph);
+		return;
+	}
+	int phase = perfCounters.enter(PerfCounters::phaseStats);
+	trace.record(graph);
+	perfCounters.enter(phase);
+	perfCounters.endTick(graph.getTicks(), graph.getVehicleCount(), graph.getEdges().size());
+}
+
+/// \brief Prints what the phases took over the run, when they are counted.
+static void printPhaseCounters(void){
+	if(countPhases)
+		perfCounters.print(stdout);
+}
+
+/// \brief Prints how many of the new trips' routes the workers found in time.
+static void printRouteSearches(void){
+	const RouteService &routing = graph.getRouting();
+	printf("Route searches: %u by the workers, %u by the stepping thread\n", unsigned(routing.getWorkerSearches()),
+		unsigned(routing.getLateSearches()));
+}
+
+/// \brief Simulates the next tick of the replay reader is at, checking the events of the run against the log.
+/// \returns 0 if they match, 1 if they differ and -1 at the end of the log.
+static int replayTick(ReplayReader &reader){
+	double tickDt;
+	if(!reader.nextTick(replayEvents, tickDt))
+		return -1;
+	step(tickDt);
+	eventLog.endTick(tickDt);
+	const std::vector<EventLog::Event> &events = eventLog.getEvents();
+	int ret = 0;
+	for(size_t i = 0; i < events.size() || i < replayEvents.size(); i++){
+		if(i < events.size() && i < replayEvents.size() && events[i] == replayEvents[i])
+			continue;
+		printf("Tick %d differs from the log at event %d\n  logged:   ", graph.getTicks(), int(i));
+		if(i < replayEvents.size())
+			EventLog::print(stdout, replayEvents[i]);
+		printf("\n  this run: ");
+		if(i < events.size())
+			EventLog::print(stdout, events[i]);
+		printf("\n");
+		ret = 1;
+		break;
+	}
+	eventLog.clear();
+	return ret;
+}
+
+/// \brief Loads the last keyframe of reader at or before tick and simulates the ticks from there on to it.
+/// \returns The tick of the keyframe, or -1 if it cannot be loaded or the run differs from the log.
+static int seekReplay(ReplayReader &reader, int tick){
+	StateBuffer state;
+	if(!reader.loadKeyframe(reader.findKeyframe(tick), state) || !graph.loadState(state)){
+		printf("Cannot load the keyframe before tick %d\n", tick);
+		return -1;
+	}
+	int keyframeTick = graph.getTicks();
+	editScript.skipTo(keyframeTick);
+	eventLog.clear();
+	while(graph.getTicks() < tick){
+		int result = replayTick(reader);
+		if(0 < result)
+			return -1;
+		if(result < 0)
+			break;
+	}
+	return keyframeTick;
+}
+
+/// \brief Plays the ticks of the replay in the window due after dt seconds of wall time.
+static void playReplay(double dt){
+	// Whole ticks only, and no more than a frame's worth of catching up.
+	static const int maxTicksPerFrame = 200;
+	static double credit = 0.;
+	credit = std::min(credit + dt * replaySpeed / player->getDt(), double(maxTicksPerFrame));
+	for(; 1. <= credit; credit -= 1.){
+		int result = replayTick(*player);
+		if(result){
+			printf(result < 0 ? "End of the replay at tick %d\n" : "Replay paused at tick %d\n", graph.getTicks());
+			pause = 1;
+			credit = 0.;
+			break;
+		}
+	}
+}
+
+/// \brief Callback for updating screen
+void display_func(void){
+	static timemeas_t tm;
+	static int init = 0;
+	static double t = 0.;
+	double dt = 0.;
+	if(!init){
+		init = 1;
+		TimeMeasStart(&tm);
+	}
+	else{
+		double t1;
+		t1 = TimeMeasLap(&tm);
+		dt = init ? t1 - t : 0.;
+
+		if(!pause){
+			if(player)
+				playReplay(dt);
+			else
+				step(dt);
+		}
+
+		gtime = t = t1;
+	}
+	int phase = countPhases ? perfCounters.enter(PerfCounters::phaseDraw) : 0;
+	draw_func(dt);
+	if(countPhases)
+		perfCounters.enter(phase);
+/*	glViewport(dim[0], dim[1], dim[2], dim[3]);*/
+}
+
+void idle(void){
+	glutPostRedisplay();
+}
+
+/// \brief Callback for window size change
+void reshape_func(int w, int h)
+{
+	int m = w < h ? h : w;
+	glViewport(0, 0, w, h);
+}
+
+
+/// \brief Callback for key input
+static void key_func(unsigned char key, int x, int y){
+	switch(key){
+		case 'p': pause = !pause; break;
+
+		case 'i': g_use_display_list = !g_use_display_list; break;
+
+		case 'r': graph.setRerouteInterval(0. < graph.getRerouteInterval() ? 0. : 2.); break;
+
+		case 'h': heatmapMode = (heatmapMode + 1) % heatmapModeCount; break;
+
+		case 'm': densityMap.setQuantity((densityMap.getQuantity() + 1) % DensityMap::quantityCount); break;
+
+		case '+': vscale *= 1.25; break;
+
+		case '-': vscale /= 1.25; break;
+
+		case '0': vscale = 1.; viewCenter[0] = viewCenter[1] = 0.; break;
+
+		case '[': replaySpeed /= 2.; break;
+
+		case ']': replaySpeed *= 2.; break;
+
+		case 'j':
+		case 'k':
+			if(player)
+				seekReplay(*player, std::max(0, graph.getTicks() + (key == 'j' ? -1 : 1) * player->getInterval()));
+			break;
+	}
+}
+
+int g_pressed = 0;
+
+int g_prevX = -1;
+int g_prevY = -1;
+int g_prevZ = -1;
+
+/// \brief Callback for mouse input
+static void mouse_func(int button, int state, int x, int y){
+	if (button == GLUT_LEFT_BUTTON) {
+		if (state == GLUT_DOWN) {
+			g_prevX = x;
+			g_prevY = y;
+			g_pressed = 1;
+		}
+		else if (state == GLUT_UP) {
+			g_pressed = 0;
+		}
+	}
+	else if(button == GLUT_RIGHT_BUTTON){
+		if(state == GLUT_DOWN) {
+			g_prevY = y;
+			g_pressed = 2;
+		}
+		else if(state == GLUT_UP) {
+			g_pressed = 0;
+		}
+	}
+}
+
+/// \brief Callback for mouse motion; the left button drags the view and the right one zooms.
+void motion_func(int x, int y){
+	if (g_pressed != 0) {
+		if(g_pressed == 1){
+			GLint vp[4];
+			glGetIntegerv(GL_VIEWPORT, vp);
+			viewCenter[0] -= (x - g_prevX) * 2. / vp[2] / vscale;
+			viewCenter[1] += (y - g_prevY) * 2. / vp[3] / vscale;
+		}
+		else
+			vscale *= exp((g_prevY - y) * 0.01);
+
+		g_prevX = x;
+		g_prevY = y;
+
+		glutPostRedisplay();
+
+	}
+
+}
+
+
+/// \brief Loads the route index from fileName, or builds it and saves it there if it is missing or stale.
+static void prepareRouteIndex(const char *fileName){
+	if(routeIndex.load(fileName, graph))
+		printf("Loaded route index %s\n", fileName);
+	else{
+		timemeas_t tm;
+		TimeMeasStart(&tm);
+		routeIndex.build(graph);
+		printf("Built route index with %d arcs in %lg s\n", int(routeIndex.getArcCount()), TimeMeasLap(&tm));
+		if(!routeIndex.save(fileName))
+			printf("Could not write route index %s\n", fileName);
+	}
+	graph.setRouteIndex(&routeIndex);
+}
+
+/// \brief Runs the simulation without a window, rendering every interval ticks into target.
+static int runExport(const char *target, int ticks, double dt, int interval, int width, int height, int encoders){
+	FrameExporter exporter(target, width, height, encoders);
+	if(!exporter.isOpen()){
+		printf("Cannot write frames to %s; give a pattern like frame%%06d.ppm, a .rgb file or -\n", target);
+		return 1;
+	}
+	timemeas_t tm;
+	TimeMeasStart(&tm);
+	for(int t = 0; t < ticks; t++){
+		if(t % interval == 0){
+			int phase = countPhases ? perfCounters.enter(PerfCounters::phaseDraw) : 0;
+			FrameSnapshot *frame = new FrameSnapshot;
+			frame->capture(graph);
+			exporter.submit(frame);
+			if(countPhases)
+				perfCounters.enter(phase);
+		}
+		step(dt);
+	}
+	int failures = exporter.finish();
+	double wall = TimeMeasLap(&tm);
+	// Keep stdout clean when it carries the video stream.
+	fprintf(stderr, "Exported %d frames of %dx%d in %lg s (%lg simulated s)\n", exporter.getFrameCount(), width, height, wall, ticks * dt);
+	if(failures)
+		fprintf(stderr, "%d frames could not be written\n", failures);
+	return failures ? 1 : 0;
+}
+
+/// \brief Runs the simulation without a window in real time, streaming it to browsers on port.
+static int runStream(int port, int ticks, double dt, int interval){
+	LiveStream stream;
+	if(!stream.listen(port)){
+		printf("Cannot listen on port %d\n", port);
+		return 1;
+	}
+	printf("Streaming on http://localhost:%d/?stream\n", port);
+	fflush(stdout);
+	// TimeMeasLap() counts processor time on some platforms, which does not pass while sleeping.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int t = 0; t < ticks; t++){
+		step(dt);
+		if(t % interval == 0)
+			stream.poll(graph);
+		std::this_thread::sleep_until(start + std::chrono::microseconds((long long)((t + 1) * dt * 1e6)));
+	}
+	printf("Streamed %d frames, %d bytes\n", int(stream.getFrameCount()), int(stream.getByteCount()));
+	return 0;
+}
+
+/// \brief Runs ticks ticks, then steps copies of the lanes on the road in every precision next to double.
+///
+/// The lanes are repeated until there are enough of them to time the stepping.
+static int runPrecisionCheck(int ticks, double dt){
+	const int checkLanes = 1 << 18;
+	const int checkTicks = 1000;
+	for(int t = 0; t < ticks; t++)
+		step(dt);
+	const KinematicsArrays &kin = graph.getKinematics();
+	if(!kin.size()){
+		printf("No vehicles on the road after %d ticks\n", ticks);
+		return 1;
+	}
+	KinematicsArraysT<DoublePrecision> lanes;
+	for(int i = 0; i < checkLanes; i++){
+		size_t src = i % kin.size();
+		lanes.add(NULL, kin.getVelocity(src), kin.getLength(src));
+		lanes.setPos(i, kin.getPos(src));
+		lanes.setAccel(i, kin.getAccel(src));
+	}
+	PrecisionReport reports[] = {
+		comparePrecision<DoublePrecision>(lanes, checkTicks, dt),
+		comparePrecision<FloatPrecision>(lanes, checkTicks, dt),
+		comparePrecision<FixedPrecision>(lanes, checkTicks, dt),
+	};
+	printf("Built with %s; %d lanes stepped %d ticks of %lg s against double\n",
+		TRAFFIC_PRECISION::getName(), checkLanes, checkTicks, dt);
+	printf("%-8s %12s %12s %12s %10s %10s\n", "format", "max error", "max rel", "mean error", "exit diff", "step ns");
+	for(size_t i = 0; i < sizeof reports / sizeof *reports; i++){
+		const PrecisionReport &r = reports[i];
+		printf("%-8s %12.3e %12.3e %12.3e %10d %10.3f\n", r.name, r.maxError, r.maxRelativeError, r.meanError,
+			r.exitMismatches, r.seconds * 1e9 / (double(r.lanes) * r.ticks));
+	}
+	return 0;
+}
+
+/// \brief Runs the simulation without a window until ticks have passed, only recording its trace.
+static int runTrace(int ticks, double dt){
+	for(int t = 0; t < ticks; t++)
+		step(dt);
+	printf("Traced %d frames over %d ticks\n", trace.getFrameCount(), ticks);
+	return 0;
+}
+
+/// \brief Runs the simulation without a window alongside the golden trace in fileName.
+///
+/// The run must be set up with the same options the golden trace was
+/// recorded with.  It stops at the first frame that differs and reports the
+/// vehicle that differs, if the trace has the vehicle records.
+static int runVerify(const char *fileName, double dt){
+	TraceReader golden;
+	if(!golden.open(fileName))
+		return 1;
+	TraceFrame expected, actual;
+	int frames = 0;
+	while(golden.next(expected)){
+		while(graph.getTicks() < expected.tick)
+			step(dt);
+		actual.capture(graph, golden.getPosBits(), golden.hasDetail());
+		if(reportDivergence(expected, actual, golden.getPosBits(), fileName, "this run"))
+			return 1;
+		frames++;
+	}
+	if(!frames){
+		printf("%s has no frames\n", fileName);
+		return 1;
+	}
+	printf("%d frames match %s up to tick %d\n", frames, fileName, graph.getTicks());
+	return 0;
+}
+
+/// \brief Runs the simulation without a window until ticks have passed, recording its events and keyframes to fileName.
+static int runRecord(const char *fileName, int interval, int ticks, double dt){
+	graph.setEventLog(&eventLog);
+	if(!replay.open(fileName, graph, dt, interval)){
+		printf("Cannot write replay %s\n", fileName);
+		return 1;
+	}
+	for(int t = 0; t < ticks; t++)
+		step(dt);
+	replay.close();
+	printf("Recorded %d ticks: %.1f kB of events and %d keyframes of %.1f kB\n", ticks, replay.getEventBytes() / 1e3,
+		replay.getKeyframeCount(), replay.getKeyframeBytes() / 1e3);
+	printf("Tick %d: %d arrived, %d on road, placement %016llx\n", graph.getTicks(), graph.getArrivals(),
+		int(graph.getVehicleCount()), (unsigned long long)graph.getPlacementDigest());
+	return 0;
+}
+
+/// \brief Seeks to tick seek in the replay in fileName without a window, then plays it to its end.
+///
+/// Like runVerify(), the run must be set up with the options the replay was
+/// recorded with.  It stops at the first tick whose events differ from the
+/// log.
+static int runVerifyReplay(const char *fileName, int seek){
+	ReplayReader reader;
+	if(!reader.open(fileName)){
+		printf("Cannot read replay %s\n", fileName);
+		return 1;
+	}
+	graph.setEventLog(&eventLog);
+	timemeas_t tm;
+	TimeMeasStart(&tm);
+	int keyframeTick = seekReplay(reader, seek);
+	if(keyframeTick < 0)
+		return 1;
+	printf("Reached tick %d from the keyframe at tick %d in %.3f s\n", graph.getTicks(), keyframeTick, TimeMeasLap(&tm));
+	int result;
+	while(!(result = replayTick(reader)));
+	if(0 < result)
+		return 1;
+	printf("Tick %d: %d arrived, %d on road, placement %016llx\n", graph.getTicks(), graph.getArrivals(),
+		int(graph.getVehicleCount()), (unsigned long long)graph.getPlacementDigest());
+	return 0;
+}
+
+/// \brief Runs warmup ticks, then the rest of ticks failing on any heap allocation inside Graph::update().
+static int runAllocationAudit(int warmup, int ticks, double dt){
+	if(!AllocationAudit::isAvailable()){
+		printf("Build with TRAFFIC_AUDIT_ALLOCATIONS defined to audit allocations\n");
+		return 1;
+	}
+	int t = 0;
+	for(; t < warmup && t < ticks; t++)
+		step(dt);
+	AllocationAudit::arm(true);
+	for(; t < ticks; t++)
+		step(dt);
+	AllocationAudit::arm(false);
+	size_t count = AllocationAudit::getCount();
+	printf("%u allocations (%u bytes) in %d ticks after %d warmup ticks, %d vehicles on the road\n",
+		unsigned(count), unsigned(AllocationAudit::getBytes()), ticks - warmup, warmup, int(graph.getVehicleCount()));
+	return count ? 1 : 0;
+}
+
+/// \brief Renumbers the network of graph in networkOrder, if one was asked for.
+/// \param report Whether to print how far apart the ends of a road lie in the numbering before and after.
+static void reorderNetwork(bool report){
+	if(networkOrder < 0)
+		return;
+	double before = NetworkOrder::getMeanSpan(graph);
+	timemeas_t tm;
+	TimeMeasStart(&tm);
+	std::vector<int> order;
+	NetworkOrder::compute(graph, networkOrder, order);
+	graph.reorder(order);
+	double seconds = TimeMeasLap(&tm);
+	if(report)
+		printf("Reordered %d vertices in %.3f ms; mean id span of a road %.1f -> %.1f\n",
+			int(order.size()), seconds * 1e3, before, NetworkOrder::getMeanSpan(graph));
+}
+
+/// \brief Runs count scenarios of ticks ticks each in this process, the i-th with traffic seed seed + i.
+///
+/// Each scenario starts from a reset of the last one rather than a new
+/// graph.  The network is kept unless newNetworks asks for a new random one
+/// each time, or an edit script must start over from the unedited network.
+static int runScenarios(int count, int ticks, double dt, uint32_t seed, bool newNetworks){
+	printf("%8s %10s %10s %10s %10s %8s %8s %16s %8s\n", "scenario", "network", "traffic", "reset ms", "run s", "arrived", "on road", "placement", "RSS MB");
+	for(int i = 0; i < count; i++){
+		uint32_t networkSeed = newNetworks ? Graph::defaultNetworkSeed + i : Graph::defaultNetworkSeed;
+		timemeas_t tm;
+		TimeMeasStart(&tm);
+		if(i == 0)
+			graph.setTrafficSeed(seed);
+		else if(newNetworks || !editScript.empty()){
+			bool indexed = graph.getRouteIndex() != NULL;
+			graph.rebuild(networkSeed, int(graph.getVertices().size()));
+			reorderNetwork(false);
+			graph.setTrafficSeed(seed + i);
+			if(indexed){
+				// The same seed gives the same network, which the index still fits.
+				if(newNetworks)
+					routeIndex.build(graph);
+				graph.setRouteIndex(&routeIndex);
+			}
+		}
+		else
+			graph.resetTraffic(seed + i);
+		editScript.rewind();
+		double resetTime = TimeMeasLap(&tm);
+		TimeMeasStart(&tm);
+		for(int t = 0; t < ticks; t++)
+			step(dt);
+		double runTime = TimeMeasLap(&tm);
+		printf("%8d %10u %10u %10.3f %10.3f %8d %8d %016llx %8.1f\n", i, unsigned(networkSeed), unsigned(seed + i), resetTime * 1e3, runTime,
+			graph.getArrivals(), int(graph.getVehicleCount()), (unsigned long long)graph.getPlacementDigest(), MemoryReport::getResidentBytes() / 1e6);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+/// \brief Prints the components of the network and the roads edge betweenness predicts to be the busiest, then runs ticks to compare.
+/// \param samples Sources to compute the betweenness from, 0 for every vertex.
+static int runAnalysis(int samples, int threads, int ticks, double dt){
+	NetworkAnalysis &analysis = graph.getAnalysis();
+	const std::vector<GraphEdge*> &edges = graph.getEdges();
+	int n = int(graph.getVertices().size());
+	analysis.setWorkers(threads);
+	timemeas_t tm;
+	TimeMeasStart(&tm);
+	analysis.computeBetweenness(graph, samples);
+	double seconds = TimeMeasLap(&tm);
+	int largest = 0;
+	for(int i = 0; i < analysis.getComponentCount(); i++)
+		largest = std::max(largest, analysis.getComponentSize(i));
+	printf("%d components, the largest with %d of %d vertices; %.1f%% of the trips drawn have a route\n",
+		analysis.getComponentCount(), largest, n, analysis.getRoutableShare() * 100.);
+	printf("Betweenness from %d of %d sources in %.3f ms, workers: %d\n", 0 < samples && samples < n ? samples : n, n,
+		seconds * 1e3, analysis.getWorkers());
+
+	for(int t = 0; t < ticks; t++)
+		step(dt);
+
+	const std::vector<double> &betweenness = analysis.getBetweenness();
+	std::vector<int> order(edges.size());
+	for(size_t i = 0; i < order.size(); i++)
+		order[i] = int(i);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b){return betweenness[b] < betweenness[a];});
+	printf("%6s %6s %6s %6s %12s %10s\n", "rank", "edge", "from", "to", "betweenness", "passes");
+	for(size_t i = 0; i < order.size() && i < 10; i++){
+		const GraphEdge *e = edges[order[i]];
+		printf("%6d %6d %6d %6d %12.1f %10d\n", int(i + 1), order[i], e->getStart()->getId(), e->getEnd()->getId(),
+			betweenness[order[i]], graph.getPassCount(order[i]));
+	}
+
+	// Pearson correlation of the prediction with the passes counted
+	double sb = 0., sp = 0., sbb = 0., spp = 0., sbp = 0.;
+	for(size_t i = 0; i < edges.size(); i++){
+		double b = betweenness[i], p = graph.getPassCount(int(i));
+		sb += b, sp += p, sbb += b * b, spp += p * p, sbp += b * p;
+	}
+	double m = double(edges.size());
+	double var = (sbb - sb * sb / m) * (spp - sp * sp / m);
+	printf("Correlation with the passes over %d ticks: %.3f\n", ticks, 0. < var ? (sbp - sb * sp / m) / sqrt(var) : 0.);
+	printf("%d trips were dropped without a search, %d blocked at the start\n", graph.getUnreachableSpawns(), graph.getBlockedSpawns());
+	return 0;
+}
+
+/// \brief Accounts the memory of the global graph and its route index.
+static void reportMemory(MemoryReport &report){
+	graph.reportMemory(report);
+	if(graph.getRouteIndex())
+		report.add("route index", routeIndex.getMemoryUsage(), MemoryReport::perVertex);
+	report.add("density map", densityMap.getMemoryUsage(), MemoryReport::fixed);
+}
+
+/// \brief Runs ticks ticks, then prints what the simulation takes in memory.
+static int runMemoryReport(int ticks, double dt){
+	for(int t = 0; t < ticks; t++)
+		step(dt);
+	MemoryReport report;
+	reportMemory(report);
+	printf("After %d ticks:\n", ticks);
+	report.print(stdout);
+	return 0;
+}
+
+/// \brief Fills the network with ten times more vehicles at a time up to maxVehicles, reporting the memory, tick time and heatmap build time at each size.
+///
+/// The bytes per vehicle are given both as accounted and as the growth of
+/// the resident set size since the start, which also catches what the
+/// accounting misses.
+static int runScaling(size_t maxVehicles, double dt){
+	const int ticks = 5;
+	size_t baseRss = MemoryReport::getResidentBytes();
+	printf("%10s %12s %12s %12s %12s %10s %10s %10s\n", "vehicles", "RSS MB", "counted MB", "B/vehicle", "RSS B/veh", "spawn s", "tick ms", "map ms");
+	for(size_t target = std::min(size_t(10000), maxVehicles); ; target = std::min(target * 10, maxVehicles)){
+		timemeas_t tm;
+		TimeMeasStart(&tm);
+		size_t vehicles = graph.populate(target);
+		double spawnTime = TimeMeasLap(&tm);
+		TimeMeasStart(&tm);
+		for(int t = 0; t < ticks; t++)
+			step(dt);
+		double tickTime = TimeMeasLap(&tm) / ticks;
+		// What a zoomed out frame would take to aggregate, in the quantity that reads the vehicles.
+		densityMap.setQuantity(DensityMap::quantitySpeed);
+		TimeMeasStart(&tm);
+		densityMap.build(graph);
+		double mapTime = TimeMeasLap(&tm);
+		MemoryReport report;
+		reportMemory(report);
+		size_t rss = MemoryReport::getResidentBytes();
+		printf("%10u %12.1f %12.1f %12.1f %12.1f %10.3f %10.3f %10.3f\n", unsigned(vehicles), rss / 1e6, report.getTotal() / 1e6,
+			report.getPerEntity(MemoryReport::perVehicle), vehicles ? double(rss - baseRss) / vehicles : 0., spawnTime, tickTime * 1e3,
+			mapTime * 1e3);
+		fflush(stdout);
+		if(vehicles < target){
+			printf("Could only place %u vehicles\n", unsigned(vehicles));
+			break;
+		}
+		if(maxVehicles <= target){
+			report.print(stdout);
+			break;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *routeIndexFile = NULL;
+	int regions = 0, region = -1;
+	int ticks = 10000;
+	double dt = 0.03;
+	int port = 27100;
+	const char *exportTarget = NULL;
+	int frameInterval = 1;
+	int frameWidth = 640, frameHeight = 480;
+	int encoders = 0;
+	int streamPort = 0;
+	int streamInterval = 3;
+	const char *editScriptFile = NULL;
+	int replicas = 0;
+	int threads = 0;
+	uint32_t seed = Graph::defaultTrafficSeed;
+	bool validatePrecision = false;
+	double crossingTime = 0., yieldTime = 0.;
+	int junctionWorkers = 1;
+	double jamDensity = 0.;
+	int gridlockPolicy = Graph::gridlockLog;
+	const char *traceFile = NULL;
+	int traceInterval = 100;
+	bool traceDetail = false;
+	const char *verifyFile = NULL;
+	const char *compareFiles[2] = {NULL, NULL};
+	const char *perfFile = NULL;
+	int perfInterval = 100;
+	int auditWarmup = -1;
+	bool memoryReport = false;
+	size_t scaleVehicles = 0;
+	int scenarios = 0;
+	double mesoFocus[3] = {0., 0., -1.}; ///< Center and radius of the microscopic area
+	bool cellular = false;
+	double cellLength = CellularModel::defaultCellLength;
+	double slowdown = CellularModel::defaultSlowdown;
+	int cellularWorkers = 1;
+	bool newNetworks = false;
+	int vertexCount = 0;
+	int analyzeSamples = -1;
+	int routeWorkers = 0;
+	const char *recordFile = NULL;
+	int keyframeInterval = 1000;
+	const char *replayFile = NULL;
+	bool verifyReplay = false;
+	int seek = 0;
+
+	// Consume our own options so that the first one left is still the window title.
+	int argn = 1;
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "--route-index") && i + 1 < argc)
+			routeIndexFile = argv[++i];
+		else if(!strcmp(argv[i], "--regions") && i + 1 < argc)
+			regions = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--region") && i + 1 < argc)
+			sscanf(argv[++i], "%d/%d", &region, &regions);
+		else if(!strcmp(argv[i], "--ticks") && i + 1 < argc)
+			ticks = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--dt") && i + 1 < argc)
+			dt = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--port") && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--export-frames") && i + 1 < argc)
+			exportTarget = argv[++i];
+		else if(!strcmp(argv[i], "--frame-interval") && i + 1 < argc)
+			frameInterval = std::max(1, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--frame-size") && i + 1 < argc)
+			sscanf(argv[++i], "%dx%d", &frameWidth, &frameHeight);
+		else if(!strcmp(argv[i], "--encoders") && i + 1 < argc)
+			encoders = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--stream") && i + 1 < argc)
+			streamPort = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--edits") && i + 1 < argc)
+			editScriptFile = argv[++i];
+		else if(!strcmp(argv[i], "--stream-interval") && i + 1 < argc)
+			streamInterval = std::max(1, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--replicas") && i + 1 < argc)
+			replicas = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+			seed = uint32_t(strtoul(argv[++i], NULL, 0));
+		else if(!strcmp(argv[i], "--junctions") && i + 1 < argc)
+			sscanf(argv[++i], "%lf,%lf", &crossingTime, &yieldTime);
+		else if(!strcmp(argv[i], "--route-workers") && i + 1 < argc)
+			routeWorkers = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--junction-workers") && i + 1 < argc)
+			junctionWorkers = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--jam-density") && i + 1 < argc)
+			jamDensity = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--gridlock") && i + 1 < argc){
+			i++;
+			gridlockPolicy = !strcmp(argv[i], "teleport") ? Graph::gridlockTeleport
+				: !strcmp(argv[i], "reroute") ? Graph::gridlockReroute : Graph::gridlockLog;
+		}
+		else if(!strcmp(argv[i], "--validate-precision"))
+			validatePrecision = true;
+		else if(!strcmp(argv[i], "--trace") && i + 1 < argc)
+			traceFile = argv[++i];
+		else if(!strcmp(argv[i], "--trace-interval") && i + 1 < argc)
+			traceInterval = std::max(1, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--trace-detail"))
+			traceDetail = true;
+		else if(!strcmp(argv[i], "--verify-trace") && i + 1 < argc)
+			verifyFile = argv[++i];
+		else if(!strcmp(argv[i], "--record") && i + 1 < argc)
+			recordFile = argv[++i];
+		else if(!strcmp(argv[i], "--keyframe-interval") && i + 1 < argc)
+			keyframeInterval = std::max(1, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--replay") && i + 1 < argc)
+			replayFile = argv[++i];
+		else if(!strcmp(argv[i], "--verify-replay") && i + 1 < argc){
+			replayFile = argv[++i];
+			verifyReplay = true;
+		}
+		else if(!strcmp(argv[i], "--seek") && i + 1 < argc)
+			seek = std::max(0, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--replay-speed") && i + 1 < argc)
+			replaySpeed = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--perf-counters") && i + 1 < argc)
+			perfFile = argv[++i];
+		else if(!strcmp(argv[i], "--perf-interval") && i + 1 < argc)
+			perfInterval = std::max(1, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--memory-report"))
+			memoryReport = true;
+		else if(!strcmp(argv[i], "--scale-vehicles") && i + 1 < argc)
+			scaleVehicles = size_t(atof(argv[++i]));
+		else if(!strcmp(argv[i], "--meso-focus") && i + 1 < argc)
+			sscanf(argv[++i], "%lf,%lf,%lf", &mesoFocus[0], &mesoFocus[1], &mesoFocus[2]);
+		else if(!strcmp(argv[i], "--cellular"))
+			cellular = true;
+		else if(!strcmp(argv[i], "--cell-length") && i + 1 < argc)
+			cellLength = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--slowdown") && i + 1 < argc)
+			slowdown = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--cellular-workers") && i + 1 < argc)
+			cellularWorkers = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--scenarios") && i + 1 < argc)
+			scenarios = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--vertices") && i + 1 < argc)
+			vertexCount = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--reorder") && i + 1 < argc){
+			i++;
+			networkOrder = !strcmp(argv[i], "rcm") ? NetworkOrder::orderCuthillMcKee
+				: !strcmp(argv[i], "hilbert") ? NetworkOrder::orderHilbert : -1;
+		}
+		else if(!strcmp(argv[i], "--analyze") && i + 1 < argc)
+			analyzeSamples = std::max(0, atoi(argv[++i]));
+		else if(!strcmp(argv[i], "--new-networks"))
+			newNetworks = true;
+		else if(!strcmp(argv[i], "--audit-allocations") && i + 1 < argc)
+			auditWarmup = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--compare-traces") && i + 2 < argc){
+			compareFiles[0] = argv[++i];
+			compareFiles[1] = argv[++i];
+		}
+		else
+			argv[argn++] = argv[i];
+	}
+	argc = argn;
+
+	if(compareFiles[0])
+		return compareTraces(compareFiles[0], compareFiles[1]);
+
+	if(0 < vertexCount)
+		graph.rebuild(Graph::defaultNetworkSeed, vertexCount);
+	reorderNetwork(true);
+	graph.getJunctions().setTiming(crossingTime, yieldTime);
+	graph.getJunctions().setWorkers(junctionWorkers);
+	graph.setJamDensity(jamDensity);
+	graph.setGridlockPolicy(gridlockPolicy);
+
+	// Decomposed runs are headless; each process only simulates its region.
+	if(0 <= region || 1 < regions){
+		// Vehicles only migrate between the lanes of the microscopic model.
+		if(routeIndexFile || cellular || 0. <= mesoFocus[2] || editScriptFile || 0 < routeWorkers || 0 < replicas){
+			printf("Regions do not support --route-index, --cellular, --meso-focus, --edits, --route-workers or --replicas\n");
+			return 1;
+		}
+		graph.setTrafficSeed(seed);
+		if(0 <= region)
+			return runRegion(graph, region, regions, port, ticks, dt);
+		return runDecomposed(graph, regions, port, ticks, dt);
+	}
+
+	if(routeIndexFile)
+		prepareRouteIndex(routeIndexFile);
+	if(cellular){
+		graph.getCellular().setCellLength(cellLength);
+		graph.getCellular().setSlowdown(slowdown);
+		graph.getCellular().setWorkers(cellularWorkers);
+		graph.setCellular(true);
+	}
+	if(0. <= mesoFocus[2]){
+		int mesoEdges = graph.setFocus(mesoFocus, mesoFocus[2]);
+		printf("%d of %d edges are mesoscopic\n", mesoEdges, int(graph.getEdges().size()));
+	}
+
+	// Replicas share the network, which an edit script would change under them.
+	if(0 < replicas)
+		return runEnsemble(graph, replicas, threads, seed, ticks, dt);
+
+	if(0 < routeWorkers){
+		graph.setRouteWorkers(routeWorkers);
+		atexit(printRouteSearches);
+	}
+	graph.setTrafficSeed(seed);
+	if(editScriptFile && !editScript.load(editScriptFile))
+		return 1;
+	// The network and the settings are final, so the ticks need not allocate from here on.
+	graph.reservePools();
+
+	if(traceFile && !trace.open(traceFile, traceInterval, 16, traceDetail)){
+		printf("Cannot write trace %s\n", traceFile);
+		return 1;
+	}
+	if(perfFile){
+		// Counting starts on this thread, which runs the ticks in every mode left.
+		if(!perfCounters.open())
+			printf("Hardware counters are not available; measuring wall time only\n");
+		if(strcmp(perfFile, "-") && !perfCounters.exportTo(perfFile, perfInterval)){
+			printf("Cannot write %s\n", perfFile);
+			return 1;
+		}
+		countPhases = true;
+		graph.setPerfCounters(&perfCounters);
+		atexit(printPhaseCounters);
+	}
+	if(0 <= auditWarmup)
+		return runAllocationAudit(auditWarmup, ticks, dt);
+	if(scaleVehicles)
+		return runScaling(scaleVehicles, dt);
+	if(0 < scenarios)
+		return runScenarios(scenarios, ticks, dt, seed, newNetworks);
+	if(memoryReport)
+		return runMemoryReport(ticks, dt);
+	if(0 <= analyzeSamples)
+		return runAnalysis(analyzeSamples, threads, ticks, dt);
+	if(verifyFile)
+		return runVerify(verifyFile, dt);
+	if(replayFile && verifyReplay)
+		return runVerifyReplay(replayFile, seek);
+	if(recordFile)
+		return runRecord(recordFile, keyframeInterval, ticks, dt);
+	if(validatePrecision)
+		return runPrecisionCheck(ticks, dt);
+	if(exportTarget)
+		return runExport(exportTarget, ticks, dt, frameInterval, frameWidth, frameHeight, encoders);
+	if(streamPort)
+		return runStream(streamPort, ticks, dt, streamInterval);
+	if(traceFile)
+		return runTrace(ticks, dt);
+	if(replayFile){
+		static ReplayReader reader;
+		graph.setEventLog(&eventLog);
+		if(!reader.open(replayFile) || seekReplay(reader, seek) < 0){
+			printf("Cannot play replay %s\n", replayFile);
+			return 1;
+		}
+		player = &reader;
+	}
+
+	glutInit(&argc, argv);
+
+	glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
+
+	glutInitWindowSize(640,480);
+
+	glutCreateWindow(2 <= argc ? argv[1] : "No File");
+
+	glutDisplayFunc(display_func);
+
+	glutReshapeFunc(reshape_func);
+
+	glutMouseFunc(mouse_func);
+
+	glutMotionFunc(motion_func);
+
+	glutKeyboardFunc(key_func);
+	glutIdleFunc(idle);
+
+	register_lists();
+
+	glutMainLoop();
+
+	return 0;
+}
+
+static void register_lists(void){
+
+}
+
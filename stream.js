@@ -0,0 +1,187 @@
+/// \brief Sequential reader of the little-endian binary frames sent by the C++ engine.
+function StreamReader(view){
+	this.view = view;
+	this.pos = 0;
+}
+
+StreamReader.prototype.uint8 = function(){
+	return this.view.getUint8(this.pos++);
+}
+
+StreamReader.prototype.uint16 = function(){
+	var ret = this.view.getUint16(this.pos, true);
+	this.pos += 2;
+	return ret;
+}
+
+StreamReader.prototype.float32 = function(){
+	var ret = this.view.getFloat32(this.pos, true);
+	this.pos += 4;
+	return ret;
+}
+
+/// Variable length unsigned integer, 7 bits per byte, lowest group first.
+/// Multiplication is used instead of shifts because they would overflow past 31 bits.
+StreamReader.prototype.varint = function(){
+	var ret = 0, scale = 1, b;
+	do{
+		b = this.uint8();
+		ret += (b & 0x7f) * scale;
+		scale *= 128;
+	} while(b & 0x80);
+	return ret;
+}
+
+
+/// \brief A Graph whose state is streamed from the C++ engine instead of simulated.
+///
+/// It is made of the same GraphVertex, GraphEdge and Vehicle objects as Graph,
+/// so that draw() can render it as is, but update() does nothing; the objects
+/// change as frames arrive on the WebSocket at url.
+/// See LiveStream.h in the C++ sources for the format.
+function StreamGraph(url, width, height){
+	this.width = width;
+	this.height = height;
+	this.vertices = [];
+	this.edges = []; // Engine edge id to a pair of directed edges, toward start and toward end
+	this.vehicles = [];
+	this.vehicleMap = {};
+	this.vehicleFreq = 0;
+	this.hasSignals = false; // The engine has no traffic signals
+	this.tick = 0;
+	this.bytes = 0;
+	this.status = "connecting to " + url;
+
+	var self = this;
+	this.socket = new WebSocket(url);
+	this.socket.binaryType = "arraybuffer";
+	this.socket.onopen = function(){
+		self.status = "connected";
+	};
+	this.socket.onclose = function(){
+		self.status = "disconnected";
+	};
+	this.socket.onmessage = function(e){
+		self.bytes += e.data.byteLength;
+		self.receive(new StreamReader(new DataView(e.data)));
+	};
+}
+
+/// The engine advances the simulation; frames are applied as they arrive.
+StreamGraph.prototype.update = function(dt){
+}
+
+StreamGraph.prototype.receive = function(r){
+	var type = String.fromCharCode(r.uint8());
+	if(type === "N")
+		this.receiveNetwork(r);
+	else if(type === "E")
+		this.receiveEdges(r);
+	else if(type === "F")
+		this.receiveFrame(r);
+}
+
+/// \brief Rebuilds the vertices and edges, mapping the engine's [-1, 1] square onto the canvas.
+StreamGraph.prototype.receiveNetwork = function(r){
+	var n = r.varint();
+	this.vertices = new Array(n);
+	for(var i = 0; i < n; i++){
+		var x = r.float32(), y = r.float32();
+		var v = new GraphVertex((x + 1) / 2 * this.width, (1 - y) / 2 * this.height);
+		v.id = i;
+		this.vertices[i] = v;
+	}
+	this.edges = [];
+	for(var m = r.varint(); 0 < m; m--)
+		this.addEdge(r);
+	this.receiveClosed(r);
+	this.vehicles = [];
+	this.vehicleMap = {};
+}
+
+/// \brief Reads the end points of the next engine edge and adds it as a pair of directed edges.
+StreamGraph.prototype.addEdge = function(r){
+	var s = this.vertices[r.varint()], e = this.vertices[r.varint()];
+	var toStart = new GraphEdge(e, s), toEnd = new GraphEdge(s, e);
+	if(s !== e){
+		s.edges[e.id] = toEnd;
+		e.edges[s.id] = toStart;
+	}
+	this.edges.push([toStart, toEnd]);
+}
+
+/// \brief Marks the edges in the list of closed ids that follows, and only those, closed.
+StreamGraph.prototype.receiveClosed = function(r){
+	for(var i = 0; i < this.edges.length; i++)
+		this.edges[i][0].closed = this.edges[i][1].closed = false;
+	var id = 0;
+	for(var n = r.varint(); 0 < n; n--){
+		id += r.varint();
+		this.edges[id][0].closed = this.edges[id][1].closed = true;
+	}
+}
+
+/// \brief Adds the edges built since the last frame and updates which are closed, keeping the vehicles.
+StreamGraph.prototype.receiveEdges = function(r){
+	var first = r.varint(), m = r.varint();
+	this.edges.length = first;
+	for(var i = first; i < m; i++)
+		this.addEdge(r);
+	this.receiveClosed(r);
+}
+
+/// \brief Applies a delta frame: changed pass counts, then removed, added and moved vehicles.
+///
+/// Ids in each list are sent as differences from the previous one.
+StreamGraph.prototype.receiveFrame = function(r){
+	var self = this;
+	function place(v, edge, pos){
+		v.edge = self.edges[Math.floor(edge / 2)][edge % 2];
+		v.pos = pos / 65535 * v.edge.length;
+	}
+
+	this.tick = r.varint();
+	GraphEdge.prototype.maxPassCount = Math.max(1, r.varint());
+
+	var id = 0;
+	for(var n = r.varint(); 0 < n; n--){
+		id += r.varint();
+		var passCount = r.varint();
+		this.edges[id][0].passCount = this.edges[id][1].passCount = passCount;
+	}
+
+	id = 0;
+	for(var n = r.varint(); 0 < n; n--){
+		id += r.varint();
+		delete this.vehicleMap[id];
+	}
+
+	id = 0;
+	for(var n = r.varint(); 0 < n; n--){
+		id += r.varint();
+		var v = new Vehicle(null);
+		v.id = id;
+		v.color = [r.uint8() / 255, r.uint8() / 255, r.uint8() / 255];
+		place(v, r.varint(), r.uint16());
+		this.vehicleMap[id] = v;
+	}
+
+	id = 0;
+	for(var n = r.varint(); 0 < n; n--){
+		var code = r.varint();
+		id += Math.floor(code / 2);
+		var v = this.vehicleMap[id];
+		var edge = code % 2 ? r.varint() : null;
+		var pos = r.uint16();
+		if(v === undefined)
+			continue;
+		if(edge === null)
+			v.pos = pos / 65535 * v.edge.length;
+		else
+			place(v, edge, pos);
+	}
+
+	this.vehicles = [];
+	for(var k in this.vehicleMap)
+		this.vehicles.push(this.vehicleMap[k]);
+}
@@ -12,6 +12,7 @@ var mouseDragging = false;
 var trans = [1,0,0,1,0,0];
 
 var drawCountElement = null;
+var streamElement = null;
 
 /// Vector 2D addition
 function vecadd(v1,v2){
@@ -56,7 +57,14 @@ window.onload = function() {
 	}
 	width = parseInt(canvas.style.width);
 	height = parseInt(canvas.style.height);
-	graph = new Graph(width, height);
+
+	// With "?stream" (or "?stream=ws://host:port/") in the URL, view the state
+	// streamed by the C++ engine instead of simulating here.
+	var streamMatch = /[?&]stream(=([^&]*))?/.exec(location.search);
+	if(streamMatch)
+		graph = new StreamGraph(streamMatch[2] ? decodeURIComponent(streamMatch[2]) : "ws://" + (location.host || "localhost:27200") + "/", width, height);
+	else
+		graph = new Graph(width, height);
 
 	var edit = document.getElementById("freqEdit");
 	if(edit !== undefined)
@@ -67,6 +75,7 @@ window.onload = function() {
 	var transElement = document.getElementById("trans");
 	var mouseElement = document.getElementById("mouse");
 	drawCountElement = document.getElementById("drawcount");
+	streamElement = document.getElementById("stream");
 
 	function magnify(f){
 		// Prepare the transformation matrix for zooming
@@ -250,8 +259,8 @@ function draw() {
 
 			drawCounts.edge++;
 
-			// Color the road with traffic intensity
-			ctx.fillStyle = roadColor(e.passCount / e.maxPassCount);
+			// Color the road with traffic intensity, or grey if it is closed
+			ctx.fillStyle = e.closed ? "#888" : roadColor(e.passCount / e.maxPassCount);
 
 			// Obtain vector perpendicular to the edge's direction.
 			var para = new Array(2);
@@ -342,7 +351,7 @@ function draw() {
 	// This is placed after vehicles rendering because the signals are more important
 	// and should not be obscured by vehicles.
 	ctx.strokeStyle = "#000";
-	for(var i = 0; i < graph.vertices.length; i++){
+	for(var i = 0; graph.hasSignals !== false && i < graph.vertices.length; i++){
 		var v = graph.vertices[i];
 
 		if(v.countEdges() <= 2)
@@ -378,6 +387,9 @@ function draw() {
 		}
 	}
 
+	if(graph.status !== undefined)
+		streamElement.innerHTML = graph.status + ", tick " + graph.tick + ", " + graph.bytes + " bytes received";
+
 	drawCountElement.innerHTML = "Edges: " + drawCounts.edge + " / " + totalCounts.edge
 		+ ", Vertices: " + drawCounts.vertex + " / " + totalCounts.vertex
 		+ ", Vehicles: " + drawCounts.vehicle + " / " + totalCounts.vehicle